@@ -43,7 +43,8 @@ INPUT_FIELDS_TYPES = [
   ("num_interior_chunks", safe_int),
   ("score_per_inner_chunk", safe_float),
   ("chunk_string", str),
-  ("score_string", str)
+  ("score_string", str),
+  ("num_trials", safe_int)
 ]
 
 FIELDS = [f[0] for f in INPUT_FIELDS_TYPES]
@@ -122,6 +123,8 @@ class Alignment(object):
 
     fields = line.strip().split('\t')
 
+    # num_trials is missing from files written before it was added.
+    self.num_trials = None
     for k,t,f in izip(FIELDS, TYPES, fields):
       setattr(self, k, t(f))
 
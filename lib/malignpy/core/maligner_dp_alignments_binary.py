@@ -0,0 +1,121 @@
+# Read the binary alignment format written by maligner_dp, maligner_ix and
+# maligner_vd with --binary-output (see src/dp/alignment_file.h).
+#
+# The alignment records and chunks are numpy structured arrays memory mapped
+# from the file, so columns can be filtered and summarized without parsing:
+#
+#   alns = AlignmentsFile('output.alnb')
+#   good = alns.alignments[alns.alignments['score_per_inner_chunk'] < 1.0]
+#   query_names = alns.names[good['query_map']]
+#
+import numpy as np
+
+MAGIC = b'MALIGNBA'
+VERSION = 1
+BYTE_ORDER = 0x01020304
+
+HEADER_DTYPE = np.dtype([
+  ("magic", "S8"),
+  ("version", "<u4"),
+  ("byte_order", "<u4"),
+  ("num_alignments", "<u8"),
+  ("num_chunks", "<u8"),
+  ("num_names", "<u8"),
+  ("alignments_offset", "<u8"),
+  ("chunks_offset", "<u8"),
+  ("name_offsets_offset", "<u8"),
+  ("names_offset", "<u8")
+])
+
+# The fields of the text output, except for the chunk_string and score_string.
+# query_map and ref_map are indices of names.
+ALIGNMENT_DTYPE = np.dtype([
+  ("query_map", "<u4"),
+  ("ref_map", "<u4"),
+  ("is_forward", "<i4"),
+  ("query_start", "<i4"),
+  ("query_end", "<i4"),
+  ("ref_start", "<i4"),
+  ("ref_end", "<i4"),
+  ("query_start_bp", "<i4"),
+  ("query_end_bp", "<i4"),
+  ("ref_start_bp", "<i4"),
+  ("ref_end_bp", "<i4"),
+  ("num_matched_chunks", "<u4"),
+  ("query_misses", "<i4"),
+  ("ref_misses", "<i4"),
+  ("num_trials", "<i4"),
+  ("num_interior_chunks", "<i4"),
+  ("query_miss_rate", "<f8"),
+  ("ref_miss_rate", "<f8"),
+  ("total_score", "<f8"),
+  ("total_rescaled_score", "<f8"),
+  ("m_score", "<f8"),
+  ("p_val", "<f8"),
+  ("sizing_score", "<f8"),
+  ("sizing_score_rescaled", "<f8"),
+  ("query_scaling_factor", "<f8"),
+  ("score_per_inner_chunk", "<f8"),
+  ("chunks_offset", "<u8")
+])
+
+# A rescaled matched chunk, from the chunk_string and score_string of the text output.
+CHUNK_DTYPE = np.dtype([
+  ("qs", "<i4"),
+  ("qe", "<i4"),
+  ("ql", "<i4"),
+  ("rs", "<i4"),
+  ("re", "<i4"),
+  ("rl", "<i4"),
+  ("query_miss", "<f8"),
+  ("ref_miss", "<f8"),
+  ("sizing", "<f8")
+])
+
+class AlignmentsFile(object):
+  """A memory mapped binary alignments file"""
+
+  def __init__(self, file_name):
+
+    header = np.fromfile(file_name, dtype=HEADER_DTYPE, count=1)
+    if len(header) != 1 or header['magic'][0] != MAGIC:
+      raise ValueError("%s is not a binary alignment file"%file_name)
+
+    header = header[0]
+    if header['version'] != VERSION or header['byte_order'] != BYTE_ORDER:
+      raise ValueError("%s was written by an incompatible version or machine"%file_name)
+
+    self.file_name = file_name
+    self.header = header
+
+    def memmap(dtype, offset, count):
+      if count == 0:
+        return np.zeros(0, dtype=dtype)
+      return np.memmap(file_name, dtype=dtype, mode='r', offset=int(offset), shape=(int(count),))
+
+    self.alignments = memmap(ALIGNMENT_DTYPE, header['alignments_offset'], header['num_alignments'])
+    self.chunks = memmap(CHUNK_DTYPE, header['chunks_offset'], header['num_chunks'])
+
+    name_offsets = memmap(np.dtype("<u8"), header['name_offsets_offset'], header['num_names'] + 1)
+    name_data = memmap(np.dtype("S1"), header['names_offset'], name_offsets[-1]).tobytes()
+    self.names = np.array([name_data[s:e].decode() for s, e in zip(name_offsets[:-1], name_offsets[1:])], dtype=object)
+
+  def __len__(self):
+    return len(self.alignments)
+
+  def alignment_chunks(self, i):
+    """Return the chunks of alignment i"""
+    a = self.alignments[i]
+    s = int(a['chunks_offset'])
+    return self.chunks[s:s + int(a['num_matched_chunks'])]
+
+  def query_maps(self):
+    """Return the query map name of each alignment"""
+    return self.names[self.alignments['query_map']]
+
+  def ref_maps(self):
+    """Return the reference map name of each alignment"""
+    return self.names[self.alignments['ref_map']]
+
+def read_alignments_binary(file_name):
+  return AlignmentsFile(file_name)
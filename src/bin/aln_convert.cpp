@@ -0,0 +1,228 @@
+#include <iostream>
+#include <fstream>
+#include <string>
+#include <vector>
+#include <memory>
+#include <getopt.h>
+#include <stdexcept>
+
+// dp includes
+#include "alignment.h"
+#include "alignment_file.h"
+
+// common includes
+#include "text_buffer.h"
+#include "compressed_stream.h"
+#include "timer.h"
+#include "common_defs.h"
+
+using std::string;
+using std::cerr;
+using maligner_dp::AlignmentHeader;
+using maligner_dp::AlignmentFile;
+using maligner_dp::AlignmentFileWriter;
+using maligner_dp::AlignmentRecord;
+using maligner_dp::AlignmentChunkRecord;
+using maligner_dp::is_alignment_file;
+using maligner_dp::parse_alignment_text;
+using lmm_utils::Timer;
+
+//
+// Getopt
+//
+#define PACKAGE_NAME "aln_convert"
+
+static const char *VERSION_MESSAGE = "Version " PACKAGE_VERSION "\n"
+"Written by " AUTHOR "(" AUTHOR_EMAIL ") \n"
+"\n";
+
+static const int NUM_POSITION_ARGS = 2;
+
+static const char *USAGE_MESSAGE =
+"Usage: " PACKAGE_NAME " [OPTION] ... INPUT_FILE OUTPUT_FILE\n"
+"\n"
+" Convert an alignments file between the text (.aln) format and the binary\n"
+" alignment format written with --binary-output by maligner_dp, maligner_ix\n"
+" and maligner_vd. The format of INPUT_FILE is detected: a binary file is\n"
+" converted to text, and a text file is converted to binary.\n"
+" Use - for a text INPUT_FILE or OUTPUT_FILE to read stdin or write stdout.\n"
+" A gzip or zstd compressed text INPUT_FILE is detected, and a text OUTPUT_FILE\n"
+" is compressed if its name ends in .gz or .zst.\n"
+"\n"
+" General arguments:\n"
+"      -h, --help                       display this help and exit\n"
+"      -v, --version                    display the version and exit\n";
+
+namespace opt
+{
+    static string input_file;
+    static string output_file;
+}
+
+static const char* shortopts = "hv";
+
+static const struct option longopts[] = {
+    { "help",     no_argument,       NULL, 'h' },
+    { "version",  no_argument,       NULL, 'v'},
+    { NULL, 0, NULL, 0 }
+};
+
+void parse_args(int argc, char** argv)
+{
+
+    bool die = false;
+    for (char c; (c = getopt_long(argc, argv, shortopts, longopts, NULL)) != -1;)
+    {
+        switch (c)
+        {
+            case 'h':
+            {
+                std::cout << USAGE_MESSAGE;
+                exit(EXIT_SUCCESS);
+                break;
+            }
+            case 'v':
+            {
+                std::cout << VERSION_MESSAGE;
+                exit(EXIT_SUCCESS);
+                break;
+            }
+            default:
+            {
+                die = true;
+                break;
+            }
+        }
+    }
+
+    if (argc - optind < NUM_POSITION_ARGS)
+    {
+        std::cerr << ": missing arguments\n";
+        die = true;
+    }
+    else if (argc - optind > NUM_POSITION_ARGS)
+    {
+        std::cerr << ": too many arguments\n";
+        die = true;
+    }
+
+    if (die)
+    {
+        std::cout << "\n" << USAGE_MESSAGE;
+        exit(EXIT_FAILURE);
+    }
+
+    opt::input_file = argv[optind++];
+    opt::output_file = argv[optind++];
+
+}
+
+// Convert a binary alignment file to text. Returns the number of alignments.
+size_t binary_to_text(const string& input_file, std::ostream& os) {
+
+  AlignmentFile aln_file(input_file);
+  lmm_utils::TextBuffer buf;
+
+  os << AlignmentHeader();
+
+  const size_t n = aln_file.num_alignments();
+  for(size_t i = 0; i < n; i++) {
+    aln_file.print_alignment(buf, i);
+    buf.write_if_full(os);
+  }
+
+  buf.write_to(os);
+
+  return n;
+
+}
+
+// Convert a text alignments file to binary. Returns the number of alignments.
+size_t text_to_binary(std::istream& is, const string& output_file) {
+
+  AlignmentFileWriter writer(output_file);
+
+  string line, query_map, ref_map;
+  AlignmentRecord rec;
+  std::vector<AlignmentChunkRecord> chunks;
+  size_t line_num = 0;
+
+  while(std::getline(is, line)) {
+
+    line_num++;
+
+    // Skip the header and blank lines.
+    if(line.empty() || line.compare(0, 10, "query_map\t") == 0) {
+      continue;
+    }
+
+    if(!parse_alignment_text(line, rec, query_map, ref_map, chunks)) {
+      throw std::runtime_error("Malformed alignment on line " + std::to_string(line_num) + ": " + line);
+    }
+
+    writer.write(rec, query_map, ref_map, chunks.data());
+
+  }
+
+  writer.close();
+
+  return writer.num_alignments();
+
+}
+
+int main(int argc, char* argv[]) {
+
+  parse_args(argc, argv);
+
+  Timer timer;
+  const bool to_text = opt::input_file != "-" && is_alignment_file(opt::input_file);
+  size_t num_alignments = 0;
+
+  try {
+
+    if(to_text) {
+
+      if(opt::output_file == "-") {
+        num_alignments = binary_to_text(opt::input_file, std::cout);
+      } else {
+        std::unique_ptr<std::ostream> os(lmm_utils::open_output_file(opt::output_file));
+        if(!*os) {
+          throw std::runtime_error("Could not open " + opt::output_file);
+        }
+        num_alignments = binary_to_text(opt::input_file, *os);
+        os->flush();
+        if(!*os) {
+          throw std::runtime_error("Error writing " + opt::output_file);
+        }
+      }
+
+    } else {
+
+      if(opt::output_file == "-") {
+        throw std::runtime_error("The binary output must be written to a file.");
+      }
+
+      if(opt::input_file == "-") {
+        num_alignments = text_to_binary(std::cin, opt::output_file);
+      } else {
+        std::unique_ptr<std::istream> is(lmm_utils::open_input_file(opt::input_file));
+        if(!*is) {
+          throw std::runtime_error("Could not open " + opt::input_file);
+        }
+        num_alignments = text_to_binary(*is, opt::output_file);
+      }
+
+    }
+
+  } catch(std::exception& e) {
+    cerr << e.what() << "\n";
+    return EXIT_FAILURE;
+  }
+
+  timer.end();
+  cerr << "Converted " << num_alignments << " alignments to "
+       << (to_text ? "text" : "binary") << ". " << timer << "\n";
+
+  return EXIT_SUCCESS;
+
+}
@@ -0,0 +1,372 @@
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <memory>
+#include <queue>
+#include <functional>
+#include <unordered_map>
+#include <getopt.h>
+#include <stdexcept>
+
+// dp includes
+#include "alignment.h"
+#include "alignment_file.h"
+
+// common includes
+#include "map.h"
+#include "map_reader.h"
+#include "text_buffer.h"
+#include "compressed_stream.h"
+#include "timer.h"
+#include "common_defs.h"
+
+using std::string;
+using std::cerr;
+using maligner_dp::AlignmentHeader;
+using maligner_dp::AlignmentFile;
+using maligner_dp::is_alignment_file;
+using lmm_utils::Timer;
+
+//
+// Getopt
+//
+#define PACKAGE_NAME "aln_merge"
+
+static const char *VERSION_MESSAGE = "Version " PACKAGE_VERSION "\n"
+"Written by " AUTHOR "(" AUTHOR_EMAIL ") \n"
+"\n";
+
+static const char *USAGE_MESSAGE =
+"Usage: " PACKAGE_NAME " [OPTION] ... INPUT_FILE ...\n"
+"\n"
+" Merge the outputs of a run split into shards with --shard-index and --num-shards\n"
+" (i.e. the alignments or score files of maligner_dp, maligner_ix or maligner_vd).\n"
+" Each line of an INPUT_FILE starts with the query map name. A header line is\n"
+" written once. Binary alignment files are converted to text.\n"
+"\n"
+" With --maps, the lines are merged into the order of the queries in MAPS_FILE.\n"
+" Otherwise the INPUT_FILEs are concatenated in the order given, which restores the\n"
+" query order of shards of an uncompressed maps file given in shard order.\n"
+"\n"
+" A summary of the merged alignments is written to stderr.\n"
+"\n"
+" General arguments:\n"
+"      --maps MAPS_FILE                 Merge into the query order of MAPS_FILE.\n"
+"      -o, --output FILE                Write to FILE instead of stdout. FILE is compressed\n"
+"                                       if its name ends in .gz or .zst.\n"
+"      -h, --help                       display this help and exit\n"
+"      -v, --version                    display the version and exit\n";
+
+namespace opt
+{
+    static string maps_file;
+    static string output_file;
+    static std::vector<string> input_files;
+}
+
+static const char* shortopts = "o:hv";
+
+enum { OPT_MAPS = 1 };
+
+static const struct option longopts[] = {
+    { "maps",     required_argument, NULL, OPT_MAPS },
+    { "output",   required_argument, NULL, 'o' },
+    { "help",     no_argument,       NULL, 'h' },
+    { "version",  no_argument,       NULL, 'v'},
+    { NULL, 0, NULL, 0 }
+};
+
+void parse_args(int argc, char** argv)
+{
+
+    bool die = false;
+    for (char c; (c = getopt_long(argc, argv, shortopts, longopts, NULL)) != -1;)
+    {
+        switch (c)
+        {
+            case OPT_MAPS: opt::maps_file = optarg; break;
+            case 'o': opt::output_file = optarg; break;
+            case 'h':
+            {
+                std::cout << USAGE_MESSAGE;
+                exit(EXIT_SUCCESS);
+                break;
+            }
+            case 'v':
+            {
+                std::cout << VERSION_MESSAGE;
+                exit(EXIT_SUCCESS);
+                break;
+            }
+            default:
+            {
+                die = true;
+                break;
+            }
+        }
+    }
+
+    if (argc - optind < 1)
+    {
+        std::cerr << ": missing arguments\n";
+        die = true;
+    }
+
+    if (die)
+    {
+        std::cout << "\n" << USAGE_MESSAGE;
+        exit(EXIT_FAILURE);
+    }
+
+    for(; optind < argc; optind++) {
+      opt::input_files.push_back(argv[optind]);
+    }
+
+}
+
+// The lines of an input file, with the query map name of each.
+class MergeInput {
+
+public:
+
+  MergeInput(const string& file_name) :
+    file_name_(file_name),
+    num_lines_(0),
+    next_record_(0)
+  {
+
+    if(is_alignment_file(file_name)) {
+      aln_file_.reset(new AlignmentFile(file_name));
+      std::ostringstream header;
+      header << AlignmentHeader();
+      header_ = header.str();
+      header_.pop_back();
+      return;
+    }
+
+    is_ = lmm_utils::open_input_file(file_name);
+    if(!*is_) {
+      throw std::runtime_error("Could not open " + file_name);
+    }
+
+    // Keep the header line, or the first line if there is no header.
+    if(std::getline(*is_, line_) && line_.compare(0, 10, "query_map\t") == 0) {
+      header_.swap(line_);
+      line_.clear();
+    }
+
+  }
+
+  // Advance to the next line. Returns false at the end of the file.
+  bool next() {
+
+    if(aln_file_) {
+      if(next_record_ == aln_file_->num_alignments()) {
+        return false;
+      }
+      buf_.clear();
+      aln_file_->print_alignment(buf_, next_record_++);
+      line_ = buf_.str();
+      line_.pop_back();
+    } else if(!line_.empty()) {
+      // The first line, read by the constructor.
+    } else {
+      while(std::getline(*is_, line_) && line_.empty()) {}
+      if(line_.empty()) {
+        return false;
+      }
+    }
+
+    query_ = line_.substr(0, line_.find('\t'));
+    num_lines_++;
+    return true;
+
+  }
+
+  // Take the current line.
+  string take_line() {
+    string line;
+    line.swap(line_);
+    return line;
+  }
+
+  const string& file_name() const { return file_name_; }
+  const string& header() const { return header_; }
+  const string& query() const { return query_; }
+  size_t num_lines() const { return num_lines_; }
+
+private:
+
+  string file_name_;
+  std::unique_ptr<std::istream> is_;
+  std::unique_ptr<AlignmentFile> aln_file_;
+  lmm_utils::TextBuffer buf_;
+  string header_;
+  string line_;
+  string query_;
+  size_t num_lines_;
+  size_t next_record_;
+
+};
+
+typedef std::unique_ptr<MergeInput> MergeInputPtr;
+
+// Totals over all of the inputs, which are not available from any one shard.
+struct MergeSummary {
+
+  MergeSummary() : num_lines(0), num_queries(0) {}
+
+  void add(const string& query) {
+    num_lines++;
+    if(query != last_query) {
+      num_queries++;
+      last_query = query;
+    }
+  }
+
+  size_t num_lines;
+  size_t num_queries;
+  string last_query;
+
+};
+
+void write_header(std::vector<MergeInputPtr>& inputs, std::ostream& os) {
+  for(auto& input : inputs) {
+    if(!input->header().empty()) {
+      os << input->header() << '\n';
+      return;
+    }
+  }
+}
+
+// Write the inputs one after the other.
+void concatenate(std::vector<MergeInputPtr>& inputs, std::ostream& os, MergeSummary& summary) {
+
+  lmm_utils::TextBuffer out;
+
+  for(auto& input : inputs) {
+    while(input->next()) {
+      summary.add(input->query());
+      out << input->take_line() << '\n';
+      out.write_if_full(os);
+    }
+  }
+
+  out.write_to(os);
+
+}
+
+// Merge the lines of the inputs into the order of the queries in maps_file.
+void merge_by_query(std::vector<MergeInputPtr>& inputs, const string& maps_file,
+  std::ostream& os, MergeSummary& summary) {
+
+  std::unordered_map<string, size_t> query_order;
+  {
+    maligner_maps::MapReader reader(maps_file);
+    maligner_maps::Map map;
+    for(size_t i = 0; reader.next(map); i++) {
+      query_order.emplace(map.name_, i);
+    }
+  }
+
+  auto query_index = [&](const MergeInput& input) {
+    auto it = query_order.find(input.query());
+    if(it == query_order.end()) {
+      throw std::runtime_error("Query " + input.query() + " of " + input.file_name() +
+        " is not in " + maps_file);
+    }
+    return it->second;
+  };
+
+  // Min heap of (query index, input index) of the current line of each input.
+  typedef std::pair<size_t, size_t> HeapItem;
+  std::priority_queue<HeapItem, std::vector<HeapItem>, std::greater<HeapItem> > heap;
+
+  for(size_t i = 0; i < inputs.size(); i++) {
+    if(inputs[i]->next()) {
+      heap.emplace(query_index(*inputs[i]), i);
+    }
+  }
+
+  lmm_utils::TextBuffer out;
+
+  while(!heap.empty()) {
+
+    const HeapItem top = heap.top();
+    heap.pop();
+
+    MergeInput& input = *inputs[top.second];
+    summary.add(input.query());
+    out << input.take_line() << '\n';
+    out.write_if_full(os);
+
+    // The lines of a shard are in the order of its queries.
+    if(input.next()) {
+      const size_t q = query_index(input);
+      if(q < top.first) {
+        throw std::runtime_error("The queries of " + input.file_name() + " are not in the order of " + maps_file);
+      }
+      heap.emplace(q, top.second);
+    }
+
+  }
+
+  out.write_to(os);
+
+}
+
+int main(int argc, char* argv[]) {
+
+  parse_args(argc, argv);
+
+  Timer timer;
+  MergeSummary summary;
+  std::vector<MergeInputPtr> inputs;
+
+  try {
+
+    for(const string& f : opt::input_files) {
+      inputs.emplace_back(new MergeInput(f));
+    }
+
+    std::unique_ptr<std::ostream> output_file;
+    if(!opt::output_file.empty() && opt::output_file != "-") {
+      output_file = lmm_utils::open_output_file(opt::output_file);
+      if(!*output_file) {
+        throw std::runtime_error("Could not open " + opt::output_file);
+      }
+    }
+    std::ostream& os = output_file ? *output_file : std::cout;
+
+    write_header(inputs, os);
+
+    if(opt::maps_file.empty()) {
+      concatenate(inputs, os, summary);
+    } else {
+      merge_by_query(inputs, opt::maps_file, os, summary);
+    }
+
+    os.flush();
+    if(!os) {
+      throw std::runtime_error("Error writing " + opt::output_file);
+    }
+
+  } catch(std::exception& e) {
+    cerr << e.what() << "\n";
+    return EXIT_FAILURE;
+  }
+
+  timer.end();
+
+  for(auto& input : inputs) {
+    cerr << input->file_name() << ": " << input->num_lines() << " lines\n";
+  }
+  cerr << "total lines: " << summary.num_lines << "\n"
+       << summary.num_queries << " maps with lines.\n"
+       << "Merged " << inputs.size() << " files. " << timer << "\n";
+
+  return EXIT_SUCCESS;
+
+}
@@ -7,6 +7,13 @@
 #include <fstream>
 #include <chrono>
 #include <getopt.h>
+#include <memory>
+#include <iterator>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <set>
+#include <system_error>
 
 // kmer_match includes
 #include "map.h"
@@ -24,13 +31,21 @@
 #include "align.h"
 #include "utils.h"
 #include "ScoreMatrix.h"
+#include "ref_index.h"
+#include "alignment_file.h"
 
 // vd includes
 #include "score_matrix_vd.h"
 
 // common includes
 #include "timer.h"
+#include "thread_pool.h"
+#include "async_io.h"
+#include "compressed_stream.h"
+#include "checkpoint.h"
+#include "unix_socket.h"
 #include "common_defs.h"
+#include "common_math.h"
 
 using std::string;
 using std::unordered_map;
@@ -55,15 +70,36 @@ using maligner_dp::Alignment;
 
 using lmm_utils::Timer;
 
-typedef ScoreMatrix<row_order_tag> ScoreMatrixType;
+typedef ScoreMatrix<compact_row_order_tag> ScoreMatrixType;
+typedef ScoreMatrix<row_order_tag> WideScoreMatrixType;
 typedef AlignTask<ScoreMatrixType, Chi2SizingPenalty> AlignTaskType;
 
+// The score matrices owned by a single thread. Only one is used, depending on
+// whether alignments are done in linear memory, and on the max misses.
+struct ScoreMatrices {
+  ScoreMatrixType sm;
+  WideScoreMatrixType wsm;
+  LinearScoreMatrix lsm;
+};
+
+// The compact ScoreMatrix has byte backpointers, so fall back to the ScoreCell
+// matrix for more consecutive missed sites than it supports.
+bool use_wide_score_matrix() {
+  return opt::query_max_misses > ScoreMatrixType::max_misses ||
+    opt::ref_max_misses > ScoreMatrixType::max_misses;
+}
+
 typedef unordered_map<string, RefMapWrapper> RefMapDB;
+typedef std::vector<RefMapWrapper> RefMapWrapperVec;
 
 
 /////////////////////////////////////////////////////////////////
 // Generate permuted maps by concatenating all fragments
-RefMapDB generate_permuted_maps(RefMapDB& ref_map_db, size_t n) {
+//
+// Trial i permutes the fragments with its own random number generator, seeded from
+// (seed, i), so the permuted maps depend only on the seed and not on the order
+// or number of threads in which they are used.
+RefMapWrapperVec generate_permuted_maps(RefMapDB& ref_map_db, size_t n, unsigned int seed) {
   
   // Gather all fragments from the reference map.
   FragVec all_frags;
@@ -87,7 +123,8 @@ RefMapDB generate_permuted_maps(RefMapDB& ref_map_db, size_t n) {
   const bool is_bounded = false;
   const bool is_random = true;
 
-  RefMapDB ret;
+  RefMapWrapperVec ret;
+  ret.reserve(n);
 
   for(size_t i = 0; i < n; i++) {
 
@@ -97,7 +134,9 @@ RefMapDB generate_permuted_maps(RefMapDB& ref_map_db, size_t n) {
     std::string map_name_str = map_name.str();
     std::cerr << "map_name: " << map_name_str << std::endl;
 
-    FragVec random_frags = permute(all_frags);
+    std::seed_seq trial_seed{seed, (unsigned int) i};
+    std::mt19937 gen(trial_seed);
+    FragVec random_frags = permute(all_frags, gen);
 
     std::cerr << "have " << random_frags.size() << " random frags." << std::endl;
 
@@ -105,13 +144,11 @@ RefMapDB generate_permuted_maps(RefMapDB& ref_map_db, size_t n) {
     MapData random_map_data(map_name_str, random_frags.size(), size,
       is_circular, is_bounded, is_random);
 
-    RefMapWrapper random_map_wrapper(random_map, random_map_data,
+    ret.push_back(RefMapWrapper(random_map, random_map_data,
         maligner_dp::opt::ref_max_misses,
         maligner_dp::opt::sd_rate,
         maligner_dp::opt::min_sd
-    );
-
-    ret.insert(RefMapDB::value_type(map_name_str, random_map_wrapper));
+    ));
 
   }
 
@@ -120,87 +157,208 @@ RefMapDB generate_permuted_maps(RefMapDB& ref_map_db, size_t n) {
 }
 
 
-///////////////////////////////////////////////////////////////////////////////////////////
-// Align the query to each map, and return a vector of the best random alignments
-AlignmentVec run_permutation_test(RefMapDB& permuted_map_db, const QueryMapWrapper& qmw,
-  ScoreMatrixType& sm, AlignOpts& align_opts) {
+// Write the permuted maps to a maps file, so that a permutation test can be inspected or repeated.
+void write_permuted_maps(const RefMapWrapperVec& permuted_maps, const std::string& file_name) {
+
+  ofstream fout(file_name);
+  if(!fout) {
+    throw std::runtime_error("Could not open file for writing: " + file_name);
+  }
+
+  // Write the fragments before circularization.
+  for(const auto& rmw : permuted_maps) {
+    const Map random_map(rmw.map_.name_, rmw.map_.size_, rmw.get_frags_noncircularized());
+    write_map(fout, random_map);
+  }
+
+}
+
+
+//////////////////////////////////////////////////////////////////////////
+// Align the query to a permuted map, forward and reverse, and return the best alignment.
+template<class MatrixType>
+Alignment align_to_permuted_map(const QueryMapWrapper& qmw, const RefMapWrapper& rmw,
+  MatrixType& sm, const AlignOpts& align_opts) {
+
+  typedef AlignTask<MatrixType, Chi2SizingPenalty> AlignTaskType;
+
+  AlignTaskType task_forward(
+    const_cast<MapData*>(&qmw.map_data_),
+    const_cast<MapData*>(&rmw.map_data_),
+    &qmw.get_frags(),
+    &rmw.get_frags(), 
+    &qmw.get_partial_sums_forward(),
+    &rmw.get_partial_sums(),
+    &rmw.sd_inv_,
+    &qmw.ix_to_locs_,
+    &rmw.ix_to_locs_,
+    0, // ref_offset
+    &sm,
+    nullptr,
+    true, // query_is_forward
+    true, // ref_is_forward
+    align_opts
+  );
+
+  AlignTaskType task_reverse(
+    const_cast<MapData*>(&qmw.map_data_),
+    const_cast<MapData*>(&rmw.map_data_),
+    &qmw.get_frags_reverse(),
+    &rmw.get_frags(), 
+    &qmw.get_partial_sums_reverse(),
+    &rmw.get_partial_sums(),
+    &rmw.sd_inv_,
+    &qmw.ix_to_locs_,
+    &rmw.ix_to_locs_,        
+    0, // ref_offset
+    &sm,
+    nullptr,
+    true, // query_is_forward
+    false, // ref_is_forward
+    align_opts
+  );
+
+  // print_align_task(std::cerr, task_forward);
+  Alignment forward_aln = make_best_alignment_using_partials(task_forward);
+
+  // print_align_task(std::cerr, task_reverse);
+  Alignment reverse_aln = make_best_alignment_using_partials(task_reverse);
+
+  if(forward_aln.total_rescaled_score > reverse_aln.total_rescaled_score) {
+    return forward_aln;
+  }
+
+  return reverse_aln;
+
+}
+
+Alignment align_to_permuted_map(const QueryMapWrapper& qmw, const RefMapWrapper& rmw,
+  ScoreMatrices& sms, const AlignOpts& align_opts) {
+
+  if(opt::linear_memory) {
+    return align_to_permuted_map(qmw, rmw, sms.lsm, align_opts);
+  }
 
+  if(use_wide_score_matrix()) {
+    return align_to_permuted_map(qmw, rmw, sms.wsm, align_opts);
+  }
+
+  return align_to_permuted_map(qmw, rmw, sms.sm, align_opts);
+
+}
+
+
+// Align the query to the permuted maps of trials [trial_begin, trial_end), and store
+// the best random alignment of each trial in alignments, which is indexed by trial.
+//
+// If a pool is given, each permuted map is aligned as a separate task using the
+// worker's score matrix. The alignments are stored by trial, so the results do
+// not depend on the number of threads.
+void run_permutation_trials(const RefMapWrapperVec& permuted_maps, size_t trial_begin, size_t trial_end,
+  const QueryMapWrapper& qmw, ScoreMatrices& sms, const AlignOpts& align_opts,
+  lmm_utils::ThreadPool* pool, std::vector<ScoreMatrices>* worker_sms,
+  AlignmentVec& alignments) {
+
+  alignments.resize(trial_end);
+
+  if(pool) {
+
+    for(size_t i = trial_begin; i < trial_end; i++) {
+      pool->submit([&, i](size_t worker_id) {
+        alignments[i] = align_to_permuted_map(qmw, permuted_maps[i], (*worker_sms)[worker_id], align_opts);
+      });
+    }
+
+    pool->wait();
+
+  } else {
+
+    for(size_t i = trial_begin; i < trial_end; i++) {
+      alignments[i] = align_to_permuted_map(qmw, permuted_maps[i], sms, align_opts);
+    }
+
+  }
+
+}
 
+// Check the sequential stopping rules of the permutation test, given the number of
+// random alignments scoring at least as well as the best alignment (num_hits) in num_trials.
+bool permutation_test_can_stop(int num_hits, int num_trials, std::ostream& log) {
+
+  if(opt::permutation_stop_hits > 0 && num_hits >= opt::permutation_stop_hits) {
+    log << "stopping permutation test after " << num_trials << " trials: "
+        << num_hits << " random alignments scored at least as well as the best alignment.\n";
+    return true;
+  }
+
+  if(opt::permutation_stop_pval > 0.0) {
+    const double pval_bound = binomial_upper_bound(num_hits, num_trials, opt::permutation_stop_confidence);
+    if(pval_bound < opt::permutation_stop_pval) {
+      log << "stopping permutation test after " << num_trials << " trials: "
+          << "p-value upper bound " << pval_bound << " is below " << opt::permutation_stop_pval << ".\n";
+      return true;
+    }
+  }
+
+  return false;
+
+}
+
+// Run the permutation test for the query, and return the sorted best random alignments.
+//
+// The trials are run in batches of opt::permutation_batch_size when a stopping rule is
+// enabled. After each batch, the test stops early if enough random alignments score
+// at least as well as the best alignment (Besag & Clifford, 1991), or if the
+// upper bound on the p-value of the best alignment is small enough.
+// The trials are always taken in order, so the results do not depend on the number of threads.
+AlignmentVec run_permutation_test(const RefMapWrapperVec& permuted_maps, const QueryMapWrapper& qmw,
+  const Alignment& best_aln, ScoreMatrices& sms, const AlignOpts& align_opts,
+  lmm_utils::ThreadPool* pool, std::vector<ScoreMatrices>* worker_sms,
+  std::ostream& log) {
 
   Timer timer;
   timer.start();
-  std::cerr << "Running permutation test... ";
+  log << "Running permutation test... ";
+
+  const size_t max_trials = permuted_maps.size();
+  const bool is_sequential = opt::permutation_stop_hits > 0 || opt::permutation_stop_pval > 0.0;
+  const size_t batch_size = is_sequential ? size_t(opt::permutation_batch_size) : max_trials;
 
   AlignmentVec alignments;
-  alignments.reserve(permuted_map_db.size());
-
-
-  for(auto permuted_map_iter = permuted_map_db.begin();
-        permuted_map_iter != permuted_map_db.end();
-        permuted_map_iter++) {
-
-
-      const RefMapWrapper& rmw = permuted_map_iter->second;
-
-      AlignTaskType task_forward(
-        const_cast<MapData*>(&qmw.map_data_),
-        const_cast<MapData*>(&rmw.map_data_),
-        &qmw.get_frags(),
-        &rmw.get_frags(), 
-        &qmw.get_partial_sums_forward(),
-        &rmw.get_partial_sums(),
-        &rmw.sd_inv_,
-        &qmw.ix_to_locs_,
-        &rmw.ix_to_locs_,
-        0, // ref_offset
-        &sm,
-        nullptr,
-        true, // query_is_forward
-        true, // ref_is_forward
-        align_opts
-      );
-
-      AlignTaskType task_reverse(
-        const_cast<MapData*>(&qmw.map_data_),
-        const_cast<MapData*>(&rmw.map_data_),
-        &qmw.get_frags_reverse(),
-        &rmw.get_frags(), 
-        &qmw.get_partial_sums_reverse(),
-        &rmw.get_partial_sums(),
-        &rmw.sd_inv_,
-        &qmw.ix_to_locs_,
-        &rmw.ix_to_locs_,        
-        0, // ref_offset
-        &sm,
-        nullptr,
-        true, // query_is_forward
-        false, // ref_is_forward
-        align_opts
-      );
-
-      // print_align_task(std::cerr, task_forward);
-      Alignment forward_aln = make_best_alignment_using_partials(task_forward);
-
-      // print_align_task(std::cerr, task_reverse);
-      Alignment reverse_aln = make_best_alignment_using_partials(task_reverse);
-
-      if(forward_aln.total_rescaled_score > reverse_aln.total_rescaled_score) {
-        alignments.push_back(std::move(forward_aln));
-      } else {
-        alignments.push_back(std::move(reverse_aln));
+  alignments.reserve(max_trials);
+
+  size_t num_trials = 0;
+  int num_hits = 0;
+
+  while(num_trials < max_trials) {
+
+    const size_t batch_end = std::min(num_trials + batch_size, max_trials);
+    run_permutation_trials(permuted_maps, num_trials, batch_end, qmw, sms, align_opts,
+      pool, worker_sms, alignments);
+
+    for(size_t i = num_trials; i < batch_end; i++) {
+      if(alignments[i].total_rescaled_score <= best_aln.total_rescaled_score) {
+        num_hits++;
       }
+    }
 
+    num_trials = batch_end;
 
+    if(is_sequential && permutation_test_can_stop(num_hits, num_trials, log)) {
+      break;
     }
 
-    std::sort(alignments.begin(), alignments.end(), AlignmentRescaledScoreComp());
+  }
+
+  std::sort(alignments.begin(), alignments.end(), AlignmentRescaledScoreComp());
+
+  log << timer << "\n";
 
-    std::cerr << timer << "\n";
+  return alignments;
 
-    return alignments;
 }
 
-void assign_pval(const AlignmentVec& sorted_random_alns, Alignment& aln) {
+void assign_pval(const AlignmentVec& sorted_random_alns, Alignment& aln, std::ostream& log) {
 
   // Compute how many sorted_random_alns have a score equal to or lower than aln.
   AlignmentVec::const_iterator ubound = std::upper_bound(
@@ -213,171 +371,164 @@ void assign_pval(const AlignmentVec& sorted_random_alns, Alignment& aln) {
   // worse than aln.
   int num_better = ubound - sorted_random_alns.begin();
 
-  std::cerr << "num_random_alns: " << sorted_random_alns.size() <<
+  log << "num_random_alns: " << sorted_random_alns.size() <<
   " first score: " << sorted_random_alns[0].total_rescaled_score <<
   " last score: " << sorted_random_alns.back().total_rescaled_score <<
   " aln score: " << aln.total_rescaled_score <<
   " num better: " << num_better << std::endl;
 
   aln.p_val =  double(num_better)/sorted_random_alns.size();
+  aln.num_trials = sorted_random_alns.size();
 
   return;
 }
 
 
-int main(int argc, char* argv[]) {
+//////////////////////////////////////////////////////////////////////////
+// Output produced by aligning a single query. Queries may finish out of
+// order when running with multiple threads, so each query writes into its
+// own buffers, which are then written out in input order.
+struct QueryResult {
+  string alignments; // Alignment records for stdout
+  AlignmentRecordBlock binary_alignments; // Alignment records for the binary output file
+  string scores; // Records for the score file
+  string log; // Messages for stderr
+  uint64_t input_position = 0; // Position of the query maps reader after the query
+};
+
+
+//////////////////////////////////////////////////////////////////////////
+// Build the task for aligning the query to a reference map in the given
+// query orientation. Alignments are appended to alns.
+template<class MatrixType>
+AlignTask<MatrixType, Chi2SizingPenalty> make_reference_task(const QueryMapWrapper& qmw,
+  const RefMapWrapper& rmw, bool query_is_forward, MatrixType& sm, AlignmentVec& alns,
+  const AlignOpts& align_opts) {
+
+  return AlignTask<MatrixType, Chi2SizingPenalty>(
+    const_cast<MapData*>(&qmw.map_data_),
+    const_cast<MapData*>(&rmw.map_data_),
+    query_is_forward ? &qmw.get_frags() : &qmw.get_frags_reverse(),
+    &rmw.get_frags(),
+    query_is_forward ? &qmw.get_partial_sums_forward() : &qmw.get_partial_sums_reverse(),
+    &rmw.get_partial_sums(),
+    &rmw.sd_inv_,
+    &qmw.ix_to_locs_,
+    &rmw.ix_to_locs_,
+    0, // ref_offset
+    &sm,
+    &alns,
+    query_is_forward,
+    true, // ref_is_forward
+    align_opts
+  );
 
-  using maligner_dp::Alignment;
-  maligner_dp::opt::program_name = argv[0];
-  parse_args(argc, argv);
+}
 
-  print_args(std::cerr);
 
-  ofstream score_file;
+//////////////////////////////////////////////////////////////////////////
+// Align the query to a reference map in the given query orientation, appending
+// the alignments to alns. Returns the number of alignments.
+int align_to_reference(const QueryMapWrapper& qmw, const RefMapWrapper& rmw,
+  bool query_is_forward, ScoreMatrices& sms, AlignmentVec& alns, const AlignOpts& align_opts) {
 
-  if(!maligner_dp::opt::score_file.empty()) {
-    score_file.open(maligner_dp::opt::score_file); 
+  if(opt::linear_memory) {
+    auto task = make_reference_task(qmw, rmw, query_is_forward, sms.lsm, alns, align_opts);
+    return make_best_alignments_using_partials(task);
   }
 
-
-  Timer timer;
-
-  AlignOpts align_opts(maligner_dp::opt::query_miss_penalty,
-                       maligner_dp::opt::ref_miss_penalty,
-                       maligner_dp::opt::query_max_misses,
-                       maligner_dp::opt::ref_max_misses,
-                       maligner_dp::opt::sd_rate,
-                       maligner_dp::opt::min_sd,
-                       maligner_dp::opt::max_chunk_sizing_error,
-                       maligner_dp::opt::ref_max_miss_rate,
-                       maligner_dp::opt::query_max_miss_rate,
-                       maligner_dp::opt::alignments_per_reference,
-                       maligner_dp::opt::min_alignment_spacing,
-                       maligner_dp::opt::neighbor_delta,
-                       maligner_dp::opt::query_is_bounded, // Perhaps this should be part of the MapData instead of AlignOpts
-                       maligner_dp::opt::ref_is_bounded, // Perhaps this should be part of the MapData instead of AlignOpts
-                       maligner_dp::opt::query_rescaling,
-                       maligner_dp::opt::min_query_scaling,
-                       maligner_dp::opt::max_query_scaling);
-
-  // Build a database of reference maps. 
-  MapVec ref_maps(read_maps(maligner_dp::opt::ref_maps_file));
-  cerr << "Read " << ref_maps.size() << " reference maps.\n";
-
-  // Store reference maps in an unordered map.
-  RefMapDB ref_map_db;
-  for(auto i = ref_maps.begin(); i != ref_maps.end(); i++) {
-    ref_map_db.insert( RefMapDB::value_type(i->name_,
-        RefMapWrapper(*i, maligner_dp::opt::reference_is_circular, 
-                          maligner_dp::opt::ref_max_misses,
-                          maligner_dp::opt::sd_rate,
-                          maligner_dp::opt::min_sd)) );
+  if(use_wide_score_matrix()) {
+    auto task = make_reference_task(qmw, rmw, query_is_forward, sms.wsm, alns, align_opts);
+    return make_best_alignments_using_partials(task);
   }
 
- cerr << "Wrapped " << ref_map_db.size() << " reference maps.\n";
+  auto task = make_reference_task(qmw, rmw, query_is_forward, sms.sm, alns, align_opts);
+  return make_best_alignments_using_partials(task);
 
-
- // Generated permuted reference map for permutation test, if necessary
- RefMapDB permuted_map_db = generate_permuted_maps(ref_map_db, opt::num_permutation_trials);
-
- // Generate a single ScoreMatrix to use throughout this program.
- ScoreMatrixType sm;
+}
 
 
- MapReader query_map_reader(maligner_dp::opt::query_maps_file);
- Map query_map;
- AlignmentVec alns_forward, alns_reverse, all_alignments;
+//////////////////////////////////////////////////////////////////////////
+// The alignment of a query to one reference map in one orientation.
+// This is the unit of work when aligning a query to the references in parallel.
+struct ReferenceJob {
+  const RefMapWrapper* rmw;
+  bool query_is_forward;
+  AlignmentVec alignments; // Private to the job; merged once all jobs are done.
+  int num_alignments;
+  Timer timer;
+};
+
+
+//////////////////////////////////////////////////////////////////////////
+// Align the query to every reference map, forward and reverse, appending
+// the alignments to all_alignments.
+//
+// If a pool is given, each (reference, orientation) pair is aligned as a separate
+// task using the worker's score matrix. The private alignment vectors are merged in
+// the same order as the serial loop, so that the results do not depend on
+// the number of threads.
+void align_to_references(const QueryMapWrapper& qmw, const RefMapDB& ref_map_db,
+  ScoreMatrices& sms, const AlignOpts& align_opts,
+  lmm_utils::ThreadPool* pool, std::vector<ScoreMatrices>* worker_sms,
+  AlignmentVec& all_alignments, std::ostream& log) {
+
+    if(pool) {
+
+      std::vector<ReferenceJob> jobs;
+      jobs.reserve(2*ref_map_db.size());
+
+      for(auto ref_map_iter = ref_map_db.begin();
+          ref_map_iter != ref_map_db.end();
+          ref_map_iter++) {
+        for(int i = 0; i < 2; i++) {
+          ReferenceJob job;
+          job.rmw = &ref_map_iter->second;
+          job.query_is_forward = (i == 0);
+          job.num_alignments = 0;
+          jobs.push_back(std::move(job));
+        }
+      }
 
+      for(auto& job : jobs) {
+        ReferenceJob* p_job = &job;
+        pool->submit([&, p_job](size_t worker_id) {
+          p_job->timer.start();
+          p_job->num_alignments = align_to_reference(qmw, *p_job->rmw, p_job->query_is_forward,
+            (*worker_sms)[worker_id], p_job->alignments, align_opts);
+          p_job->timer.end();
+        });
+      }
 
- std::cout << AlignmentHeader();
+      pool->wait();
 
- while(query_map_reader.next(query_map)) {
+      size_t num_alignments = 0;
+      for(const auto& job : jobs) {
+        num_alignments += job.alignments.size();
+      }
+      all_alignments.reserve(all_alignments.size() + num_alignments);
 
-    all_alignments.clear();
-    alns_forward.clear();
-    alns_reverse.clear();
+      for(auto& job : jobs) {
 
-    const IntVec& query_frags_forward = query_map.frags_;
+        if(opt::verbose) {
+          log << "Num alignments " << (job.query_is_forward ? "forward" : "reverse") << ": "
+              << job.num_alignments << " " << job.timer << "\n";
+        }
 
-    if(query_map.frags_.size() < maligner_dp::opt::min_query_frags) {
+        std::move(job.alignments.begin(), job.alignments.end(), std::back_inserter(all_alignments));
 
-      if(opt::verbose) {
-        std::cerr << "Skipping map " << query_map.name_ << " with " 
-                  << query_map.frags_.size() << " fragments.\n";
       }
 
-      continue;
-    }
-
-    if(query_map.frags_.size() > maligner_dp::opt::max_query_frags) {
-
-      if(opt::verbose) {
-        std::cerr << "Skipping map " << query_map.name_ << " with " 
-                  << query_map.frags_.size() << " fragments.\n";
-      }
+      return;
 
-      continue;
     }
 
-    const QueryMapWrapper qmw(query_map, align_opts.query_max_misses);
-
-    const size_t num_query_frags = query_map.frags_.size();
-
-    Timer query_timer;
-    query_timer.start();
-
     for(auto ref_map_iter = ref_map_db.begin();
         ref_map_iter != ref_map_db.end();
         ref_map_iter++) {
 
-      using maligner_vd::ScoreMatrixProfile;
-
       const RefMapWrapper& rmw = ref_map_iter->second;
 
-      // const IntVec* p_frags_forward = &query_frags_forward;
-      // const IntVec* p_frags_reverse = &query_frags_reverse;
-
-      AlignTaskType task_forward(
-        const_cast<MapData*>(&qmw.map_data_),
-        const_cast<MapData*>(&rmw.map_data_),
-        &qmw.get_frags(),
-        &rmw.get_frags(), 
-        &qmw.get_partial_sums_forward(),
-        &rmw.get_partial_sums(),
-        &rmw.sd_inv_,
-        &qmw.ix_to_locs_,
-        &rmw.ix_to_locs_,
-        0, // ref_offset
-        &sm,
-        &all_alignments,
-        true, // query_is_forward
-        true, // ref_is_forward
-        align_opts
-      );
-
-      AlignTaskType task_reverse(
-        const_cast<MapData*>(&qmw.map_data_),
-        const_cast<MapData*>(&rmw.map_data_),
-        &qmw.get_frags_reverse(),
-        &rmw.get_frags(), 
-        &qmw.get_partial_sums_reverse(),
-        &rmw.get_partial_sums(),
-        &rmw.sd_inv_,
-        &qmw.ix_to_locs_,
-        &rmw.ix_to_locs_,        
-        0, // ref_offset
-        &sm,
-        &all_alignments,
-        false, // query_is_forward
-        true, // ref_is_forward
-        align_opts
-      );
-
-      // ScoreMatrixProfile profile_forward, profile_rev;
-
-      // std::cerr << "Align task forward: "; print_align_task(std::cerr, task_forward);
-      // std::cerr << "Align task reverse: "; print_align_task(std::cerr, task_reverse);
-
       // std::cerr << "Aligning " << query_map.name_ << " to " << rmw.map_.name_ << "\n";
       Timer timer;
 
@@ -385,76 +536,58 @@ int main(int argc, char* argv[]) {
       {
 
         timer.start();
-        // Alignment aln_forward = make_best_alignment_using_partials(task_forward);
-        int num_alignments = make_best_alignments_using_partials(task_forward);
+        int num_alignments = align_to_reference(qmw, rmw, true, sms, all_alignments, align_opts);
         timer.end();
 
         if(opt::verbose) {
-          std::cerr << "Num alignments forward: " << num_alignments
-                    << " " << timer << "\n";
+          log << "Num alignments forward: " << num_alignments
+              << " " << timer << "\n";
         }
 
-        ////////////////////////////////////////////////
-        // DEBUG      
-        // std::cerr << sm.getNumRows() << " x " << sm.getNumCols() << "\n";    
-        // std::cerr << "last_row: " << sm.countFilledByRow(sm.getNumRows() - 1) << "\n";
-        // profile_forward = get_score_matrix_row_profile(sm,
-        //   sm.getNumRows()-1,
-        //   qmw.get_name(),
-        //   rmw.get_name(), maligner_vd::AlignmentOrientation::RF_QF);
-        
-        // std::sort(profile_forward.begin(), profile_forward.end(), maligner_vd::ScoreMatrixRecordScoreCmp());
-        
-        // if(profile_forward.size() > 100) {
-        //   profile_forward.resize(100);
-        // }
-        //////////////////////////////////////////////
-
       }
 
       // Align Reverse
       {
 
         timer.start();
-        int num_alignments = make_best_alignments_using_partials(task_reverse);
+        int num_alignments = align_to_reference(qmw, rmw, false, sms, all_alignments, align_opts);
         timer.end();
 
         if(opt::verbose) {
-          std::cerr << "Num alignments reverse: " << num_alignments
-                    << " " << timer << "\n";
+          log << "Num alignments reverse: " << num_alignments
+              << " " << timer << "\n";
         }
 
-        ////////////////////////////////////////////////////////////////////
-        // DEBUG
-        // std::cerr << sm.getNumRows() << " x " << sm.getNumCols() << "\n";
-        // std::cerr << "last_row: " << sm.countFilledByRow(sm.getNumRows() - 1) << "\n";
-        // profile_rev = get_score_matrix_row_profile(sm,
-        //   sm.getNumRows()-1,
-        //   qmw.get_name(),
-        //   rmw.get_name(), maligner_vd::AlignmentOrientation::RF_QR);
-        
-        // std::sort(profile_rev.begin(), profile_rev.end(), maligner_vd::ScoreMatrixRecordScoreCmp());
-
-        // if(profile_rev.size() > 100) {
-        //   profile_rev.resize(100);
-        // }
-        ////////////////////////////////////////////////////////////////////
-
       }
 
+    }
 
-      ////////////////////////////////////////////////////////////////////
-      // DEBUG WRITE OUT!
-      // std::cerr << maligner_vd::ScoreMatrixRecordHeader() << "\n";
-      // for(auto& rec : profile_forward) {
-      //   std::cerr << rec << "\n";
-      // }
-      // for(auto& rec : profile_rev) {
-      //   std::cerr << rec << "\n";
-      // }
-      ////////////////////////////////////////////////////////////////////
+}
 
-    }
+
+///////////////////////////////////////////////////////////////////////////////////////////
+// Align a single query to all reference maps, and write the selected alignments,
+// the scores, and log messages to result.
+//
+// If pool is not null, the query is aligned to the references, and to the permuted
+// maps of the permutation test, in parallel using the pool and the per-worker score matrices.
+void align_query(const Map& query_map, const RefMapDB& ref_map_db, const RefMapWrapperVec& permuted_maps,
+  ScoreMatrices& sms, const AlignOpts& align_opts, bool write_scores,
+  lmm_utils::ThreadPool* pool, std::vector<ScoreMatrices>* worker_sms,
+  QueryResult& result) {
+
+    lmm_utils::TextBuffer aln_buf, score_buf;
+    const bool write_binary = !opt::binary_output_file.empty();
+    result.binary_alignments.clear();
+    ostringstream log_os;
+    AlignmentVec all_alignments;
+
+    const QueryMapWrapper qmw(query_map, align_opts.query_max_misses);
+
+    Timer query_timer;
+    query_timer.start();
+
+    align_to_references(qmw, ref_map_db, sms, align_opts, pool, worker_sms, all_alignments, log_os);
 
     // Sort alignments by the rescaled scores.
     std::sort(all_alignments.begin(), all_alignments.end(), AlignmentRescaledScoreComp());
@@ -468,34 +601,35 @@ int main(int argc, char* argv[]) {
     
     query_timer.end();    
 
-    std::cerr << "done aligning query: " << query_map.name_ << " "
-              << "aln_num: " << num_all_alignments << " "
-              << "mad: " << mad << "\n"
-              << query_timer << "\n";
+    log_os << "done aligning query: " << query_map.name_ << " "
+           << "aln_num: " << num_all_alignments << " "
+           << "mad: " << mad << "\n"
+           << query_timer << "\n";
 
 
     //////////////////////////////////////////////////           
     // Run permutation test to assign bootstrapped p-values, if necessary
 
-    if(opt::num_permutation_trials > 0) {
+    if(opt::num_permutation_trials > 0 && !all_alignments.empty()) {
 
       query_timer.start();
-      std::cerr << "Runing permutation test...";
+      log_os << "Runing permutation test...";
 
 
       // Null distribution of alignment scores
-      AlignmentVec random_alns = run_permutation_test(permuted_map_db, qmw, sm, align_opts);
+      AlignmentVec random_alns = run_permutation_test(permuted_maps, qmw, all_alignments[0],
+        sms, align_opts, pool, worker_sms, log_os);
 
       // Assign pvals
       const size_t n = all_alignments.size();
       for(int i = 0; i < n; i++) {
       // for(Alignment& aln : all_alignments) {
         Alignment& aln = all_alignments[i];
-        assign_pval(random_alns, aln);
+        assign_pval(random_alns, aln, log_os);
       }
 
       query_timer.end();
-      std::cerr << "done running permutation tests. " << query_timer;
+      log_os << "done running permutation tests. " << query_timer;
 
     }
 
@@ -506,25 +640,533 @@ int main(int argc, char* argv[]) {
       Alignment& aln = all_alignments[i];
 
       if(aln.score_per_inner_chunk < opt::max_score_per_inner_chunk) {
-        print_alignment(std::cout, all_alignments[i]);
+        if(write_binary) {
+          result.binary_alignments.add(aln);
+        } else {
+          print_alignment(aln_buf, aln);
+        }
       }
 
     }
 
-    if(score_file.is_open()) {
+    if(write_scores) {
 
       for(const auto& aln : all_alignments) {
-        score_file << AlignmentScoreInfo(aln) << "\n";
+        score_buf << AlignmentScoreInfo(aln) << '\n';
       }
 
     }
 
-    std::cerr << "*****************************************\n";
+    log_os << "*****************************************\n";
+
+    result.alignments = aln_buf.release();
+    result.scores = score_buf.release();
+    result.log = log_os.str();
+
+}
+
+
+//////////////////////////////////////////////////////////////////////////
+// Returns true if the query should be aligned, given the limits on the
+// number of query fragments. If not, a message is appended to log when verbose.
+bool use_query(const Map& query_map, string& log) {
+
+  if(query_map.frags_.size() < maligner_dp::opt::min_query_frags ||
+     query_map.frags_.size() > maligner_dp::opt::max_query_frags) {
+
+    if(opt::verbose) {
+      std::ostringstream msg;
+      msg << "Skipping map " << query_map.name_ << " with " 
+          << query_map.frags_.size() << " fragments.\n";
+      log += msg.str();
+    }
+
+    return false;
+  }
+
+  return true;
+
+}
+
+
+//////////////////////////////////////////////////////////////////////////
+// Serve alignments on a Unix domain socket until killed, keeping the
+// reference maps, the permuted maps and a ScoreMatrix per worker between
+// connections. Each connection is read by its own thread, and its queries
+// are aligned in parallel by the shared pool and answered in order.
+// If the listener fails, the connections stop being read, and the server
+// returns once their queries are answered.
+int run_server(const string& socket_path, const RefMapDB& ref_map_db,
+  const RefMapWrapperVec& permuted_maps, const AlignOpts& align_opts, std::ostream& query_log) {
+
+  std::unique_ptr<lmm_utils::UnixSocketListener> listener;
+  try {
+    listener.reset(new lmm_utils::UnixSocketListener(socket_path));
+  } catch(lmm_utils::SocketException& e) {
+    std::cerr << e.what() << "\n";
+    return EXIT_FAILURE;
+  }
+
+  std::vector<ScoreMatrices> worker_sms(opt::num_threads);
+  lmm_utils::ThreadPool pool(opt::num_threads);
+  const size_t max_pending = 64 * size_t(opt::num_threads);
+  std::mutex log_mutex;
+
+  std::ostringstream header;
+  header << AlignmentHeader();
+
+  // The connections being served. Their threads use the pool and the worker score
+  // matrices, so these are only destroyed once every connection thread is done.
+  std::mutex connections_mutex;
+  std::condition_variable connections_done;
+  std::set<lmm_utils::SocketConnection*> connections;
+  size_t num_connection_threads = 0;
+  bool stopping = false;
+
+  // The connection and its results are shared with the alignment tasks,
+  // so that they outlive the last task of the connection.
+  typedef std::function<void(lmm_utils::SocketConnection&, QueryResult&)> SessionSink;
+
+  struct Session {
+
+    Session(int fd, SessionSink sink) :
+      connection(fd),
+      output([this, sink](QueryResult& result) { sink(connection, result); }) {}
+
+    lmm_utils::SocketConnection connection;
+    lmm_utils::ReorderBuffer<QueryResult> output;
+
+  };
+
+  auto serve = [&](int fd) {
+
+    // Called in query order, under the lock of the ReorderBuffer.
+    auto write_result = [&](lmm_utils::SocketConnection& connection, QueryResult& result) {
+      result.alignments.push_back('\n');
+      connection.write(result.alignments);
+      std::lock_guard<std::mutex> lock(log_mutex);
+      query_log << result.log;
+      query_log.flush();
+    };
+
+    // Count the thread as done once it returns, even on error.
+    lmm_utils::SocketConnection* p_connection = nullptr;
+    struct ConnectionGuard {
+      std::function<void()> done;
+      ~ConnectionGuard() { done(); }
+    } guard{[&]() {
+      std::lock_guard<std::mutex> lock(connections_mutex);
+      connections.erase(p_connection);
+      num_connection_threads--;
+      connections_done.notify_all();
+    }};
+
+    std::shared_ptr<Session> session = std::make_shared<Session>(fd, write_result);
+    lmm_utils::SocketConnection& connection = session->connection;
+
+    // Register the connection, so that the server can stop reading it when it stops.
+    {
+      std::lock_guard<std::mutex> lock(connections_mutex);
+      p_connection = &connection;
+      connections.insert(p_connection);
+      if(stopping) connection.shutdown_read();
+    }
+
+    connection.write(header.str());
+
+    size_t query_num = 0;
+    string line;
+
+    while(connection.is_open() && connection.read_line(line)) {
+
+      if(line.empty()) {
+        continue;
+      }
+
+      session->output.wait_for_room(query_num, max_pending);
+      const size_t seq = query_num++;
+
+      std::shared_ptr<Map> p_query_map = std::make_shared<Map>();
+      QueryResult skipped;
+
+      if(!parse_map(line.data(), line.data() + line.size(), *p_query_map)) {
+        skipped.alignments = "#error\tMalformed map line: " + line.substr(0, 64) + "\n";
+        session->output.push(seq, std::move(skipped));
+        continue;
+      }
+
+      if(!use_query(*p_query_map, skipped.log)) {
+        session->output.push(seq, std::move(skipped));
+        continue;
+      }
+
+      pool.submit([&, seq, p_query_map, session](size_t worker_id) {
+        QueryResult result;
+        try {
+          align_query(*p_query_map, ref_map_db, permuted_maps, worker_sms[worker_id],
+            align_opts, false, nullptr, nullptr, result);
+        } catch(std::exception& e) {
+          result = QueryResult();
+          result.alignments = string("#error\t") + e.what() + "\n";
+        }
+        session->output.push(seq, std::move(result));
+      });
+
+    }
+
+    // Answer every query before closing the connection.
+    session->output.wait_for_room(query_num, 1);
+
+  };
+
+  std::cerr << "Listening on " << socket_path << "\n";
+
+  while(true) {
+
+    int fd;
+    try {
+      fd = listener->accept();
+    } catch(lmm_utils::SocketException& e) {
+      std::cerr << e.what() << "\n";
+      break;
+    }
+
+    {
+      std::lock_guard<std::mutex> lock(connections_mutex);
+      num_connection_threads++;
+    }
+
+    try {
+      std::thread(serve, fd).detach();
+    } catch(std::system_error& e) {
+      std::cerr << "Could not start a connection thread: " << e.what() << "\n";
+      lmm_utils::SocketConnection closed(fd);
+      std::lock_guard<std::mutex> lock(connections_mutex);
+      num_connection_threads--;
+    }
+
+  }
+
+  // Stop reading the connections, and wait for their queries to be answered
+  // before the pool and the worker score matrices are destroyed.
+  std::unique_lock<std::mutex> lock(connections_mutex);
+  stopping = true;
+  for(lmm_utils::SocketConnection* connection : connections) {
+    connection->shutdown_read();
+  }
+  connections_done.wait(lock, [&]() { return num_connection_threads == 0; });
+
+  return EXIT_FAILURE;
+
+}
+
+
+int main(int argc, char* argv[]) {
+
+  using maligner_dp::Alignment;
+  maligner_dp::opt::program_name = argv[0];
+  parse_args(argc, argv);
+
+  // The checkpoints record the outputs and the position in the query maps.
+  // On resume, the outputs are truncated to the checkpoint and appended to.
+  std::unique_ptr<lmm_utils::Checkpointer> checkpointer;
+  uint64_t start_position = 0;
+  uint64_t num_queries_done = 0;
+
+  if(!maligner_dp::opt::checkpoint_file.empty()) {
+
+    checkpointer.reset(new lmm_utils::Checkpointer(maligner_dp::opt::checkpoint_file,
+      maligner_dp::opt::checkpoint_interval));
+    checkpointer->add_output(maligner_dp::opt::output_file.empty() ? "-" : maligner_dp::opt::output_file);
+    if(!maligner_dp::opt::score_file.empty()) {
+      checkpointer->add_output(maligner_dp::opt::score_file);
+    }
+    if(!maligner_dp::opt::log_file.empty()) {
+      checkpointer->add_output(maligner_dp::opt::log_file);
+    }
+
+    std::ostringstream shard;
+    shard << maligner_dp::opt::shard_index << "/" << maligner_dp::opt::num_shards;
+    checkpointer->set_value("query_maps_file", maligner_dp::opt::query_maps_file);
+    checkpointer->set_value("ref_maps_file", maligner_dp::opt::ref_maps_file);
+    checkpointer->set_value("shard", shard.str());
+
+    if(maligner_dp::opt::resume) {
+
+      try {
+        checkpointer->resume();
+      } catch(lmm_utils::CheckpointException& e) {
+        std::cerr << e.what() << "\n";
+        return EXIT_FAILURE;
+      }
+
+      // The permuted maps must be the same as before the checkpoint.
+      const string& seed = checkpointer->get_value("permutation_seed");
+      if(!seed.empty() && !maligner_dp::opt::have_permutation_seed) {
+        std::istringstream(seed) >> maligner_dp::opt::permutation_seed;
+      }
+
+      start_position = checkpointer->input_position();
+      num_queries_done = checkpointer->num_queries();
+      std::cerr << "Resuming after " << num_queries_done << " queries.\n";
+
+    }
+
+    checkpointer->set_value("permutation_seed", std::to_string(maligner_dp::opt::permutation_seed));
+
+  }
+
+  print_args(std::cerr);
+
+  // Output files are compressed if their names end in .gz or .zst.
+  std::unique_ptr<std::ostream> score_file, output_file, log_file;
+  const bool append = maligner_dp::opt::resume;
+
+  try {
+    if(!maligner_dp::opt::score_file.empty()) {
+      score_file = lmm_utils::open_output_file(maligner_dp::opt::score_file, append);
+    }
+    if(!maligner_dp::opt::output_file.empty()) {
+      output_file = lmm_utils::open_output_file(maligner_dp::opt::output_file, append);
+    }
+    if(!maligner_dp::opt::log_file.empty()) {
+      log_file = lmm_utils::open_output_file(maligner_dp::opt::log_file, append);
+    }
+  } catch(std::exception& e) {
+    std::cerr << e.what() << "\n";
+    return EXIT_FAILURE;
+  }
+
+  std::unique_ptr<AlignmentFileWriter> binary_output;
+  if(!maligner_dp::opt::binary_output_file.empty()) {
+    try {
+      binary_output.reset(new AlignmentFileWriter(maligner_dp::opt::binary_output_file));
+    } catch(std::exception& e) {
+      std::cerr << e.what() << "\n";
+      return EXIT_FAILURE;
+    }
+  }
+
+
+  Timer timer;
+
+  AlignOpts align_opts(maligner_dp::opt::query_miss_penalty,
+                       maligner_dp::opt::ref_miss_penalty,
+                       maligner_dp::opt::query_max_misses,
+                       maligner_dp::opt::ref_max_misses,
+                       maligner_dp::opt::sd_rate,
+                       maligner_dp::opt::min_sd,
+                       maligner_dp::opt::max_chunk_sizing_error,
+                       maligner_dp::opt::ref_max_miss_rate,
+                       maligner_dp::opt::query_max_miss_rate,
+                       maligner_dp::opt::alignments_per_reference,
+                       maligner_dp::opt::min_alignment_spacing,
+                       maligner_dp::opt::neighbor_delta,
+                       maligner_dp::opt::query_is_bounded, // Perhaps this should be part of the MapData instead of AlignOpts
+                       maligner_dp::opt::ref_is_bounded, // Perhaps this should be part of the MapData instead of AlignOpts
+                       maligner_dp::opt::query_rescaling,
+                       maligner_dp::opt::min_query_scaling,
+                       maligner_dp::opt::max_query_scaling);
+
+  // Build a database of reference maps, from a prebuilt reference index if given one.
+  // The index must outlive the reference maps, which are views of it.
+  std::unique_ptr<RefIndex> ref_index;
+  RefMapDB ref_map_db;
+
+  if(is_ref_index_file(maligner_dp::opt::ref_maps_file)) {
+
+    try {
+      ref_index.reset(new RefIndex(maligner_dp::opt::ref_maps_file));
+      ref_index->check_params(maligner_dp::opt::ref_max_misses, maligner_dp::opt::sd_rate,
+        maligner_dp::opt::min_sd, maligner_dp::opt::reference_is_circular);
+      for(size_t i = 0; i < ref_index->num_maps(); i++) {
+        RefMapWrapper rmw(ref_index->get_ref_map_wrapper(i));
+        const string name = rmw.get_name();
+        ref_map_db.insert( RefMapDB::value_type(name, std::move(rmw)) );
+      }
+    } catch(RefIndexException& e) {
+      cerr << e.what() << "\n";
+      return EXIT_FAILURE;
+    }
+
+    cerr << "Read " << ref_index->num_maps() << " reference maps from index.\n";
+
+  } else {
+
+    MapVec ref_maps(read_maps(maligner_dp::opt::ref_maps_file));
+    cerr << "Read " << ref_maps.size() << " reference maps.\n";
+
+    // Store reference maps in an unordered map.
+    for(auto i = ref_maps.begin(); i != ref_maps.end(); i++) {
+      ref_map_db.insert( RefMapDB::value_type(i->name_,
+          RefMapWrapper(*i, maligner_dp::opt::reference_is_circular, 
+                            maligner_dp::opt::ref_max_misses,
+                            maligner_dp::opt::sd_rate,
+                            maligner_dp::opt::min_sd)) );
+    }
+
+  }
+
+ cerr << "Wrapped " << ref_map_db.size() << " reference maps.\n";
+
+
+ // Generated permuted reference map for permutation test, if necessary
+ RefMapWrapperVec permuted_maps = generate_permuted_maps(ref_map_db, opt::num_permutation_trials,
+   opt::permutation_seed);
+ if(!opt::permuted_maps_file.empty()) {
+   write_permuted_maps(permuted_maps, opt::permuted_maps_file);
+ }
+
+ if(!maligner_dp::opt::server_socket.empty()) {
+   return run_server(maligner_dp::opt::server_socket, ref_map_db, permuted_maps, align_opts,
+     log_file ? *log_file : std::cerr);
+ }
+
+ const bool write_scores = bool(score_file);
+
+ // The alignments go to stdout and the per query log messages go to stderr,
+ // unless output files are given.
+ std::ostream& aln_out = output_file ? *output_file : std::cout;
+ std::ostream& query_log = log_file ? *log_file : std::cerr;
+
+ // Results are written by the writer thread, while the next queries are aligned.
+ // Queries are read ahead by the reader thread.
+ lmm_utils::AsyncWriter writer;
+
+ auto write_result = [&](QueryResult& result) {
+    writer.write(aln_out, std::move(result.alignments));
+    if(binary_output) {
+      binary_output->write(result.binary_alignments);
+    }
+    if(write_scores) {
+      writer.write(*score_file, std::move(result.scores));
+    }
+    writer.write(query_log, std::move(result.log));
+
+    num_queries_done++;
+    if(checkpointer && checkpointer->due()) {
+      writer.sync();
+      try {
+        checkpointer->write(result.input_position, num_queries_done);
+      } catch(lmm_utils::CheckpointException& e) {
+        std::cerr << "Warning: " << e.what() << "\n";
+      }
+    }
+ };
+
+ lmm_utils::AsyncMapReader query_map_reader(maligner_dp::opt::query_maps_file,
+   maligner_dp::opt::shard_index, maligner_dp::opt::num_shards, start_position);
+
+ // The last position read, for the final checkpoint.
+ uint64_t input_position = start_position;
+
+ if(!binary_output && !maligner_dp::opt::resume) {
+   aln_out << AlignmentHeader();
+ }
+
+ if(opt::num_threads <= 1 || opt::reference_parallel) {
+
+    // Generate a single ScoreMatrix to use throughout this program.
+    ScoreMatrices sms;
+    Map query_map;
+    QueryResult result;
+
+    // When aligning each query to the references in parallel, each worker
+    // uses its own ScoreMatrix for the life of the pool.
+    std::unique_ptr<lmm_utils::ThreadPool> pool;
+    std::vector<ScoreMatrices> worker_sms;
+    if(opt::reference_parallel) {
+      pool.reset(new lmm_utils::ThreadPool(opt::num_threads));
+      worker_sms.resize(opt::num_threads);
+    }
+
+    while(query_map_reader.next(query_map, input_position)) {
+
+      result = QueryResult();
+      result.input_position = input_position;
+      if(!use_query(query_map, result.log)) {
+        write_result(result);
+        continue;
+      }
+
+      align_query(query_map, ref_map_db, permuted_maps, sms, align_opts, write_scores,
+        pool.get(), &worker_sms, result);
+      write_result(result);
+
+    }
+
+ } else {
+
+    // Each worker reuses its own ScoreMatrix for the life of the pool.
+    // Queries are numbered in the order they are read, and the results
+    // are written in that order.
+    std::vector<ScoreMatrices> worker_sms(opt::num_threads);
+    lmm_utils::ThreadPool pool(opt::num_threads);
+    lmm_utils::ReorderBuffer<QueryResult> output(write_result);
+
+    const size_t max_pending = 64 * size_t(opt::num_threads);
+    size_t query_num = 0;
+    Map query_map;
+
+    while(query_map_reader.next(query_map, input_position)) {
+
+      output.wait_for_room(query_num, max_pending);
+
+      // A skipped query still takes its turn in the output, for its log message.
+      QueryResult skipped;
+      skipped.input_position = input_position;
+      if(!use_query(query_map, skipped.log)) {
+        output.push(query_num++, std::move(skipped));
+        continue;
+      }
+
+      const size_t seq = query_num++;
+      std::shared_ptr<Map> p_query_map = std::make_shared<Map>(std::move(query_map));
+      query_map = Map();
+
+      const uint64_t position = input_position;
+      pool.submit([&, seq, p_query_map, position](size_t worker_id) {
+        QueryResult result;
+        result.input_position = position;
+        try {
+          align_query(*p_query_map, ref_map_db, permuted_maps, worker_sms[worker_id],
+            align_opts, write_scores, nullptr, nullptr, result);
+        } catch(...) {
+          output.push(seq, std::move(result));
+          throw;
+        }
+        output.push(seq, std::move(result));
+      });
+
+    }
+
+    pool.wait();
 
  }
 
-  if(score_file.is_open())
-    score_file.close();
+  writer.close();
+
+  if(checkpointer) {
+    try {
+      checkpointer->write(input_position, num_queries_done);
+    } catch(lmm_utils::CheckpointException& e) {
+      std::cerr << "Warning: " << e.what() << "\n";
+    }
+  }
+
+  // Close the output files, ending any compressed streams.
+  score_file.reset();
+  output_file.reset();
+  log_file.reset();
+
+  if(binary_output) {
+    try {
+      binary_output->close();
+    } catch(std::exception& e) {
+      std::cerr << e.what() << "\n";
+      return EXIT_FAILURE;
+    }
+  }
 
   std::cerr << "maligner_dp done.\n";
   return EXIT_SUCCESS;
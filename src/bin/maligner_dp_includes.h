@@ -2,6 +2,7 @@
 // Getopt
 //
 #include <limits>
+#include <random>
 
 
 static const char *VERSION_MESSAGE = "Version " PACKAGE_VERSION "\n"
@@ -12,6 +13,7 @@ static const int NUM_POSITION_ARGS = 2;
 
 static const char *USAGE_MESSAGE =
 "Usage: " PACKAGE_NAME " [OPTION] ... QUERY_MAPS_FILE REFERENCE_MAPS_FILE\n"
+"   or: " PACKAGE_NAME " [OPTION] ... --server SOCKET REFERENCE_MAPS_FILE\n"
 "\n"
 " Align the maps in the QUERY_MAPS_FILE to the maps in the REFERENCE_MAPS_FILE\n"
 " using dynamic programming.\n"
@@ -20,9 +22,24 @@ static const char *USAGE_MESSAGE =
 "      --reference-is-circular              Treat reference maps as circular. Default: false\n"
 "      --num-permutation-trials INT         Number of trials for the permutation test.\n"
 "                                               (Default: 0)\n"
+"      --permutation-seed INT               Seed for the permuted maps of the permutation test, for\n"
+"                                               reproducible p-values. (Default: random, and reported\n"
+"                                               in the settings)\n"
+"      --permuted-maps-file FILE            Write the permuted maps of the permutation test to FILE.\n"
+"      --permutation-batch-size INT         Run the permutation trials in batches of INT, and check the\n"
+"                                               stopping rules after each batch. (Default: 100)\n"
+"      --permutation-stop-hits INT          Stop the permutation test for a query once INT random alignments\n"
+"                                               score at least as well as its best alignment\n"
+"                                               (Besag-Clifford sequential test). 0 to disable. (Default: 0)\n"
+"      --permutation-stop-pval FLOAT        Stop the permutation test for a query once the 99% upper bound\n"
+"                                               on the p-value of its best alignment is below FLOAT.\n"
+"                                               0 to disable. (Default: 0)\n"
 "      --no-query-rescaling                 Default: perform query rescaling\n"
 "      --min-query-rescaling                Do not perform query rescaling if scaling factor less than this. (Default: 0.85)\n"
 "      --max-query-rescaling                Do not perform query rescaling if scaling factor greater than this. (Default: 1.15)\n"
+"      --linear-memory                      Keep only a window of rows of the score matrix plus checkpoints,\n"
+"                                               and recompute rows for traceback. Uses much less memory\n"
+"                                               for long queries, at the cost of extra computation.\n"
 "\n"    
 " Scoring parameters:\n"    
 "      -q,--query-miss-penalty FLOAT        Query unmatched site penalty (Default 18.0)\n"
@@ -47,8 +64,40 @@ static const char *USAGE_MESSAGE =
 " General arguments:\n"
 "      -h, --help                           display this help and exit\n"
 "      -v, --version                        display the version and exit\n"
+"      --output FILE                        Write the alignments to FILE instead of stdout. Default: none\n"
 "      --score-file FILE                    score-file path. Default: none\n"
-"      --verbose                            Verbose output\n";
+"      --log-file FILE                      Write the per query log messages to FILE instead of stderr.\n"
+"      --binary-output FILE                 Write the alignments to FILE in the binary alignment format,\n"
+"                                               instead of as text to stdout. Convert it to text with\n"
+"                                               aln_convert. Default: none\n"
+"      Output files are gzip or zstd compressed if their names end in .gz or .zst.\n"
+"      Compressed input maps files are detected and decompressed.\n"
+"      --num-shards INT                     Split the query maps file into INT shards, for runs split\n"
+"                                               across nodes, and align only one shard. (Default: 1)\n"
+"      --shard-index INT                    The shard to align, from 0 to num-shards - 1. Merge the\n"
+"                                               outputs of the shards with aln_merge. (Default: 0)\n"
+"      --checkpoint FILE                    Write checkpoints of the run to FILE, so that it can be resumed\n"
+"                                               with --resume if it is stopped. The outputs must be\n"
+"                                               uncompressed text. Default: none\n"
+"      --checkpoint-interval SECONDS        Seconds between checkpoints. (Default: 600)\n"
+"      --resume                             Resume the run from the checkpoint: truncate the outputs to the\n"
+"                                               checkpoint, and continue with the next query. Append\n"
+"                                               stdout to the earlier output (>>).\n"
+"      --threads INT                        Number of worker threads. Queries are aligned in parallel,\n"
+"                                               and output is written in input order. (Default: 1)\n"
+"      --reference-parallel                 Use the threads to align each query to the reference maps\n"
+"                                               in parallel, one task per reference and orientation,\n"
+"                                               instead of aligning queries in parallel.\n"
+"      --verbose                            Verbose output\n"
+"\n"
+" Server mode:\n"
+"      --server SOCKET                      Load the reference maps once, and align the query maps sent\n"
+"                                               to the Unix domain socket SOCKET until killed. Each line\n"
+"                                               of a maps file sent on a connection is answered with its\n"
+"                                               alignment records and an empty line, after a header line\n"
+"                                               for the connection. A malformed line is answered with\n"
+"                                               \"#error\" and a message. The output, score, binary output\n"
+"                                               and checkpoint options do not apply.\n";
 
 
 
@@ -61,6 +110,9 @@ namespace maligner_dp {
       static string ref_maps_file;
       string program_name;
       string score_file;
+      string binary_output_file;
+      string log_file;
+      string output_file;
 
       static double query_miss_penalty = 18.0;
       static double ref_miss_penalty = 3.0;
@@ -82,12 +134,28 @@ namespace maligner_dp {
       static double min_query_scaling = 0.85;
       static double max_query_scaling = 1.15;      
       static int num_permutation_trials = 0; // Number of trials for permutation test.
+      static unsigned int permutation_seed = 0; // Seed for the permuted maps.
+      static bool have_permutation_seed = false;
+      static string permuted_maps_file; // If given, write the permuted maps to this file.
+      static int permutation_batch_size = 100; // Trials between checks of the stopping rules.
+      static int permutation_stop_hits = 0; // Stop after this many random alignments beat the best alignment.
+      static double permutation_stop_pval = 0.0; // Stop once the p-value upper bound is below this.
+      static double permutation_stop_confidence = 0.99; // Confidence of the p-value upper bound.
       static bool query_rescaling = true;
       static bool verbose = false;
       static bool reference_is_circular = false;
       static double min_mad = 1.0; // Minimum mad to use when computing mad scores.
       static int min_query_frags = 3;
       static int max_query_frags = 50000;
+      static int num_threads = 1;
+      static int shard_index = 0; // Align only this shard of the query maps.
+      static int num_shards = 1;
+      static string checkpoint_file; // Write checkpoints to this file.
+      static double checkpoint_interval = 600.0;
+      static bool resume = false; // Resume from the checkpoint.
+      static string server_socket; // Serve alignments on this Unix domain socket.
+      static bool reference_parallel = false; // Parallelize over references instead of queries.
+      static bool linear_memory = false; // Use the LinearScoreMatrix instead of the full ScoreMatrix.
   }
 
 }
@@ -110,7 +178,24 @@ enum {
   OPT_VERBOSE,
   OPT_NO_QUERY_RESCALING,
   OPT_SCORE_FILE,
-  OPT_REFERENCE_IS_CIRCULAR
+  OPT_BINARY_OUTPUT,
+  OPT_LOG_FILE,
+  OPT_OUTPUT,
+  OPT_SHARD_INDEX,
+  OPT_NUM_SHARDS,
+  OPT_CHECKPOINT,
+  OPT_CHECKPOINT_INTERVAL,
+  OPT_RESUME,
+  OPT_SERVER,
+  OPT_REFERENCE_IS_CIRCULAR,
+  OPT_THREADS,
+  OPT_REFERENCE_PARALLEL,
+  OPT_LINEAR_MEMORY,
+  OPT_PERMUTATION_SEED,
+  OPT_PERMUTED_MAPS_FILE,
+  OPT_PERMUTATION_BATCH_SIZE,
+  OPT_PERMUTATION_STOP_HITS,
+  OPT_PERMUTATION_STOP_PVAL
 };
 
 static const struct option longopts[] = {
@@ -130,12 +215,29 @@ static const struct option longopts[] = {
     { "min-query-rescaling", required_argument, NULL, OPT_MIN_QUERY_SCALING},
     { "max-query-rescaling", required_argument, NULL, OPT_MAX_QUERY_SCALING},
     { "num-permutation-trials", required_argument, NULL, OPT_NUM_PERMUTATION_TRIALS},
+    { "permutation-seed", required_argument, NULL, OPT_PERMUTATION_SEED},
+    { "permuted-maps-file", required_argument, NULL, OPT_PERMUTED_MAPS_FILE},
+    { "permutation-batch-size", required_argument, NULL, OPT_PERMUTATION_BATCH_SIZE},
+    { "permutation-stop-hits", required_argument, NULL, OPT_PERMUTATION_STOP_HITS},
+    { "permutation-stop-pval", required_argument, NULL, OPT_PERMUTATION_STOP_PVAL},
     { "no-query-rescaling", no_argument, NULL, OPT_NO_QUERY_RESCALING},
     { "reference-is-circular", no_argument, NULL, OPT_REFERENCE_IS_CIRCULAR},
     { "verbose", no_argument, NULL, OPT_VERBOSE},
     { "help",     no_argument,       NULL, 'h' },
     { "version",  no_argument,       NULL, 'v'},
     { "score-file", required_argument, NULL, OPT_SCORE_FILE},
+    { "binary-output", required_argument, NULL, OPT_BINARY_OUTPUT},
+    { "log-file", required_argument, NULL, OPT_LOG_FILE},
+    { "output", required_argument, NULL, OPT_OUTPUT},
+    { "shard-index", required_argument, NULL, OPT_SHARD_INDEX},
+    { "num-shards", required_argument, NULL, OPT_NUM_SHARDS},
+    { "checkpoint", required_argument, NULL, OPT_CHECKPOINT},
+    { "checkpoint-interval", required_argument, NULL, OPT_CHECKPOINT_INTERVAL},
+    { "resume", no_argument, NULL, OPT_RESUME},
+    { "server", required_argument, NULL, OPT_SERVER},
+    { "threads", required_argument, NULL, OPT_THREADS},
+    { "reference-parallel", no_argument, NULL, OPT_REFERENCE_PARALLEL},
+    { "linear-memory", no_argument, NULL, OPT_LINEAR_MEMORY},
     { NULL, 0, NULL, 0 }
 
 };
@@ -165,6 +267,14 @@ void parse_args(int argc, char** argv)
             case OPT_ALIGNMENTS_PER_REFERENCE: arg >> opt::alignments_per_reference; break;
             case OPT_MAX_ALIGNMENTS: arg >> opt::max_alignments; break;
             case OPT_NUM_PERMUTATION_TRIALS: arg >> opt::num_permutation_trials; break;
+            case OPT_PERMUTATION_SEED:
+              arg >> opt::permutation_seed;
+              opt::have_permutation_seed = true;
+              break;
+            case OPT_PERMUTED_MAPS_FILE: arg >> opt::permuted_maps_file; break;
+            case OPT_PERMUTATION_BATCH_SIZE: arg >> opt::permutation_batch_size; break;
+            case OPT_PERMUTATION_STOP_HITS: arg >> opt::permutation_stop_hits; break;
+            case OPT_PERMUTATION_STOP_PVAL: arg >> opt::permutation_stop_pval; break;
             case OPT_VERBOSE: opt::verbose = true; break;
             case OPT_NO_QUERY_RESCALING: opt::query_rescaling = false; break;
             case OPT_REFERENCE_IS_CIRCULAR: 
@@ -172,6 +282,18 @@ void parse_args(int argc, char** argv)
               opt::ref_is_bounded = true;
               break;
             case OPT_SCORE_FILE: arg >> opt::score_file; break;
+            case OPT_BINARY_OUTPUT: arg >> opt::binary_output_file; break;
+            case OPT_LOG_FILE: arg >> opt::log_file; break;
+            case OPT_OUTPUT: arg >> opt::output_file; break;
+            case OPT_SHARD_INDEX: arg >> opt::shard_index; break;
+            case OPT_NUM_SHARDS: arg >> opt::num_shards; break;
+            case OPT_CHECKPOINT: arg >> opt::checkpoint_file; break;
+            case OPT_CHECKPOINT_INTERVAL: arg >> opt::checkpoint_interval; break;
+            case OPT_RESUME: opt::resume = true; break;
+            case OPT_SERVER: arg >> opt::server_socket; break;
+            case OPT_THREADS: arg >> opt::num_threads; break;
+            case OPT_REFERENCE_PARALLEL: opt::reference_parallel = true; break;
+            case OPT_LINEAR_MEMORY: opt::linear_memory = true; break;
             case 'h':
             {
                 std::cout << USAGE_MESSAGE;
@@ -193,12 +315,16 @@ void parse_args(int argc, char** argv)
         }
     }
 
-    if (argc - optind < NUM_POSITION_ARGS) 
+    // A server gets the query maps from its socket.
+    const bool server = !opt::server_socket.empty();
+    const int num_position_args = server ? 1 : NUM_POSITION_ARGS;
+
+    if (argc - optind < num_position_args) 
     {
         std::cerr << ": missing arguments\n";
         die = true;
     } 
-    else if (argc - optind > NUM_POSITION_ARGS) 
+    else if (argc - optind > num_position_args) 
     {
         std::cerr << ": too many arguments\n";
         die = true;
@@ -234,14 +360,85 @@ void parse_args(int argc, char** argv)
       die = true;
     }
 
+    // The LinearScoreMatrix backpointers are bytes.
+    if(opt::linear_memory && (opt::query_max_misses > 254 || opt::ref_max_misses > 254)) {
+      std::cerr << "Linear memory supports at most 254 query and ref max misses\n";
+      die = true;
+    }
+
+    if(opt::num_threads < 1) {
+      std::cerr << "Number of threads must be positive\n";
+      die = true;
+    }
+
+    if(opt::num_shards < 1) {
+      std::cerr << "Number of shards must be positive\n";
+      die = true;
+    }
+
+    if(opt::shard_index < 0 || opt::shard_index >= opt::num_shards) {
+      std::cerr << "Shard index must be from 0 to the number of shards - 1\n";
+      die = true;
+    }
+
+    if(opt::resume && opt::checkpoint_file.empty()) {
+      std::cerr << "Resume requires a checkpoint file\n";
+      die = true;
+    }
+
+    if(!opt::checkpoint_file.empty()) {
+
+      if(!opt::binary_output_file.empty()) {
+        std::cerr << "Checkpoints do not support the binary output\n";
+        die = true;
+      }
+
+      for(const string& f : {opt::output_file, opt::score_file, opt::log_file}) {
+        if(lmm_utils::compression_for_name(f) != lmm_utils::Compression::NONE) {
+          std::cerr << "Checkpoints do not support the compressed output " << f << "\n";
+          die = true;
+        }
+      }
+
+    }
+
+    if(server && (!opt::output_file.empty() || !opt::score_file.empty() ||
+                  !opt::binary_output_file.empty() || !opt::checkpoint_file.empty())) {
+      std::cerr << "The server returns alignments on its socket, without output, score or checkpoint files\n";
+      die = true;
+    }
+
+    if(opt::permutation_batch_size < 1) {
+      std::cerr << "Permutation batch size must be positive\n";
+      die = true;
+    }
+
+    if(opt::permutation_stop_hits < 0) {
+      std::cerr << "Permutation stop hits must be non-negative\n";
+      die = true;
+    }
+
+    if(opt::permutation_stop_pval < 0.0) {
+      std::cerr << "Permutation stop p-value must be non-negative\n";
+      die = true;
+    }
+
     if (die) 
     {
         std::cout << "\n" << USAGE_MESSAGE;
         exit(EXIT_FAILURE);
     }
 
+    // Choose a seed for the permutation test. It is reported with the settings,
+    // so that the run can be repeated.
+    if(!opt::have_permutation_seed) {
+      opt::permutation_seed = std::random_device()();
+    }
+
     // Parse the query maps file and reference maps file
-    opt::query_maps_file = argv[optind++];
+    if(!server) {
+      opt::query_maps_file = argv[optind++];
+    }
     opt::ref_maps_file = argv[optind++];
 
 }
@@ -272,6 +469,10 @@ std::ostream& print_args(std::ostream& os) {
      << "\tmax_alignments: " << max_alignments << "\n"
      << "\tmin_alignment_spacing: " << min_alignment_spacing << "\n"
      << "\tnum_permutation_trials: " << num_permutation_trials << "\n"
+     << "\tpermutation_seed: " << permutation_seed << "\n"
+     << "\tpermutation_batch_size: " << permutation_batch_size << "\n"
+     << "\tpermutation_stop_hits: " << permutation_stop_hits << "\n"
+     << "\tpermutation_stop_pval: " << permutation_stop_pval << "\n"
      << "\tneighbor_delta: " << neighbor_delta << "\n"
      << "\treference_is_circular: " << reference_is_circular << "\n"
      << "\tquery_rescaling: " << query_rescaling << "\n"
@@ -279,7 +480,19 @@ std::ostream& print_args(std::ostream& os) {
      << "\tref_is_bounded: " << ref_is_bounded << "\n"
      << "\treference_is_circular: " << reference_is_circular << "\n"
      << "\tmin_query_frags: " << min_query_frags << "\n"
-     << "\tmax_query_frags: " << max_query_frags << "\n";
+     << "\tmax_query_frags: " << max_query_frags << "\n"
+     << "\tnum_threads: " << num_threads << "\n"
+     << "\treference_parallel: " << reference_parallel << "\n"
+     << "\tlinear_memory: " << linear_memory << "\n"
+     << "\tbinary_output_file: " << binary_output_file << "\n"
+     << "\tlog_file: " << log_file << "\n"
+     << "\toutput_file: " << output_file << "\n"
+     << "\tshard_index: " << shard_index << "\n"
+     << "\tnum_shards: " << num_shards << "\n"
+     << "\tcheckpoint_file: " << checkpoint_file << "\n"
+     << "\tcheckpoint_interval: " << checkpoint_interval << "\n"
+     << "\tresume: " << resume << "\n"
+     << "\tserver_socket: " << server_socket << "\n";
 
   return os;
 
@@ -0,0 +1,177 @@
+#include <iostream>
+#include <vector>
+#include <string>
+#include <sstream>
+#include <getopt.h>
+#include <stdexcept>
+
+#include "map.h"
+#include "map_reader.h"
+
+// dp includes
+#include "map_wrappers.h"
+#include "ref_index.h"
+
+// common includes
+#include "timer.h"
+#include "common_defs.h"
+
+using std::string;
+using std::cerr;
+using namespace maligner_maps;
+using namespace maligner_dp;
+using lmm_utils::Timer;
+
+//
+// Getopt
+//
+#define PACKAGE_NAME "maligner_index"
+
+static const char *VERSION_MESSAGE = "Version " PACKAGE_VERSION "\n"
+"Written by " AUTHOR "(" AUTHOR_EMAIL ") \n"
+"\n";
+
+static const int NUM_POSITION_ARGS = 2;
+
+static const char *USAGE_MESSAGE =
+"Usage: " PACKAGE_NAME " [OPTION] ... REFERENCE_MAPS_FILE INDEX_FILE\n"
+"\n"
+" Build a binary index of the maps in the REFERENCE_MAPS_FILE, with the partial sums\n"
+" and standard deviations used for alignment, and write it to INDEX_FILE.\n"
+" The INDEX_FILE can be given to maligner_dp and maligner_vd in place of the\n"
+" REFERENCE_MAPS_FILE, with the same options as below.\n"
+"\n"
+" Options:\n"
+"      --reference-is-circular          Treat reference maps as circular. Default: false\n"
+"      --ref-max-misses                 Reference max. consecutive unmatched sites. Default: 5\n"
+"      --sd-rate                        Standard deviation rate. Default: 0.05\n"
+"      --min-sd                         Minimum standard deviation (bp). Default: 500\n"
+"\n"
+" General arguments:\n"
+"      -h, --help                       display this help and exit\n"
+"      -v, --version                    display the version and exit\n";
+
+namespace opt
+{
+    static string ref_maps_file;
+    static string index_file;
+    static int ref_max_misses = 5;
+    static double sd_rate = 0.05;
+    static double min_sd = 500.0;
+    static bool reference_is_circular = false;
+}
+
+static const char* shortopts = "hv";
+enum { OPT_REF_MAX_MISSES = 1, OPT_SD_RATE, OPT_MIN_SD, OPT_REFERENCE_IS_CIRCULAR };
+
+static const struct option longopts[] = {
+    { "ref-max-misses", required_argument, NULL, OPT_REF_MAX_MISSES},
+    { "sd-rate", required_argument, NULL, OPT_SD_RATE},
+    { "min-sd", required_argument, NULL, OPT_MIN_SD},
+    { "reference-is-circular", no_argument, NULL, OPT_REFERENCE_IS_CIRCULAR},
+    { "help",     no_argument,       NULL, 'h' },
+    { "version",  no_argument,       NULL, 'v'},
+    { NULL, 0, NULL, 0 }
+};
+
+void parse_args(int argc, char** argv)
+{
+
+    bool die = false;
+    for (char c; (c = getopt_long(argc, argv, shortopts, longopts, NULL)) != -1;)
+    {
+        std::istringstream arg(optarg != NULL ? optarg : "");
+        switch (c)
+        {
+            case OPT_REF_MAX_MISSES: arg >> opt::ref_max_misses; break;
+            case OPT_SD_RATE: arg >> opt::sd_rate; break;
+            case OPT_MIN_SD: arg >> opt::min_sd; break;
+            case OPT_REFERENCE_IS_CIRCULAR: opt::reference_is_circular = true; break;
+            case 'h':
+            {
+                std::cout << USAGE_MESSAGE;
+                exit(EXIT_SUCCESS);
+                break;
+            }
+            case 'v':
+            {
+                std::cout << VERSION_MESSAGE;
+                exit(EXIT_SUCCESS);
+                break;
+            }
+        }
+
+        if(arg.fail()) {
+          std::cerr << "Trouble parsing input: " << optarg << "\n";
+          die = true;
+          break;
+        }
+    }
+
+    if (argc - optind < NUM_POSITION_ARGS)
+    {
+        std::cerr << ": missing arguments\n";
+        die = true;
+    }
+    else if (argc - optind > NUM_POSITION_ARGS)
+    {
+        std::cerr << ": too many arguments\n";
+        die = true;
+    }
+
+    if(opt::ref_max_misses < 0) {
+      std::cerr << "Ref max misses must be positive\n";
+      die = true;
+    }
+
+    if (die)
+    {
+        std::cout << "\n" << USAGE_MESSAGE;
+        exit(EXIT_FAILURE);
+    }
+
+    opt::ref_maps_file = argv[optind++];
+    opt::index_file = argv[optind++];
+
+}
+
+int main(int argc, char* argv[]) {
+
+  parse_args(argc, argv);
+
+  cerr << VERSION_MESSAGE
+       << "Settings:\n"
+       << "\tref_maps_file: " << opt::ref_maps_file << "\n"
+       << "\tindex_file: " << opt::index_file << "\n"
+       << "\tref_max_misses: " << opt::ref_max_misses << "\n"
+       << "\tsd_rate: " << opt::sd_rate << "\n"
+       << "\tmin_sd: " << opt::min_sd << "\n"
+       << "\treference_is_circular: " << opt::reference_is_circular << "\n";
+
+  Timer timer;
+
+  MapVec ref_maps(read_maps(opt::ref_maps_file));
+  cerr << "Read " << ref_maps.size() << " reference maps.\n";
+
+  std::vector<RefMapWrapper> ref_map_wrappers;
+  ref_map_wrappers.reserve(ref_maps.size());
+  for(const auto& ref_map : ref_maps) {
+    ref_map_wrappers.push_back(RefMapWrapper(ref_map, opt::reference_is_circular,
+      opt::ref_max_misses, opt::sd_rate, opt::min_sd));
+  }
+
+  try {
+    write_ref_index(opt::index_file, ref_map_wrappers, opt::ref_max_misses,
+      opt::sd_rate, opt::min_sd, opt::reference_is_circular);
+  } catch(std::exception& e) {
+    cerr << e.what() << "\n";
+    return EXIT_FAILURE;
+  }
+
+  timer.end();
+  cerr << "Wrote index of " << ref_map_wrappers.size() << " reference maps to "
+       << opt::index_file << ". " << timer << "\n";
+
+  return EXIT_SUCCESS;
+
+}
@@ -6,6 +6,7 @@
 #include <fstream>
 #include <chrono>
 #include <getopt.h>
+#include <memory>
 #include <unordered_map>
 #include <stdexcept>
 #include <limits>
@@ -18,11 +19,16 @@
 #include "map_chunk.h"
 #include "ref_alignment.h"
 #include "map_chunk_db.h"
+#include "map_chunk_db_file.h"
+#include "alignment_file.h"
 #include "matched_chunk.h"
 #include "map_wrapper_base.h"
 #include "alignment.h"
 #include "scorer.h"
 #include "bitcover.h"
+#include "async_io.h"
+#include "thread_pool.h"
+#include "compressed_stream.h"
 
 #include "common_defs.h"
 
@@ -55,6 +61,8 @@ static const char *USAGE_MESSAGE =
 "      -h, --help                       display this help and exit\n"
 "      -v, --version                    display the version and exit\n"
 "      -u, --unmatched VAL              Maximum number of consecutive unmatched sites in reference\n"
+"      --query-unmatched VAL            Maximum number of consecutive unmatched sites in query. A\n"
+"                                       reference chunk may match up to VAL + 1 query fragments. Default: 0\n"
 "      --rel-error VAL                  Maximum allowed relative sizing error. Default: 0.05\n"
 "      -a, --abs-error VAL              Minimum sizing error setting. Default: 1000 bp\n"
 "      -m, --max-match VAL              Maximum number of matches per query. Default: 100\n"
@@ -62,6 +70,23 @@ static const char *USAGE_MESSAGE =
 "      --ref-is-circular                Reference map(s) are circular. Default: false\n"
 "      --max-unmatched-rate  VAL        Maximum unmatched site rate of an alignment. Default: 0.50\n"
 "      --max-score-per-inner-chunk VAL  Maximum score per inner chunk for alignment to be reported. Default: inf\n"
+"      --seed-frags INT                 Seed on INT adjacent query fragments at once, using an index of\n"
+"                                       the runs of INT reference chunks (1 to 3). 1 seeds on the largest\n"
+"                                       fragment only. Default: 2\n"
+"      --chunk-db FILE                  Load the reference chunk database from FILE. If FILE does not exist,\n"
+"                                       build the database and save it to FILE for later runs.\n"
+"      --binary-output FILE             Write the alignments to FILE in the binary alignment format,\n"
+"                                       instead of as text to stdout. Convert it to text with aln_convert.\n"
+"      --output FILE                    Write the alignments to FILE instead of stdout.\n"
+"      --log-file FILE                  Write the per query log messages to FILE instead of stderr.\n"
+"                                       Output files are gzip or zstd compressed if their names end\n"
+"                                       in .gz or .zst. Compressed input maps files are detected.\n"
+"      --num-shards INT                 Split the query maps file into INT shards, for runs split\n"
+"                                       across nodes, and align only one shard. Default: 1\n"
+"      --shard-index INT                The shard to align, from 0 to num-shards - 1. Merge the\n"
+"                                       outputs of the shards with aln_merge. Default: 0\n"
+"      --threads INT                    Number of worker threads. Queries are aligned in parallel,\n"
+"                                       and output is written in input order. Default: 1\n"
 "\n\n"
 "Scoring Function Arguments:\n"
 "      -q,--query-miss-penalty          Query unmatched site penalty. Default: 18.0\n"
@@ -74,6 +99,7 @@ static const char *USAGE_MESSAGE =
 namespace opt
 {
     static int max_unmatched_sites = 2;
+    static int max_query_unmatched_sites = 0;
     static double rel_error = 0.05;
     static int min_abs_error = 1000;
     static int min_frag = 5;
@@ -88,12 +114,22 @@ namespace opt
     static double max_score_per_inner_chunk = std::numeric_limits<double>::infinity();
     static string query_maps_file;
     static string ref_maps_file;
+    static string chunk_db_file;
+    static string binary_output_file;
+    static string log_file;
+    static string output_file;
+    static int shard_index = 0;
+    static int num_shards = 1;
+    static int num_threads = 1;
+    static int seed_frags = 2;
     string program_name;
 }
 
 static const char* shortopts = "u:r:a:m:q:r:hv";
 enum {OPT_MIN_FRAG = 1, OPT_MAX_UNMATCHED_RATE, OPT_REF_IS_CIRCULAR, OPT_SD_RATE, OPT_MIN_SD,
-  OPT_REL_ERROR, OPT_MAX_SCORE_PER_INNER_CHUNK};
+  OPT_REL_ERROR, OPT_MAX_SCORE_PER_INNER_CHUNK, OPT_CHUNK_DB, OPT_BINARY_OUTPUT,
+  OPT_LOG_FILE, OPT_OUTPUT, OPT_SHARD_INDEX, OPT_NUM_SHARDS, OPT_THREADS,
+  OPT_SEED_FRAGS, OPT_QUERY_UNMATCHED};
 
 static const struct option longopts[] = {
     { "unmatched", required_argument, NULL, 'u' },
@@ -108,6 +144,15 @@ static const struct option longopts[] = {
     { "sd-rate", required_argument, NULL, OPT_SD_RATE},
     { "ref-is-circular", no_argument, NULL, OPT_REF_IS_CIRCULAR},
     { "max-score-per-inner-chunk", required_argument, NULL, OPT_MAX_SCORE_PER_INNER_CHUNK},
+    { "seed-frags", required_argument, NULL, OPT_SEED_FRAGS},
+    { "query-unmatched", required_argument, NULL, OPT_QUERY_UNMATCHED},
+    { "chunk-db", required_argument, NULL, OPT_CHUNK_DB},
+    { "binary-output", required_argument, NULL, OPT_BINARY_OUTPUT},
+    { "log-file", required_argument, NULL, OPT_LOG_FILE},
+    { "output", required_argument, NULL, OPT_OUTPUT},
+    { "shard-index", required_argument, NULL, OPT_SHARD_INDEX},
+    { "num-shards", required_argument, NULL, OPT_NUM_SHARDS},
+    { "threads", required_argument, NULL, OPT_THREADS},
     { "help",     no_argument,       NULL, 'h' },
     { "version",  no_argument,       NULL, 'v'},
     { NULL, 0, NULL, 0 }
@@ -123,6 +168,7 @@ void parse_args(int argc, char** argv)
         switch (c) 
         {
             case 'u': arg >> opt::max_unmatched_sites; break;
+            case OPT_QUERY_UNMATCHED: arg >> opt::max_query_unmatched_sites; break;
             case OPT_REL_ERROR: arg >> opt::rel_error; break;
             case 'a': arg >> opt::min_abs_error; break;
             case 'm': arg >> opt::max_match; break;
@@ -133,6 +179,14 @@ void parse_args(int argc, char** argv)
             case OPT_MIN_FRAG: arg >> opt::min_frag; break;
             case OPT_MAX_UNMATCHED_RATE: arg >> opt::max_unmatched_rate; break;
             case OPT_MAX_SCORE_PER_INNER_CHUNK: arg >> opt::max_score_per_inner_chunk; break;
+            case OPT_SEED_FRAGS: arg >> opt::seed_frags; break;
+            case OPT_CHUNK_DB: arg >> opt::chunk_db_file; break;
+            case OPT_BINARY_OUTPUT: arg >> opt::binary_output_file; break;
+            case OPT_LOG_FILE: arg >> opt::log_file; break;
+            case OPT_OUTPUT: arg >> opt::output_file; break;
+            case OPT_SHARD_INDEX: arg >> opt::shard_index; break;
+            case OPT_NUM_SHARDS: arg >> opt::num_shards; break;
+            case OPT_THREADS: arg >> opt::num_threads; break;
             case OPT_REF_IS_CIRCULAR:
               opt::ref_is_circular = true;
               opt::ref_is_bounded = true;
@@ -169,6 +223,12 @@ void parse_args(int argc, char** argv)
         die = true;
     }
 
+    if(opt::max_query_unmatched_sites < 0)
+    {
+        std::cerr << "The number of unmatched query sites must be greater than or equal to zero.\n";
+        die = true;
+    }
+
     if(opt::rel_error < 0) {
       std::cerr << "The relative error cannot be negative.\n";
       die = true;
@@ -189,6 +249,26 @@ void parse_args(int argc, char** argv)
       die = true;
     }
 
+    if(opt::seed_frags < 1 || opt::seed_frags > int(kmer_match::MAX_SEED_FRAGS)) {
+      std::cerr << "The seed fragments must be from 1 to " << kmer_match::MAX_SEED_FRAGS << "\n";
+      die = true;
+    }
+
+    if(opt::num_shards < 1) {
+      std::cerr << "The number of shards must be positive\n";
+      die = true;
+    }
+
+    if(opt::shard_index < 0 || opt::shard_index >= opt::num_shards) {
+      std::cerr << "The shard index must be from 0 to the number of shards - 1\n";
+      die = true;
+    }
+
+    if(opt::num_threads < 1) {
+      std::cerr << "The number of threads must be positive\n";
+      die = true;
+    }
+
     if (die) 
     {
         std::cerr << "\n" << USAGE_MESSAGE;
@@ -203,24 +283,64 @@ void parse_args(int argc, char** argv)
 
 typedef std::unordered_map<std::string, MapWrapper> MapDB;
 
+/////////////////////////////////////////////////////////////////////////////
+// The covered fragments of the reference maps, for selecting the non overlapping
+// alignments of a query. Each worker keeps its own, so that the reference maps
+// are shared read only. Only the covers used since the last reset are cleared.
+class RefCovers {
+
+public:
+
+  BitCover& get(const MapWrapper& ref_map) {
+    auto it = covers_.find(&ref_map);
+    if(it == covers_.end()) {
+      it = covers_.emplace(&ref_map, Cover(ref_map.num_frags_total())).first;
+    }
+    Cover& cover = it->second;
+    if(!cover.used) {
+      cover.used = true;
+      used_.push_back(&cover);
+    }
+    return cover.bits;
+  }
+
+  void reset() {
+    for(Cover * cover : used_) {
+      cover->bits.reset();
+      cover->used = false;
+    }
+    used_.clear();
+  }
+
+private:
+
+  struct Cover {
+    Cover(size_t n) : bits(n), used(false) {}
+    BitCover bits;
+    bool used;
+  };
+
+  std::unordered_map<const MapWrapper *, Cover> covers_;
+  std::vector<Cover *> used_;
+
+};
+
 // Select the non overlapping set of alignments. Alignment should already be sorted in the desired order.
-maligner_dp::AlignmentVec sift_alignments(maligner_dp::AlignmentVec& alns, MapDB& ref_map_db) {
+maligner_dp::AlignmentVec sift_alignments(maligner_dp::AlignmentVec& alns, const MapDB& ref_map_db,
+  RefCovers& covers) {
 
   maligner_dp::AlignmentVec alns_out;
   alns_out.reserve(alns.size());
 
-  // Reset the bitcovers of the reference maps.
-  for(auto i = ref_map_db.begin(); i != ref_map_db.end(); i++) {
-    MapWrapper& ref_map = i->second;
-    ref_map.bit_cover_.reset();
-  }
+  covers.reset();
 
   for(auto i = alns.begin(); i != alns.end(); i++) {
 
     maligner_dp::Alignment aln = *i;
-    MapWrapper& ref_map = ref_map_db.at(aln.ref_map_data.map_name_);
+    const MapWrapper& ref_map = ref_map_db.at(aln.ref_map_data->map_name_);
+    BitCover& cover = covers.get(ref_map);
 
-    if(ref_map.bit_cover_.is_covered(aln.ref_start, aln.ref_end)) {
+    if(cover.is_covered(aln.ref_start, aln.ref_end)) {
       continue;
     }
 
@@ -230,7 +350,7 @@ maligner_dp::AlignmentVec sift_alignments(maligner_dp::AlignmentVec& alns, MapDB
       continue;
     }
 
-    ref_map.bit_cover_.cover(aln.ref_start, aln.ref_end);
+    cover.cover(aln.ref_start, aln.ref_end);
     alns_out.push_back(std::move(aln));
 
   }
@@ -239,6 +359,36 @@ maligner_dp::AlignmentVec sift_alignments(maligner_dp::AlignmentVec& alns, MapDB
 
 }
 
+//////////////////////////////////////////////////////////////////////////////////////////////////////
+// The query chunks of an alignment whose chunks match query_frags[i] interior query fragments each,
+// represented as in convert_alignments. query_frags is in the orientation of the query, and the
+// chunks are returned with increasing indices of the forward (or reversed, if is_reverse) query.
+maligner_dp::ChunkVec make_query_chunks(const Map& query_map, const std::vector<size_t>& query_frags,
+  bool is_reverse) {
+
+  using maligner_dp::ChunkVec;
+
+  ChunkVec query_chunks;
+  query_chunks.reserve(query_frags.size());
+  const size_t num_query_frags = query_map.frags_.size();
+  size_t start = 1;
+  for(size_t n : query_frags) {
+    const size_t end = start + n;
+    int size = 0;
+    for(size_t i = start; i < end; i++) {
+      size += query_map.frags_[i];
+    }
+    query_chunks.emplace_back(start, end, size, false);
+    if(is_reverse) query_chunks.back().reverse_coords(num_query_frags);
+    start = end;
+  }
+
+  if(is_reverse) std::reverse(query_chunks.begin(), query_chunks.end());
+
+  return query_chunks;
+
+}
+
 //////////////////////////////////////////////////////////////////////////////////////////////////////
 // Convert alignments to the common format used by maligner dp.
 // maligner_ix handles reverse alignments by reversing the reference (since we index the reverse of the reference)
@@ -247,8 +397,9 @@ maligner_dp::AlignmentVec sift_alignments(maligner_dp::AlignmentVec& alns, MapDB
 maligner_dp::AlignmentVec convert_alignments(
   const RefAlignmentVec& ref_alignments,
   const MapWrapper& query,
-  MapDB& ref_map_db,
-  const Scorer& scorer) {
+  const MapDB& ref_map_db,
+  const Scorer& scorer,
+  RefCovers& covers) {
 
   using maligner_dp::Score;
   using maligner_dp::MatchedChunk;
@@ -323,6 +474,13 @@ maligner_dp::AlignmentVec convert_alignments(
       p_query_chunks = &query_chunks_reverse;
     }
 
+    // The query chunks of an alignment with unmatched query sites.
+    ChunkVec query_chunks_merged;
+    if(!ref_alignment.query_frags_.empty()) {
+      query_chunks_merged = make_query_chunks(query_map, ref_alignment.query_frags_, ref_alignment.is_reverse());
+      p_query_chunks = &query_chunks_merged;
+    }
+
 
     // std::cerr << "query:\n\t" << *p_query_chunks << "\n"
     //           << "ref:\n\t" << ref_chunks << "\n"
@@ -359,7 +517,7 @@ maligner_dp::AlignmentVec convert_alignments(
   // Sort the alignments by total rescaled score
   std::sort(alns.begin(), alns.end(), AlignmentRescaledScoreComp());
 
-  alns = sift_alignments(alns, ref_map_db);
+  alns = sift_alignments(alns, ref_map_db, covers);
 
   return alns;
 
@@ -383,6 +541,115 @@ MapWrapperVec read_ref_maps(std::string& maps_file, bool is_circular, bool is_bo
 }
 
 
+/////////////////////////////////////////
+// Build the chunk database of the reference maps, or load it from opt::chunk_db_file
+// if it exists. A newly built database is saved to opt::chunk_db_file, if given.
+MapChunkDB make_chunk_db(const MapWrapperPVec& p_ref_maps) {
+
+  const bool have_file = !opt::chunk_db_file.empty() && std::ifstream(opt::chunk_db_file).good();
+
+  if(have_file) {
+
+    try {
+      MapChunkDB chunkDB = read_map_chunk_db(opt::chunk_db_file, p_ref_maps, opt::max_unmatched_sites);
+      cerr << "Loaded MapChunkDB with " << chunkDB.map_chunks_.size() << " chunks from "
+           << opt::chunk_db_file << ".\n";
+      return chunkDB;
+    } catch(MapChunkDBException& e) {
+      cerr << e.what() << "\n";
+      exit(EXIT_FAILURE);
+    }
+
+  }
+
+  MapChunkDB chunkDB(p_ref_maps, opt::max_unmatched_sites);
+  cerr << "Made MapChunkDB with " << chunkDB.map_chunks_.size() << " chunks.\n";
+
+  if(!opt::chunk_db_file.empty()) {
+    write_map_chunk_db(opt::chunk_db_file, chunkDB, p_ref_maps);
+    cerr << "Saved MapChunkDB to " << opt::chunk_db_file << ".\n";
+  }
+
+  return chunkDB;
+
+}
+
+
+/////////////////////////////////////////
+// The output of aligning one query, written in query order.
+struct QueryResult {
+  QueryResult() : num_alignments(0) {}
+  string alignments; // Alignment records for the output
+  maligner_dp::AlignmentRecordBlock binary_alignments; // Alignment records for the binary output file
+  string log; // Messages for the log
+  size_t num_alignments; // Number of alignments written
+};
+
+
+/////////////////////////////////////////
+// Align a query map to the reference maps. The chunk database and the reference
+// maps are only read, so that queries can be aligned in parallel, each worker with
+// its own covers.
+void align_query(const Map& query_map, const MapChunkDB& chunkDB, const MapDB& ref_map_db,
+  const ErrorModel& error_model, const Scorer& scorer, bool write_binary, RefCovers& covers,
+  QueryResult& result) {
+
+  MapWrapper query(query_map, false, false);
+  lmm_utils::TextBuffer aln_buf;
+  lmm_utils::TextBuffer log_buf;
+
+  log_buf << "Aligning " << query.get_name() << "\n";
+
+  const FragVec& frags = query.get_frags();
+
+  // Note: We ignore boundary fragments
+  IntPairVec bounds = error_model.compute_bounds(frags.begin() + 1, frags.end() - 1);
+
+  // Determine the maximum number of unmatched sites allowed
+  const double mur = opt::max_unmatched_rate;
+  size_t max_unmatched = mur > 0.0 ?
+    size_t((mur/(1-mur)) * bounds.size()) : std::numeric_limits<size_t>::max();
+
+
+  RefAlignmentVec ref_alns;
+  if(opt::max_query_unmatched_sites > 0) {
+    // Reference chunks may also match chunks of several query fragments.
+    QueryChunkBounds query_bounds(error_model, frags.begin() + 1, frags.end() - 1,
+      opt::max_query_unmatched_sites + 1);
+    ref_alns = chunkDB.get_compatible_alignments_best(query_bounds, max_unmatched);
+  } else {
+    ref_alns = chunkDB.get_compatible_alignments_best(bounds, max_unmatched);
+  }
+
+  // Sort the alignments in ascending order of miss_rate
+  std::sort(ref_alns.begin(), ref_alns.end(), ReferenceAlignmentMissRateSort());
+  AlignmentVec alns = convert_alignments(ref_alns, query, ref_map_db, scorer, covers);
+  log_buf << "Converted " << alns.size() << " alignments.\n";
+  int query_aln_count = 0;
+  for(auto a = alns.begin(); a != alns.end(); a++) {
+
+    if(query_aln_count == opt::max_match) break;
+
+    const maligner_dp::Alignment& aln = *a;
+
+    if(aln.score_per_inner_chunk <= opt::max_score_per_inner_chunk) {
+      if(write_binary) {
+        result.binary_alignments.add(aln);
+      } else {
+        maligner_dp::print_alignment(aln_buf, aln);
+      }
+      ++query_aln_count;
+    }
+
+  }
+
+  result.alignments = aln_buf.release();
+  result.log += log_buf.release();
+  result.num_alignments = query_aln_count;
+
+}
+
+
 int main(int argc, char* argv[]) {
 
   using namespace kmer_match;
@@ -396,11 +663,15 @@ int main(int argc, char* argv[]) {
        << "\tquery_maps_file: " << opt::query_maps_file << "\n"
        << "\tref_maps_file: " << opt::ref_maps_file << "\n"
        << "\tmax. consecutive unmatched sites: " << opt::max_unmatched_sites << "\n"
+       << "\tmax. consecutive unmatched query sites: " << opt::max_query_unmatched_sites << "\n"
        << "\tmax. unmatched rate: " << opt::max_unmatched_rate << "\n"
+       << "\tseed fragments: " << opt::seed_frags << "\n"
        << "\trelative_error: " << opt::rel_error << "\n"
        << "\tabsolute_error: " << opt::min_abs_error << "\n"
        << "\tminimum query frags: " << opt::min_frag << "\n"
        << "\tmax matches per query: " << opt::max_match << "\n"
+       << "\tshard: " << opt::shard_index << " of " << opt::num_shards << "\n"
+       << "\tthreads: " << opt::num_threads << "\n"
        << "................................................\n\n";
 
   ErrorModel error_model(opt::rel_error, opt::min_abs_error);
@@ -427,12 +698,47 @@ int main(int argc, char* argv[]) {
   cerr << "Read " << ref_maps.size() << " reference maps.\n";
 
   ////////////////////////////////////////////////////////////////
-  // Build Chunk Database
-  MapChunkDB chunkDB(p_ref_maps, opt::max_unmatched_sites);
-  cerr << "Made MapChunkDB with " << chunkDB.map_chunks_.size() << " chunks.\n";
+  // Build Chunk Database, or load it from the chunk database file.
+  MapChunkDB chunkDB = make_chunk_db(p_ref_maps);
+
+  if(opt::seed_frags > 1) {
+    chunkDB.build_seed_index(opt::seed_frags);
+    cerr << "Made seed index with " << chunkDB.seed_keys_.size() << " runs of "
+         << opt::seed_frags << " chunks.\n";
+  }
+
+  // Open the output files, which are compressed if their names end in .gz or .zst.
+  std::unique_ptr<maligner_dp::AlignmentFileWriter> binary_output;
+  std::unique_ptr<std::ostream> output_file, log_file;
+  try {
+    if(!opt::binary_output_file.empty()) {
+      binary_output.reset(new maligner_dp::AlignmentFileWriter(opt::binary_output_file));
+    }
+    if(!opt::output_file.empty()) {
+      output_file = lmm_utils::open_output_file(opt::output_file);
+    }
+    if(!opt::log_file.empty()) {
+      log_file = lmm_utils::open_output_file(opt::log_file);
+    }
+  } catch(std::exception& e) {
+    cerr << e.what() << "\n";
+    return EXIT_FAILURE;
+  }
 
-  // Write alignment header
-  std::cout << AlignmentHeader();
+  // The alignments go to stdout and the per query log messages go to stderr,
+  // unless output files are given.
+  std::ostream& aln_out = output_file ? *output_file : std::cout;
+  std::ostream& query_log = log_file ? *log_file : std::cerr;
+
+  // Write alignment header.
+  if(!binary_output) {
+    aln_out << AlignmentHeader();
+  }
+  lmm_utils::TextBuffer aln_buf;
+
+  // The output is written by the writer thread, and the query maps are read
+  // ahead by the reader thread.
+  lmm_utils::AsyncWriter writer;
 
   size_t aln_count = 0;
   size_t map_with_aln = 0;
@@ -442,71 +748,119 @@ int main(int argc, char* argv[]) {
 
   Scorer scorer(opt::query_miss_penalty, opt::ref_miss_penalty, opt::min_sd, opt::sd_rate);
 
-  // Iterate through query maps file.
-  Map query_map;
-  MapReader query_map_reader(opt::query_maps_file);
-  for(; query_map_reader.next(query_map); counter++) {
+  // Write the result of a query. This is called in query order.
+  auto write_result = [&](QueryResult& result) {
 
-    if(counter == interval_report) {
-      std::cerr << ".";
-      counter = 0;
+    if(binary_output) {
+      binary_output->write(result.binary_alignments);
+    } else {
+      aln_buf << result.alignments;
     }
 
-    MapWrapper query = MapWrapper(std::move(query_map), false, false);
+    aln_count += result.num_alignments;
+    if(result.num_alignments > 0) {
+      ++map_with_aln;
+    }
 
-    if(int(query.num_frags()) < opt::min_frag) {
-      continue;
+    if(aln_buf.size() >= (1 << 16)) {
+      writer.write(aln_out, aln_buf.release());
     }
+    writer.write(query_log, std::move(result.log));
+
+  };
+
+  // Iterate through query maps file.
+  Map query_map;
+  lmm_utils::AsyncMapReader query_map_reader(opt::query_maps_file, opt::shard_index, opt::num_shards);
+  const bool write_binary = bool(binary_output);
 
-    std::cerr << "Aligning " << query.get_name() << "\n";
+  if(opt::num_threads <= 1) {
 
-    const FragVec& frags = query.get_frags();
+    RefCovers covers;
+    QueryResult result;
 
-    // Note: We ignore boundary fragments
-    IntPairVec bounds = error_model.compute_bounds(frags.begin() + 1, frags.end() - 1);
+    for(; query_map_reader.next(query_map); counter++) {
 
-    // Determine the maximum number of unmatched sites allowed
-    const double mur = opt::max_unmatched_rate;
-    size_t max_unmatched = mur > 0.0 ?
-      size_t((mur/(1-mur)) * bounds.size()) : std::numeric_limits<size_t>::max();
+      result = QueryResult();
 
+      if(counter == interval_report) {
+        result.log = ".";
+        counter = 0;
+      }
+
+      if(int(query_map.frags_.size()) >= opt::min_frag) {
+        align_query(query_map, chunkDB, ref_map_db, error_model, scorer, write_binary, covers, result);
+      }
 
-    RefAlignmentVec ref_alns = chunkDB.get_compatible_alignments_best(bounds, max_unmatched);
+      write_result(result);
 
-    // std::cerr << qi->name_ << "\n";
-    // std::cerr << frags << "\n";
-    // std::cerr << "max_unmatched: " << max_unmatched << "\n";
-    // std::cerr << "num_frags: " << bounds.size() << "\n";
-    // std::cerr << "num aln: " << " " << ref_alns.size() << std::endl;
+    }
 
+  } else {
 
-    // Sort the alignments in ascending order of miss_rate
-    std::sort(ref_alns.begin(), ref_alns.end(), ReferenceAlignmentMissRateSort());
-    AlignmentVec alns = convert_alignments(ref_alns, query, ref_map_db, scorer);
-    cerr << "Converted " << alns.size() << " alignments.\n";
-    int query_aln_count = 0;
-    bool map_has_alignment = false;
-    for(auto a = alns.begin(); a != alns.end(); a++) {
+    // The chunk database and the reference maps are shared by the workers, which
+    // each keep their own covers. Queries are numbered in the order they are read,
+    // and the results are written in that order.
+    std::vector<RefCovers> worker_covers(opt::num_threads);
+    lmm_utils::ThreadPool pool(opt::num_threads);
+    lmm_utils::ReorderBuffer<QueryResult> output(write_result);
 
-      if(query_aln_count == opt::max_match) break;
+    const size_t max_pending = 64 * size_t(opt::num_threads);
+    size_t query_num = 0;
 
-      const maligner_dp::Alignment& aln = *a;
-      bool have_aln = false;
+    for(; query_map_reader.next(query_map); counter++) {
 
-      if(aln.score_per_inner_chunk <= opt::max_score_per_inner_chunk) {
-        maligner_dp::print_alignment(std::cout, aln);
-        ++aln_count;
-        ++query_aln_count;
-        have_aln = true;
-        map_has_alignment = true;
+      output.wait_for_room(query_num, max_pending);
+      const size_t seq = query_num++;
+
+      // A skipped query still takes its turn in the output, for the progress dots.
+      string progress;
+      if(counter == interval_report) {
+        progress = ".";
+        counter = 0;
       }
 
-    }
+      if(int(query_map.frags_.size()) < opt::min_frag) {
+        QueryResult skipped;
+        skipped.log = progress;
+        output.push(seq, std::move(skipped));
+        continue;
+      }
+
+      std::shared_ptr<Map> p_query_map = std::make_shared<Map>(std::move(query_map));
+      query_map = Map();
+
+      pool.submit([&, seq, p_query_map, progress](size_t worker_id) {
+        QueryResult result;
+        result.log = progress;
+        try {
+          align_query(*p_query_map, chunkDB, ref_map_db, error_model, scorer, write_binary,
+            worker_covers[worker_id], result);
+        } catch(...) {
+          output.push(seq, std::move(result));
+          throw;
+        }
+        output.push(seq, std::move(result));
+      });
 
-    if(map_has_alignment) {
-      ++map_with_aln;
     }
 
+    pool.wait();
+
+  }
+
+  writer.write(aln_out, aln_buf.release());
+  writer.close();
+  output_file.reset();
+  log_file.reset();
+
+  if(binary_output) {
+    try {
+      binary_output->close();
+    } catch(std::exception& e) {
+      cerr << e.what() << "\n";
+      return EXIT_FAILURE;
+    }
   }
   
   cerr << "\ntotal alignments: " << aln_count << "\n";
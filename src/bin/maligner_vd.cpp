@@ -7,6 +7,7 @@
 #include <fstream>
 #include <chrono>
 #include <getopt.h>
+#include <memory>
 
 // kmer_match includes
 #include "map.h"
@@ -24,6 +25,8 @@
 #include "align.h"
 #include "utils.h"
 #include "ScoreMatrix.h"
+#include "ref_index.h"
+#include "alignment_file.h"
 
 // vd includes
 #include "score_matrix_vd.h"
@@ -32,6 +35,7 @@
 
 // common includes
 #include "timer.h"
+#include "checkpoint.h"
 #include "common_defs.h"
 
 using std::string;
@@ -65,12 +69,108 @@ typedef maligner_vd::RefScoreMatrixVD<ScoreMatrixType> RefScoreMatrixVDType;
 typedef maligner_vd::RefScoreMatrixVDDB<RefScoreMatrixVDType> RefScoreMatrixDB;
 typedef std::vector<RefScoreMatrixVDType> RefScoreMatrixVDVec;
 
+// An alignment output file, written as text (FILE_PFX.aln) or in the
+// binary alignment format (FILE_PFX.alnb). A text file is appended to
+// when resuming from a checkpoint.
+class AlignmentOutput {
+public:
+
+  AlignmentOutput(const std::string& file_pfx, bool binary, bool append = false) {
+    if(binary) {
+      binary_.reset(new AlignmentFileWriter(file_pfx + ".alnb"));
+    } else if(append) {
+      text_.open(file_pfx + ".aln", std::ios::app);
+    } else {
+      text_.open(file_pfx + ".aln");
+      text_ << AlignmentHeader();
+    }
+  }
+
+  void write(const Alignment& aln) {
+    if(binary_) {
+      binary_->write(aln);
+    } else {
+      print_alignment(buf_, aln);
+    }
+  }
+
+  void write_if_full() {
+    if(!binary_) {
+      buf_.write_if_full(text_);
+    }
+  }
+
+  // Write the buffered text to the file.
+  void flush() {
+    if(!binary_) {
+      buf_.write_to(text_);
+      text_.flush();
+    }
+  }
+
+  void close() {
+    if(binary_) {
+      binary_->close();
+    } else {
+      buf_.write_to(text_);
+      text_.close();
+    }
+  }
+
+private:
+  std::ofstream text_;
+  lmm_utils::TextBuffer buf_;
+  std::unique_ptr<AlignmentFileWriter> binary_;
+};
+
 int main(int argc, char* argv[]) {
 
   using maligner_dp::Alignment;
   maligner_vd::opt::program_name = argv[0];
   parse_args(argc, argv);
 
+  const string pfx_file = maligner_vd::opt::output_pfx + ".pfx";
+  const string sfx_file = maligner_vd::opt::output_pfx + ".sfx";
+  const string full_file = maligner_vd::opt::output_pfx + ".full";
+
+  // The checkpoints record the alignment files, the profiles on stdout,
+  // and the position in the query maps.
+  std::unique_ptr<lmm_utils::Checkpointer> checkpointer;
+  uint64_t start_position = 0;
+  uint64_t num_queries_done = 0;
+
+  if(!maligner_vd::opt::checkpoint_file.empty()) {
+
+    checkpointer.reset(new lmm_utils::Checkpointer(maligner_vd::opt::checkpoint_file,
+      maligner_vd::opt::checkpoint_interval));
+    checkpointer->add_output(pfx_file + ".aln");
+    checkpointer->add_output(sfx_file + ".aln");
+    checkpointer->add_output(full_file + ".aln");
+    checkpointer->add_output("-");
+
+    std::ostringstream shard;
+    shard << maligner_vd::opt::shard_index << "/" << maligner_vd::opt::num_shards;
+    checkpointer->set_value("query_maps_file", maligner_vd::opt::query_maps_file);
+    checkpointer->set_value("ref_maps_file", maligner_vd::opt::ref_maps_file);
+    checkpointer->set_value("shard", shard.str());
+
+    if(maligner_vd::opt::resume) {
+
+      try {
+        checkpointer->resume();
+      } catch(lmm_utils::CheckpointException& e) {
+        std::cerr << e.what() << "\n";
+        return EXIT_FAILURE;
+      }
+
+      start_position = checkpointer->input_position();
+      num_queries_done = checkpointer->num_queries();
+      std::cerr << "Resuming after " << num_queries_done << " queries.\n";
+
+    }
+
+  }
+
   print_args(std::cerr);
 
   Timer timer;
@@ -93,26 +193,51 @@ int main(int argc, char* argv[]) {
                        maligner_vd::opt::min_query_scaling,
                        maligner_vd::opt::max_query_scaling);
 
-  // Build a database of reference maps. 
-  MapVec ref_maps(read_maps(maligner_vd::opt::ref_maps_file));
-  cerr << "Read " << ref_maps.size() << " reference maps.\n";
-
+  // Build a database of reference maps, from a prebuilt reference index if given one.
+  // The index must outlive the reference maps, which are views of it.
+  std::unique_ptr<RefIndex> ref_index;
   RefScoreMatrixVDVec ref_score_matrix_vd_vec;
   RefScoreMatrixDB ref_score_matrix_db;
-  for(auto& rm : ref_maps ) {
 
-    RefMapWrapper rmw(rm, maligner_vd::opt::reference_is_circular, 
-                          maligner_vd::opt::ref_max_misses,
-                          maligner_vd::opt::sd_rate,
-                          maligner_vd::opt::min_sd);
+  if(is_ref_index_file(maligner_vd::opt::ref_maps_file)) {
+
+    try {
+      ref_index.reset(new RefIndex(maligner_vd::opt::ref_maps_file));
+      ref_index->check_params(maligner_vd::opt::ref_max_misses, maligner_vd::opt::sd_rate,
+        maligner_vd::opt::min_sd, maligner_vd::opt::reference_is_circular);
+      for(size_t i = 0; i < ref_index->num_maps(); i++) {
+        ref_score_matrix_db.add_ref_map(ref_index->get_ref_map_wrapper(i));
+      }
+    } catch(RefIndexException& e) {
+      cerr << e.what() << "\n";
+      return EXIT_FAILURE;
+    }
+
+    cerr << "Read " << ref_index->num_maps() << " reference maps from index.\n";
+
+  } else {
 
-    ref_score_matrix_db.add_ref_map(std::move(rmw));
+    MapVec ref_maps(read_maps(maligner_vd::opt::ref_maps_file));
+    cerr << "Read " << ref_maps.size() << " reference maps.\n";
+
+    for(auto& rm : ref_maps ) {
+
+      RefMapWrapper rmw(rm, maligner_vd::opt::reference_is_circular, 
+                            maligner_vd::opt::ref_max_misses,
+                            maligner_vd::opt::sd_rate,
+                            maligner_vd::opt::min_sd);
+
+      ref_score_matrix_db.add_ref_map(std::move(rmw));
+
+    }
 
   }
 
   cerr << "Wrapped " << ref_score_matrix_db.size() << " reference maps.\n";
 
-  MapReader query_map_reader(maligner_vd::opt::query_maps_file);
+  MapReader query_map_reader(maligner_vd::opt::query_maps_file,
+    maligner_vd::opt::shard_index, maligner_vd::opt::num_shards);
+  query_map_reader.seek(start_position);
   Map query_map;
   AlignmentVec alns_forward, alns_reverse, all_alignments;
 
@@ -122,21 +247,44 @@ int main(int argc, char* argv[]) {
   // std::ofstream fout_rf_qr(maligner_vd::opt::output_pfx + ".rf_qr.aln");
   // std::ofstream fout_rr_qf(maligner_vd::opt::output_pfx + ".rr_qf.aln");
   // std::ofstream fout_rr_qr(maligner_vd::opt::output_pfx + ".rr_qr.aln");
-  std::ofstream fout_prefix(maligner_vd::opt::output_pfx + ".pfx.aln");
-  std::ofstream fout_suffix(maligner_vd::opt::output_pfx + ".sfx.aln");
-  std::ofstream fout_full_aln(maligner_vd::opt::output_pfx + ".full.aln");
+  const bool append = maligner_vd::opt::resume;
+  AlignmentOutput fout_prefix(pfx_file, maligner_vd::opt::binary_output, append);
+  AlignmentOutput fout_suffix(sfx_file, maligner_vd::opt::binary_output, append);
+  AlignmentOutput fout_full_aln(full_file, maligner_vd::opt::binary_output, append);
 
   // fout_rf_qf << AlignmentHeader();
   // fout_rf_qr << AlignmentHeader();
   // fout_rr_qf << AlignmentHeader();
   // fout_rr_qr << AlignmentHeader();
-  fout_prefix << AlignmentHeader();
-  fout_suffix << AlignmentHeader();
-  fout_full_aln << AlignmentHeader();
 
-  std::cout << maligner_vd::ScoreMatrixRecordHeader() << "\n";
+  if(!append) {
+    std::cout << maligner_vd::ScoreMatrixRecordHeader() << "\n";
+  }
 
-  while(query_map_reader.next(query_map)) {
+  // Checkpoint after the queries read so far, which are completely written.
+  auto write_checkpoint = [&]() {
+    fout_prefix.flush();
+    fout_suffix.flush();
+    fout_full_aln.flush();
+    std::cout.flush();
+    try {
+      checkpointer->write(query_map_reader.tell(), num_queries_done);
+    } catch(lmm_utils::CheckpointException& e) {
+      std::cerr << "Warning: " << e.what() << "\n";
+    }
+  };
+
+  while(true) {
+
+    if(checkpointer && checkpointer->due()) {
+      write_checkpoint();
+    }
+
+    if(!query_map_reader.next(query_map)) {
+      break;
+    }
+
+    num_queries_done++;
 
     all_alignments.clear();
     alns_forward.clear();
@@ -243,7 +391,7 @@ int main(int argc, char* argv[]) {
       for(const auto& a : alns) {
         // std::cerr << "aln m_score: " << a.m_score << "\n";
         // if(a.m_score <= maligner_vd::opt::max_m_score) {
-          print_alignment(fout_prefix, a);
+          fout_prefix.write(a);
           // print_alignment(std::cerr, a);
           wrote_count++;
         // }
@@ -256,7 +404,7 @@ int main(int argc, char* argv[]) {
       for(const auto& a : alns) {
         // std::cerr << "aln m_score: " << a.m_score << "\n";
         // if(a.m_score <= maligner_vd::opt::max_m_score) {
-          print_alignment(fout_suffix, a);
+          fout_suffix.write(a);
           // print_alignment(std::cerr, a);
           wrote_count++;
         // }
@@ -269,13 +417,17 @@ int main(int argc, char* argv[]) {
       for(const auto& a : alns) {
         // std::cerr << "aln m_score: " << a.m_score << "\n";
         if(a.m_score <= maligner_vd::opt::max_m_score) {
-          print_alignment(fout_full_aln, a);
+          fout_full_aln.write(a);
           // print_alignment(std::cerr, a);
           wrote_count++;
         }
       }
     }     
 
+    fout_prefix.write_if_full();
+    fout_suffix.write_if_full();
+    fout_full_aln.write_if_full();
+
     // Output the best partial alignments.
     ///////////////////////////////////////////////////////////////////////////////////////
     std::cout << ref_score_matrix_db.get_score_matrix_profile_rf_qf(qmw.get_name())
@@ -294,15 +446,24 @@ int main(int argc, char* argv[]) {
   
  }
 
+  if(checkpointer) {
+    write_checkpoint();
+  }
+
   std::cerr << "maligner_vd done.\n";
 
   // fout_rf_qf.close();
   // fout_rf_qr.close();
   // fout_rr_qf.close();
   // fout_rr_qr.close();
-  fout_prefix.close();
-  fout_suffix.close();
-  fout_full_aln.close();
+  try {
+    fout_prefix.close();
+    fout_suffix.close();
+    fout_full_aln.close();
+  } catch(std::exception& e) {
+    std::cerr << e.what() << "\n";
+    return EXIT_FAILURE;
+  }
 
   return EXIT_SUCCESS;
 
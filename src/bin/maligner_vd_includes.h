@@ -49,6 +49,18 @@ static const char *USAGE_MESSAGE =
 " General arguments:\n"
 "      -h, --help                       display this help and exit\n"
 "      -v, --version                    display the version and exit\n"
+"      --binary-output                  Write the alignments in the binary alignment format, to\n"
+"                                          OUTPUT_PFX.{pfx,sfx,full}.alnb. Convert them to text with aln_convert.\n"
+"      --num-shards INT                 Split the query maps file into INT shards, for runs split\n"
+"                                          across nodes, and align only one shard. Default: 1\n"
+"      --shard-index INT                The shard to align, from 0 to num-shards - 1. Merge the\n"
+"                                          outputs of the shards with aln_merge. Default: 0\n"
+"      --checkpoint FILE                Write checkpoints of the run to FILE, so that it can be resumed\n"
+"                                          with --resume if it is stopped. Default: none\n"
+"      --checkpoint-interval SECONDS    Seconds between checkpoints. (Default: 600)\n"
+"      --resume                         Resume the run from the checkpoint: truncate the outputs to the\n"
+"                                          checkpoint, and continue with the next query. Append\n"
+"                                          stdout to the earlier output (>>).\n"
 "      --verbose                        Verbose output\n";
 
 
@@ -91,6 +103,12 @@ namespace maligner_vd {
       static int max_query_frags = 50000;
       static int min_aln_chunks = 5; // Minimum number of chunks to report a prefix/suffix alignment.
       static double max_m_score = -5.0; // Maximum m_score to report an alignment.
+      static bool binary_output = false; // Write alignments in the binary alignment format.
+      static int shard_index = 0; // Align only this shard of the query maps.
+      static int num_shards = 1;
+      static string checkpoint_file; // Write checkpoints to this file.
+      static double checkpoint_interval = 600.0;
+      static bool resume = false; // Resume from the checkpoint.
 
   }
 }
@@ -112,7 +130,13 @@ enum {
   OPT_NO_QUERY_RESCALING,
   OPT_REFERENCE_IS_CIRCULAR,
   OPT_MIN_ALN_CHUNKS,
-  OPT_MAX_M_SCORE
+  OPT_MAX_M_SCORE,
+  OPT_BINARY_OUTPUT,
+  OPT_SHARD_INDEX,
+  OPT_NUM_SHARDS,
+  OPT_CHECKPOINT,
+  OPT_CHECKPOINT_INTERVAL,
+  OPT_RESUME
 };
 
 static const struct option longopts[] = {
@@ -135,6 +159,12 @@ static const struct option longopts[] = {
     { "no-query-rescaling", no_argument, NULL, OPT_NO_QUERY_RESCALING},
     { "reference-is-circular", no_argument, NULL, OPT_REFERENCE_IS_CIRCULAR},
     { "verbose", no_argument, NULL, OPT_VERBOSE},
+    { "binary-output", no_argument, NULL, OPT_BINARY_OUTPUT},
+    { "shard-index", required_argument, NULL, OPT_SHARD_INDEX},
+    { "num-shards", required_argument, NULL, OPT_NUM_SHARDS},
+    { "checkpoint", required_argument, NULL, OPT_CHECKPOINT},
+    { "checkpoint-interval", required_argument, NULL, OPT_CHECKPOINT_INTERVAL},
+    { "resume", no_argument, NULL, OPT_RESUME},
     { "help",     no_argument,       NULL, 'h' },
     { "version",  no_argument,       NULL, 'v'},
     { NULL, 0, NULL, 0 }
@@ -168,6 +198,12 @@ void parse_args(int argc, char** argv)
             case OPT_MAX_M_SCORE: arg >> opt::max_m_score; break;
             case OPT_NUM_PERMUTATION_TRIALS: arg >> opt::num_permutation_trials; break;
             case OPT_VERBOSE: opt::verbose = true; break;
+            case OPT_BINARY_OUTPUT: opt::binary_output = true; break;
+            case OPT_SHARD_INDEX: arg >> opt::shard_index; break;
+            case OPT_NUM_SHARDS: arg >> opt::num_shards; break;
+            case OPT_CHECKPOINT: arg >> opt::checkpoint_file; break;
+            case OPT_CHECKPOINT_INTERVAL: arg >> opt::checkpoint_interval; break;
+            case OPT_RESUME: opt::resume = true; break;
             case OPT_NO_QUERY_RESCALING: opt::query_rescaling = false; break;
             case OPT_REFERENCE_IS_CIRCULAR: 
               opt::reference_is_circular = true;
@@ -235,6 +271,26 @@ void parse_args(int argc, char** argv)
       die = true;
     }
 
+    if(opt::num_shards < 1) {
+      std::cerr << "Number of shards must be positive\n";
+      die = true;
+    }
+
+    if(opt::shard_index < 0 || opt::shard_index >= opt::num_shards) {
+      std::cerr << "Shard index must be from 0 to the number of shards - 1\n";
+      die = true;
+    }
+
+    if(opt::resume && opt::checkpoint_file.empty()) {
+      std::cerr << "Resume requires a checkpoint file\n";
+      die = true;
+    }
+
+    if(!opt::checkpoint_file.empty() && opt::binary_output) {
+      std::cerr << "Checkpoints do not support the binary output\n";
+      die = true;
+    }
+
     if (die) 
     {
         std::cout << "\n" << USAGE_MESSAGE;
@@ -282,7 +338,13 @@ std::ostream& print_args(std::ostream& os) {
      << "\tref_is_bounded: " << ref_is_bounded << "\n"
      << "\treference_is_circular: " << reference_is_circular << "\n"
      << "\tmin_query_frags: " << min_query_frags << "\n"
-     << "\tmax_query_frags: " << max_query_frags << "\n";
+     << "\tmax_query_frags: " << max_query_frags << "\n"
+     << "\tbinary_output: " << binary_output << "\n"
+     << "\tshard_index: " << shard_index << "\n"
+     << "\tnum_shards: " << num_shards << "\n"
+     << "\tcheckpoint_file: " << checkpoint_file << "\n"
+     << "\tcheckpoint_interval: " << checkpoint_interval << "\n"
+     << "\tresume: " << resume << "\n";
 
   return os;
 }
@@ -0,0 +1,125 @@
+#include <set>
+#include <utility>
+
+#include "async_io.h"
+
+namespace lmm_utils {
+
+  AsyncMapReader::AsyncMapReader(const std::string& file_name, size_t shard_index, size_t num_shards,
+    uint64_t start_position, size_t max_ahead) :
+    reader_(file_name, shard_index, num_shards),
+    queue_(max_ahead),
+    stop_(false)
+  {
+    reader_.seek(start_position);
+    thread_ = std::thread(&AsyncMapReader::read_loop, this);
+  }
+
+  AsyncMapReader::~AsyncMapReader() {
+    stop_.store(true);
+    thread_.join();
+  }
+
+  void AsyncMapReader::read_loop() {
+    Item item;
+    try {
+      while(!stop_.load(std::memory_order_relaxed) && reader_.next(item.map)) {
+        item.position = reader_.tell();
+        if(!queue_.push(item, stop_)) {
+          break;
+        }
+      }
+    } catch(...) {
+      // Rethrown by next, on the consumer's thread.
+      error_ = std::current_exception();
+    }
+    queue_.close();
+  }
+
+  bool AsyncMapReader::next(maligner_maps::Map& map) {
+    uint64_t position;
+    return next(map, position);
+  }
+
+  bool AsyncMapReader::next(maligner_maps::Map& map, uint64_t& position) {
+    if(queue_.pop(item_)) {
+      map = std::move(item_.map);
+      position = item_.position;
+      return true;
+    }
+    if(error_) {
+      std::rethrow_exception(error_);
+    }
+    return false;
+  }
+
+  AsyncWriter::AsyncWriter(size_t max_pending) :
+    queue_(max_pending),
+    is_open_(true),
+    num_syncs_(0),
+    num_synced_(0)
+  {
+    thread_ = std::thread(&AsyncWriter::write_loop, this);
+  }
+
+  AsyncWriter::~AsyncWriter() {
+    close();
+  }
+
+  void AsyncWriter::write(std::ostream& os, std::string&& data) {
+    if(data.empty()) {
+      return;
+    }
+    Block block;
+    block.os = &os;
+    block.data = std::move(data);
+    queue_.push(block);
+  }
+
+  void AsyncWriter::sync() {
+
+    // A block without a stream tells the writer thread to flush.
+    Block block;
+    queue_.push(block);
+    num_syncs_++;
+
+    Backoff backoff;
+    while(num_synced_.load(std::memory_order_acquire) != num_syncs_) {
+      backoff.wait();
+    }
+
+  }
+
+  void AsyncWriter::close() {
+    if(!is_open_) {
+      return;
+    }
+    is_open_ = false;
+    queue_.close();
+    thread_.join();
+  }
+
+  void AsyncWriter::write_loop() {
+
+    std::set<std::ostream*> streams;
+    Block block;
+
+    while(queue_.pop(block)) {
+      if(!block.os) {
+        for(std::ostream * os : streams) {
+          os->flush();
+        }
+        num_synced_.fetch_add(1, std::memory_order_release);
+        continue;
+      }
+      block.os->write(block.data.data(), block.data.size());
+      streams.insert(block.os);
+    }
+
+    for(std::ostream * os : streams) {
+      os->flush();
+    }
+
+  }
+
+}
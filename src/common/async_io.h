@@ -0,0 +1,110 @@
+#ifndef LMM_ASYNC_IO_H
+#define LMM_ASYNC_IO_H
+
+/**********************************************************
+
+Pipeline stages that move file I/O off the aligning thread.
+
+AsyncMapReader reads and parses maps on its own thread, up to a bounded
+number ahead of the consumer, with the same next() interface as MapReader.
+
+AsyncWriter writes blocks of output (i.e. the alignments, scores and log
+messages of a query) to their streams on its own thread, in the order
+they were written. Several streams can share one AsyncWriter.
+
+Both pass items through an SPSCQueue, so the aligning thread only blocks
+when it is far enough ahead (or behind) to fill (or empty) a queue.
+
+**************************************************************/
+
+#include <atomic>
+#include <exception>
+#include <ostream>
+#include <string>
+#include <thread>
+
+#include "map.h"
+#include "map_reader.h"
+#include "spsc_queue.h"
+
+namespace lmm_utils {
+
+  class AsyncMapReader {
+
+  public:
+
+    // Read the maps of a shard of file_name (see MapReader), from start_position
+    // (see MapReader::tell), up to max_ahead maps ahead of next().
+    AsyncMapReader(const std::string& file_name, size_t shard_index = 0, size_t num_shards = 1,
+      uint64_t start_position = 0, size_t max_ahead = 256);
+    ~AsyncMapReader();
+
+    AsyncMapReader(const AsyncMapReader&) = delete;
+    AsyncMapReader& operator=(const AsyncMapReader&) = delete;
+
+    // Rethrows an exception from reading the maps (i.e. a CompressionException).
+    bool next(maligner_maps::Map& map);
+
+    // Also get the position of the reader after the map.
+    bool next(maligner_maps::Map& map, uint64_t& position);
+
+  private:
+
+    struct Item {
+      Item() : position(0) {}
+      maligner_maps::Map map;
+      uint64_t position;
+    };
+
+    void read_loop();
+
+    maligner_maps::MapReader reader_;
+    SPSCQueue<Item> queue_;
+    Item item_;
+    std::atomic<bool> stop_;
+    std::exception_ptr error_;
+    std::thread thread_;
+
+  };
+
+  class AsyncWriter {
+
+  public:
+
+    // Buffer up to max_pending blocks of output.
+    AsyncWriter(size_t max_pending = 256);
+    ~AsyncWriter();
+
+    AsyncWriter(const AsyncWriter&) = delete;
+    AsyncWriter& operator=(const AsyncWriter&) = delete;
+
+    // Queue data to be written to os. os must outlive the AsyncWriter, or the call to close.
+    void write(std::ostream& os, std::string&& data);
+
+    // Wait until all queued data is written, and flush the streams.
+    void sync();
+
+    // Write all queued data, flush the streams, and stop the writer thread.
+    void close();
+
+  private:
+
+    struct Block {
+      Block() : os(nullptr) {}
+      std::ostream * os;
+      std::string data;
+    };
+
+    void write_loop();
+
+    SPSCQueue<Block> queue_;
+    std::thread thread_;
+    bool is_open_;
+    size_t num_syncs_;
+    std::atomic<size_t> num_synced_;
+
+  };
+
+}
+
+#endif
@@ -0,0 +1,207 @@
+#include <cstdio>
+#include <fstream>
+#include <sstream>
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "checkpoint.h"
+
+namespace lmm_utils {
+
+  namespace {
+
+    const char * CHECKPOINT_MAGIC = "maligner_checkpoint\t1";
+
+    // Flush the data of a file to disk. Returns false on error.
+    bool fsync_file(const std::string& name) {
+      if(name == "-") {
+        return fsync(STDOUT_FILENO) == 0;
+      }
+      const int fd = open(name.c_str(), O_RDONLY);
+      if(fd < 0) return false;
+      const bool ok = fsync(fd) == 0;
+      close(fd);
+      return ok;
+    }
+
+    // The size of a file, or of stdout. Returns false if it is not a regular file.
+    bool file_size(const std::string& name, uint64_t& size) {
+      struct stat st;
+      const int ret = name == "-" ? fstat(STDOUT_FILENO, &st) : stat(name.c_str(), &st);
+      if(ret != 0 || !S_ISREG(st.st_mode)) return false;
+      size = st.st_size;
+      return true;
+    }
+
+    bool truncate_file(const std::string& name, uint64_t size) {
+      if(name == "-") {
+        return ftruncate(STDOUT_FILENO, size) == 0;
+      }
+      return truncate(name.c_str(), size) == 0;
+    }
+
+  }
+
+  Checkpointer::Checkpointer(const std::string& file_name, double interval_seconds) :
+    file_name_(file_name),
+    interval_seconds_(interval_seconds),
+    input_position_(0),
+    num_queries_(0)
+  {
+  }
+
+  void Checkpointer::add_output(const std::string& name) {
+    outputs_.push_back(name);
+  }
+
+  void Checkpointer::set_value(const std::string& key, const std::string& value) {
+    values_[key] = value;
+  }
+
+  const std::string& Checkpointer::get_value(const std::string& key) const {
+    static const std::string empty;
+    auto it = values_.find(key);
+    return it == values_.end() ? empty : it->second;
+  }
+
+  bool Checkpointer::due() const {
+    return timer_.elapsed_seconds() >= interval_seconds_;
+  }
+
+  void Checkpointer::write(uint64_t input_position, uint64_t num_queries) {
+
+    std::ostringstream os;
+    os << CHECKPOINT_MAGIC << "\n"
+       << "input_position\t" << input_position << "\n"
+       << "num_queries\t" << num_queries << "\n";
+
+    for(const auto& kv : values_) {
+      os << "value\t" << kv.first << "\t" << kv.second << "\n";
+    }
+
+    // The outputs are on disk before the checkpoint which refers to them.
+    for(const std::string& name : outputs_) {
+      uint64_t size = 0;
+      if(!file_size(name, size)) {
+        continue;
+      }
+      if(!fsync_file(name)) {
+        throw CheckpointException("Could not sync " + name + " for the checkpoint.");
+      }
+      os << "output\t" << size << "\t" << name << "\n";
+    }
+
+    // Replace the checkpoint file atomically.
+    const std::string tmp_name = file_name_ + ".tmp";
+    {
+      std::ofstream f(tmp_name);
+      f << os.str();
+      f.close();
+      if(!f) {
+        throw CheckpointException("Could not write the checkpoint file " + tmp_name);
+      }
+    }
+
+    if(!fsync_file(tmp_name) || std::rename(tmp_name.c_str(), file_name_.c_str()) != 0) {
+      throw CheckpointException("Could not write the checkpoint file " + file_name_);
+    }
+
+    input_position_ = input_position;
+    num_queries_ = num_queries;
+    timer_.start();
+
+  }
+
+  void Checkpointer::resume() {
+
+    std::ifstream f(file_name_);
+    if(!f) {
+      throw CheckpointException("Could not open the checkpoint file " + file_name_);
+    }
+
+    std::string line;
+    if(!std::getline(f, line) || line != CHECKPOINT_MAGIC) {
+      throw CheckpointException(file_name_ + " is not a checkpoint file.");
+    }
+
+    std::map<std::string, std::string> values;
+    std::map<std::string, uint64_t> output_sizes;
+
+    while(std::getline(f, line)) {
+
+      std::istringstream iss(line);
+      std::string key;
+      std::getline(iss, key, '\t');
+
+      if(key == "input_position") {
+        iss >> input_position_;
+      } else if(key == "num_queries") {
+        iss >> num_queries_;
+      } else if(key == "value") {
+        std::string name, value;
+        std::getline(iss, name, '\t');
+        std::getline(iss, value);
+        values[name] = value;
+      } else if(key == "output") {
+        uint64_t size = 0;
+        std::string name;
+        iss >> size;
+        iss.ignore(1);
+        std::getline(iss, name);
+        output_sizes[name] = size;
+      }
+
+      if(iss.fail()) {
+        throw CheckpointException("Malformed line in checkpoint file " + file_name_ + ": " + line);
+      }
+
+    }
+
+    // The run settings must match.
+    for(const auto& kv : values_) {
+      auto it = values.find(kv.first);
+      if(it == values.end() || it->second != kv.second) {
+        throw CheckpointException("The " + kv.first + " of the checkpoint (" +
+          (it == values.end() ? "" : it->second) + ") differs from this run (" + kv.second + ").");
+      }
+    }
+
+    // Keep the settings of the checkpoint which this run did not set.
+    values_.insert(values.begin(), values.end());
+
+    // Check all outputs before truncating any.
+    for(const std::string& name : outputs_) {
+
+      uint64_t size = 0;
+      const bool is_file = file_size(name, size);
+      auto it = output_sizes.find(name);
+
+      if(it == output_sizes.end()) {
+        if(is_file) {
+          throw CheckpointException("The output " + name + " is not in the checkpoint.");
+        }
+        continue;
+      }
+
+      if(!is_file || size < it->second) {
+        throw CheckpointException("The output " + (name == "-" ? std::string("to stdout") : name) +
+          " is shorter than at the checkpoint." +
+          (name == "-" ? " Append stdout to the earlier output (>>) to resume." : ""));
+      }
+
+    }
+
+    for(const std::string& name : outputs_) {
+      auto it = output_sizes.find(name);
+      if(it != output_sizes.end() && !truncate_file(name, it->second)) {
+        throw CheckpointException("Could not truncate " + name + " to the checkpoint.");
+      }
+    }
+
+    timer_.start();
+
+  }
+
+}
@@ -0,0 +1,94 @@
+#ifndef LMM_CHECKPOINT_H
+#define LMM_CHECKPOINT_H
+
+/**********************************************************
+
+Checkpoints of a long run, so that it can be resumed after it is stopped.
+
+A checkpoint records the position in the query maps file after the last
+query whose output is completely written (see MapReader::tell), and the
+size of each output file at that point. The outputs are fsync'd before
+the checkpoint is written, and the checkpoint file is replaced atomically,
+so the last checkpoint is always consistent with the outputs.
+
+To resume, the outputs are truncated to their sizes at the checkpoint,
+which drops any partial records written after it, and the run continues
+from the recorded position (see MapReader::seek).
+
+The output "-" is stdout. It is checkpointed only if it is a regular file,
+which must be opened for appending (>>) to resume.
+
+Run settings, such as the input file, are stored as key value pairs. A
+resumed run must set the same values, and can get the values it did not set
+(i.e. a random seed) from the checkpoint.
+
+**************************************************************/
+
+#include <cstdint>
+#include <exception>
+#include <map>
+#include <string>
+#include <vector>
+
+#include "timer.h"
+
+namespace lmm_utils {
+
+  class CheckpointException : public std::exception
+  {
+    public:
+
+      CheckpointException(const std::string& msg) :
+        message_(msg) {};
+
+      virtual const char* what() const noexcept
+      {
+        return message_.c_str();
+      }
+
+      std::string message_;
+
+  };
+
+  class Checkpointer {
+
+  public:
+
+    // Write checkpoints to file_name, at most every interval_seconds.
+    Checkpointer(const std::string& file_name, double interval_seconds);
+
+    // Add an output file (or "-" for stdout) to the checkpoints.
+    void add_output(const std::string& name);
+
+    // Set or get a setting of the run.
+    void set_value(const std::string& key, const std::string& value);
+    const std::string& get_value(const std::string& key) const;
+
+    // True if interval_seconds have passed since the last checkpoint.
+    bool due() const;
+
+    // Write a checkpoint. The output streams must be flushed first.
+    void write(uint64_t input_position, uint64_t num_queries);
+
+    // Read the checkpoint and truncate the outputs to their sizes at the checkpoint.
+    // Settings not set by this run are read from the checkpoint. Throws a CheckpointException if the checkpoint can not be resumed.
+    void resume();
+
+    uint64_t input_position() const { return input_position_; }
+    uint64_t num_queries() const { return num_queries_; }
+
+  private:
+
+    std::string file_name_;
+    double interval_seconds_;
+    Timer timer_;
+    std::vector<std::string> outputs_;
+    std::map<std::string, std::string> values_;
+    uint64_t input_position_;
+    uint64_t num_queries_;
+
+  };
+
+}
+
+#endif
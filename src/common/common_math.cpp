@@ -78,3 +78,49 @@ double median_sorted(const std::vector<double>& in) {
 
   return in[size_t(N/2)];
 }
+
+
+// Compute the probability of at most k successes in n trials with success probability p.
+double binomial_cdf(int k, int n, double p) {
+
+  if(k < 0) return 0.0;
+  if(k >= n) return 1.0;
+  if(p <= 0.0) return 1.0;
+  if(p >= 1.0) return 0.0;
+
+  // Sum the terms in log space to avoid underflow for large n.
+  const double log_p = std::log(p);
+  const double log_q = std::log1p(-p);
+  double cdf = 0.0;
+  for(int i = 0; i <= k; i++) {
+    const double log_choose = std::lgamma(n + 1.0) - std::lgamma(i + 1.0) - std::lgamma(n - i + 1.0);
+    cdf += std::exp(log_choose + i*log_p + (n - i)*log_q);
+  }
+
+  return std::min(cdf, 1.0);
+
+}
+
+// Compute the one sided Clopper-Pearson upper bound on the success probability,
+// given k successes in n trials. This is the p for which binomial_cdf(k, n, p)
+// equals 1 - confidence, found by bisection.
+double binomial_upper_bound(int k, int n, double confidence) {
+
+  if(n <= 0 || k >= n) return 1.0;
+
+  const double alpha = 1.0 - confidence;
+  double lo = 0.0;
+  double hi = 1.0;
+
+  for(int iter = 0; iter < 64; iter++) {
+    const double mid = 0.5*(lo + hi);
+    if(binomial_cdf(k, n, mid) > alpha) {
+      lo = mid;
+    } else {
+      hi = mid;
+    }
+  }
+
+  return hi;
+
+}
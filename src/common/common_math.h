@@ -7,4 +7,11 @@ double mad(const std::vector<double>& in, double m); // For when median m alread
 double median(const std::vector<double>&in);
 double median_sorted(const std::vector<double>&in);
 
+// Probability of at most k successes in n trials with success probability p.
+double binomial_cdf(int k, int n, double p);
+
+// One sided upper confidence bound (Clopper-Pearson) on the success probability,
+// given k successes in n trials.
+double binomial_upper_bound(int k, int n, double confidence);
+
 #endif
\ No newline at end of file
@@ -0,0 +1,533 @@
+#include <cstring>
+#include <vector>
+
+#ifdef MALIGNER_HAVE_ZLIB
+#include <zlib.h>
+#endif
+
+#ifdef MALIGNER_HAVE_ZSTD
+#include <zstd.h>
+#endif
+
+#include "compressed_stream.h"
+
+namespace lmm_utils {
+
+  namespace {
+
+    const size_t IN_BLOCK_SIZE = 1 << 16;
+    const size_t OUT_BLOCK_SIZE = 1 << 18;
+
+    const char * compression_name(Compression compression) {
+      switch(compression) {
+        case Compression::GZIP: return "gzip";
+        case Compression::ZSTD: return "zstd";
+        default: return "uncompressed";
+      }
+    }
+
+    bool ends_with(const std::string& s, const std::string& suffix) {
+      return s.size() >= suffix.size() &&
+        s.compare(s.size() - suffix.size(), suffix.size(), suffix) == 0;
+    }
+
+    void check_supported(const std::string& file_name, Compression compression) {
+      if(!compression_supported(compression)) {
+        throw CompressionException(std::string("Can not read or write ") + compression_name(compression) +
+          " file " + file_name + ": maligner was built without " + compression_name(compression) + " support.");
+      }
+    }
+
+  }
+
+  Compression detect_compression(const char * data, size_t size) {
+
+    const unsigned char * d = reinterpret_cast<const unsigned char *>(data);
+
+    if(size >= 2 && d[0] == 0x1f && d[1] == 0x8b) {
+      return Compression::GZIP;
+    }
+
+    if(size >= 4 && d[0] == 0x28 && d[1] == 0xb5 && d[2] == 0x2f && d[3] == 0xfd) {
+      return Compression::ZSTD;
+    }
+
+    return Compression::NONE;
+
+  }
+
+  Compression file_compression(const std::string& file_name) {
+    std::ifstream f(file_name, std::ios::binary);
+    char magic[4];
+    f.read(magic, sizeof(magic));
+    return detect_compression(magic, f.gcount());
+  }
+
+  Compression compression_for_name(const std::string& file_name) {
+    if(ends_with(file_name, ".gz")) return Compression::GZIP;
+    if(ends_with(file_name, ".zst")) return Compression::ZSTD;
+    return Compression::NONE;
+  }
+
+  bool compression_supported(Compression compression) {
+    switch(compression) {
+      case Compression::NONE: return true;
+#ifdef MALIGNER_HAVE_ZLIB
+      case Compression::GZIP: return true;
+#endif
+#ifdef MALIGNER_HAVE_ZSTD
+      case Compression::ZSTD: return true;
+#endif
+      default: return false;
+    }
+  }
+
+
+  ////////////////////////////////////////////////////////////
+  // DecompressingBuf
+
+  DecompressingBuf::DecompressingBuf(const std::string& file_name, Compression compression, size_t max_blocks) :
+    file_name_(file_name),
+    compression_(compression),
+    queue_(max_blocks),
+    stop_(false)
+  {
+    check_supported(file_name, compression);
+    setg(nullptr, nullptr, nullptr);
+    thread_ = std::thread(&DecompressingBuf::decompress_loop, this);
+  }
+
+  DecompressingBuf::~DecompressingBuf() {
+    stop_.store(true);
+    thread_.join();
+  }
+
+  DecompressingBuf::int_type DecompressingBuf::underflow() {
+
+    if(gptr() < egptr()) {
+      return traits_type::to_int_type(*gptr());
+    }
+
+    if(!queue_.pop(block_)) {
+      // The helper thread writes error_ before closing the queue.
+      if(!error_.empty()) {
+        throw CompressionException(error_);
+      }
+      return traits_type::eof();
+    }
+
+    char * data = &block_[0];
+    setg(data, data, data + block_.size());
+    return traits_type::to_int_type(*gptr());
+
+  }
+
+  bool DecompressingBuf::push_block(std::string& block) {
+    if(block.empty()) {
+      return true;
+    }
+    const bool pushed = queue_.push(block, stop_);
+    block.clear();
+    return pushed;
+  }
+
+  void DecompressingBuf::decompress_loop() {
+
+    std::ifstream f(file_name_, std::ios::binary);
+
+    if(!f) {
+      error_ = "Could not open " + file_name_;
+    } else if(compression_ == Compression::GZIP) {
+      inflate_gzip(f);
+    } else if(compression_ == Compression::ZSTD) {
+      decompress_zstd(f);
+    }
+
+    queue_.close();
+
+  }
+
+  void DecompressingBuf::inflate_gzip(std::ifstream& f) {
+
+#ifdef MALIGNER_HAVE_ZLIB
+
+    std::vector<char> in(IN_BLOCK_SIZE);
+    std::string out;
+
+    z_stream zs;
+    std::memset(&zs, 0, sizeof(zs));
+
+    // Decode the gzip header.
+    if(inflateInit2(&zs, 15 + 16) != Z_OK) {
+      error_ = "Could not initialize zlib for " + file_name_;
+      return;
+    }
+
+    bool at_member_end = false;
+    bool out_full = false;
+
+    while(!stop_.load(std::memory_order_relaxed)) {
+
+      // Read more input once the output of the input so far has been taken.
+      if(zs.avail_in == 0 && !out_full) {
+        f.read(in.data(), in.size());
+        zs.next_in = reinterpret_cast<Bytef*>(in.data());
+        zs.avail_in = f.gcount();
+        if(zs.avail_in == 0) break;
+      }
+
+      // A gzip file may hold several members, which are decompressed in turn.
+      if(at_member_end) {
+        inflateReset(&zs);
+        at_member_end = false;
+      }
+
+      out.resize(OUT_BLOCK_SIZE);
+      zs.next_out = reinterpret_cast<Bytef*>(&out[0]);
+      zs.avail_out = out.size();
+
+      const int ret = inflate(&zs, Z_NO_FLUSH);
+
+      if(ret != Z_OK && ret != Z_STREAM_END && ret != Z_BUF_ERROR) {
+        error_ = "Error decompressing " + file_name_ + ": " + (zs.msg ? zs.msg : "invalid gzip data");
+        break;
+      }
+
+      out_full = zs.avail_out == 0 && ret != Z_STREAM_END;
+      out.resize(OUT_BLOCK_SIZE - zs.avail_out);
+      at_member_end = ret == Z_STREAM_END;
+
+      if(!push_block(out)) break;
+
+    }
+
+    if(error_.empty() && !at_member_end && !stop_.load()) {
+      error_ = "Error decompressing " + file_name_ + ": unexpected end of file";
+    }
+
+    inflateEnd(&zs);
+
+#else
+
+    (void)f;
+
+#endif
+
+  }
+
+  void DecompressingBuf::decompress_zstd(std::ifstream& f) {
+
+#ifdef MALIGNER_HAVE_ZSTD
+
+    std::vector<char> in(ZSTD_DStreamInSize());
+    const size_t out_size = ZSTD_DStreamOutSize() > OUT_BLOCK_SIZE ? ZSTD_DStreamOutSize() : OUT_BLOCK_SIZE;
+    std::string out;
+
+    ZSTD_DStream * zs = ZSTD_createDStream();
+    ZSTD_initDStream(zs);
+
+    ZSTD_inBuffer input = { in.data(), 0, 0 };
+    size_t ret = 0;
+    bool out_full = false;
+
+    while(!stop_.load(std::memory_order_relaxed)) {
+
+      // Read more input once the output of the input so far has been taken.
+      if(input.pos == input.size && !out_full) {
+        f.read(in.data(), in.size());
+        input.size = f.gcount();
+        input.pos = 0;
+        if(input.size == 0) break;
+      }
+
+      out.resize(out_size);
+      ZSTD_outBuffer output = { &out[0], out.size(), 0 };
+
+      // Consecutive frames are decompressed in turn. ret is 0 at the end of a frame.
+      ret = ZSTD_decompressStream(zs, &output, &input);
+
+      if(ZSTD_isError(ret)) {
+        error_ = "Error decompressing " + file_name_ + ": " + ZSTD_getErrorName(ret);
+        break;
+      }
+
+      out_full = output.pos == output.size;
+      out.resize(output.pos);
+
+      if(!push_block(out)) break;
+
+    }
+
+    if(error_.empty() && ret != 0 && !stop_.load()) {
+      error_ = "Error decompressing " + file_name_ + ": unexpected end of file";
+    }
+
+    ZSTD_freeDStream(zs);
+
+#else
+
+    (void)f;
+
+#endif
+
+  }
+
+
+  ////////////////////////////////////////////////////////////
+  // CompressingBuf
+
+  struct CompressingBuf::Impl {
+
+    Impl(Compression c) : compression(c) {}
+
+    Compression compression;
+    std::vector<char> out;
+
+#ifdef MALIGNER_HAVE_ZLIB
+    z_stream zs;
+#endif
+
+#ifdef MALIGNER_HAVE_ZSTD
+    ZSTD_CStream * cs;
+#endif
+
+  };
+
+  CompressingBuf::CompressingBuf(const std::string& file_name, Compression compression, int level) :
+    impl_(new Impl(compression)),
+    f_(file_name, std::ios::binary),
+    ok_(true)
+  {
+
+    check_supported(file_name, compression);
+
+    if(!f_) {
+      throw CompressionException("Could not open " + file_name);
+    }
+
+    buf_.resize(IN_BLOCK_SIZE);
+    setp(&buf_[0], &buf_[0] + buf_.size());
+
+#ifdef MALIGNER_HAVE_ZLIB
+    if(compression == Compression::GZIP) {
+      impl_->out.resize(OUT_BLOCK_SIZE);
+      std::memset(&impl_->zs, 0, sizeof(impl_->zs));
+      // Write a gzip header.
+      if(deflateInit2(&impl_->zs, level < 0 ? Z_DEFAULT_COMPRESSION : level, Z_DEFLATED,
+          15 + 16, 8, Z_DEFAULT_STRATEGY) != Z_OK) {
+        throw CompressionException("Could not initialize zlib for " + file_name);
+      }
+    }
+#endif
+
+#ifdef MALIGNER_HAVE_ZSTD
+    if(compression == Compression::ZSTD) {
+      impl_->out.resize(ZSTD_CStreamOutSize());
+      impl_->cs = ZSTD_createCStream();
+      ZSTD_initCStream(impl_->cs, level < 0 ? 3 : level);
+    }
+#endif
+
+#if !defined(MALIGNER_HAVE_ZLIB) && !defined(MALIGNER_HAVE_ZSTD)
+    (void)level;
+#endif
+
+  }
+
+  CompressingBuf::~CompressingBuf() {
+    close();
+  }
+
+  CompressingBuf::int_type CompressingBuf::overflow(int_type c) {
+
+    if(!compress(false)) {
+      return traits_type::eof();
+    }
+
+    if(!traits_type::eq_int_type(c, traits_type::eof())) {
+      *pptr() = traits_type::to_char_type(c);
+      pbump(1);
+    }
+
+    return traits_type::not_eof(c);
+
+  }
+
+  int CompressingBuf::sync() {
+    return compress(true) ? 0 : -1;
+  }
+
+  bool CompressingBuf::compress(bool flush) {
+
+    if(!impl_) {
+      return false;
+    }
+
+    char * const data = pbase();
+    const size_t size = pptr() - pbase();
+
+#ifdef MALIGNER_HAVE_ZLIB
+    if(impl_->compression == Compression::GZIP) {
+
+      z_stream& zs = impl_->zs;
+      zs.next_in = reinterpret_cast<Bytef*>(data);
+      zs.avail_in = size;
+
+      int ret;
+      do {
+        zs.next_out = reinterpret_cast<Bytef*>(impl_->out.data());
+        zs.avail_out = impl_->out.size();
+        ret = deflate(&zs, flush ? Z_SYNC_FLUSH : Z_NO_FLUSH);
+        f_.write(impl_->out.data(), impl_->out.size() - zs.avail_out);
+      } while(zs.avail_out == 0 && ret == Z_OK);
+
+      ok_ = ok_ && ret != Z_STREAM_ERROR;
+
+    }
+#endif
+
+#ifdef MALIGNER_HAVE_ZSTD
+    if(impl_->compression == Compression::ZSTD) {
+
+      ZSTD_inBuffer input = { data, size, 0 };
+
+      while(input.pos < input.size) {
+        ZSTD_outBuffer output = { impl_->out.data(), impl_->out.size(), 0 };
+        const size_t ret = ZSTD_compressStream(impl_->cs, &output, &input);
+        if(ZSTD_isError(ret)) { ok_ = false; break; }
+        f_.write(impl_->out.data(), output.pos);
+      }
+
+      size_t remaining = flush ? 1 : 0;
+      while(ok_ && remaining) {
+        ZSTD_outBuffer output = { impl_->out.data(), impl_->out.size(), 0 };
+        remaining = ZSTD_flushStream(impl_->cs, &output);
+        if(ZSTD_isError(remaining)) { ok_ = false; break; }
+        f_.write(impl_->out.data(), output.pos);
+      }
+
+    }
+#endif
+
+#if !defined(MALIGNER_HAVE_ZLIB) && !defined(MALIGNER_HAVE_ZSTD)
+    (void)data;
+    (void)size;
+#endif
+
+    setp(&buf_[0], &buf_[0] + buf_.size());
+
+    if(flush) {
+      f_.flush();
+    }
+
+    ok_ = ok_ && f_.good();
+    return ok_;
+
+  }
+
+  bool CompressingBuf::close() {
+
+    if(!impl_) {
+      return ok_;
+    }
+
+    compress(false);
+
+#ifdef MALIGNER_HAVE_ZLIB
+    if(impl_->compression == Compression::GZIP) {
+      z_stream& zs = impl_->zs;
+      zs.avail_in = 0;
+      int ret;
+      do {
+        zs.next_out = reinterpret_cast<Bytef*>(impl_->out.data());
+        zs.avail_out = impl_->out.size();
+        ret = deflate(&zs, Z_FINISH);
+        f_.write(impl_->out.data(), impl_->out.size() - zs.avail_out);
+      } while(ret == Z_OK);
+      ok_ = ok_ && ret == Z_STREAM_END;
+      deflateEnd(&zs);
+    }
+#endif
+
+#ifdef MALIGNER_HAVE_ZSTD
+    if(impl_->compression == Compression::ZSTD) {
+      size_t remaining = 1;
+      while(remaining) {
+        ZSTD_outBuffer output = { impl_->out.data(), impl_->out.size(), 0 };
+        remaining = ZSTD_endStream(impl_->cs, &output);
+        if(ZSTD_isError(remaining)) { ok_ = false; break; }
+        f_.write(impl_->out.data(), output.pos);
+      }
+      ZSTD_freeCStream(impl_->cs);
+    }
+#endif
+
+    impl_.reset();
+    setp(nullptr, nullptr);
+
+    f_.close();
+    ok_ = ok_ && !f_.fail();
+    return ok_;
+
+  }
+
+
+  ////////////////////////////////////////////////////////////
+  // Streams
+
+  DecompressingIStream::DecompressingIStream(const std::string& file_name, Compression compression) :
+    std::istream(nullptr),
+    buf_(file_name, compression)
+  {
+    rdbuf(&buf_);
+    // Rethrow a decompression error from the reader, instead of ending the stream early.
+    exceptions(std::ios::badbit);
+  }
+
+  CompressingOStream::CompressingOStream(const std::string& file_name, Compression compression, int level) :
+    std::ostream(nullptr),
+    buf_(file_name, compression, level)
+  {
+    rdbuf(&buf_);
+  }
+
+  void CompressingOStream::close() {
+    if(!buf_.close()) {
+      setstate(std::ios::badbit);
+    }
+  }
+
+  std::unique_ptr<std::istream> open_input_file(const std::string& file_name) {
+
+    const Compression compression = file_compression(file_name);
+
+    if(compression == Compression::NONE) {
+      return std::unique_ptr<std::istream>(new std::ifstream(file_name));
+    }
+
+    return std::unique_ptr<std::istream>(new DecompressingIStream(file_name, compression));
+
+  }
+
+  std::unique_ptr<std::ostream> open_output_file(const std::string& file_name, bool append) {
+
+    const Compression compression = compression_for_name(file_name);
+
+    if(compression == Compression::NONE) {
+      std::unique_ptr<std::ofstream> f(new std::ofstream(file_name,
+        append ? std::ios::app : std::ios::out));
+      if(!f->is_open()) {
+        throw CompressionException("Could not open " + file_name);
+      }
+      return std::unique_ptr<std::ostream>(std::move(f));
+    }
+
+    if(append) {
+      throw CompressionException("Can not append to the compressed file " + file_name);
+    }
+
+    return std::unique_ptr<std::ostream>(new CompressingOStream(file_name, compression));
+
+  }
+
+}
@@ -0,0 +1,160 @@
+#ifndef LMM_COMPRESSED_STREAM_H
+#define LMM_COMPRESSED_STREAM_H
+
+/**********************************************************
+
+Streams for reading and writing gzip and zstd compressed text files.
+
+An input file is detected as compressed by its magic bytes. It is read and
+decompressed on a helper thread, which passes blocks of decompressed data
+to the reading thread through an SPSCQueue, so decompression overlaps with
+the parsing and aligning of the maps already read.
+
+An output file is compressed if its name ends in .gz or .zst. Data is
+compressed as it is written, on the writing thread (i.e. an AsyncWriter).
+
+Support for each format depends on the libraries found when maligner is
+built (MALIGNER_HAVE_ZLIB and MALIGNER_HAVE_ZSTD). Opening a file in a
+format that is not supported throws a CompressionException.
+
+**************************************************************/
+
+#include <atomic>
+#include <exception>
+#include <fstream>
+#include <istream>
+#include <memory>
+#include <ostream>
+#include <streambuf>
+#include <string>
+#include <thread>
+
+#include "spsc_queue.h"
+
+namespace lmm_utils {
+
+  enum class Compression { NONE, GZIP, ZSTD };
+
+  class CompressionException : public std::exception
+  {
+    public:
+
+      CompressionException(const std::string& msg) :
+        message_(msg) {};
+
+      virtual const char* what() const noexcept
+      {
+        return message_.c_str();
+      }
+
+      std::string message_;
+
+  };
+
+  // Detect the compression from the magic bytes at the start of a file.
+  Compression detect_compression(const char * data, size_t size);
+  Compression file_compression(const std::string& file_name);
+
+  // The compression for an output file, from the extension of its name.
+  Compression compression_for_name(const std::string& file_name);
+
+  bool compression_supported(Compression compression);
+
+
+  class DecompressingBuf : public std::streambuf {
+
+  public:
+
+    DecompressingBuf(const std::string& file_name, Compression compression, size_t max_blocks = 8);
+    ~DecompressingBuf();
+
+    DecompressingBuf(const DecompressingBuf&) = delete;
+    DecompressingBuf& operator=(const DecompressingBuf&) = delete;
+
+  protected:
+
+    int_type underflow();
+
+  private:
+
+    void decompress_loop();
+    void inflate_gzip(std::ifstream& f);
+    void decompress_zstd(std::ifstream& f);
+
+    // Pass a block of decompressed data to the reader. Returns false if stopped.
+    bool push_block(std::string& block);
+
+    const std::string file_name_;
+    const Compression compression_;
+    SPSCQueue<std::string> queue_;
+    std::string block_;
+    std::string error_;
+    std::atomic<bool> stop_;
+    std::thread thread_;
+
+  };
+
+
+  class CompressingBuf : public std::streambuf {
+
+  public:
+
+    CompressingBuf(const std::string& file_name, Compression compression, int level);
+    ~CompressingBuf();
+
+    CompressingBuf(const CompressingBuf&) = delete;
+    CompressingBuf& operator=(const CompressingBuf&) = delete;
+
+    // Compress the buffered data, end the compressed stream and close the file.
+    // Returns false on error.
+    bool close();
+
+  protected:
+
+    int_type overflow(int_type c);
+    int sync();
+
+  private:
+
+    struct Impl;
+
+    // Compress the buffered data. If flush, also write all pending output.
+    bool compress(bool flush);
+
+    std::unique_ptr<Impl> impl_;
+    std::string buf_;
+    std::ofstream f_;
+    bool ok_;
+
+  };
+
+
+  // An istream of a compressed file.
+  class DecompressingIStream : public std::istream {
+  public:
+    DecompressingIStream(const std::string& file_name, Compression compression);
+  private:
+    DecompressingBuf buf_;
+  };
+
+  // An ostream to a compressed file.
+  class CompressingOStream : public std::ostream {
+  public:
+    CompressingOStream(const std::string& file_name, Compression compression, int level = -1);
+    void close();
+  private:
+    CompressingBuf buf_;
+  };
+
+  // Open a file for reading, decompressing it if it is compressed.
+  std::unique_ptr<std::istream> open_input_file(const std::string& file_name);
+
+  // Open a file for writing, compressing it if its name ends in .gz or .zst.
+  // The stream is closed (and a compressed stream ended) when it is destroyed.
+  // An uncompressed file may be opened for appending. Throws a CompressionException
+  // if the file can not be opened.
+  std::unique_ptr<std::ostream> open_output_file(const std::string& file_name, bool append = false);
+
+}
+
+#endif
@@ -3,6 +3,8 @@
 #include <fstream>
 #include <iterator>
 #include <exception>
+#include <algorithm>
+#include <limits>
 
 #include "map.h"
 #include "map_reader.h"
@@ -22,46 +24,118 @@ namespace maligner_maps {
     }
 
 
-  /////////////////////////////////////////////////////
-  // Construct a map from a line.
-  Map::Map(const std::string& line) {
+  namespace {
 
-    istringstream iss(line);
-    
-    iss >> name_;
+    // The characters skipped by operator>>.
+    inline bool is_space(char c) {
+      return c == ' ' || c == '\t' || c == '\n' || c == '\r' || c == '\v' || c == '\f';
+    }
 
-    if (iss.fail()) throw ReadMapException(line);
+    inline const char* skip_space(const char* p, const char* end) {
+      while(p != end && is_space(*p)) p++;
+      return p;
+    }
 
-    iss >> size_;
+    // Parse an optionally signed decimal integer starting at p, as operator>> does.
+    // On return, p points past the characters consumed, which may be a lone sign or
+    // the digits of an out of range number when the parse fails.
+    // Returns false if there are no digits or if the value does not fit in [min_value, max_value].
+    inline bool parse_integer(const char*& p, const char* end, long long min_value,
+      long long max_value, long long& value) {
+
+      bool negative = false;
+      if(p != end && (*p == '-' || *p == '+')) {
+        negative = (*p == '-');
+        p++;
+      }
 
-    if (iss.fail()) throw ReadMapException(line);
+      const char* digits_start = p;
+      unsigned long long v = 0;
+      bool overflow = false;
 
-    unsigned int num_frags;
-    iss >> num_frags;
+      for(; p != end && *p >= '0' && *p <= '9'; p++) {
+        if(v > 1000000000000ULL) {
+          overflow = true; // Keep consuming the digits, as operator>> does.
+        } else {
+          v = 10*v + (*p - '0');
+        }
+      }
 
-    if (iss.fail()) throw ReadMapException(line);
+      if(p == digits_start || overflow) return false;
 
-    frags_.clear();
-    frags_.reserve(num_frags);
+      value = negative ? -(long long)(v) : (long long)(v);
+      return value >= min_value && value <= max_value;
 
-    int frag_size;
+    }
 
-    while(iss) {
+    // Parse an unsigned int as operator>> does: a negative value is negated in
+    // unsigned arithmetic, and a magnitude out of range is an error.
+    inline bool parse_unsigned(const char*& p, const char* end, unsigned int& value) {
+      const long long max_value = std::numeric_limits<unsigned int>::max();
+      long long v = 0;
+      if(!parse_integer(p, end, -max_value, max_value, v)) return false;
+      value = (unsigned int)(v);
+      return true;
+    }
 
-      // The next operation may fail if we reach the end of the file
-      iss >> frag_size;
-      if(!iss.fail()) {
-        frags_.push_back(frag_size);
+  }
+
+  /////////////////////////////////////////////////////
+  // Parse a line of a maps file, with the same rules as reading the
+  // name, size, number of fragments and the fragments with operator>>.
+  bool parse_map(const char* begin, const char* end, Map& map) {
+
+    const char* p = skip_space(begin, end);
+
+    // Name
+    const char* name_start = p;
+    while(p != end && !is_space(*p)) p++;
+    if(p == name_start) return false;
+    map.name_.assign(name_start, p);
+
+    // Size
+    p = skip_space(p, end);
+    if(!parse_unsigned(p, end, map.size_)) return false;
+
+    // Number of fragments
+    unsigned int num_frags;
+    p = skip_space(p, end);
+    if(!parse_unsigned(p, end, num_frags)) return false;
+
+    // Each fragment takes at least one character and a separator, so only
+    // reserve what the rest of the line can hold.
+    map.frags_.clear();
+    map.frags_.reserve(std::min(size_t(num_frags), size_t(end - p)/2 + 1));
+
+    // Fragments. A failed read which reaches the end of the line ends the fragments,
+    // as a failed read at eof does for operator>>. Any other failed read is an error.
+    const long long min_frag = std::numeric_limits<int>::min();
+    const long long max_frag = std::numeric_limits<int>::max();
+    while(true) {
+
+      p = skip_space(p, end);
+      if(p == end) break;
+
+      long long frag_size = 0;
+      if(!parse_integer(p, end, min_frag, max_frag, frag_size)) {
+        if(p == end) break;
+        return false;
       }
-    }
 
-    // Check if we failed for some reason other than eof.
-    if (iss.fail() && !iss.eof()) {
-      throw ReadMapException(line);
+      map.frags_.push_back(int(frag_size));
+
     }
 
     // Check that the number of fragments read matches num_frags:
-    if (num_frags != frags_.size()) {
+    return num_frags == map.frags_.size();
+
+  }
+
+  /////////////////////////////////////////////////////
+  // Construct a map from a line.
+  Map::Map(const std::string& line) {
+
+    if(!parse_map(line.data(), line.data() + line.size(), *this)) {
       throw ReadMapException(line);
     }
 
@@ -91,4 +165,22 @@ namespace maligner_maps {
     return os;
 
   }
+
+  ///////////////////////////////////////////////////////
+  // Write a map as a line of a maps file: name, size, number of fragments,
+  // and the fragments, separated by tabs.
+  void write_map(std::ostream& os, const Map& m) {
+
+    os << m.name_ << "\t"
+       << m.size_ << "\t"
+       << m.frags_.size();
+
+    for(auto frag : m.frags_) {
+      os << "\t" << frag;
+    }
+
+    os << "\n";
+
+  }
+
 }
@@ -62,6 +62,14 @@ namespace maligner_maps {
 
   std::ostream& operator<<(std::ostream& os, const Map& m);
 
+  // Write a map as a line of a maps file.
+  void write_map(std::ostream& os, const Map& m);
+
+  // Parse the line [begin, end) of a maps file into map, reusing the storage of map.
+  // Returns false if the line is malformed, in which case map is left partially filled.
+  // This accepts exactly the lines accepted by Map(const std::string& line).
+  bool parse_map(const char* begin, const char* end, Map& map);
+
   // MapVec read_maps(const std::string& file_name);
 
 }
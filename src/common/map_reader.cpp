@@ -1,29 +1,169 @@
 #include <iostream>
+#include <fstream>
+#include <cstring>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
 #include "map_reader.h"
+#include "compressed_stream.h"
 
 using namespace std;
 
 namespace maligner_maps {
 
+  MapReader::MapReader(const std::string& file_name, size_t shard_index, size_t num_shards) :
+    data_(nullptr),
+    size_(0),
+    pos_(nullptr),
+    shard_begin_(nullptr),
+    shard_end_(nullptr),
+    shard_index_(shard_index),
+    num_shards_(num_shards),
+    line_index_(0) {
+
+    lmm_utils::Compression compression = lmm_utils::Compression::NONE;
+
+    const int fd = open(file_name.c_str(), O_RDONLY);
+
+    if(fd >= 0) {
+
+      struct stat st;
+      if(fstat(fd, &st) == 0 && S_ISREG(st.st_mode) && st.st_size > 0) {
+
+        void* data = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+
+        if(data != MAP_FAILED) {
+
+          compression = lmm_utils::detect_compression(static_cast<const char*>(data), st.st_size);
+
+          if(compression == lmm_utils::Compression::NONE) {
+            madvise(data, st.st_size, MADV_SEQUENTIAL);
+            data_ = static_cast<const char*>(data);
+            size_ = st.st_size;
+            set_shard_range();
+          } else {
+            munmap(data, st.st_size);
+          }
+
+        }
+
+      }
+
+      close(fd);
+
+    }
+
+    if(compression != lmm_utils::Compression::NONE) {
+      is_.reset(new lmm_utils::DecompressingIStream(file_name, compression));
+    } else if(!data_) {
+      is_.reset(new std::ifstream(file_name));
+    }
+
+  }
+
+  MapReader::~MapReader() {
+
+    if(data_) {
+      munmap(const_cast<char*>(data_), size_);
+    }
+
+  }
+
+  void MapReader::set_shard_range() {
+
+    const size_t begin = size_ * shard_index_ / num_shards_;
+    const size_t end = size_ * (shard_index_ + 1) / num_shards_;
+    const char* const data_end = data_ + size_;
+
+    // Start at the first line that starts at or after begin.
+    pos_ = data_ + begin;
+    if(begin > 0 && pos_[-1] != '\n') {
+      const char* line_end = static_cast<const char*>(memchr(pos_, '\n', data_end - pos_));
+      pos_ = line_end ? line_end + 1 : data_end;
+    }
+
+    shard_begin_ = pos_;
+    shard_end_ = data_ + end;
+
+  }
+
   bool MapReader::next(Map& map) {
+    return data_ ? next_mapped(map) : next_line(map);
+  }
+
+  bool MapReader::next_mapped(Map& map) {
 
-    std::string line;
+    const char* const end = data_ + size_;
 
-    while(std::getline(f_, line)) {
+    // The last line of the shard may end past shard_end_.
+    while(pos_ < shard_end_) {
 
-      try {
-          map = std::move(Map(line));
-          return true;
-      } catch(ReadMapException& e) {
-          cerr << e.what() << "\n";
+      const char* line_start = pos_;
+      const char* line_end = static_cast<const char*>(memchr(pos_, '\n', end - pos_));
+
+      if(line_end) {
+        pos_ = line_end + 1;
+      } else {
+        line_end = end;
+        pos_ = end;
+      }
+
+      if(parse_map(line_start, line_end, map)) {
+        return true;
       }
 
+      cerr << ReadMapException(std::string(line_start, line_end)).what() << "\n";
+
     }
 
     return false;
 
   }
 
+  bool MapReader::next_line(Map& map) {
+
+    while(std::getline(*is_, line_)) {
+
+      if(line_index_++ % num_shards_ != shard_index_) {
+        continue;
+      }
+
+      if(parse_map(line_.data(), line_.data() + line_.size(), map)) {
+        return true;
+      }
+
+      cerr << ReadMapException(line_).what() << "\n";
+
+    }
+
+    return false;
+
+  }
+
+  uint64_t MapReader::tell() const {
+    return data_ ? pos_ - data_ : line_index_;
+  }
+
+  void MapReader::seek(uint64_t position) {
+
+    if(data_) {
+      pos_ = data_ + (position < size_ ? position : size_);
+      if(pos_ < shard_begin_) {
+        pos_ = shard_begin_;
+      }
+      return;
+    }
+
+    // Streams can only be read forward.
+    while(line_index_ < position && std::getline(*is_, line_)) {
+      line_index_++;
+    }
+
+  }
+
   MapVec MapReader::read_all_maps() {
     MapVec maps;
     Map map;
@@ -38,4 +178,4 @@ namespace maligner_maps {
     return reader.read_all_maps();
   }
 
-}
\ No newline at end of file
+}
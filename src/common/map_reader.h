@@ -1,7 +1,9 @@
 #ifndef MAPREADER_H
 #define MAPREADER_H
 
-#include <fstream>
+#include <cstdint>
+#include <istream>
+#include <memory>
 #include "map.h"
 
 namespace maligner_maps {
@@ -24,15 +26,55 @@ namespace maligner_maps {
   };
 
 
+  // Read the maps of a maps file, one line at a time.
+  //
+  // A regular file is memory mapped and parsed in place, so reading a map does not
+  // allocate once the storage of the map passed to next has grown to fit.
+  // Other files (e.g. pipes) are read with getline, and gzip or zstd compressed
+  // files are decompressed on a helper thread and read with getline.
+  // Malformed lines are reported on stderr and skipped.
+  //
+  // A reader may read only one of num_shards shards of the file, so that a run can be
+  // split across nodes without splitting the file. The shards of a memory mapped file
+  // are equal byte ranges: a shard reads the lines that start in its range, so the
+  // shards in order hold the maps in file order. The shards of other files are the
+  // lines with line index % num_shards == shard_index.
   class MapReader {
   public:
-    MapReader(const std::string& file_name) : f_(file_name) {};
-    ~MapReader() { f_.close(); }
+    MapReader(const std::string& file_name, size_t shard_index = 0, size_t num_shards = 1);
+    ~MapReader();
+
+    MapReader(const MapReader&) = delete;
+    MapReader& operator=(const MapReader&) = delete;
+
     bool next(Map& map);
     MapVec read_all_maps();
 
+    // The position of the next line: its byte offset in a memory mapped file,
+    // or its line index in other files. seek returns to a position from tell.
+    // Positions before the start of the shard (e.g. 0) seek to the start of the shard.
+    uint64_t tell() const;
+    void seek(uint64_t position);
+
   private:
-    std::ifstream f_;
+
+    bool next_mapped(Map& map);
+    bool next_line(Map& map);
+    void set_shard_range();
+
+    // Memory mapped file
+    const char* data_;
+    size_t size_;
+    const char* pos_;
+    const char* shard_begin_;
+    const char* shard_end_;
+
+    // Fall back for files which can not be memory mapped, or are compressed.
+    std::unique_ptr<std::istream> is_;
+    std::string line_;
+    size_t shard_index_;
+    size_t num_shards_;
+    size_t line_index_;
 
   };
 
@@ -25,13 +25,11 @@ std::vector<T> sample_with_replacement(const std::vector<T>& frags, const size_t
     return ret;
 }
 
-// Return a permuted copy of frags
-template< class T>
-std::vector<T> permute(const std::vector<T>& frags) {
+// Return a permuted copy of frags, drawing from the random number generator gen.
+template< class T, class Generator>
+std::vector<T> permute(const std::vector<T>& frags, Generator& gen) {
 
     std::vector<T> ret(frags);
-    std::random_device rd;
-    std::mt19937 gen(rd());
 
     const size_t n = ret.size();
     for(size_t i = 0; i < n; i++) {
@@ -42,4 +40,13 @@ std::vector<T> permute(const std::vector<T>& frags) {
 }
 
 
+// Return a permuted copy of frags
+template< class T>
+std::vector<T> permute(const std::vector<T>& frags) {
+    std::random_device rd;
+    std::mt19937 gen(rd());
+    return permute(frags, gen);
+}
+
+
 #endif
\ No newline at end of file
@@ -5,6 +5,7 @@
 #include <numeric>
 #include <iostream>
 #include <string>
+#include <utility>
 
 #include "map.h"
 #include "map_data.h"
@@ -85,6 +86,16 @@ namespace maligner_maps {
 
     }
 
+    // Construct from the parts of a wrapper which was built before (i.e. read from a
+    // reference index). The map is used as is, and is not circularized again.
+    MapWrapper(Map map, const MapData& map_data, FragVec frags_reverse, IntVec ix_to_locs) :
+      map_(std::move(map)),
+      map_data_(map_data),
+      frags_reverse_(std::move(frags_reverse)),
+      ix_to_locs_(std::move(ix_to_locs)),
+      bit_cover_(map_.frags_.size()) {
+    }
+
     MapWrapper(const MapWrapper& o) = default;
     MapWrapper& operator=(const MapWrapper& o) = default;
 
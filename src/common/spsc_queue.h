@@ -0,0 +1,139 @@
+#ifndef LMM_SPSC_QUEUE_H
+#define LMM_SPSC_QUEUE_H
+
+/**********************************************************
+
+A bounded, lock free queue with a single producer and a single consumer,
+for passing items between the stages of a pipeline (i.e. a thread reading
+maps ahead of the aligner, or a thread writing its output).
+
+The queue is a ring buffer. The producer only writes tail_ and the consumer
+only writes head_, so try_push and try_pop never block. push and pop wait
+for room or for an item with a backoff of yields and short sleeps.
+
+Several threads may produce (or consume) as long as they are serialized by
+a mutex, since the mutex orders their accesses to tail_ (or head_).
+
+close is called by the producer after its last push. pop returns false
+once the queue is closed and empty.
+
+**************************************************************/
+
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <vector>
+#include <cstddef>
+
+namespace lmm_utils {
+
+  // Wait with yields, then sleeps of increasing length, while polling a queue.
+  class Backoff {
+  public:
+    Backoff() : count_(0) {}
+
+    void wait() {
+      if(count_ < 16) {
+        std::this_thread::yield();
+      } else {
+        const int shift = count_ - 16 < 6 ? count_ - 16 : 6;
+        std::this_thread::sleep_for(std::chrono::microseconds(16 << shift));
+      }
+      count_++;
+    }
+
+  private:
+    int count_;
+  };
+
+  template<typename T>
+  class SPSCQueue {
+
+  public:
+
+    // The capacity is rounded up to a power of two.
+    SPSCQueue(size_t capacity) : head_(0), tail_(0), closed_(false) {
+      size_t n = 2;
+      while(n < capacity) n *= 2;
+      slots_.resize(n);
+      mask_ = n - 1;
+    }
+
+    SPSCQueue(const SPSCQueue&) = delete;
+    SPSCQueue& operator=(const SPSCQueue&) = delete;
+
+    bool try_push(T& item) {
+      const size_t tail = tail_.load(std::memory_order_relaxed);
+      if(tail - head_.load(std::memory_order_acquire) == slots_.size()) {
+        return false;
+      }
+      slots_[tail & mask_] = std::move(item);
+      tail_.store(tail + 1, std::memory_order_release);
+      return true;
+    }
+
+    bool try_pop(T& item) {
+      const size_t head = head_.load(std::memory_order_relaxed);
+      if(head == tail_.load(std::memory_order_acquire)) {
+        return false;
+      }
+      item = std::move(slots_[head & mask_]);
+      head_.store(head + 1, std::memory_order_release);
+      return true;
+    }
+
+    // Wait until there is room for the item.
+    void push(T& item) {
+      Backoff backoff;
+      while(!try_push(item)) {
+        backoff.wait();
+      }
+    }
+
+    // Wait until there is room for the item, or until stop is set.
+    // Returns false if the item was not pushed.
+    bool push(T& item, const std::atomic<bool>& stop) {
+      Backoff backoff;
+      while(!try_push(item)) {
+        if(stop.load(std::memory_order_relaxed)) return false;
+        backoff.wait();
+      }
+      return true;
+    }
+
+    // Wait for an item. Returns false if the queue is closed and empty.
+    bool pop(T& item) {
+      Backoff backoff;
+      while(!try_pop(item)) {
+        if(closed_.load(std::memory_order_acquire)) {
+          // Items pushed before close are visible once closed_ is.
+          return try_pop(item);
+        }
+        backoff.wait();
+      }
+      return true;
+    }
+
+    void close() {
+      closed_.store(true, std::memory_order_release);
+    }
+
+  private:
+
+    std::vector<T> slots_;
+    size_t mask_;
+
+    // head_ and tail_ are padded onto separate cache lines, so that the producer
+    // and consumer do not contend for one line.
+    char pad0_[64];
+    std::atomic<size_t> head_;
+    char pad1_[64];
+    std::atomic<size_t> tail_;
+    char pad2_[64];
+    std::atomic<bool> closed_;
+
+  };
+
+}
+
+#endif
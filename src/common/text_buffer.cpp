@@ -0,0 +1,157 @@
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+
+#include "text_buffer.h"
+
+namespace lmm_utils {
+
+  namespace {
+
+    // The powers of ten that are exactly representable as a double.
+    const double POW10[] = {
+      1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+      1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+    };
+
+    // Significant digits of the default ostream precision.
+    const int PRECISION = 6;
+
+    size_t format_double_printf(char * buf, double v) {
+      return snprintf(buf, FORMAT_DOUBLE_MAX, "%g", v);
+    }
+
+    // a * 10^p, with a single rounding.
+    double scale(double a, int p) {
+      return p >= 0 ? a * POW10[p] : a / POW10[-p];
+    }
+
+  }
+
+  size_t format_uint(char * buf, unsigned long long v) {
+    char tmp[20];
+    size_t n = 0;
+    do {
+      tmp[n++] = '0' + v % 10;
+      v /= 10;
+    } while (v);
+    for(size_t i = 0; i < n; i++) {
+      buf[i] = tmp[n - 1 - i];
+    }
+    return n;
+  }
+
+  // Format with PRECISION significant digits as "%g", for the values whose digits
+  // can be computed exactly with a single scaling by a power of ten. Values that are
+  // too large, too small, or too close to halfway between two roundings are left
+  // to printf.
+  size_t format_double(char * buf, double v) {
+
+    if(v == 0.0) {
+      return format_double_printf(buf, v);
+    }
+
+    const double a = std::fabs(v);
+    if(!(a >= 1e-15 && a < 1e15)) {
+      return format_double_printf(buf, v);
+    }
+
+    // Find e such that a = d.ddddd * 10^e, and the digits m = a * 10^(PRECISION - 1 - e).
+    // The estimate of e from the binary exponent is off by at most one.
+    int binary_exponent;
+    std::frexp(a, &binary_exponent);
+    int e = int(std::floor((binary_exponent - 1) * 0.30102999566398120));
+    double m = scale(a, PRECISION - 1 - e);
+    if(m >= 1e6) {
+      e++;
+      m = scale(a, PRECISION - 1 - e);
+    }
+
+    if(m < 1e5 || m >= 1e6) {
+      return format_double_printf(buf, v);
+    }
+
+    // m is within a relative 2^-53 of the exact scaled value, so the rounding is
+    // exact unless the fraction is close to one half.
+    double digits = std::floor(m);
+    const double frac = m - digits;
+    if(std::fabs(frac - 0.5) < 1e-8) {
+      return format_double_printf(buf, v);
+    }
+    if(frac > 0.5) {
+      digits += 1.0;
+    }
+
+    unsigned long d = static_cast<unsigned long>(digits);
+    if(d == 1000000UL) {
+      d = 100000UL;
+      e++;
+    }
+
+    char ds[PRECISION];
+    for(int i = PRECISION - 1; i >= 0; i--) {
+      ds[i] = '0' + d % 10;
+      d /= 10;
+    }
+
+    // Number of significant digits left after removing trailing zeros.
+    int nd = PRECISION;
+    while(nd > 1 && ds[nd - 1] == '0') {
+      nd--;
+    }
+
+    char * p = buf;
+    if(v < 0) {
+      *p++ = '-';
+    }
+
+    if(e >= -4 && e < PRECISION) {
+
+      // Fixed notation
+      if(e >= 0) {
+        const int int_digits = e + 1;
+        for(int i = 0; i < int_digits; i++) {
+          *p++ = ds[i];
+        }
+        if(nd > int_digits) {
+          *p++ = '.';
+          for(int i = int_digits; i < nd; i++) {
+            *p++ = ds[i];
+          }
+        }
+      } else {
+        *p++ = '0';
+        *p++ = '.';
+        for(int i = 0; i < -e - 1; i++) {
+          *p++ = '0';
+        }
+        for(int i = 0; i < nd; i++) {
+          *p++ = ds[i];
+        }
+      }
+
+    } else {
+
+      // Scientific notation, with at least two exponent digits.
+      *p++ = ds[0];
+      if(nd > 1) {
+        *p++ = '.';
+        for(int i = 1; i < nd; i++) {
+          *p++ = ds[i];
+        }
+      }
+      *p++ = 'e';
+      *p++ = e < 0 ? '-' : '+';
+      const int ae = e < 0 ? -e : e;
+      if(ae < 10) {
+        *p++ = '0';
+      }
+      p += format_uint(p, ae);
+
+    }
+
+    return p - buf;
+
+  }
+
+}
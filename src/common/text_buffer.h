@@ -0,0 +1,114 @@
+#ifndef LMM_TEXT_BUFFER_H
+#define LMM_TEXT_BUFFER_H
+
+/////////////////////////////////////////////////////////////////////////////
+// A growable character buffer with operator<< for strings and numbers, for
+// writing large amounts of text output without going through iostream
+// formatting. Numbers are formatted as a std::ostream with the default
+// flags would format them (doubles as printf's "%g"), so output written
+// through a TextBuffer is byte identical to output written to an ostream.
+//
+// The buffer is written to an ostream with write_to, or taken with release.
+/////////////////////////////////////////////////////////////////////////////
+
+#include <cstddef>
+#include <ostream>
+#include <string>
+
+namespace lmm_utils {
+
+  // Format v into buf as an ostream with the default flags and precision would.
+  // buf must hold at least FORMAT_DOUBLE_MAX chars. Returns the number of chars written.
+  const size_t FORMAT_DOUBLE_MAX = 32;
+  size_t format_double(char * buf, double v);
+
+  // Format v into buf, which must hold at least 20 chars. Returns the number of chars written.
+  size_t format_uint(char * buf, unsigned long long v);
+
+  class TextBuffer {
+
+  public:
+
+    TextBuffer() {}
+
+    TextBuffer& operator<<(char c) {
+      buf_.push_back(c);
+      return *this;
+    }
+
+    TextBuffer& operator<<(const char * s) {
+      buf_.append(s);
+      return *this;
+    }
+
+    TextBuffer& operator<<(const std::string& s) {
+      buf_.append(s);
+      return *this;
+    }
+
+    TextBuffer& operator<<(int v) { return append_int(v); }
+    TextBuffer& operator<<(long v) { return append_int(v); }
+    TextBuffer& operator<<(long long v) { return append_int(v); }
+    TextBuffer& operator<<(unsigned v) { return append_uint(v); }
+    TextBuffer& operator<<(unsigned long v) { return append_uint(v); }
+    TextBuffer& operator<<(unsigned long long v) { return append_uint(v); }
+
+    TextBuffer& operator<<(double v) {
+      char tmp[FORMAT_DOUBLE_MAX];
+      buf_.append(tmp, format_double(tmp, v));
+      return *this;
+    }
+
+    size_t size() const { return buf_.size(); }
+    bool empty() const { return buf_.empty(); }
+    const std::string& str() const { return buf_; }
+    void clear() { buf_.clear(); }
+
+    // Return the contents and leave the buffer empty.
+    std::string release() {
+      std::string ret;
+      ret.swap(buf_);
+      return ret;
+    }
+
+    // Write the contents to os and clear the buffer.
+    void write_to(std::ostream& os) {
+      os.write(buf_.data(), buf_.size());
+      buf_.clear();
+    }
+
+    // Write the contents to os if the buffer has grown past max_size.
+    void write_if_full(std::ostream& os, size_t max_size = 1 << 16) {
+      if(buf_.size() >= max_size) {
+        write_to(os);
+      }
+    }
+
+  private:
+
+    TextBuffer& append_int(long long v) {
+      char tmp[24];
+      char * p = tmp;
+      unsigned long long u = v;
+      if(v < 0) {
+        *p++ = '-';
+        u = 0ULL - u;
+      }
+      p += format_uint(p, u);
+      buf_.append(tmp, p - tmp);
+      return *this;
+    }
+
+    TextBuffer& append_uint(unsigned long long v) {
+      char tmp[24];
+      buf_.append(tmp, format_uint(tmp, v));
+      return *this;
+    }
+
+    std::string buf_;
+
+  };
+
+}
+
+#endif
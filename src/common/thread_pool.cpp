@@ -0,0 +1,80 @@
+#include "thread_pool.h"
+
+namespace lmm_utils {
+
+  ThreadPool::ThreadPool(size_t num_threads, size_t max_queued) :
+    max_queued_(max_queued > 0 ? max_queued : 2*num_threads),
+    num_active_(0),
+    stopping_(false)
+  {
+    if(num_threads == 0) num_threads = 1;
+    threads_.reserve(num_threads);
+    for(size_t i = 0; i < num_threads; i++) {
+      threads_.push_back(std::thread(&ThreadPool::worker_loop, this, i));
+    }
+  }
+
+  ThreadPool::~ThreadPool() {
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      stopping_ = true;
+    }
+    task_ready_.notify_all();
+    for(auto& t : threads_) {
+      t.join();
+    }
+  }
+
+  void ThreadPool::submit(Task task) {
+    std::unique_lock<std::mutex> lock(mutex_);
+    queue_not_full_.wait(lock, [this]{ return queue_.size() < max_queued_; });
+    queue_.push_back(std::move(task));
+    lock.unlock();
+    task_ready_.notify_one();
+  }
+
+  void ThreadPool::wait() {
+    std::unique_lock<std::mutex> lock(mutex_);
+    all_done_.wait(lock, [this]{ return queue_.empty() && num_active_ == 0; });
+    if(error_) {
+      std::exception_ptr e = error_;
+      error_ = nullptr;
+      std::rethrow_exception(e);
+    }
+  }
+
+  void ThreadPool::worker_loop(size_t worker_id) {
+
+    while(true) {
+
+      Task task;
+
+      {
+        std::unique_lock<std::mutex> lock(mutex_);
+        task_ready_.wait(lock, [this]{ return stopping_ || !queue_.empty(); });
+        if(queue_.empty()) return; // stopping
+        task = std::move(queue_.front());
+        queue_.pop_front();
+        num_active_++;
+      }
+
+      queue_not_full_.notify_one();
+
+      try {
+        task(worker_id);
+      } catch(...) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if(!error_) error_ = std::current_exception();
+      }
+
+      {
+        std::lock_guard<std::mutex> lock(mutex_);
+        num_active_--;
+        if(queue_.empty() && num_active_ == 0) all_done_.notify_all();
+      }
+
+    }
+
+  }
+
+}
@@ -0,0 +1,118 @@
+#ifndef LMM_THREAD_POOL_H
+#define LMM_THREAD_POOL_H
+
+/**********************************************************
+
+A fixed size pool of worker threads pulling tasks from a shared queue.
+
+Each task is handed the index of the worker running it, so that a caller can
+keep per-worker state (i.e. one ScoreMatrix per thread) in a vector indexed
+by worker and reuse it for the lifetime of the pool.
+
+submit blocks once max_queued tasks are waiting, so that a fast producer
+(i.e. a MapReader) does not run arbitrarily far ahead of the workers.
+
+If a task throws, the first exception is stored and rethrown from wait().
+
+**************************************************************/
+
+#include <vector>
+#include <deque>
+#include <map>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <exception>
+
+namespace lmm_utils {
+
+  class ThreadPool {
+
+  public:
+
+    typedef std::function<void(size_t)> Task;
+
+    ThreadPool(size_t num_threads, size_t max_queued = 0);
+    ~ThreadPool();
+
+    // Queue a task. Blocks while the queue is full.
+    void submit(Task task);
+
+    // Block until every submitted task has completed.
+    void wait();
+
+    size_t size() const { return threads_.size(); }
+
+  private:
+
+    void worker_loop(size_t worker_id);
+
+    std::vector<std::thread> threads_;
+    std::deque<Task> queue_;
+    size_t max_queued_;
+    size_t num_active_;
+    bool stopping_;
+    std::exception_ptr error_;
+
+    std::mutex mutex_;
+    std::condition_variable task_ready_;
+    std::condition_variable queue_not_full_;
+    std::condition_variable all_done_;
+
+    ThreadPool(const ThreadPool&);
+    ThreadPool& operator=(const ThreadPool&);
+
+  };
+
+
+  //////////////////////////////////////////////////////////////////
+  // Collects results completed out of order by worker threads and
+  // passes them to a sink in sequence order, starting from sequence 0.
+  // Every sequence number must be pushed exactly once.
+  template<typename T>
+  class ReorderBuffer {
+
+  public:
+
+    typedef std::function<void(T&)> Sink;
+
+    ReorderBuffer(Sink sink) : sink_(sink), next_(0) {}
+
+    void push(size_t seq, T&& item) {
+      std::unique_lock<std::mutex> lock(mutex_);
+      pending_.insert(std::make_pair(seq, std::move(item)));
+      while(!pending_.empty() && pending_.begin()->first == next_) {
+        sink_(pending_.begin()->second);
+        pending_.erase(pending_.begin());
+        next_++;
+      }
+      lock.unlock();
+      written_.notify_all();
+    }
+
+    // Block until fewer than max_pending items before seq are unwritten.
+    // This bounds the memory held by results waiting on a slow item.
+    void wait_for_room(size_t seq, size_t max_pending) {
+      std::unique_lock<std::mutex> lock(mutex_);
+      written_.wait(lock, [&]{ return seq < next_ + max_pending; });
+    }
+
+    size_t num_written() {
+      std::lock_guard<std::mutex> lock(mutex_);
+      return next_;
+    }
+
+  private:
+
+    Sink sink_;
+    size_t next_;
+    std::map<size_t, T> pending_;
+    std::mutex mutex_;
+    std::condition_variable written_;
+
+  };
+
+}
+
+#endif
@@ -42,6 +42,12 @@ namespace lmm_utils {
       start();
     }
 
+    // Seconds from start to end, or to now if the Timer has not ended.
+    double elapsed_seconds() const {
+      time_point end_time = has_ended_ ? end_time_ : std::chrono::steady_clock::now();
+      return std::chrono::duration<double>(end_time - start_time_).count();
+    }
+
   private:
 
     
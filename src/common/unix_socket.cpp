@@ -0,0 +1,147 @@
+#include <cerrno>
+#include <cstring>
+#include <chrono>
+#include <thread>
+
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include "unix_socket.h"
+
+namespace lmm_utils {
+
+  namespace {
+
+    std::string error_message(const std::string& msg) {
+      return msg + ": " + std::strerror(errno);
+    }
+
+  }
+
+  UnixSocketListener::UnixSocketListener(const std::string& path) :
+    path_(path),
+    fd_(-1)
+  {
+
+    struct sockaddr_un addr;
+    std::memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    if(path.size() >= sizeof(addr.sun_path)) {
+      throw SocketException("Socket path is too long: " + path);
+    }
+    std::strncpy(addr.sun_path, path.c_str(), sizeof(addr.sun_path) - 1);
+
+    // Replace a socket left by an earlier server, but no other file.
+    struct stat st;
+    if(stat(path.c_str(), &st) == 0) {
+      if(!S_ISSOCK(st.st_mode)) {
+        throw SocketException(path + " exists and is not a socket.");
+      }
+      unlink(path.c_str());
+    }
+
+    fd_ = socket(AF_UNIX, SOCK_STREAM, 0);
+    if(fd_ < 0) {
+      throw SocketException(error_message("Could not create a socket"));
+    }
+
+    if(bind(fd_, reinterpret_cast<struct sockaddr*>(&addr), sizeof(addr)) != 0 ||
+       listen(fd_, SOMAXCONN) != 0) {
+      const std::string msg = error_message("Could not listen on " + path);
+      close(fd_);
+      throw SocketException(msg);
+    }
+
+  }
+
+  UnixSocketListener::~UnixSocketListener() {
+    close(fd_);
+    unlink(path_.c_str());
+  }
+
+  int UnixSocketListener::accept() {
+    while(true) {
+      const int fd = ::accept(fd_, nullptr, nullptr);
+      if(fd >= 0) {
+        return fd;
+      }
+      if(errno == EMFILE || errno == ENFILE || errno == ENOBUFS || errno == ENOMEM) {
+        // Out of file descriptors or memory: wait for connections to close.
+        std::this_thread::sleep_for(std::chrono::milliseconds(100));
+      } else if(errno != EINTR && errno != ECONNABORTED) {
+        throw SocketException(error_message("Could not accept a connection on " + path_));
+      }
+    }
+  }
+
+  SocketConnection::SocketConnection(int fd) :
+    fd_(fd),
+    is_open_(true),
+    pos_(0),
+    eof_(false)
+  {
+  }
+
+  SocketConnection::~SocketConnection() {
+    close(fd_);
+  }
+
+  bool SocketConnection::read_line(std::string& line) {
+
+    while(true) {
+
+      const size_t newline = buf_.find('\n', pos_);
+      if(newline != std::string::npos) {
+        line.assign(buf_, pos_, newline - pos_);
+        pos_ = newline + 1;
+        return true;
+      }
+
+      if(eof_) {
+        if(pos_ == buf_.size()) {
+          return false;
+        }
+        line.assign(buf_, pos_, std::string::npos);
+        pos_ = buf_.size();
+        return true;
+      }
+
+      // Keep the partial line, and read more.
+      buf_.erase(0, pos_);
+      pos_ = 0;
+
+      char data[65536];
+      const ssize_t n = ::read(fd_, data, sizeof(data));
+      if(n > 0) {
+        buf_.append(data, n);
+      } else if(n == 0 || errno != EINTR) {
+        eof_ = true;
+      }
+
+    }
+
+  }
+
+  void SocketConnection::shutdown_read() {
+    ::shutdown(fd_, SHUT_RD);
+  }
+
+  bool SocketConnection::write(const std::string& data) {
+
+    size_t written = 0;
+    while(is_open_ && written < data.size()) {
+      const ssize_t n = send(fd_, data.data() + written, data.size() - written, MSG_NOSIGNAL);
+      if(n > 0) {
+        written += n;
+      } else if(n == 0 || errno != EINTR) {
+        is_open_ = false;
+      }
+    }
+
+    return is_open_;
+
+  }
+
+}
@@ -0,0 +1,101 @@
+#ifndef LMM_UNIX_SOCKET_H
+#define LMM_UNIX_SOCKET_H
+
+/**********************************************************
+
+A listening Unix domain socket, and line oriented connections to it, for
+serving requests from a process which keeps its state (i.e. the reference
+maps) loaded between requests.
+
+A stale socket file left by a server which was killed is replaced, but
+another file at the path is not.
+
+Writes to a connection closed by the client fail instead of raising SIGPIPE.
+
+**************************************************************/
+
+#include <exception>
+#include <string>
+
+namespace lmm_utils {
+
+  class SocketException : public std::exception
+  {
+    public:
+
+      SocketException(const std::string& msg) :
+        message_(msg) {};
+
+      virtual const char* what() const noexcept
+      {
+        return message_.c_str();
+      }
+
+      std::string message_;
+
+  };
+
+  class UnixSocketListener {
+
+  public:
+
+    // Listen on the socket file path. Throws a SocketException on error.
+    UnixSocketListener(const std::string& path);
+
+    // Stop listening and remove the socket file.
+    ~UnixSocketListener();
+
+    UnixSocketListener(const UnixSocketListener&) = delete;
+    UnixSocketListener& operator=(const UnixSocketListener&) = delete;
+
+    // Wait for a connection, and return its file descriptor. Waits out a lack of
+    // file descriptors or memory, and throws a SocketException on other errors.
+    int accept();
+
+    const std::string& path() const { return path_; }
+
+  private:
+
+    std::string path_;
+    int fd_;
+
+  };
+
+  class SocketConnection {
+
+  public:
+
+    // Take ownership of a connected socket.
+    explicit SocketConnection(int fd);
+    ~SocketConnection();
+
+    SocketConnection(const SocketConnection&) = delete;
+    SocketConnection& operator=(const SocketConnection&) = delete;
+
+    // Read the next line, without the newline. Returns false once the client
+    // stops writing, or on error. A last line without a newline is returned.
+    bool read_line(std::string& line);
+
+    // Stop reading from the client, so that read_line returns false, even if it
+    // is blocked in another thread.
+    void shutdown_read();
+
+    // Write all of data. Returns false if the client has closed the connection.
+    bool write(const std::string& data);
+
+    // True until a write fails.
+    bool is_open() const { return is_open_; }
+
+  private:
+
+    int fd_;
+    bool is_open_;
+    std::string buf_;
+    size_t pos_;
+    bool eof_;
+
+  };
+
+}
+
+#endif
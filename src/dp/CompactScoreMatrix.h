@@ -0,0 +1,225 @@
+#ifndef COMPACTSCOREMATRIX_H
+#define COMPACTSCOREMATRIX_H
+
+/**********************************************************
+
+ScoreMatrix<compact_row_order_tag> stores the dynamic programming table
+as a structure of arrays, in row order, instead of as ScoreCell objects:
+
+  - scores in a contiguous array of doubles
+  - backpointers as a (query delta, ref delta) byte pair
+  - cumulative query misses and reference misses in separate arrays
+  - optionally, the reference start of the trail through each cell
+
+A ScoreCell is 56 bytes, so the fill reads about one useful score per cache line.
+Here a cell takes 18 bytes (22 with reference starts), and the scores of
+neighboring cells are adjacent.
+
+Backpointers are bytes, so the max miss fill supports at most
+max_misses consecutive missed sites. Use the ScoreCell matrix for more.
+
+Cells are identified by (row, col) rather than by pointer. Use build_trail
+to get ScoreCells for the trail ending at a cell.
+
+The matrix is not cleared when it is resized for a new fill. Instead, each
+row is stamped with the epoch of the fill which last wrote it, and resize
+starts a new epoch. A row with an old stamp reads as unfilled (-INF).
+The fill writes every cell of a row before stamping it, so the cost
+of clearing is only paid for the rows that are actually filled.
+
+As with ScoreMatrix, a single matrix should be used per thread
+for the lifetime of the thread.
+
+**************************************************************/
+
+#include <vector>
+#include <cstdint>
+#include <algorithm>
+
+#include "ScoreCell.h"
+#include "types.h"
+
+namespace maligner_dp {
+
+    template<>
+    class ScoreMatrix<compact_row_order_tag>
+    {
+    public:
+
+        typedef compact_row_order_tag order_tag;
+
+        // The largest query_max_misses and ref_max_misses supported by the byte backpointers.
+        static const int max_misses = 254;
+
+        ScoreMatrix(size_t numRows = 0, size_t numCols = 0, bool track_ref_start = false) :
+            numRows_(0),
+            numCols_(0),
+            size_(0),
+            track_ref_start_(track_ref_start),
+            epoch_(0)
+        {
+            resize(numRows, numCols);
+        }
+
+        void resize(size_t numRows, size_t numCols) {
+            numRows_ = numRows;
+            numCols_ = numCols;
+            size_ = numRows*numCols;
+            if (size_ > score_.size()) {
+                score_.resize(size_);
+                bp_.resize(size_);
+                qm_.resize(size_);
+                rm_.resize(size_);
+                if (track_ref_start_) ref_start_.resize(size_);
+            }
+            if (numRows_ > row_epoch_.size()) {
+                row_epoch_.resize(numRows_, 0);
+            }
+            if (numCols_ > empty_row_.size()) {
+                empty_row_.resize(numCols_, -INF);
+            }
+            reset();
+        }
+
+        // Start a new epoch, so that every row reads as unfilled.
+        void reset() {
+            if (++epoch_ == 0) {
+                // The epoch wrapped around. Old stamps could look current.
+                std::fill(row_epoch_.begin(), row_epoch_.end(), 0);
+                epoch_ = 1;
+            }
+            rows_filled_ = numRows_;
+        }
+
+        size_t getSize() const { return size_; }
+        size_t getCapacity() const { return score_.size(); }
+        size_t getNumRows() const { return numRows_; }
+        size_t getNumCols() const { return numCols_; }
+        uint64_t getMemoryUsage() const {
+            return uint64_t(score_.size()) * sizeof(double) +
+                   uint64_t(bp_.size()) * sizeof(CompactBackPointer) +
+                   uint64_t(qm_.size() + rm_.size() + ref_start_.size()) * sizeof(int);
+        }
+
+        // The number of rows filled by the last fill. This is less than the number of rows
+        // when the fill stopped because no alignment could reach the last row.
+        size_t getNumRowsFilled() const { return rows_filled_; }
+        void setNumRowsFilled(size_t n) { rows_filled_ = n; }
+
+        bool tracks_ref_start() const { return track_ref_start_; }
+
+        ///////////////////////////////////////////////////////////////
+        // Cell access
+        bool row_is_current(size_t row) const { return row_epoch_[row] == epoch_; }
+        double score(size_t row, size_t col) const { return scores(row)[col]; }
+        int query_misses(size_t row, size_t col) const { return qm_[row*numCols_ + col]; }
+        int ref_misses(size_t row, size_t col) const { return rm_[row*numCols_ + col]; }
+        int ref_start(size_t row, size_t col) const { return ref_start_[row*numCols_ + col]; }
+        const CompactBackPointer& back_pointer(size_t row, size_t col) const { return bp_[row*numCols_ + col]; }
+
+        // Cells in the first row have no backpointer.
+        bool has_back_pointer(size_t row, size_t col) const {
+            return row > 0 && score(row, col) > -INF;
+        }
+
+        // Build the trail which starts at (row, col) by following its backpointers.
+        // The cell at the end of the alignment has its score set.
+        void build_trail(size_t row, size_t col, ScoreCellVec& trail) const {
+            trail.clear();
+            trail.reserve(row + 1);
+            ScoreCell cell(row, col);
+            cell.score_ = score(row, col);
+            cell.m_score_ = INF; // As for a reset ScoreCell
+            trail.push_back(cell);
+            while (has_back_pointer(row, col)) {
+                const CompactBackPointer& bp = back_pointer(row, col);
+                row -= bp.dq;
+                col -= bp.dr;
+                trail.push_back(ScoreCell(row, col));
+            }
+        }
+
+        ///////////////////////////////////////////////////////////////
+        // Row access used by the fill.
+        // The scores of a row which has not been filled in this epoch are all -INF.
+        const double * scores(size_t row) const {
+            return row_is_current(row) ? &score_[row*numCols_] : &empty_row_[0];
+        }
+        const int * query_misses(size_t row) const { return &qm_[row*numCols_]; }
+        const int * ref_misses(size_t row) const { return &rm_[row*numCols_]; }
+
+        void clear_row(size_t row) {
+            std::fill(score_.begin() + row*numCols_, score_.begin() + (row+1)*numCols_, -INF);
+            row_epoch_[row] = epoch_;
+        }
+
+        // Mark a cell in a row being filled as having no alignment through it.
+        void clear_cell(size_t i, size_t j) {
+            score_[i*numCols_ + j] = -INF;
+        }
+
+        // Set a cell in the first row as a possible alignment start.
+        void set_start(size_t col, double score) {
+            score_[col] = score;
+            qm_[col] = 0;
+            rm_[col] = 0;
+            if (track_ref_start_) ref_start_[col] = col;
+        }
+
+        void assign(size_t i, size_t j, double score, int qm, int rm, size_t k, size_t l) {
+            const size_t ix = i*numCols_ + j;
+            score_[ix] = score;
+            qm_[ix] = qm;
+            rm_[ix] = rm;
+            bp_[ix].dq = uint8_t(i - k);
+            bp_[ix].dr = uint8_t(j - l);
+            if (track_ref_start_) ref_start_[ix] = ref_start_[k*numCols_ + l];
+        }
+
+        // Every cell of the row has been written with assign or clear_cell.
+        void row_filled(size_t row) {
+            row_epoch_[row] = epoch_;
+        }
+
+        ///////////////////////////////////////////////////////////////
+        // Summary Functions
+        size_t countFilledByRow(size_t row) const {
+            if (row >= numRows_) return 0;
+            const double * s = scores(row);
+            return std::count_if(s, s + numCols_, [](double v) { return v > -INF; });
+        }
+
+        double getMaxScoreByRow(size_t row) const {
+            if (row >= numRows_) return -INF;
+            const double * s = scores(row);
+            return numCols_ > 0 ? *std::max_element(s, s + numCols_) : -INF;
+        }
+
+        double getMaxScore() const {
+            return getMaxScoreByRow(numRows_ - 1);
+        }
+
+    private:
+
+        size_t numRows_;
+        size_t numCols_;
+        size_t size_;
+        size_t rows_filled_;
+        bool track_ref_start_;
+        uint32_t epoch_;
+
+        DoubleVec score_;
+        std::vector<CompactBackPointer> bp_;
+        IntVec qm_; // cumulative query misses
+        IntVec rm_; // cumulative reference misses
+        IntVec ref_start_; // starting location in the reference of the trail that passes through.
+        std::vector<uint32_t> row_epoch_; // The epoch in which each row was last filled.
+        DoubleVec empty_row_; // -INF scores for rows which have not been filled.
+
+    };
+
+    typedef ScoreMatrix<compact_row_order_tag> CompactScoreMatrix;
+
+}
+
+#endif
@@ -0,0 +1,229 @@
+#ifndef LINEARSCOREMATRIX_H
+#define LINEARSCOREMATRIX_H
+
+/**********************************************************
+
+LinearScoreMatrix is a score matrix for the max miss fill which does
+not hold the whole dynamic programming table.
+
+The recurrence for row i only looks back at rows i-query_max_misses-1 to i-1,
+so the fill keeps a rolling window of query_max_misses+2 rows. After every
+checkpoint_spacing rows, the window rows needed to restart the fill at that
+row are copied to a checkpoint.
+
+Traceback is done in segments of checkpoint_spacing rows, from the last segment
+to the first. The rows of a segment are recomputed from its checkpoint, this time
+recording a compact (query delta, ref delta) backpointer for each cell, and all
+trails that are in the segment are followed back to the segment start.
+
+With S = checkpoint_spacing, peak memory is O(ref * (S + query_max_misses * rows / S))
+instead of O(query * ref), and the rows are filled at most twice.
+
+As with ScoreMatrix, a single LinearScoreMatrix should be used per thread
+for the lifetime of the thread.
+
+**************************************************************/
+
+#include <vector>
+#include <cmath>
+#include <cstdint>
+#include <stdexcept>
+#include <algorithm>
+
+#include "globals.h"
+#include "types.h"
+
+namespace maligner_dp {
+
+  using maligner_dp::Constants::INF;
+
+  struct linear_memory_tag{};
+
+  class LinearScoreMatrix {
+
+  public:
+
+    typedef linear_memory_tag order_tag;
+
+    LinearScoreMatrix(size_t checkpoint_spacing = 0) :
+      numRows_(0),
+      numCols_(0),
+      window_(0),
+      spacing_(checkpoint_spacing),
+      default_spacing_(checkpoint_spacing == 0),
+      rows_filled_(0),
+      record_begin_(0),
+      recording_(false) {}
+
+    // Prepare the matrix for a fill of numRows x numCols cells where row i depends
+    // on rows at most max_row_delta before it, and on columns at most
+    // max_col_delta before it.
+    void resize(size_t numRows, size_t numCols, size_t max_row_delta, size_t max_col_delta) {
+
+      if(max_row_delta > 255 || max_col_delta > 255) {
+        throw std::runtime_error("LinearScoreMatrix supports at most 254 consecutive missed sites.");
+      }
+
+      numRows_ = numRows;
+      numCols_ = numCols;
+      window_ = max_row_delta + 1;
+
+      if(default_spacing_) {
+        // Balance the size of the checkpoints against the size of a recomputed segment.
+        spacing_ = size_t(std::ceil(std::sqrt(double(numRows_) * double(max_row_delta))));
+      }
+      spacing_ = std::max(spacing_, max_row_delta);
+      if(spacing_ == 0) spacing_ = 1;
+
+      size_t num_checkpoints = numRows_ / spacing_;
+      size_t checkpoint_size = (window_ - 1) * numCols_;
+
+      grow(score_, window_ * numCols_);
+      grow(qm_, window_ * numCols_);
+      grow(rm_, window_ * numCols_);
+      grow(cp_score_, num_checkpoints * checkpoint_size);
+      grow(cp_qm_, num_checkpoints * checkpoint_size);
+      grow(cp_rm_, num_checkpoints * checkpoint_size);
+      grow(bp_, spacing_ * numCols_);
+
+      rows_filled_ = 0;
+      recording_ = false;
+
+    }
+
+    size_t getNumRows() const { return numRows_; }
+    size_t getNumCols() const { return numCols_; }
+    size_t getCheckpointSpacing() const { return spacing_; }
+
+    // The number of rows filled by the last fill. This is less than the number of rows
+    // when the fill stopped because no alignment could reach the last row.
+    size_t getNumRowsFilled() const { return rows_filled_; }
+    void setNumRowsFilled(size_t n) { rows_filled_ = n; }
+
+    uint64_t getMemoryUsage() const {
+      return uint64_t(score_.size() + cp_score_.size()) * sizeof(double) +
+             uint64_t(qm_.size() + rm_.size() + cp_qm_.size() + cp_rm_.size()) * sizeof(int) +
+             uint64_t(bp_.size()) * sizeof(CompactBackPointer);
+    }
+
+    ///////////////////////////////////////////////////////////////
+    // Row access used by the fill. The row must be in the window.
+    const double * scores(size_t row) const { return &score_[slot(row)]; }
+    const int * query_misses(size_t row) const { return &qm_[slot(row)]; }
+    const int * ref_misses(size_t row) const { return &rm_[slot(row)]; }
+
+    void clear_row(size_t row) {
+      const size_t s = slot(row);
+      std::fill(score_.begin() + s, score_.begin() + s + numCols_, -INF);
+    }
+
+    // Mark a cell in a row being filled as having no alignment through it.
+    void clear_cell(size_t i, size_t j) {
+      score_[slot(i) + j] = -INF;
+    }
+
+    // Set a cell in the first row as a possible alignment start.
+    void set_start(size_t col, double score) {
+      score_[col] = score;
+      qm_[col] = 0;
+      rm_[col] = 0;
+    }
+
+    void assign(size_t i, size_t j, double score, int qm, int rm, size_t k, size_t l) {
+      const size_t ix = slot(i) + j;
+      score_[ix] = score;
+      qm_[ix] = qm;
+      rm_[ix] = rm;
+      if(recording_) {
+        CompactBackPointer& bp = bp_[(i - record_begin_)*numCols_ + j];
+        bp.dq = uint8_t(i - k);
+        bp.dr = uint8_t(j - l);
+      }
+    }
+
+    // Called by the fill once row i is complete. Saves a checkpoint when the next
+    // row starts a segment.
+    void row_filled(size_t i) {
+      if(!recording_ && (i + 1) % spacing_ == 0 && i + 1 < numRows_) {
+        save_checkpoint(i + 1);
+      }
+    }
+
+    ///////////////////////////////////////////////////////////////
+    // Traceback support
+
+    // Restore the window to hold the rows preceding row, which must start a segment.
+    void restore_checkpoint(size_t row) {
+      const size_t checkpoint_size = (window_ - 1) * numCols_;
+      const size_t offset = (row / spacing_ - 1) * checkpoint_size;
+      for(size_t r = row - std::min(row, window_ - 1); r < row; r++) {
+        const size_t src = offset + (r + window_ - 1 - row) * numCols_;
+        const size_t dest = slot(r);
+        std::copy(cp_score_.begin() + src, cp_score_.begin() + src + numCols_, score_.begin() + dest);
+        std::copy(cp_qm_.begin() + src, cp_qm_.begin() + src + numCols_, qm_.begin() + dest);
+        std::copy(cp_rm_.begin() + src, cp_rm_.begin() + src + numCols_, rm_.begin() + dest);
+      }
+    }
+
+    // Record backpointers for the rows of the segment starting at row_begin while they are filled.
+    void start_recording(size_t row_begin) {
+      record_begin_ = row_begin;
+      recording_ = true;
+    }
+
+    void stop_recording() {
+      recording_ = false;
+    }
+
+    const CompactBackPointer& back_pointer(size_t i, size_t j) const {
+      return bp_[(i - record_begin_)*numCols_ + j];
+    }
+
+  private:
+
+    size_t slot(size_t row) const { return (row % window_) * numCols_; }
+
+    void save_checkpoint(size_t row) {
+      const size_t checkpoint_size = (window_ - 1) * numCols_;
+      const size_t offset = (row / spacing_ - 1) * checkpoint_size;
+      for(size_t r = row - std::min(row, window_ - 1); r < row; r++) {
+        const size_t dest = offset + (r + window_ - 1 - row) * numCols_;
+        const size_t src = slot(r);
+        std::copy(score_.begin() + src, score_.begin() + src + numCols_, cp_score_.begin() + dest);
+        std::copy(qm_.begin() + src, qm_.begin() + src + numCols_, cp_qm_.begin() + dest);
+        std::copy(rm_.begin() + src, rm_.begin() + src + numCols_, cp_rm_.begin() + dest);
+      }
+    }
+
+    template<typename T>
+    static void grow(std::vector<T>& v, size_t n) {
+      if(n > v.size()) v.resize(n);
+    }
+
+    size_t numRows_;
+    size_t numCols_;
+    size_t window_; // Number of rows in the rolling window
+    size_t spacing_; // Number of rows between checkpoints
+    bool default_spacing_;
+    size_t rows_filled_;
+
+    // Rolling window of rows
+    DoubleVec score_;
+    IntVec qm_; // cumulative query misses
+    IntVec rm_; // cumulative reference misses
+
+    // Checkpoint k holds the window_ - 1 rows preceding row (k+1)*spacing_
+    DoubleVec cp_score_;
+    IntVec cp_qm_;
+    IntVec cp_rm_;
+
+    // Backpointers for the segment being traced back.
+    std::vector<CompactBackPointer> bp_;
+    size_t record_begin_;
+    bool recording_;
+
+  };
+
+}
+
+#endif
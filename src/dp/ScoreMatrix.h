@@ -27,6 +27,7 @@ namespace maligner_dp {
 
     struct row_order_tag{};
     struct column_order_tag{};
+    struct compact_row_order_tag{}; // Structure of arrays layout. See CompactScoreMatrix.h
 
     template<class OrderTag>
     class ScoreMatrix
@@ -385,4 +386,7 @@ namespace maligner_dp {
 
 }
 
+// The compact, structure of arrays specialization of ScoreMatrix
+#include "CompactScoreMatrix.h"
+
 #endif
@@ -12,6 +12,7 @@
 #include <limits>
 
 #include "ScoreMatrix.h"
+#include "LinearScoreMatrix.h"
 #include "ScoreCell.h"
 #include "types.h"
 #include "alignment.h"
@@ -19,6 +20,7 @@
 #include "map.h"
 #include "map_wrappers.h"
 #include "partialsums.h"
+#include "chunk_scores.h"
 #include "bitcover.h"
 
 namespace maligner_dp {
@@ -330,6 +332,38 @@ namespace maligner_dp {
   // Build the trail which starts at pCell by following its backpointers.
   void build_trail(const ScoreCell* pCell, ScoreCellPVec& trail);
 
+  // The trails of the alignments ending in the last row of a filled ScoreMatrix.
+  // Each trail starts at the end of its alignment.
+  struct LastRowTrails {
+    void clear() { trails.clear(); cells.clear(); }
+    std::vector<ScoreCellPVec> trails;
+    std::vector<ScoreCellVec> cells; // Storage for the cells of the trails, if they are not in the ScoreMatrix.
+  };
+
+  // The rescaled score and reference span of the alignment for a trail.
+  // These are enough to select which alignments to build.
+  struct AlignmentCandidate {
+    double total_rescaled_score;
+    int ref_start;
+    int ref_end;
+    size_t trail_ix; // Index of the trail in LastRowTrails
+  };
+  typedef std::vector<AlignmentCandidate> AlignmentCandidateVec;
+
+  // Sort an AlignmentCandidateVec in ascending order of rescaled score.
+  class AlignmentCandidateComp {
+  public:
+      bool operator()(const AlignmentCandidate& a1, const AlignmentCandidate& a2) {
+        return a1.total_rescaled_score < a2.total_rescaled_score;
+      }
+  };
+
+  template<typename AlignTaskType, typename OrderTag>
+  void get_last_row_trails(const AlignTaskType& task, LastRowTrails& trails, OrderTag);
+
+  template<typename AlignTaskType>
+  AlignmentCandidate alignment_candidate_from_trail(const AlignTaskType& task, const ScoreCellPVec& trail, size_t trail_ix);
+
   // Create a vector of query chunks and reference chunks for the given trail.
   template<typename AlignTaskType>
   void build_chunk_trail(const AlignTaskType& task, ScoreCellPVec& trail, ChunkVec& query_chunks, ChunkVec& ref_chunks);
@@ -348,11 +382,24 @@ namespace maligner_dp {
   template<typename AlignTaskType>
   int get_best_alignments_try_all(const AlignTaskType& task);
 
+  // Fill a LinearScoreMatrix, keeping only a window of rows and checkpoints.
+  template<typename AlignTaskType>
+  void fill_score_matrix_using_partials_with_breaks_hardcode_penalty_max_miss(const AlignTaskType& align_task, linear_memory_tag);
+
+  // Build the trails ending at the given columns of the last row by recomputing
+  // the rows of a filled LinearScoreMatrix.
+  template<typename AlignTaskType>
+  void build_trails_linear_memory(const AlignTaskType& align_task, const IntVec& cols, std::vector<ScoreCellVec>& trails);
+
   // Make and return an alignment from the trail through the
   // score matrix.
   template<typename AlignTaskType>
   Alignment alignment_from_trail(const AlignTaskType& task, ScoreCellPVec& trail);
 
+  // Make an alignment from the trail, then rescale and orient it.
+  template<typename AlignTaskType>
+  Alignment alignment_from_trail_rescaled(const AlignTaskType& task, ScoreCellPVec& trail);
+
   // Build an alignment by tracing back from ScoreCell.
   template<typename AlignTaskType>
   Alignment alignment_from_cell(const AlignTaskType& task, ScoreCell* p_cell);
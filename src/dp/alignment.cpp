@@ -23,6 +23,7 @@ namespace maligner_dp {
     }
 
 
+    rescale_opts = &align_opts;
     rescaled_score = score;
     rescaled_score.sizing_score = 0.0;
 
@@ -30,26 +31,15 @@ namespace maligner_dp {
     std::cerr << "Rescaling with query factor: " << query_scaling_factor << "\n";
     #endif
 
-    const size_t l = rescaled_matched_chunks.size();
+    const size_t l = matched_chunks.size();
+    MatchedChunk rmc;
     for (size_t i = 0; i < l; i++) {
 
-      const MatchedChunk& mc = matched_chunks[i];
-      MatchedChunk& rmc =  rescaled_matched_chunks[i];
-      int old_query_size = mc.query_chunk.size;
-      int new_query_size = query_scaling_factor*old_query_size;
-      const int ref_size = mc.ref_chunk.size;
-      double old_sizing_score = mc.score.sizing_score;
-      double new_sizing_score = sizing_penalty(new_query_size, ref_size, align_opts);
-      rmc.query_chunk.size = new_query_size;
-
-      if (!mc.ref_chunk.is_boundary &&
-          (!mc.query_chunk.is_boundary || new_query_size > ref_size)) {
-
-        rmc.score.sizing_score = new_sizing_score;
-        rescaled_score.sizing_score += new_sizing_score;
+      if (rescale_chunk(matched_chunks[i], rmc)) {
+        rescaled_score.sizing_score += rmc.score.sizing_score;
         #if RESCALE_DEBUG > 10
-        std::cerr << "old_q: " << old_query_size << " new_q: " << new_query_size
-                << " old_sizing_score: " << old_sizing_score << " new: " << new_sizing_score << "\n";
+        std::cerr << "old_q: " << matched_chunks[i].query_chunk.size << " new_q: " << rmc.query_chunk.size
+                << " old_sizing_score: " << matched_chunks[i].score.sizing_score << " new: " << rmc.score.sizing_score << "\n";
         #endif
       }
 
@@ -60,6 +50,35 @@ namespace maligner_dp {
 
   }
 
+  bool Alignment::rescale_chunk(const MatchedChunk& mc, MatchedChunk& rmc) const {
+
+    rmc = mc;
+
+    if (!rescale_opts) {
+      return false;
+    }
+
+    const int old_query_size = mc.query_chunk.size;
+    const int new_query_size = query_scaling_factor*old_query_size;
+    const int ref_size = mc.ref_chunk.size;
+    rmc.query_chunk.size = new_query_size;
+
+    if (!mc.ref_chunk.is_boundary &&
+        (!mc.query_chunk.is_boundary || new_query_size > ref_size)) {
+      rmc.score.sizing_score = sizing_penalty(new_query_size, ref_size, *rescale_opts);
+      return true;
+    }
+
+    return false;
+
+  }
+
+  MatchedChunk Alignment::rescaled_matched_chunk(size_t i) const {
+    MatchedChunk rmc;
+    rescale_chunk(matched_chunks[i], rmc);
+    return rmc;
+  }
+
 
   std::ostream& operator<<(std::ostream& os, const AlignmentHeader&) {
     os << "query_map" << "\t"
@@ -88,15 +107,16 @@ namespace maligner_dp {
        << "num_interior_chunks" << "\t"
        << "score_per_inner_chunk" << "\t"
        << "chunk_string" << "\t"
-       << "score_string" << "\n";
+       << "score_string" << "\t"
+       << "num_trials" << "\n";
     return os;
   }
 
 
   void print_alignment(std::ostream& os, const Alignment& aln) {
 
-    os << aln.query_map_data.map_name_ << "\t"
-       << aln.ref_map_data.map_name_ << "\t"
+    os << aln.query_map_data->map_name_ << "\t"
+       << aln.ref_map_data->map_name_ << "\t"
        << (aln.is_forward ? "F" : "R") << "\t"
        << aln << "\n";
   }
@@ -128,28 +148,94 @@ namespace maligner_dp {
        << aln.num_interior_chunks << "\t"
        << aln.score_per_inner_chunk << "\t";
 
-    for(auto& mc : aln.rescaled_matched_chunks) {
-      os << mc << ";";
+    const size_t num_chunks = aln.matched_chunks.size();
+    for(size_t i = 0; i < num_chunks; i++) {
+      os << aln.rescaled_matched_chunk(i) << ";";
     }
 
     os << "\t";
 
     // NEW DEBUG OUTPUT WITH SCORES
-    for(auto& mc : aln.rescaled_matched_chunks) {
-      os << mc.score << ";";
+    for(size_t i = 0; i < num_chunks; i++) {
+      os << aln.rescaled_matched_chunk(i).score << ";";
     }
 
+    // Last, so that readers of the earlier columns are not affected.
+    os << "\t" << aln.num_trials;
+
     return os;
 
   }
 
 
+  void print_alignment(lmm_utils::TextBuffer& buf, const Alignment& aln) {
+
+    buf << aln.query_map_data->map_name_ << '\t'
+        << aln.ref_map_data->map_name_ << '\t'
+        << (aln.is_forward ? "F" : "R") << '\t'
+        << aln << '\n';
+  }
+
+  lmm_utils::TextBuffer& operator<<(lmm_utils::TextBuffer& buf, const Alignment& aln) {
+
+    buf << aln.query_start << '\t'
+        << aln.query_end << '\t'
+        << aln.ref_start << '\t'
+        << aln.ref_end << '\t'
+        << aln.query_start_bp << '\t'
+        << aln.query_end_bp << '\t'
+        << aln.ref_start_bp << '\t'
+        << aln.ref_end_bp << '\t'
+        << aln.matched_chunks.size() << '\t'
+        << aln.query_misses << '\t'
+        << aln.ref_misses << '\t'
+        << aln.query_miss_rate << '\t'
+        << aln.ref_miss_rate << '\t'
+        << aln.total_score << '\t'
+        << aln.total_rescaled_score << '\t'
+        << aln.m_score << '\t'
+        << aln.p_val << '\t'
+        << aln.score.sizing_score << '\t'
+        << aln.rescaled_score.sizing_score << '\t'
+        << aln.query_scaling_factor << '\t'
+        << aln.num_interior_chunks << '\t'
+        << aln.score_per_inner_chunk << '\t';
+
+    // Rescale each chunk once, for both the chunk string and the score string.
+    const size_t num_chunks = aln.matched_chunks.size();
+    MatchedChunkVec rescaled_chunks;
+    rescaled_chunks.reserve(num_chunks);
+    for(size_t i = 0; i < num_chunks; i++) {
+      rescaled_chunks.push_back(aln.rescaled_matched_chunk(i));
+      buf << rescaled_chunks.back() << ';';
+    }
+
+    buf << '\t';
+
+    for(size_t i = 0; i < num_chunks; i++) {
+      buf << rescaled_chunks[i].score << ';';
+    }
+
+    // Last, so that readers of the earlier columns are not affected.
+    buf << '\t' << aln.num_trials;
+
+    return buf;
+
+  }
+
+
   const Alignment INVALID_ALIGNMENT;
 
   std::ostream& operator<<(std::ostream& os, const AlignmentScoreInfo& a) {
-    os << a.a_.query_map_data.map_name_ << "\t"
+    os << a.a_.query_map_data->map_name_ << "\t"
        << a.a_.total_rescaled_score;
     return os;
   }
 
+  lmm_utils::TextBuffer& operator<<(lmm_utils::TextBuffer& buf, const AlignmentScoreInfo& a) {
+    buf << a.a_.query_map_data->map_name_ << '\t'
+        << a.a_.total_rescaled_score;
+    return buf;
+  }
+
 }
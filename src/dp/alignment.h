@@ -4,11 +4,13 @@
 #include <vector>
 #include <ostream>
 #include <algorithm>
+#include <utility>
 
 #include "globals.h"
 #include "common_types.h"
 #include "map_data.h"
 #include "matched_chunk.h"
+#include "text_buffer.h"
 
 #define ALIGNMENT_CLASS_DEBUG 0
 
@@ -29,23 +31,28 @@ namespace maligner_dp {
   class Alignment {
   public:
 
-    Alignment() : is_valid(false) {
+    Alignment() :
+      query_map_data(nullptr),
+      ref_map_data(nullptr),
+      rescale_opts(nullptr),
+      is_valid(false) {
     }
 
-    Alignment(const MatchedChunkVec& mc, const Score& s,
+    Alignment(MatchedChunkVec mc, const Score& s,
       const MapData& query_md,
       const MapData& ref_md,
       bool is_forward_in) :
-      query_map_data(query_md),
-      ref_map_data(ref_md),
-      matched_chunks(mc),
-      rescaled_matched_chunks(matched_chunks),
+      query_map_data(&query_md),
+      ref_map_data(&ref_md),
+      matched_chunks(std::move(mc)),
+      rescale_opts(nullptr),
       score(s),
       rescaled_score(s),
       total_score(0.0),
       total_rescaled_score(0.0),
       m_score(INF),
       p_val(0.0),
+      num_trials(0),
       num_matched_sites(0),
       query_misses(0),
       ref_misses(0),
@@ -119,6 +126,10 @@ namespace maligner_dp {
     // recompute the sizing error for those chunks.
     void rescale_matched_chunks(const AlignOpts& align_opts);
 
+    // The rescaled chunks are not stored. They are computed from the
+    // matched chunk when needed, e.g. for printing.
+    MatchedChunk rescaled_matched_chunk(size_t i) const;
+
     // Compute summary statistics from matched chunks.
     void summarize(); 
 
@@ -148,10 +159,11 @@ namespace maligner_dp {
 
 
     // Attributes
-    MapData query_map_data;
-    MapData ref_map_data;
+    // The maps are not owned by the Alignment, and must outlive it.
+    const MapData* query_map_data;
+    const MapData* ref_map_data;
     MatchedChunkVec matched_chunks;
-    MatchedChunkVec rescaled_matched_chunks;
+    const AlignOpts* rescale_opts; // The options used to rescale the query chunks, or nullptr if not rescaled.
     Score score;
     Score rescaled_score;
 
@@ -159,6 +171,7 @@ namespace maligner_dp {
     double total_rescaled_score;
     double m_score;
     double p_val;
+    int num_trials; // Number of permutation trials used to compute p_val.
 
     // summary statistics of an alignment.
     // These are computable from the matched_chunks
@@ -191,8 +204,8 @@ namespace maligner_dp {
 
     private:
 
-
-    
+    // Rescale mc into rmc. Returns true if the sizing score of the chunk was recomputed.
+    bool rescale_chunk(const MatchedChunk& mc, MatchedChunk& rmc) const;
 
   };
 
@@ -228,6 +241,7 @@ namespace maligner_dp {
     const Alignment& a_;
   };
   std::ostream& operator<<(std::ostream& os, const AlignmentScoreInfo& a);
+  lmm_utils::TextBuffer& operator<<(lmm_utils::TextBuffer& buf, const AlignmentScoreInfo& a);
 
 
   extern const Alignment INVALID_ALIGNMENT;
@@ -305,6 +319,7 @@ namespace maligner_dp {
   //     ref_end_bp = 0;
   //     m_score = 0.0;
   //     p_val = 0.0;
+  //     num_trials = 0;
   //     score_per_inner_chunk = 0.0;
   // }
 
@@ -340,25 +355,10 @@ namespace maligner_dp {
     #endif
 
     size_t num_chunks {matched_chunks.size()};
-    const size_t num_query_frags = query_map_data.num_frags_;
+    const size_t num_query_frags = query_map_data->num_frags_;
 
     for (size_t i = 0; i < num_chunks; i++) {
 
-      // Had an embarassing bug here when using references.
-      // So we use pointers instead and are careful not to use brackets to protect the scope
-      // of local variables used to flip coordinates.
-      //
-      // Reason why references are dangerous:
-      //
-      //     Chunk& qc = matched_chunks[0].query_chunk;
-      //     [ do stuff to qc]
-      //     qc = rescaled_matched_chunks[0].query_chunk. // OOPS! Does a copy assign to matched_chunks[0].query_chunk!
-      //
-      // Pointers are safer:
-      //     Chunk * qc = &matched_chunks[0].query_chunk;
-      //     [do stuff to qc]
-      //     qc = &rescaled_matched_chunks[0].query_chunk; // OK!
-      //
       {
         MatchedChunk * mc = &matched_chunks[i];
         Chunk * qc = &mc->query_chunk;
@@ -368,15 +368,6 @@ namespace maligner_dp {
         qc->end = num_query_frags - qc->end;
       }
 
-      {
-        MatchedChunk * mc = &rescaled_matched_chunks[i];
-        Chunk * qc = &mc->query_chunk;
-
-        std::swap(qc->start, qc->end);
-        qc->start = num_query_frags - qc->start;
-        qc->end = num_query_frags - qc->end;
-      }
-
     }
   }
 
@@ -393,7 +384,7 @@ namespace maligner_dp {
     #endif
 
     size_t num_chunks {matched_chunks.size()};
-    const size_t num_ref_frags = ref_map_data.num_frags_;
+    const size_t num_ref_frags = ref_map_data->num_frags_;
 
 
     for (size_t i = 0; i < num_chunks; i++) {
@@ -407,23 +398,13 @@ namespace maligner_dp {
         rc->end = num_ref_frags - rc->end;
       }
 
-      {
-        MatchedChunk * mc = &rescaled_matched_chunks[i];
-        Chunk * rc = &mc->ref_chunk;
-
-        std::swap(rc->start, rc->end);
-        rc->start = num_ref_frags - rc->start;
-        rc->end = num_ref_frags - rc->end;
-      }
-
     }
 
     std::reverse(matched_chunks.begin(), matched_chunks.end());
-    std::reverse(rescaled_matched_chunks.begin(), rescaled_matched_chunks.end());
 
     // If the reference is circular, we may end up with a starting location that is negative after flipping.
     // If this is the case, increase all indices by num_ref_frags.
-    if(ref_map_data.is_circular_ && (matched_chunks.front().ref_chunk.start < 0)) {
+    if(ref_map_data->is_circular_ && (matched_chunks.front().ref_chunk.start < 0)) {
 
       for(size_t i = 0; i < num_chunks; i++) {
 
@@ -434,13 +415,6 @@ namespace maligner_dp {
           rc->end += num_ref_frags;
         }
 
-        {
-          MatchedChunk * mc = &rescaled_matched_chunks[i];
-          Chunk * rc = &mc->ref_chunk;
-          rc->start += num_ref_frags;
-          rc->end += num_ref_frags;
-        }        
-
       }
 
     }
@@ -472,6 +446,11 @@ namespace maligner_dp {
 
   std::ostream& operator<<(std::ostream& os, const Alignment& aln);
 
+  // Write the same record as above to a TextBuffer, without iostream formatting.
+  // Use these when writing many alignments.
+  void print_alignment(lmm_utils::TextBuffer& buf, const Alignment& aln);
+  lmm_utils::TextBuffer& operator<<(lmm_utils::TextBuffer& buf, const Alignment& aln);
+
 
 
 }
@@ -0,0 +1,541 @@
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <sstream>
+#include <stdexcept>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "alignment_file.h"
+
+namespace maligner_dp {
+
+  namespace {
+
+    const size_t ALIGNMENT = 8;
+
+    // Number of chunks buffered by the writer before they are written to the chunks file.
+    const size_t CHUNK_BUFFER_SIZE = 1 << 16;
+
+    uint64_t aligned(uint64_t offset) {
+      return (offset + ALIGNMENT - 1) / ALIGNMENT * ALIGNMENT;
+    }
+
+    // Pad the file to the next aligned offset, and return the offset.
+    uint64_t pad(std::ofstream& f) {
+      const uint64_t pos = f.tellp();
+      const uint64_t offset = aligned(pos);
+      const char zeros[ALIGNMENT] = {0};
+      f.write(zeros, offset - pos);
+      return offset;
+    }
+
+    bool parse_value(const char * s, int32_t& v) {
+      char * end;
+      errno = 0;
+      const long l = std::strtol(s, &end, 10);
+      v = l;
+      return end != s && *end == '\0' && errno == 0 && l == v;
+    }
+
+    bool parse_value(const char * s, uint32_t& v) {
+      int32_t i;
+      if(!parse_value(s, i) || i < 0) return false;
+      v = i;
+      return true;
+    }
+
+    bool parse_value(const char * s, double& v) {
+      char * end;
+      v = std::strtod(s, &end);
+      return end != s && *end == '\0';
+    }
+
+    // Split s on the delimiter, in place.
+    std::vector<char *> split(char * s, char delim) {
+      std::vector<char *> fields;
+      fields.push_back(s);
+      for(char * p = s; *p; p++) {
+        if(*p == delim) {
+          *p = '\0';
+          fields.push_back(p + 1);
+        }
+      }
+      return fields;
+    }
+
+    // Parse the chunk_string and score_string of the text output.
+    bool parse_chunks(char * chunk_string, char * score_string, std::vector<AlignmentChunkRecord>& chunks) {
+
+      chunks.clear();
+
+      std::vector<char *> chunk_strs = split(chunk_string, ';');
+      std::vector<char *> score_strs = split(score_string, ';');
+
+      // Each chunk is terminated by a ';', so the last field is empty.
+      if(*chunk_strs.back() != '\0' || *score_strs.back() != '\0' || chunk_strs.size() != score_strs.size()) {
+        return false;
+      }
+
+      const size_t num_chunks = chunk_strs.size() - 1;
+      chunks.resize(num_chunks);
+
+      for(size_t i = 0; i < num_chunks; i++) {
+
+        AlignmentChunkRecord& c = chunks[i];
+
+        std::vector<char *> v = split(chunk_strs[i], ',');
+        if(v.size() != 6 ||
+           !parse_value(v[0], c.query_start) || !parse_value(v[1], c.query_end) || !parse_value(v[2], c.query_size) ||
+           !parse_value(v[3], c.ref_start) || !parse_value(v[4], c.ref_end) || !parse_value(v[5], c.ref_size)) {
+          return false;
+        }
+
+        // (query_miss_score, ref_miss_score, sizing_score)
+        char * s = score_strs[i];
+        const size_t n = std::strlen(s);
+        if(n < 2 || s[0] != '(' || s[n - 1] != ')') {
+          return false;
+        }
+        s[n - 1] = '\0';
+        std::vector<char *> scores = split(s + 1, ',');
+        if(scores.size() != 3 || scores[1][0] != ' ' || scores[2][0] != ' ' ||
+           !parse_value(scores[0], c.query_miss_score) ||
+           !parse_value(scores[1] + 1, c.ref_miss_score) ||
+           !parse_value(scores[2] + 1, c.sizing_score)) {
+          return false;
+        }
+
+      }
+
+      return true;
+
+    }
+
+  }
+
+  bool is_alignment_file(const std::string& file_name) {
+
+    std::ifstream f(file_name, std::ios::binary);
+    char magic[sizeof(ALIGNMENT_FILE_MAGIC)];
+
+    if(!f.read(magic, sizeof(magic))) {
+      return false;
+    }
+
+    return std::memcmp(magic, ALIGNMENT_FILE_MAGIC, sizeof(magic)) == 0;
+
+  }
+
+  bool parse_alignment_text(const std::string& line, AlignmentRecord& rec,
+    std::string& query_map, std::string& ref_map, std::vector<AlignmentChunkRecord>& chunks) {
+
+    std::vector<char> buf(line.begin(), line.end());
+    buf.push_back('\0');
+
+    std::vector<char *> f = split(buf.data(), '\t');
+    // num_trials is the last column, and is missing from files written before it was added.
+    if(f.size() != 27 && f.size() != 28) {
+      return false;
+    }
+
+    std::memset(&rec, 0, sizeof(rec));
+    query_map = f[0];
+    ref_map = f[1];
+
+    if(std::strcmp(f[2], "F") == 0) {
+      rec.is_forward = 1;
+    } else if(std::strcmp(f[2], "R") == 0) {
+      rec.is_forward = 0;
+    } else {
+      return false;
+    }
+
+    const bool ok =
+      parse_value(f[3], rec.query_start) &&
+      parse_value(f[4], rec.query_end) &&
+      parse_value(f[5], rec.ref_start) &&
+      parse_value(f[6], rec.ref_end) &&
+      parse_value(f[7], rec.query_start_bp) &&
+      parse_value(f[8], rec.query_end_bp) &&
+      parse_value(f[9], rec.ref_start_bp) &&
+      parse_value(f[10], rec.ref_end_bp) &&
+      parse_value(f[11], rec.num_matched_chunks) &&
+      parse_value(f[12], rec.query_misses) &&
+      parse_value(f[13], rec.ref_misses) &&
+      parse_value(f[14], rec.query_miss_rate) &&
+      parse_value(f[15], rec.ref_miss_rate) &&
+      parse_value(f[16], rec.total_score) &&
+      parse_value(f[17], rec.total_rescaled_score) &&
+      parse_value(f[18], rec.m_score) &&
+      parse_value(f[19], rec.p_val) &&
+      parse_value(f[20], rec.sizing_score) &&
+      parse_value(f[21], rec.sizing_score_rescaled) &&
+      parse_value(f[22], rec.query_scaling_factor) &&
+      parse_value(f[23], rec.num_interior_chunks) &&
+      parse_value(f[24], rec.score_per_inner_chunk) &&
+      parse_chunks(f[25], f[26], chunks) &&
+      (f.size() == 27 || parse_value(f[27], rec.num_trials));
+
+    return ok && chunks.size() == rec.num_matched_chunks;
+
+  }
+
+  void print_alignment(lmm_utils::TextBuffer& buf, const AlignmentRecord& rec,
+    const std::string& query_map, const std::string& ref_map, const AlignmentChunkRecord * chunks) {
+
+    buf << query_map << '\t'
+        << ref_map << '\t'
+        << (rec.is_forward ? "F" : "R") << '\t'
+        << rec.query_start << '\t'
+        << rec.query_end << '\t'
+        << rec.ref_start << '\t'
+        << rec.ref_end << '\t'
+        << rec.query_start_bp << '\t'
+        << rec.query_end_bp << '\t'
+        << rec.ref_start_bp << '\t'
+        << rec.ref_end_bp << '\t'
+        << rec.num_matched_chunks << '\t'
+        << rec.query_misses << '\t'
+        << rec.ref_misses << '\t'
+        << rec.query_miss_rate << '\t'
+        << rec.ref_miss_rate << '\t'
+        << rec.total_score << '\t'
+        << rec.total_rescaled_score << '\t'
+        << rec.m_score << '\t'
+        << rec.p_val << '\t'
+        << rec.sizing_score << '\t'
+        << rec.sizing_score_rescaled << '\t'
+        << rec.query_scaling_factor << '\t'
+        << rec.num_interior_chunks << '\t'
+        << rec.score_per_inner_chunk << '\t';
+
+    for(size_t i = 0; i < rec.num_matched_chunks; i++) {
+      const AlignmentChunkRecord& c = chunks[i];
+      buf << c.query_start << ',' << c.query_end << ',' << c.query_size << ','
+          << c.ref_start << ',' << c.ref_end << ',' << c.ref_size << ';';
+    }
+
+    buf << '\t';
+
+    for(size_t i = 0; i < rec.num_matched_chunks; i++) {
+      const AlignmentChunkRecord& c = chunks[i];
+      buf << '(' << c.query_miss_score
+          << ", " << c.ref_miss_score
+          << ", " << c.sizing_score
+          << ");";
+    }
+
+    buf << '\t' << rec.num_trials << '\n';
+
+  }
+
+
+  ///////////////////////////////////////////////////////////////////////////
+  // AlignmentFileWriter
+
+  AlignmentFileWriter::AlignmentFileWriter(const std::string& file_name) :
+    file_name_(file_name),
+    chunks_file_name_(file_name + ".chunks.tmp"),
+    f_(file_name, std::ios::binary),
+    chunks_f_(chunks_file_name_, std::ios::binary),
+    num_alignments_(0),
+    num_chunks_(0),
+    is_open_(true) {
+
+    if(!f_ || !chunks_f_) {
+      throw std::runtime_error("Could not open alignment file for writing: " + file_name);
+    }
+
+    // Reserve space for the header, which is written on close.
+    AlignmentFileHeader header;
+    std::memset(&header, 0, sizeof(header));
+    f_.write(reinterpret_cast<const char*>(&header), sizeof(header));
+
+    chunks_.reserve(CHUNK_BUFFER_SIZE);
+
+  }
+
+  AlignmentFileWriter::~AlignmentFileWriter() {
+    if(is_open_) {
+      try {
+        close();
+      } catch(std::exception& e) {
+        std::cerr << e.what() << "\n";
+      }
+    }
+  }
+
+  uint32_t AlignmentFileWriter::name_index(const std::string& name) {
+    auto it = name_indices_.find(name);
+    if(it != name_indices_.end()) {
+      return it->second;
+    }
+    const uint32_t ind = names_.size();
+    names_.push_back(name);
+    name_indices_.insert(std::make_pair(name, ind));
+    return ind;
+  }
+
+  void AlignmentFileWriter::flush_chunks() {
+    chunks_f_.write(reinterpret_cast<const char*>(chunks_.data()), chunks_.size() * sizeof(AlignmentChunkRecord));
+    chunks_.clear();
+  }
+
+  void AlignmentFileWriter::write(const AlignmentRecord& rec, const std::string& query_map, const std::string& ref_map,
+    const AlignmentChunkRecord * chunks) {
+
+    AlignmentRecord r(rec);
+    r.query_map = name_index(query_map);
+    r.ref_map = name_index(ref_map);
+    r.chunks_offset = num_chunks_;
+    f_.write(reinterpret_cast<const char*>(&r), sizeof(r));
+
+    chunks_.insert(chunks_.end(), chunks, chunks + rec.num_matched_chunks);
+    if(chunks_.size() >= CHUNK_BUFFER_SIZE) {
+      flush_chunks();
+    }
+
+    num_chunks_ += rec.num_matched_chunks;
+    num_alignments_++;
+
+  }
+
+  void make_alignment_record(const Alignment& aln, AlignmentRecord& rec, std::vector<AlignmentChunkRecord>& chunks) {
+
+    std::memset(&rec, 0, sizeof(rec));
+    std::memset(&rec, 0, sizeof(rec));
+    rec.is_forward = aln.is_forward;
+    rec.query_start = aln.query_start;
+    rec.query_end = aln.query_end;
+    rec.ref_start = aln.ref_start;
+    rec.ref_end = aln.ref_end;
+    rec.query_start_bp = aln.query_start_bp;
+    rec.query_end_bp = aln.query_end_bp;
+    rec.ref_start_bp = aln.ref_start_bp;
+    rec.ref_end_bp = aln.ref_end_bp;
+    rec.num_matched_chunks = aln.matched_chunks.size();
+    rec.query_misses = aln.query_misses;
+    rec.ref_misses = aln.ref_misses;
+    rec.query_miss_rate = aln.query_miss_rate;
+    rec.ref_miss_rate = aln.ref_miss_rate;
+    rec.total_score = aln.total_score;
+    rec.total_rescaled_score = aln.total_rescaled_score;
+    rec.m_score = aln.m_score;
+    rec.p_val = aln.p_val;
+    rec.num_trials = aln.num_trials;
+    rec.sizing_score = aln.score.sizing_score;
+    rec.sizing_score_rescaled = aln.rescaled_score.sizing_score;
+    rec.query_scaling_factor = aln.query_scaling_factor;
+    rec.num_interior_chunks = aln.num_interior_chunks;
+    rec.score_per_inner_chunk = aln.score_per_inner_chunk;
+
+    rec.chunks_offset = chunks.size();
+
+    for(size_t i = 0; i < rec.num_matched_chunks; i++) {
+      const MatchedChunk mc = aln.rescaled_matched_chunk(i);
+      AlignmentChunkRecord c;
+      c.query_start = mc.query_chunk.start;
+      c.query_end = mc.query_chunk.end;
+      c.query_size = mc.query_chunk.size;
+      c.ref_start = mc.ref_chunk.start;
+      c.ref_end = mc.ref_chunk.end;
+      c.ref_size = mc.ref_chunk.size;
+      c.query_miss_score = mc.score.query_miss_score;
+      c.ref_miss_score = mc.score.ref_miss_score;
+      c.sizing_score = mc.score.sizing_score;
+      chunks.push_back(c);
+    }
+
+  }
+
+  void AlignmentRecordBlock::add(const Alignment& aln) {
+    records.emplace_back();
+    make_alignment_record(aln, records.back(), chunks);
+    query_maps.push_back(aln.query_map_data->map_name_);
+    ref_maps.push_back(aln.ref_map_data->map_name_);
+  }
+
+  void AlignmentRecordBlock::clear() {
+    records.clear();
+    chunks.clear();
+    query_maps.clear();
+    ref_maps.clear();
+  }
+
+  void AlignmentFileWriter::write(const Alignment& aln) {
+    AlignmentRecord rec;
+    std::vector<AlignmentChunkRecord> chunks;
+    make_alignment_record(aln, rec, chunks);
+    write(rec, aln.query_map_data->map_name_, aln.ref_map_data->map_name_, chunks.data());
+  }
+
+  void AlignmentFileWriter::write(const AlignmentRecordBlock& block) {
+    for(size_t i = 0; i < block.records.size(); i++) {
+      const AlignmentRecord& rec = block.records[i];
+      write(rec, block.query_maps[i], block.ref_maps[i], block.chunks.data() + rec.chunks_offset);
+    }
+  }
+
+  void AlignmentFileWriter::close() {
+
+    if(!is_open_) {
+      return;
+    }
+    is_open_ = false;
+
+    flush_chunks();
+    chunks_f_.close();
+
+    AlignmentFileHeader header;
+    std::memset(&header, 0, sizeof(header));
+    std::memcpy(header.magic, ALIGNMENT_FILE_MAGIC, sizeof(header.magic));
+    header.version = ALIGNMENT_FILE_VERSION;
+    header.byte_order = ALIGNMENT_FILE_BYTE_ORDER;
+    header.num_alignments = num_alignments_;
+    header.num_chunks = num_chunks_;
+    header.num_names = names_.size();
+    header.alignments_offset = sizeof(header);
+
+    // Copy the chunks from the temporary file.
+    header.chunks_offset = pad(f_);
+    {
+      std::ifstream chunks_in(chunks_file_name_, std::ios::binary);
+      if(num_chunks_ > 0) {
+        f_ << chunks_in.rdbuf();
+      }
+    }
+    std::remove(chunks_file_name_.c_str());
+
+    std::vector<uint64_t> name_offsets;
+    name_offsets.reserve(names_.size() + 1);
+    uint64_t name_offset = 0;
+    for(const auto& name : names_) {
+      name_offsets.push_back(name_offset);
+      name_offset += name.size();
+    }
+    name_offsets.push_back(name_offset);
+
+    header.name_offsets_offset = pad(f_);
+    f_.write(reinterpret_cast<const char*>(name_offsets.data()), name_offsets.size() * sizeof(uint64_t));
+
+    header.names_offset = pad(f_);
+    for(const auto& name : names_) {
+      f_.write(name.data(), name.size());
+    }
+
+    f_.seekp(0);
+    f_.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    f_.close();
+
+    if(!f_) {
+      throw std::runtime_error("Error writing alignment file: " + file_name_);
+    }
+
+  }
+
+
+  ///////////////////////////////////////////////////////////////////////////
+  // AlignmentFile
+
+  // Return the count values of type T at offset, or nullptr if they are not within the file.
+  template<typename T>
+  const T * AlignmentFile::values_at(uint64_t offset, uint64_t count) const {
+
+    if(offset % ALIGNMENT != 0 || offset > size_ || count > (size_ - offset) / sizeof(T)) {
+      return nullptr;
+    }
+
+    return reinterpret_cast<const T*>(data_ + offset);
+
+  }
+
+  AlignmentFile::AlignmentFile(const std::string& file_name) :
+    file_name_(file_name),
+    data_(nullptr),
+    size_(0),
+    header_(nullptr),
+    records_(nullptr),
+    chunks_(nullptr),
+    name_offsets_(nullptr),
+    names_(nullptr) {
+
+    const int fd = open(file_name.c_str(), O_RDONLY);
+    if(fd < 0) {
+      throw AlignmentFileException("could not open " + file_name);
+    }
+
+    struct stat st;
+    if(fstat(fd, &st) != 0 || size_t(st.st_size) < sizeof(AlignmentFileHeader)) {
+      close(fd);
+      throw AlignmentFileException(file_name + " is too short");
+    }
+
+    void * data = mmap(nullptr, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+
+    if(data == MAP_FAILED) {
+      throw AlignmentFileException("could not map " + file_name);
+    }
+
+    madvise(data, st.st_size, MADV_SEQUENTIAL);
+
+    data_ = static_cast<const char*>(data);
+    size_ = st.st_size;
+    header_ = reinterpret_cast<const AlignmentFileHeader*>(data_);
+
+    std::string error;
+
+    if(std::memcmp(header_->magic, ALIGNMENT_FILE_MAGIC, sizeof(ALIGNMENT_FILE_MAGIC)) != 0) {
+      error = file_name + " is not a binary alignment file";
+    } else if(header_->version != ALIGNMENT_FILE_VERSION || header_->byte_order != ALIGNMENT_FILE_BYTE_ORDER) {
+      error = file_name + " was written by an incompatible version or machine";
+    } else {
+      records_ = values_at<AlignmentRecord>(header_->alignments_offset, header_->num_alignments);
+      chunks_ = values_at<AlignmentChunkRecord>(header_->chunks_offset, header_->num_chunks);
+      name_offsets_ = values_at<uint64_t>(header_->name_offsets_offset, header_->num_names + 1);
+      if(!records_ || !chunks_ || !name_offsets_ ||
+         !(names_ = values_at<char>(header_->names_offset, name_offsets_[header_->num_names]))) {
+        error = file_name + " is truncated";
+      }
+    }
+
+    if(!error.empty()) {
+      munmap(data, size_);
+      throw AlignmentFileException(error);
+    }
+
+  }
+
+  AlignmentFile::~AlignmentFile() {
+    munmap(const_cast<char*>(data_), size_);
+  }
+
+  std::string AlignmentFile::name(uint32_t i) const {
+    if(i >= header_->num_names || name_offsets_[i] > name_offsets_[i + 1] ||
+       name_offsets_[i + 1] > name_offsets_[header_->num_names]) {
+      throw AlignmentFileException(file_name_ + " is corrupt");
+    }
+    return std::string(names_ + name_offsets_[i], names_ + name_offsets_[i + 1]);
+  }
+
+  void AlignmentFile::print_alignment(lmm_utils::TextBuffer& buf, size_t i) const {
+
+    const AlignmentRecord& rec = records_[i];
+
+    if(rec.chunks_offset > header_->num_chunks ||
+       rec.num_matched_chunks > header_->num_chunks - rec.chunks_offset) {
+      std::ostringstream msg;
+      msg << file_name_ << " is corrupt at alignment " << i;
+      throw AlignmentFileException(msg.str());
+    }
+
+    maligner_dp::print_alignment(buf, rec, name(rec.query_map), name(rec.ref_map), chunks_ + rec.chunks_offset);
+
+  }
+
+}
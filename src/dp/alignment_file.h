@@ -0,0 +1,234 @@
+#ifndef ALIGNMENT_FILE_H
+#define ALIGNMENT_FILE_H
+
+/**********************************************************
+
+A compact binary file of alignments, with the same fields as the
+.aln text output (see AlignmentHeader and print_alignment).
+
+Each alignment is a fixed width AlignmentRecord. The map names are
+stored once, in a string table, and referred to by index. The rescaled
+matched chunks of all alignments are stored out of line, in a single
+array of AlignmentChunkRecord, with the chunks of each alignment
+contiguous from AlignmentRecord::chunks_offset.
+
+Doubles are stored at full precision. Converting a binary file to
+text gives the same text as the aligner would have written, and
+converting text to binary and back gives the same text.
+
+Layout (native byte order, all sections aligned to 8 bytes):
+  AlignmentFileHeader
+  AlignmentRecord for each alignment
+  AlignmentChunkRecord for each chunk
+  name offsets: num_names + 1 uint64 offsets of the names in the name data
+  name data: the names, without terminators
+
+The file is written with an AlignmentFileWriter, which writes the
+chunks to a temporary file next to the output until it is closed.
+lib/malignpy/core/maligner_dp_alignments_binary.py reads the file
+with numpy.
+
+**************************************************************/
+
+#include <cstdint>
+#include <cstdio>
+#include <exception>
+#include <fstream>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "alignment.h"
+#include "text_buffer.h"
+
+namespace maligner_dp {
+
+  class AlignmentFileException : public std::exception
+  {
+    public:
+
+      AlignmentFileException(const std::string& msg) {
+        message_ = "Error reading alignment file: " + msg;
+      };
+
+      virtual const char* what() const noexcept
+      {
+        return message_.c_str();
+      }
+
+      std::string message_;
+
+  };
+
+  struct AlignmentFileHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t byte_order; // Written as ALIGNMENT_FILE_BYTE_ORDER.
+    uint64_t num_alignments;
+    uint64_t num_chunks;
+    uint64_t num_names;
+    uint64_t alignments_offset;
+    uint64_t chunks_offset;
+    uint64_t name_offsets_offset;
+    uint64_t names_offset;
+  };
+
+  // The fields of an alignment, in the order of the text output.
+  struct AlignmentRecord {
+    uint32_t query_map; // Index in the name table
+    uint32_t ref_map; // Index in the name table
+    int32_t is_forward;
+    int32_t query_start;
+    int32_t query_end;
+    int32_t ref_start;
+    int32_t ref_end;
+    int32_t query_start_bp;
+    int32_t query_end_bp;
+    int32_t ref_start_bp;
+    int32_t ref_end_bp;
+    uint32_t num_matched_chunks;
+    int32_t query_misses;
+    int32_t ref_misses;
+    int32_t num_trials;
+    int32_t num_interior_chunks;
+    double query_miss_rate;
+    double ref_miss_rate;
+    double total_score;
+    double total_rescaled_score;
+    double m_score;
+    double p_val;
+    double sizing_score;
+    double sizing_score_rescaled;
+    double query_scaling_factor;
+    double score_per_inner_chunk;
+    uint64_t chunks_offset; // Index of the first chunk of the alignment in the chunk array.
+  };
+
+  // A rescaled matched chunk, as in the chunk_string and score_string of the text output.
+  struct AlignmentChunkRecord {
+    int32_t query_start;
+    int32_t query_end;
+    int32_t query_size;
+    int32_t ref_start;
+    int32_t ref_end;
+    int32_t ref_size;
+    double query_miss_score;
+    double ref_miss_score;
+    double sizing_score;
+  };
+
+  const char ALIGNMENT_FILE_MAGIC[8] = {'M', 'A', 'L', 'I', 'G', 'N', 'B', 'A'};
+  const uint32_t ALIGNMENT_FILE_VERSION = 1;
+  const uint32_t ALIGNMENT_FILE_BYTE_ORDER = 0x01020304;
+
+  // Return true if the file starts with the alignment file magic bytes.
+  bool is_alignment_file(const std::string& file_name);
+
+  // Parse an alignment line of the text output. Returns false if the line is malformed.
+  bool parse_alignment_text(const std::string& line, AlignmentRecord& rec,
+    std::string& query_map, std::string& ref_map, std::vector<AlignmentChunkRecord>& chunks);
+
+  // Write an alignment line of the text output.
+  void print_alignment(lmm_utils::TextBuffer& buf, const AlignmentRecord& rec,
+    const std::string& query_map, const std::string& ref_map, const AlignmentChunkRecord * chunks);
+
+  // Convert an alignment to a record, appending its rescaled chunks to chunks.
+  // rec.chunks_offset is set to the index of the first of them, and the name indices are not set.
+  void make_alignment_record(const Alignment& aln, AlignmentRecord& rec, std::vector<AlignmentChunkRecord>& chunks);
+
+  // Alignments converted to records, to be written later by an AlignmentFileWriter.
+  // Use this to keep alignments whose maps do not outlive them.
+  struct AlignmentRecordBlock {
+    void add(const Alignment& aln);
+    void clear();
+    bool empty() const { return records.empty(); }
+
+    std::vector<AlignmentRecord> records; // chunks_offset is the index in chunks.
+    std::vector<AlignmentChunkRecord> chunks;
+    std::vector<std::string> query_maps;
+    std::vector<std::string> ref_maps;
+  };
+
+  class AlignmentFileWriter {
+
+  public:
+
+    // Throws std::runtime_error if the file can not be opened.
+    AlignmentFileWriter(const std::string& file_name);
+    ~AlignmentFileWriter();
+
+    AlignmentFileWriter(const AlignmentFileWriter&) = delete;
+    AlignmentFileWriter& operator=(const AlignmentFileWriter&) = delete;
+
+    void write(const Alignment& aln);
+    void write(const AlignmentRecordBlock& block);
+
+    // Write an alignment from its fields. rec.chunks_offset is ignored.
+    void write(const AlignmentRecord& rec, const std::string& query_map, const std::string& ref_map,
+      const AlignmentChunkRecord * chunks);
+
+    // Write the chunks and the name table, and complete the header.
+    // Throws std::runtime_error on a write error.
+    void close();
+
+    uint64_t num_alignments() const { return num_alignments_; }
+
+  private:
+
+    uint32_t name_index(const std::string& name);
+    void flush_chunks();
+
+    std::string file_name_;
+    std::string chunks_file_name_;
+    std::ofstream f_;
+    std::ofstream chunks_f_;
+    std::vector<AlignmentChunkRecord> chunks_; // Buffered chunks, not yet written to chunks_f_.
+    std::unordered_map<std::string, uint32_t> name_indices_;
+    std::vector<std::string> names_;
+    uint64_t num_alignments_;
+    uint64_t num_chunks_;
+    bool is_open_;
+
+  };
+
+  // A read only, memory mapped alignment file.
+  class AlignmentFile {
+
+  public:
+
+    // Throws AlignmentFileException if the file can not be read.
+    AlignmentFile(const std::string& file_name);
+    ~AlignmentFile();
+
+    AlignmentFile(const AlignmentFile&) = delete;
+    AlignmentFile& operator=(const AlignmentFile&) = delete;
+
+    uint64_t num_alignments() const { return header_->num_alignments; }
+    uint64_t num_names() const { return header_->num_names; }
+
+    const AlignmentRecord& record(size_t i) const { return records_[i]; }
+    const AlignmentChunkRecord * chunks(size_t i) const { return chunks_ + records_[i].chunks_offset; }
+    std::string name(uint32_t i) const;
+
+    // Write alignment i as a line of the text output.
+    void print_alignment(lmm_utils::TextBuffer& buf, size_t i) const;
+
+  private:
+
+    template<typename T>
+    const T * values_at(uint64_t offset, uint64_t count) const;
+
+    std::string file_name_;
+    const char * data_;
+    size_t size_;
+    const AlignmentFileHeader * header_;
+    const AlignmentRecord * records_;
+    const AlignmentChunkRecord * chunks_;
+    const uint64_t * name_offsets_;
+    const char * names_;
+
+  };
+
+}
+
+#endif
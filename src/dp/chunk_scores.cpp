@@ -0,0 +1,454 @@
+#include <algorithm>
+#include <limits>
+
+#include "chunk_scores.h"
+#include "globals.h"
+
+#if (defined(__x86_64__) || defined(__i386__)) && defined(__GNUC__)
+#define MALIGNER_X86_SIMD 1
+#include <immintrin.h>
+#else
+#define MALIGNER_X86_SIMD 0
+#endif
+
+namespace maligner_dp {
+
+  using Constants::INF;
+
+  void RowExtensions::reset(int n, int ref_max_misses) {
+    const int int_max = std::numeric_limits<int>::max();
+    score.assign(n, -INF);
+    ref_miss_total.assign(n, int_max);
+    query_miss_total.assign(n, int_max);
+    ref_miss.assign(n, int_max);
+    query_miss.assign(n, int_max);
+    k.assign(n, -1);
+    l.assign(n, -1);
+    lane_scores.resize(ref_max_misses + 1);
+  }
+
+  namespace {
+
+    // The number of lanes scored at once, one bit per lane in a uint64_t.
+    const int MAX_LANES = 64;
+
+    // Lanes [begin, end) of cell (i, j). Lane r is the chunk with r reference misses,
+    // from column l = j - 1 - r.
+    struct Lanes {
+      int j;
+      int begin;
+      int end;
+      const int * ref_sizes; // ref_partial_sums(j-1, r)
+      const double * ref_sd_inv; // sd_inv(j-1, r)
+      bool is_last_ref_col;
+      double best_score; // Lanes scoring below the best extension of the cell so far can be dropped.
+    };
+
+    // Set up the lanes for cell (i, j). Returns the number of lanes.
+    inline int start_cell(const RowExtensionInputs& in, Lanes& lanes) {
+      lanes.ref_sizes = in.ref_partial_sums->chunks_ending_at(lanes.j - 1);
+      lanes.ref_sd_inv = in.ref_sd_inv->chunks_ending_at(lanes.j - 1);
+      lanes.is_last_ref_col = (lanes.j == in.n - 1);
+      return std::min(lanes.j, in.ref_max_misses + 1);
+    }
+
+    // Score lane r exactly as the scalar loop of the max miss fill does.
+    // Returns false if the fill stops at this lane.
+    inline bool score_lane(const RowExtensionInputs& in, const Lanes& lanes, int r, double * scores,
+      uint64_t& mask) {
+
+      const int l = lanes.j - 1 - r;
+      const double target_score = in.target_scores[l];
+
+      if (target_score == -INF) return true;
+
+      if (in.target_query_misses[l] + in.query_miss > in.query_max_total_misses ||
+          in.target_ref_misses[l] + r > in.ref_max_total_misses) {
+        return true;
+      }
+
+      const bool is_ref_boundary = !in.ref_is_bounded && (l == 0 || lanes.is_last_ref_col);
+      const int ref_size = lanes.ref_sizes[r];
+
+      double size_penalty = 0.0;
+      if (!is_ref_boundary && (!in.is_query_boundary || in.query_size > ref_size)) {
+        double delta = in.query_size - ref_size;
+        size_penalty = delta*lanes.ref_sd_inv[r];
+        size_penalty = size_penalty*size_penalty;
+      }
+
+      if (size_penalty > in.max_chunk_sizing_error) {
+        // Ref chunk only grows with r.
+        return !(ref_size > in.query_size);
+      }
+
+      double chunk_score = -size_penalty - in.query_miss_penalty - in.ref_miss_penalties[r];
+      scores[r] = chunk_score + target_score;
+      if (scores[r] >= lanes.best_score) {
+        mask |= uint64_t(1) << (r - lanes.begin);
+      }
+      return true;
+
+    }
+
+    inline uint64_t score_lanes_scalar(const RowExtensionInputs& in, const Lanes& lanes, int r,
+      double * scores, bool& stopped, uint64_t mask) {
+      for (; r < lanes.end; r++) {
+        if (!score_lane(in, lanes, r, scores, mask)) {
+          stopped = true;
+          break;
+        }
+      }
+      return mask;
+    }
+
+    // Update the best extension of cell j with the allowed lanes, in order of increasing ref_miss.
+    // Lanes which score below the best may be left out, since they can not replace it.
+    inline void update_best(const RowExtensionInputs& in, const Lanes& lanes, uint64_t allowed,
+      RowExtensions& best) {
+
+      const int j = lanes.j;
+
+      for(; allowed; allowed &= allowed - 1) {
+
+        const int ref_miss = lanes.begin + __builtin_ctzll(allowed);
+        const int l = j - ref_miss - 1;
+        const int ref_miss_total = in.target_ref_misses[l] + ref_miss;
+        const int query_miss_total = in.target_query_misses[l] + in.query_miss;
+        const double this_score = best.lane_scores[ref_miss];
+
+        // Test whether this score is better. Break ties consistently, by
+        // first minimizing reference misses. If tied there, minimize query misses.
+        bool this_is_better {false};
+        if(this_score > best.score[j]) {
+          this_is_better = true;
+        } else if (this_score == best.score[j]) {
+          if(ref_miss_total < best.ref_miss_total[j]) {
+            this_is_better = true;
+          } else if (ref_miss_total == best.ref_miss_total[j]) {
+            if(query_miss_total < best.query_miss_total[j]) {
+              this_is_better = true;
+            } else if (query_miss_total == best.query_miss_total[j]) {
+              this_is_better = (ref_miss < best.ref_miss[j]) ||
+                               (ref_miss == best.ref_miss[j] && in.query_miss < best.query_miss[j]);
+            }
+          }
+        }
+
+        if (this_is_better) {
+          best.score[j] = this_score;
+          best.ref_miss_total[j] = ref_miss_total;
+          best.query_miss_total[j] = query_miss_total;
+          best.ref_miss[j] = ref_miss;
+          best.query_miss[j] = in.query_miss;
+          best.k[j] = in.k;
+          best.l[j] = l;
+        }
+
+      }
+
+    }
+
+  }
+
+  void extend_row_scalar(const RowExtensionInputs& in, RowExtensions& best) {
+    Lanes lanes;
+    for (lanes.j = 1; lanes.j < in.n; lanes.j++) {
+      const int num_lanes = start_cell(in, lanes);
+      lanes.best_score = best.score[lanes.j];
+      bool stopped = false;
+      for (lanes.begin = 0; lanes.begin < num_lanes && !stopped; lanes.begin = lanes.end) {
+        lanes.end = std::min(num_lanes, lanes.begin + MAX_LANES);
+        const uint64_t allowed = score_lanes_scalar(in, lanes, lanes.begin, &best.lane_scores[0], stopped, 0);
+        update_best(in, lanes, allowed, best);
+      }
+    }
+  }
+
+#if MALIGNER_X86_SIMD
+
+  namespace {
+
+    // The lanes of a block which may replace the best extension: lanes that are
+    // allowed and have the highest score in the block. Any other allowed lane
+    // is worse than these, since no two lanes of a cell tie on (score, misses).
+    inline int block_best(int in_play, int too_big, int ref_is_longer, int not_worse, bool& stopped) {
+      const int stops = in_play & too_big & ref_is_longer;
+      int allowed = in_play & ~too_big & not_worse;
+      if (stops) {
+        allowed &= (stops & -stops) - 1; // Lanes before the first stop
+        stopped = true;
+      }
+      return allowed;
+    }
+
+    // Values which are the same for every cell of the row, broadcast to the lanes.
+    struct Sse41Row {
+
+      __attribute__((target("sse4.1")))
+      Sse41Row(const RowExtensionInputs& in) :
+        neg_inf(_mm_set1_pd(-INF)),
+        sign_bit(_mm_set1_pd(-0.0)),
+        query_miss_penalty(_mm_set1_pd(in.query_miss_penalty)),
+        max_error(_mm_set1_pd(in.max_chunk_sizing_error)),
+        query_size(_mm_set1_epi32(in.query_size)),
+        query_miss(_mm_set1_epi32(in.query_miss)),
+        query_max_total_misses(_mm_set1_epi32(in.query_max_total_misses)),
+        ref_max_total_misses(_mm_set1_epi32(in.ref_max_total_misses)),
+        ref_boundary_check(_mm_set1_epi32(in.ref_is_bounded ? 0 : -1)),
+        query_boundary_check(_mm_set1_epi32(in.is_query_boundary ? -1 : 0)),
+        lane_bits(_mm_setr_epi32(1, 2, 0, 0)) {}
+
+      __m128d neg_inf, sign_bit, query_miss_penalty, max_error;
+      __m128i query_size, query_miss, query_max_total_misses, ref_max_total_misses;
+      __m128i ref_boundary_check, query_boundary_check, lane_bits;
+
+    };
+
+    // Two lanes per block. An odd last lane is scored by the scalar code.
+    __attribute__((target("sse4.1")))
+    inline uint64_t score_lanes_sse41(const RowExtensionInputs& in, const Sse41Row& c, const Lanes& lanes,
+      double * scores, bool& stopped) {
+
+      uint64_t mask = 0;
+
+      const __m128d best_score = _mm_set1_pd(lanes.best_score);
+      const __m128i first_col_lane = _mm_set1_epi32(lanes.j - 1); // The lane with l == 0
+      const __m128i all_ref_boundary = lanes.is_last_ref_col ? c.ref_boundary_check : _mm_setzero_si128();
+
+      int r = lanes.begin;
+      for (; r + 2 <= lanes.end; r += 2) {
+
+        // Lane r is at column l_low + 1, and lane r + 1 at column l_low.
+        const int l_low = lanes.j - 2 - r;
+        __m128d target_score = _mm_loadu_pd(in.target_scores + l_low);
+        target_score = _mm_shuffle_pd(target_score, target_score, 1);
+        const __m128i target_qm = _mm_shuffle_epi32(_mm_loadl_epi64((const __m128i*)(in.target_query_misses + l_low)), 0xE1);
+        const __m128i target_rm = _mm_shuffle_epi32(_mm_loadl_epi64((const __m128i*)(in.target_ref_misses + l_low)), 0xE1);
+        const __m128i lane = _mm_setr_epi32(r, r + 1, 0, 0);
+        const __m128i ref_size = _mm_loadl_epi64((const __m128i*)(lanes.ref_sizes + r));
+
+        const __m128i too_many_misses = _mm_or_si128(
+          _mm_cmpgt_epi32(_mm_add_epi32(target_qm, c.query_miss), c.query_max_total_misses),
+          _mm_cmpgt_epi32(_mm_add_epi32(target_rm, lane), c.ref_max_total_misses));
+        const int in_play = ~(_mm_movemask_pd(_mm_cmpeq_pd(target_score, c.neg_inf)) |
+                              _mm_movemask_ps(_mm_castsi128_ps(too_many_misses))) & 0x3;
+
+        const __m128i is_ref_boundary = _mm_or_si128(all_ref_boundary,
+          _mm_and_si128(c.ref_boundary_check, _mm_cmpeq_epi32(lane, first_col_lane)));
+        const __m128i no_query_penalty = _mm_andnot_si128(_mm_cmpgt_epi32(c.query_size, ref_size), c.query_boundary_check);
+        const __m128d no_penalty = _mm_castsi128_pd(_mm_cvtepi32_epi64(_mm_or_si128(is_ref_boundary, no_query_penalty)));
+
+        const __m128d delta = _mm_cvtepi32_pd(_mm_sub_epi32(c.query_size, ref_size));
+        __m128d size_penalty = _mm_mul_pd(delta, _mm_loadu_pd(lanes.ref_sd_inv + r));
+        size_penalty = _mm_mul_pd(size_penalty, size_penalty);
+        size_penalty = _mm_andnot_pd(no_penalty, size_penalty);
+
+        __m128d chunk_score = _mm_sub_pd(_mm_xor_pd(size_penalty, c.sign_bit), c.query_miss_penalty);
+        chunk_score = _mm_sub_pd(chunk_score, _mm_loadu_pd(in.ref_miss_penalties + r));
+        const __m128d score = _mm_add_pd(chunk_score, target_score);
+        _mm_storeu_pd(scores + r, score);
+
+        const int too_big = _mm_movemask_pd(_mm_cmpgt_pd(size_penalty, c.max_error));
+        const int ref_is_longer = _mm_movemask_ps(_mm_castsi128_ps(_mm_cmpgt_epi32(ref_size, c.query_size))) & 0x3;
+        const int not_worse = _mm_movemask_pd(_mm_cmpge_pd(score, best_score));
+        const int allowed = block_best(in_play, too_big, ref_is_longer, not_worse, stopped);
+
+        // Keep the allowed lanes with the highest score.
+        const __m128d is_allowed = _mm_castsi128_pd(_mm_cvtepi32_epi64(
+          _mm_cmpeq_epi32(_mm_and_si128(_mm_set1_epi32(allowed), c.lane_bits), c.lane_bits)));
+        __m128d max_score = _mm_blendv_pd(c.neg_inf, score, is_allowed);
+        max_score = _mm_max_pd(max_score, _mm_shuffle_pd(max_score, max_score, 1));
+        const int at_max = _mm_movemask_pd(_mm_cmpeq_pd(score, max_score)) & allowed;
+
+        mask |= uint64_t(at_max) << (r - lanes.begin);
+        if (stopped) return mask;
+
+      }
+
+      return score_lanes_scalar(in, lanes, r, scores, stopped, mask);
+
+    }
+
+    // Values which are the same for every cell of the row, broadcast to the lanes.
+    struct Avx2Row {
+
+      __attribute__((target("avx2")))
+      Avx2Row(const RowExtensionInputs& in) :
+        neg_inf(_mm256_set1_pd(-INF)),
+        sign_bit(_mm256_set1_pd(-0.0)),
+        query_miss_penalty(_mm256_set1_pd(in.query_miss_penalty)),
+        max_error(_mm256_set1_pd(in.max_chunk_sizing_error)),
+        query_size(_mm_set1_epi32(in.query_size)),
+        query_miss(_mm_set1_epi32(in.query_miss)),
+        query_max_total_misses(_mm_set1_epi32(in.query_max_total_misses)),
+        ref_max_total_misses(_mm_set1_epi32(in.ref_max_total_misses)),
+        ref_boundary_check(_mm_set1_epi32(in.ref_is_bounded ? 0 : -1)),
+        query_boundary_check(_mm_set1_epi32(in.is_query_boundary ? -1 : 0)),
+        lane_offsets(_mm_setr_epi32(0, 1, 2, 3)),
+        reversed_lane_offsets(_mm_setr_epi32(3, 2, 1, 0)),
+        lane_bits(_mm_setr_epi32(1, 2, 4, 8)) {}
+
+      __m256d neg_inf, sign_bit, query_miss_penalty, max_error;
+      __m128i query_size, query_miss, query_max_total_misses, ref_max_total_misses;
+      __m128i ref_boundary_check, query_boundary_check;
+      __m128i lane_offsets, reversed_lane_offsets, lane_bits;
+
+    };
+
+    // Four lanes per block. The last block is loaded with a mask, so that no element
+    // past the lanes is read.
+    __attribute__((target("avx2")))
+    inline uint64_t score_lanes_avx2(const RowExtensionInputs& in, const Avx2Row& c, const Lanes& lanes,
+      double * scores, bool& stopped) {
+
+      uint64_t mask = 0;
+
+      const __m256d best_score = _mm256_set1_pd(lanes.best_score);
+      const __m128i first_col_lane = _mm_set1_epi32(lanes.j - 1); // The lane with l == 0
+      const __m128i all_ref_boundary = lanes.is_last_ref_col ? c.ref_boundary_check : _mm_setzero_si128();
+
+      for (int r = lanes.begin; r < lanes.end; r += 4) {
+
+        const __m128i num_lanes = _mm_set1_epi32(lanes.end - r);
+        const __m128i lane_mask = _mm_cmpgt_epi32(num_lanes, c.lane_offsets);
+        const __m128i col_mask = _mm_cmpgt_epi32(num_lanes, c.reversed_lane_offsets);
+        const __m256i lane_mask_64 = _mm256_cvtepi32_epi64(lane_mask);
+        const __m256i col_mask_64 = _mm256_cvtepi32_epi64(col_mask);
+
+        // Lane r + t is at column l_low + 3 - t. Reverse the columns to get lane order.
+        const int l_low = lanes.j - 4 - r;
+        const __m256d target_score = _mm256_permute4x64_pd(
+          _mm256_maskload_pd(in.target_scores + l_low, col_mask_64), 0x1B);
+        const __m128i target_qm = _mm_shuffle_epi32(_mm_maskload_epi32(in.target_query_misses + l_low, col_mask), 0x1B);
+        const __m128i target_rm = _mm_shuffle_epi32(_mm_maskload_epi32(in.target_ref_misses + l_low, col_mask), 0x1B);
+        const __m128i lane = _mm_add_epi32(_mm_set1_epi32(r), c.lane_offsets);
+        const __m128i ref_size = _mm_maskload_epi32(lanes.ref_sizes + r, lane_mask);
+
+        const __m128i too_many_misses = _mm_or_si128(
+          _mm_cmpgt_epi32(_mm_add_epi32(target_qm, c.query_miss), c.query_max_total_misses),
+          _mm_cmpgt_epi32(_mm_add_epi32(target_rm, lane), c.ref_max_total_misses));
+        const int in_play = ~(_mm256_movemask_pd(_mm256_cmp_pd(target_score, c.neg_inf, _CMP_EQ_OQ)) |
+                              _mm_movemask_ps(_mm_castsi128_ps(too_many_misses))) &
+                            _mm_movemask_ps(_mm_castsi128_ps(lane_mask));
+
+        const __m128i is_ref_boundary = _mm_or_si128(all_ref_boundary,
+          _mm_and_si128(c.ref_boundary_check, _mm_cmpeq_epi32(lane, first_col_lane)));
+        const __m128i no_query_penalty = _mm_andnot_si128(_mm_cmpgt_epi32(c.query_size, ref_size), c.query_boundary_check);
+        const __m256d no_penalty = _mm256_castsi256_pd(_mm256_cvtepi32_epi64(_mm_or_si128(is_ref_boundary, no_query_penalty)));
+
+        const __m256d delta = _mm256_cvtepi32_pd(_mm_sub_epi32(c.query_size, ref_size));
+        __m256d size_penalty = _mm256_mul_pd(delta, _mm256_maskload_pd(lanes.ref_sd_inv + r, lane_mask_64));
+        size_penalty = _mm256_mul_pd(size_penalty, size_penalty);
+        size_penalty = _mm256_andnot_pd(no_penalty, size_penalty);
+
+        __m256d chunk_score = _mm256_sub_pd(_mm256_xor_pd(size_penalty, c.sign_bit), c.query_miss_penalty);
+        chunk_score = _mm256_sub_pd(chunk_score, _mm256_maskload_pd(in.ref_miss_penalties + r, lane_mask_64));
+        const __m256d score = _mm256_add_pd(chunk_score, target_score);
+        _mm256_maskstore_pd(scores + r, lane_mask_64, score);
+
+        const int too_big = _mm256_movemask_pd(_mm256_cmp_pd(size_penalty, c.max_error, _CMP_GT_OQ));
+        const int ref_is_longer = _mm_movemask_ps(_mm_castsi128_ps(_mm_cmpgt_epi32(ref_size, c.query_size)));
+        const int not_worse = _mm256_movemask_pd(_mm256_cmp_pd(score, best_score, _CMP_GE_OQ));
+        const int allowed = block_best(in_play, too_big, ref_is_longer, not_worse, stopped);
+
+        // Keep the allowed lanes with the highest score.
+        const __m256d is_allowed = _mm256_castsi256_pd(_mm256_cvtepi32_epi64(
+          _mm_cmpeq_epi32(_mm_and_si128(_mm_set1_epi32(allowed), c.lane_bits), c.lane_bits)));
+        __m256d max_score = _mm256_blendv_pd(c.neg_inf, score, is_allowed);
+        max_score = _mm256_max_pd(max_score, _mm256_permute2f128_pd(max_score, max_score, 1));
+        max_score = _mm256_max_pd(max_score, _mm256_permute_pd(max_score, 0x5));
+        const int at_max = _mm256_movemask_pd(_mm256_cmp_pd(score, max_score, _CMP_EQ_OQ)) & allowed;
+
+        mask |= uint64_t(at_max) << (r - lanes.begin);
+        if (stopped) return mask;
+
+      }
+
+      return mask;
+
+    }
+
+  }
+
+  __attribute__((target("sse4.1")))
+  void extend_row_sse41(const RowExtensionInputs& in, RowExtensions& best) {
+    const Sse41Row c(in);
+    Lanes lanes;
+    for (lanes.j = 1; lanes.j < in.n; lanes.j++) {
+      const int num_lanes = start_cell(in, lanes);
+      lanes.best_score = best.score[lanes.j];
+      bool stopped = false;
+      for (lanes.begin = 0; lanes.begin < num_lanes && !stopped; lanes.begin = lanes.end) {
+        lanes.end = std::min(num_lanes, lanes.begin + MAX_LANES);
+        const uint64_t allowed = score_lanes_sse41(in, c, lanes, &best.lane_scores[0], stopped);
+        update_best(in, lanes, allowed, best);
+      }
+    }
+  }
+
+  __attribute__((target("avx2")))
+  void extend_row_avx2(const RowExtensionInputs& in, RowExtensions& best) {
+    const Avx2Row c(in);
+    Lanes lanes;
+    for (lanes.j = 1; lanes.j < in.n; lanes.j++) {
+      const int num_lanes = start_cell(in, lanes);
+      lanes.best_score = best.score[lanes.j];
+      bool stopped = false;
+      for (lanes.begin = 0; lanes.begin < num_lanes && !stopped; lanes.begin = lanes.end) {
+        lanes.end = std::min(num_lanes, lanes.begin + MAX_LANES);
+        const uint64_t allowed = score_lanes_avx2(in, c, lanes, &best.lane_scores[0], stopped);
+        update_best(in, lanes, allowed, best);
+      }
+    }
+  }
+
+#endif
+
+  const char * simd_level_name(SimdLevel level) {
+    switch(level) {
+      case SIMD_AVX2: return "avx2";
+      case SIMD_SSE41: return "sse4.1";
+      default: return "scalar";
+    }
+  }
+
+  SimdLevel detect_simd_level() {
+#if MALIGNER_X86_SIMD
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) return SIMD_AVX2;
+    if (__builtin_cpu_supports("sse4.1")) return SIMD_SSE41;
+#endif
+    return SIMD_SCALAR;
+  }
+
+  namespace {
+    SimdLevel& current_simd_level() {
+      static SimdLevel level = detect_simd_level();
+      return level;
+    }
+  }
+
+  SimdLevel get_simd_level() {
+    return current_simd_level();
+  }
+
+  SimdLevel set_simd_level(SimdLevel level) {
+    const SimdLevel supported = detect_simd_level();
+    current_simd_level() = level < supported ? level : supported;
+    return current_simd_level();
+  }
+
+  RowExtensionFunction get_row_extension_function(SimdLevel level) {
+#if MALIGNER_X86_SIMD
+    if (level >= SIMD_AVX2) return &extend_row_avx2;
+    if (level >= SIMD_SSE41) return &extend_row_sse41;
+#endif
+    return &extend_row_scalar;
+  }
+
+  RowExtensionFunction get_row_extension_function() {
+    return get_row_extension_function(get_simd_level());
+  }
+
+}
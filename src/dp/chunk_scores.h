@@ -0,0 +1,102 @@
+#ifndef CHUNK_SCORES_H
+#define CHUNK_SCORES_H
+
+/**********************************************************
+
+Vectorized scoring of the reference chunks in the max miss fill.
+
+For a cell (i, j) and a target row k, the fill tries every column
+l = j - 1 - ref_miss for ref_miss in [0, ref_max_misses]. The sizing
+penalty of each chunk only depends on ref_miss, so the candidate scores
+for all ref_miss are computed together, in SIMD lanes. The best candidate
+of each cell is then chosen with the same tie breaking as the scalar loop.
+
+The kernel is chosen at runtime from the instruction sets supported
+by the CPU (AVX2, SSE4.1 or scalar). Every version gives exactly the
+same scores as the scalar loop: the same double operations are done in
+the same order, without fused multiply-add.
+
+**************************************************************/
+
+#include <cstdint>
+
+#include "types.h"
+#include "partialsums.h"
+
+namespace maligner_dp {
+
+  // Inputs for extending the cells of row i from the cells of target row k.
+  struct RowExtensionInputs {
+
+    // The reference
+    const PartialSums * ref_partial_sums;
+    const SDInv * ref_sd_inv;
+    const double * ref_miss_penalties;
+    int n; // Number of columns
+    int ref_max_misses;
+    bool ref_is_bounded;
+
+    // The target row k
+    int k;
+    const double * target_scores;
+    const int * target_query_misses;
+    const int * target_ref_misses;
+
+    // The query chunk from row k to row i
+    int query_size;
+    int query_miss;
+    double query_miss_penalty;
+    bool is_query_boundary;
+
+    int query_max_total_misses;
+    int ref_max_total_misses;
+    double max_chunk_sizing_error;
+
+  };
+
+  // The best extension found so far for each cell of row i.
+  struct RowExtensions {
+
+    // Prepare for a row of n cells.
+    void reset(int n, int ref_max_misses);
+
+    DoubleVec score;
+    IntVec ref_miss_total;
+    IntVec query_miss_total;
+    IntVec ref_miss;
+    IntVec query_miss;
+    IntVec k; // -1 if the cell has no extension
+    IntVec l;
+
+    DoubleVec lane_scores; // Scratch space for the kernel, indexed by ref_miss
+
+  };
+
+  // Update the best extensions of the cells in row i with the chunks from target row k.
+  // Target rows must be tried in the order k = i - 1, i - 2, ... to break ties as the scalar loop.
+  typedef void (*RowExtensionFunction)(const RowExtensionInputs& in, RowExtensions& best);
+
+  enum SimdLevel {
+    SIMD_SCALAR = 0,
+    SIMD_SSE41 = 1,
+    SIMD_AVX2 = 2
+  };
+
+  const char * simd_level_name(SimdLevel level);
+
+  // The best level supported by this CPU.
+  SimdLevel detect_simd_level();
+
+  // The level used by get_row_extension_function. This defaults to detect_simd_level().
+  SimdLevel get_simd_level();
+
+  // Set the level used by get_row_extension_function, capped at the level supported by the CPU.
+  // Returns the level which is used. This should be called before any alignments are started.
+  SimdLevel set_simd_level(SimdLevel level);
+
+  RowExtensionFunction get_row_extension_function();
+  RowExtensionFunction get_row_extension_function(SimdLevel level);
+
+}
+
+#endif
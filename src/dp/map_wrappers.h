@@ -64,6 +64,19 @@ namespace maligner_dp {
 
     }
 
+    // Construct from prebuilt parts (i.e. from a reference index). The partial sums
+    // and sd inverses may be views of memory owned by someone else.
+    RefMapWrapper(MapWrapper&& map_wrapper, PartialSums&& ps, PartialSums&& ps_reverse,
+      SDInv&& sd_inv, SDInv&& sd_inv_reverse) :
+      MapWrapper(std::move(map_wrapper)),
+      ps_(std::move(ps)),
+      ps_reverse_(std::move(ps_reverse)),
+      sd_inv_(std::move(sd_inv)),
+      sd_inv_reverse_(std::move(sd_inv_reverse))
+    {
+
+    }
+
     RefMapWrapper(const RefMapWrapper& o) = default;
     RefMapWrapper& operator=(const RefMapWrapper& o) = default;
     
@@ -27,6 +27,27 @@ namespace maligner_dp {
     return os;
   }
 
+  lmm_utils::TextBuffer& operator<<(lmm_utils::TextBuffer& buf, const MatchedChunk& chunk) {
+
+    const Chunk& q = chunk.query_chunk;
+    const Chunk& r = chunk.ref_chunk;
+
+    buf << q.start << ',' << q.end << ',' << q.size << ','
+        << r.start << ',' << r.end << ',' << r.size;
+
+    return buf;
+  }
+
+  lmm_utils::TextBuffer& operator<<(lmm_utils::TextBuffer& buf, const Score& score) {
+
+    buf << '(' << score.query_miss_score
+        << ", " << score.ref_miss_score
+        << ", " << score.sizing_score
+        << ')';
+
+    return buf;
+  }
+
   Score sum_scores(const MatchedChunkVec& mcs) {
     Score score;
     const size_t N = mcs.size();
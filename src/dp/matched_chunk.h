@@ -3,6 +3,7 @@
 #include <vector>
 
 #include "chunk.h"
+#include "text_buffer.h"
 
 
 namespace maligner_dp {
@@ -108,6 +109,10 @@ namespace maligner_dp {
   std::ostream& operator<<(std::ostream& os, const MatchedChunk& chunk);
   std::ostream& operator<<(std::ostream& os, const Score& score);
 
+  // The same output as above, for writing alignment records.
+  lmm_utils::TextBuffer& operator<<(lmm_utils::TextBuffer& buf, const MatchedChunk& chunk);
+  lmm_utils::TextBuffer& operator<<(lmm_utils::TextBuffer& buf, const Score& score);
+
 
   
 
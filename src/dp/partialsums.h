@@ -3,6 +3,7 @@
 
 #include <ostream>
 #include <algorithm>
+#include <utility>
 #include "common_types.h"
 
 namespace maligner_dp {
@@ -21,11 +22,16 @@ namespace maligner_dp {
     // ps(i, 2) = f[i] + f[i-1] + f[i-2]
     //
     // This indexing may be counterintuitive, but it works more seamlessly with the dynamic programming
+    //
+    // The sums are either owned, or a view of sums stored elsewhere (i.e. in a mapped reference index).
 
   private:
 
     friend class SDInv;
-    IntVec d_;
+    IntVec d_; // Owned sums. Empty for a view.
+    const int * data_; // Points to d_, or to the viewed sums.
+    size_t size_;
+    bool is_view_;
     const size_t m_;
     friend std::ostream& operator<<(std::ostream&, const PartialSums&);
 
@@ -34,33 +40,63 @@ namespace maligner_dp {
     struct forward_tag {};
     struct reverse_tag {};
 
-    PartialSums(const IntVec& d, int max_miss) : m_(max_miss + 1) {
+    PartialSums(const IntVec& d, int max_miss) : is_view_(false), m_(max_miss + 1) {
       fill_forward(d); 
     }
 
-    PartialSums(const IntVec& d, int max_miss, forward_tag) : m_(max_miss + 1) {
+    PartialSums(const IntVec& d, int max_miss, forward_tag) : is_view_(false), m_(max_miss + 1) {
       fill_forward(d);
     }
 
-    PartialSums(const IntVec& d, int max_miss, reverse_tag) : m_(max_miss + 1) {
+    PartialSums(const IntVec& d, int max_miss, reverse_tag) : is_view_(false), m_(max_miss + 1) {
       fill_reverse(d);
     }
 
+    // A view of size sums laid out as data(). The sums must outlive the PartialSums and its copies.
+    PartialSums(const int * data, size_t size, int max_miss) :
+      data_(data), size_(size), is_view_(true), m_(max_miss + 1) {
+    }
+
     int operator()(size_t i, size_t num_miss) const {
-      return d_[i*m_ + num_miss];
+      return data_[i*m_ + num_miss];
+    }
+
+    // The lengths of the chunks ending with fragment i, indexed by number of misses.
+    const int * chunks_ending_at(size_t i) const {
+      return &data_[i*m_];
     }
 
-    PartialSums(const PartialSums& o) = default;
-    PartialSums& operator=(const PartialSums& o) = default;  
+    // The sums, with the sums for fragment i at [i*(max_miss + 1), (i+1)*(max_miss + 1)).
+    const int * data() const { return data_; }
+    size_t size() const { return size_; }
+
+    PartialSums(const PartialSums& o) :
+      d_(o.d_),
+      data_(o.is_view_ ? o.data_ : d_.data()),
+      size_(o.size_),
+      is_view_(o.is_view_),
+      m_(o.m_) {
+    }
+
+    PartialSums& operator=(const PartialSums& o) = delete;
+
+    PartialSums(PartialSums&& o) :
+      d_(std::move(o.d_)),
+      data_(o.is_view_ ? o.data_ : d_.data()),
+      size_(o.size_),
+      is_view_(o.is_view_),
+      m_(o.m_) {
+    }
 
-    PartialSums(PartialSums&& o) = default;
-    PartialSums& operator=(PartialSums&& o) = default;   
+    PartialSums& operator=(PartialSums&& o) = delete;
 
   private:
 
     void fill_forward(const IntVec& d) {
       const size_t n = d.size();
       d_ = IntVec(n*m_);
+      data_ = d_.data();
+      size_ = d_.size();
 
       for(size_t s = 0; s < n; s++) {
 
@@ -80,6 +116,8 @@ namespace maligner_dp {
     void fill_reverse(const IntVec& d) {
       const size_t n = d.size();
       d_ = IntVec(n*m_);
+      data_ = d_.data();
+      size_ = d_.size();
 
       for(size_t s = 0; s < n; s++) {
 
@@ -103,15 +141,19 @@ namespace maligner_dp {
   class SDInv {
 
     // Precompute 1/(sd) for each reference chunk
+    // Like PartialSums, the values are either owned or a view of values stored elsewhere.
 
     public:
       SDInv(const PartialSums& ps, double sd_rate, double min_sd) :
-        d_(ps.d_.size()),
+        d_(ps.size_),
+        data_(d_.data()),
+        size_(d_.size()),
+        is_view_(false),
         m_(ps.m_) {
 
           const size_t n = d_.size();
           for(size_t i = 0; i < n; i++) {
-            int ref_size = ps.d_[i];
+            int ref_size = ps.data_[i];
             double sd = sd_rate * ref_size;
             if (sd < min_sd) { sd = min_sd; }
             double sd_1 = 1.0/sd;
@@ -120,17 +162,48 @@ namespace maligner_dp {
 
       }
 
-      SDInv(const SDInv& o) = default;
-      SDInv& operator=(const SDInv& o) = default;  
+      // A view of size values laid out as data(). The values must outlive the SDInv and its copies.
+      SDInv(const double * data, size_t size, int max_miss) :
+        data_(data), size_(size), is_view_(true), m_(max_miss + 1) {
+      }
+
+      SDInv(const SDInv& o) :
+        d_(o.d_),
+        data_(o.is_view_ ? o.data_ : d_.data()),
+        size_(o.size_),
+        is_view_(o.is_view_),
+        m_(o.m_) {
+      }
+
+      SDInv& operator=(const SDInv& o) = delete;
+
+      SDInv(SDInv&& o) :
+        d_(std::move(o.d_)),
+        data_(o.is_view_ ? o.data_ : d_.data()),
+        size_(o.size_),
+        is_view_(o.is_view_),
+        m_(o.m_) {
+      }
 
-      SDInv(SDInv&& o) = default;
-      SDInv& operator=(SDInv&& o) = default;   
+      SDInv& operator=(SDInv&& o) = delete;
       
       double operator()(size_t i, size_t num_miss) const {
-        return d_[i*m_ + num_miss];
+        return data_[i*m_ + num_miss];
+      }
+
+      const double * chunks_ending_at(size_t i) const {
+        return &data_[i*m_];
       }
 
-    DoubleVec d_;
+      const double * data() const { return data_; }
+      size_t size() const { return size_; }
+
+    private:
+
+    DoubleVec d_; // Owned values. Empty for a view.
+    const double * data_; // Points to d_, or to the viewed values.
+    size_t size_;
+    bool is_view_;
     const size_t m_;
   };
   
@@ -0,0 +1,230 @@
+#include <cstring>
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "ref_index.h"
+
+namespace maligner_dp {
+
+  namespace {
+
+    const size_t ALIGNMENT = 8;
+
+    uint64_t aligned(uint64_t offset) {
+      return (offset + ALIGNMENT - 1) / ALIGNMENT * ALIGNMENT;
+    }
+
+    // Append count values to the file at the next aligned offset, and return the offset.
+    uint64_t write_values(std::ofstream& f, const void * values, size_t count, size_t value_size) {
+      const uint64_t pos = f.tellp();
+      const uint64_t offset = aligned(pos);
+      const char zeros[ALIGNMENT] = {0};
+      f.write(zeros, offset - pos);
+      f.write(static_cast<const char*>(values), count * value_size);
+      return offset;
+    }
+
+  }
+
+  void write_ref_index(const std::string& file_name, const std::vector<RefMapWrapper>& ref_maps,
+    int ref_max_misses, double sd_rate, double min_sd, bool is_circular) {
+
+    std::ofstream f(file_name, std::ios::binary);
+    if(!f) {
+      throw std::runtime_error("Could not open reference index for writing: " + file_name);
+    }
+
+    RefIndexHeader header;
+    std::memset(&header, 0, sizeof(header));
+    std::memcpy(header.magic, REF_INDEX_MAGIC, sizeof(header.magic));
+    header.version = REF_INDEX_VERSION;
+    header.byte_order = REF_INDEX_BYTE_ORDER;
+    header.num_maps = ref_maps.size();
+    header.ref_max_misses = ref_max_misses;
+    header.sd_rate = sd_rate;
+    header.min_sd = min_sd;
+    header.is_circular = is_circular;
+
+    // Reserve space for the header and the records, which are written once the offsets are known.
+    std::vector<RefIndexMapRecord> records(ref_maps.size());
+    f.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    f.write(reinterpret_cast<const char*>(records.data()), records.size() * sizeof(RefIndexMapRecord));
+
+    for(size_t i = 0; i < ref_maps.size(); i++) {
+
+      const RefMapWrapper& rmw = ref_maps[i];
+      RefIndexMapRecord& rec = records[i];
+      const FragVec& frags = rmw.get_frags();
+
+      rec.name_size = rmw.map_.name_.size();
+      rec.size = rmw.map_.size_;
+      rec.num_frags = rmw.num_frags();
+      rec.num_frags_total = frags.size();
+      rec.is_circular = rmw.map_data_.is_circular_;
+      rec.is_bounded = rmw.map_data_.is_bounded_;
+      rec.ps_size = rmw.ps_.size();
+
+      rec.name_offset = write_values(f, rmw.map_.name_.data(), rec.name_size, 1);
+      rec.frags_offset = write_values(f, frags.data(), frags.size(), sizeof(int));
+      rec.frags_reverse_offset = write_values(f, rmw.get_frags_reverse().data(), frags.size(), sizeof(int));
+      rec.ix_to_locs_offset = write_values(f, rmw.ix_to_locs_.data(), frags.size() + 1, sizeof(int));
+      rec.ps_offset = write_values(f, rmw.ps_.data(), rec.ps_size, sizeof(int));
+      rec.ps_reverse_offset = write_values(f, rmw.ps_reverse_.data(), rec.ps_size, sizeof(int));
+      rec.sd_inv_offset = write_values(f, rmw.sd_inv_.data(), rec.ps_size, sizeof(double));
+      rec.sd_inv_reverse_offset = write_values(f, rmw.sd_inv_reverse_.data(), rec.ps_size, sizeof(double));
+
+    }
+
+    f.seekp(0);
+    f.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    f.write(reinterpret_cast<const char*>(records.data()), records.size() * sizeof(RefIndexMapRecord));
+
+    if(!f) {
+      throw std::runtime_error("Error writing reference index: " + file_name);
+    }
+
+  }
+
+  bool is_ref_index_file(const std::string& file_name) {
+
+    std::ifstream f(file_name, std::ios::binary);
+    char magic[sizeof(REF_INDEX_MAGIC)];
+
+    if(!f.read(magic, sizeof(magic))) {
+      return false;
+    }
+
+    return std::memcmp(magic, REF_INDEX_MAGIC, sizeof(magic)) == 0;
+
+  }
+
+  // Return the count values of type T at offset, or nullptr if they are not within the file.
+  template<typename T>
+  const T * RefIndex::values_at(uint64_t offset, uint64_t count) const {
+
+    if(offset % ALIGNMENT != 0 || offset > size_ || count > (size_ - offset) / sizeof(T)) {
+      return nullptr;
+    }
+
+    return reinterpret_cast<const T*>(data_ + offset);
+
+  }
+
+  RefIndex::RefIndex(const std::string& file_name) :
+    file_name_(file_name),
+    data_(nullptr),
+    size_(0),
+    header_(nullptr),
+    records_(nullptr) {
+
+    const int fd = open(file_name.c_str(), O_RDONLY);
+    if(fd < 0) {
+      throw RefIndexException("could not open " + file_name);
+    }
+
+    struct stat st;
+    if(fstat(fd, &st) != 0 || size_t(st.st_size) < sizeof(RefIndexHeader)) {
+      close(fd);
+      throw RefIndexException(file_name + " is too short");
+    }
+
+    // A shared read only mapping, so that processes using the same index share the pages.
+    void * data = mmap(nullptr, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+
+    if(data == MAP_FAILED) {
+      throw RefIndexException("could not map " + file_name);
+    }
+
+    data_ = static_cast<const char*>(data);
+    size_ = st.st_size;
+    header_ = reinterpret_cast<const RefIndexHeader*>(data_);
+
+    if(std::memcmp(header_->magic, REF_INDEX_MAGIC, sizeof(REF_INDEX_MAGIC)) != 0) {
+      munmap(data, size_);
+      throw RefIndexException(file_name + " is not a reference index");
+    }
+
+    if(header_->version != REF_INDEX_VERSION || header_->byte_order != REF_INDEX_BYTE_ORDER) {
+      munmap(data, size_);
+      throw RefIndexException(file_name + " was written by an incompatible version or machine. Rebuild it with maligner_index");
+    }
+
+    records_ = values_at<RefIndexMapRecord>(sizeof(RefIndexHeader), header_->num_maps);
+
+    if(!records_ && header_->num_maps > 0) {
+      munmap(data, size_);
+      throw RefIndexException(file_name + " is truncated");
+    }
+
+  }
+
+  RefIndex::~RefIndex() {
+    munmap(const_cast<char*>(data_), size_);
+  }
+
+  void RefIndex::check_params(int ref_max_misses, double sd_rate, double min_sd, bool is_circular) const {
+
+    if(ref_max_misses != this->ref_max_misses() || sd_rate != this->sd_rate() ||
+       min_sd != this->min_sd() || is_circular != this->is_circular()) {
+
+      std::ostringstream msg;
+      msg << file_name_ << " was built with ref_max_misses: " << this->ref_max_misses()
+          << " sd_rate: " << this->sd_rate()
+          << " min_sd: " << this->min_sd()
+          << " reference_is_circular: " << this->is_circular()
+          << ", but the options are ref_max_misses: " << ref_max_misses
+          << " sd_rate: " << sd_rate
+          << " min_sd: " << min_sd
+          << " reference_is_circular: " << is_circular;
+
+      throw RefIndexException(msg.str());
+
+    }
+
+  }
+
+  RefMapWrapper RefIndex::get_ref_map_wrapper(size_t i) const {
+
+    const RefIndexMapRecord& rec = records_[i];
+    const uint64_t n = rec.num_frags_total;
+
+    const char * name = values_at<char>(rec.name_offset, rec.name_size);
+    const int * frags = values_at<int>(rec.frags_offset, n);
+    const int * frags_reverse = values_at<int>(rec.frags_reverse_offset, n);
+    const int * ix_to_locs = values_at<int>(rec.ix_to_locs_offset, n + 1);
+    const int * ps = values_at<int>(rec.ps_offset, rec.ps_size);
+    const int * ps_reverse = values_at<int>(rec.ps_reverse_offset, rec.ps_size);
+    const double * sd_inv = values_at<double>(rec.sd_inv_offset, rec.ps_size);
+    const double * sd_inv_reverse = values_at<double>(rec.sd_inv_reverse_offset, rec.ps_size);
+
+    if(!name || !frags || !frags_reverse || !ix_to_locs || !ps || !ps_reverse || !sd_inv || !sd_inv_reverse ||
+       rec.ps_size != n * size_t(ref_max_misses() + 1)) {
+      std::ostringstream msg;
+      msg << file_name_ << " is truncated or corrupt at map " << i;
+      throw RefIndexException(msg.str());
+    }
+
+    Map map;
+    map.name_.assign(name, rec.name_size);
+    map.size_ = rec.size;
+    map.frags_.assign(frags, frags + n);
+
+    MapData map_data(map.name_, rec.num_frags, rec.size, rec.is_circular != 0, rec.is_bounded != 0);
+
+    return RefMapWrapper(
+      MapWrapper(std::move(map), map_data, FragVec(frags_reverse, frags_reverse + n), IntVec(ix_to_locs, ix_to_locs + n + 1)),
+      PartialSums(ps, rec.ps_size, ref_max_misses()),
+      PartialSums(ps_reverse, rec.ps_size, ref_max_misses()),
+      SDInv(sd_inv, rec.ps_size, ref_max_misses()),
+      SDInv(sd_inv_reverse, rec.ps_size, ref_max_misses()));
+
+  }
+
+}
@@ -0,0 +1,132 @@
+#ifndef REF_INDEX_H
+#define REF_INDEX_H
+
+/**********************************************************
+
+A prebuilt, binary index of reference maps.
+
+The index stores everything in a RefMapWrapper: the (circularized)
+fragments, the reverse fragments, the index to bp locations, and
+the partial sums and sd inverses in both orientations, along with the
+parameters these were built with (ref_max_misses, sd_rate, min_sd and
+whether the maps are circular).
+
+A RefIndex maps the file into memory. The partial sums and sd inverses
+of the RefMapWrapper's it returns are views of the mapping, so they are
+not rebuilt at startup, and the pages are shared by all processes using
+the same index. The fragment vectors, which are small, are copied.
+
+Layout (native byte order, all sections aligned to 8 bytes):
+  RefIndexHeader
+  RefIndexMapRecord for each map
+  The name, fragments, reverse fragments, index locations, partial sums,
+  reverse partial sums, sd inverses and reverse sd inverses of each map.
+
+**************************************************************/
+
+#include <cstdint>
+#include <exception>
+#include <string>
+#include <vector>
+
+#include "map_wrappers.h"
+
+namespace maligner_dp {
+
+  class RefIndexException : public std::exception
+  {
+    public:
+
+      RefIndexException(const std::string& msg) {
+        message_ = "Error reading reference index: " + msg;
+      };
+
+      virtual const char* what() const noexcept
+      {
+        return message_.c_str();
+      }
+
+      std::string message_;
+
+  };
+
+  struct RefIndexHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t byte_order; // Written as REF_INDEX_BYTE_ORDER.
+    uint32_t num_maps;
+    int32_t ref_max_misses;
+    double sd_rate;
+    double min_sd;
+    uint32_t is_circular;
+    uint32_t padding;
+  };
+
+  struct RefIndexMapRecord {
+    uint64_t name_offset;
+    uint64_t name_size;
+    uint64_t size; // bp
+    uint64_t num_frags; // Number of fragments in the original map
+    uint64_t num_frags_total; // Number of fragments after circularization
+    uint64_t is_circular;
+    uint64_t is_bounded;
+    uint64_t frags_offset;
+    uint64_t frags_reverse_offset;
+    uint64_t ix_to_locs_offset; // num_frags_total + 1 values
+    uint64_t ps_size; // Number of values in each of the partial sums and sd inverses
+    uint64_t ps_offset;
+    uint64_t ps_reverse_offset;
+    uint64_t sd_inv_offset;
+    uint64_t sd_inv_reverse_offset;
+  };
+
+  const char REF_INDEX_MAGIC[8] = {'M', 'A', 'L', 'I', 'G', 'N', 'R', 'I'};
+  const uint32_t REF_INDEX_VERSION = 1;
+  const uint32_t REF_INDEX_BYTE_ORDER = 0x01020304;
+
+  // Write the reference maps, which were built with the given parameters, to an index file.
+  void write_ref_index(const std::string& file_name, const std::vector<RefMapWrapper>& ref_maps,
+    int ref_max_misses, double sd_rate, double min_sd, bool is_circular);
+
+  // Return true if the file starts with the magic bytes of a reference index.
+  bool is_ref_index_file(const std::string& file_name);
+
+  class RefIndex {
+  public:
+
+    // Map the index file into memory. Throws RefIndexException if the file is not a valid index.
+    RefIndex(const std::string& file_name);
+    ~RefIndex();
+
+    RefIndex(const RefIndex&) = delete;
+    RefIndex& operator=(const RefIndex&) = delete;
+
+    size_t num_maps() const { return header_->num_maps; }
+    int ref_max_misses() const { return header_->ref_max_misses; }
+    double sd_rate() const { return header_->sd_rate; }
+    double min_sd() const { return header_->min_sd; }
+    bool is_circular() const { return header_->is_circular != 0; }
+
+    // Throw RefIndexException if the index was built with different parameters.
+    void check_params(int ref_max_misses, double sd_rate, double min_sd, bool is_circular) const;
+
+    // Return the wrapper of map i. Its partial sums and sd inverses are views of the index,
+    // so the RefIndex must outlive it.
+    RefMapWrapper get_ref_map_wrapper(size_t i) const;
+
+  private:
+
+    template<typename T>
+    const T * values_at(uint64_t offset, uint64_t count) const;
+
+    std::string file_name_;
+    const char * data_;
+    size_t size_;
+    const RefIndexHeader * header_;
+    const RefIndexMapRecord * records_;
+
+  };
+
+}
+
+#endif
@@ -1522,21 +1522,8 @@ namespace maligner_dp {
       pCell->backPointer_ = nullptr;
     }
 
-    // Initialize the first column
-    for (int i = 1; i < m; i++ ) {
-      ScoreCell* pCell = mat.getCell(i,0);
-      pCell->score_ = -INF;
-      pCell->backPointer_ = nullptr;
-    }
-
-    // Initialize the body of the matrix.
-    for (int i = 1; i < m; i++) {
-      for (int j = 1; j < n; j++) {
-        ScoreCell* pCell = mat.getCell(i, j);
-        pCell->score_ = -INF;
-        pCell->backPointer_ = nullptr;
-      }
-    }
+    // The first column and the body of the matrix were reset to -INF with null
+    // backpointers by mat.resize, so they are not initialized a second time here.
 
     #if FILL_DEBUG > 0
     int num_breaks = 0;
@@ -1741,6 +1728,264 @@ namespace maligner_dp {
   } // fill_score_matrix_using_partials_with_breaks_hardcode_penalty_max_miss, row_order
 
 
+  ////////////////////////////////////////////////////////////////////////////////////
+  // Row based versions of the max miss fill, for score matrices which store each row
+  // as separate arrays of scores and cumulative misses.
+  //
+  // The matrix type must provide:
+  //   scores(row), query_misses(row), ref_misses(row): pointers to the row's arrays
+  //   clear_row(row): set all scores in the row to -INF
+  //   set_start(col, score): set a cell in the first row
+  //   assign(i, j, score, qm, rm, k, l): set cell (i,j) with backpointer to (k,l)
+  //   row_filled(row): called once each row is complete.
+  //
+  // These give exactly the same scores and backpointers as the ScoreCell version
+  // of fill_score_matrix_using_partials_with_breaks_hardcode_penalty_max_miss.
+
+  // Initialize the first row.
+  template<typename AlignTaskType, typename RowMatrixType>
+  void init_first_row_max_miss(const AlignTaskType& align_task, RowMatrixType& mat) {
+
+    const int num_ref_frags = align_task.ref_map_data->num_frags_; // This may be different than n in the case of circularization
+
+    // Do not allow alignments to start past right of the circularization point,
+    // where fragments have been doubled.
+    mat.clear_row(0);
+    for (int j = 0; j < num_ref_frags + 1; j++) {
+      mat.set_start(j, 0.0);
+    }
+
+  }
+
+  // Fill the rows in [row_begin, row_end). Rows before row_begin must already be filled.
+  // last_row_in_play is the last row with a cell in play, and is updated by the fill.
+  // Returns the row at which the fill stopped, which is less than row_end if no
+  // alignment can reach the remaining rows.
+  template<typename AlignTaskType, typename RowMatrixType>
+  int fill_rows_max_miss(const AlignTaskType& align_task, RowMatrixType& mat,
+    int row_begin, int row_end, int& last_row_in_play) {
+
+    // Unpack the alignment task
+    const AlignOpts& align_opts = *align_task.align_opts;
+    const IntVec& query = *align_task.query;
+    const IntVec& ref = *align_task.ref;
+    const PartialSums& query_partial_sums = *align_task.query_partial_sums;
+    const DoubleVec& query_miss_penalties = align_opts.query_miss_penalties;
+
+    const int m = query.size() + 1;
+    const int n = ref.size() + 1;
+
+    // The chunks from a target row are scored by a SIMD kernel chosen for this CPU.
+    const RowExtensionFunction extend_row = get_row_extension_function();
+    RowExtensions best;
+
+    RowExtensionInputs in;
+    in.ref_partial_sums = align_task.ref_partial_sums;
+    in.ref_sd_inv = align_task.ref_sd_inv;
+    in.ref_miss_penalties = &align_opts.ref_miss_penalties[0];
+    in.n = n;
+    in.ref_max_misses = align_opts.ref_max_misses;
+    in.ref_is_bounded = align_opts.ref_is_bounded;
+    in.query_max_total_misses = align_task.query_max_total_misses;
+    in.ref_max_total_misses = align_task.ref_max_total_misses;
+    in.max_chunk_sizing_error = align_opts.max_chunk_sizing_error;
+
+    for (int i = row_begin; i < row_end; i++) {
+
+      int k0 = (i > align_opts.query_max_misses) ? i - align_opts.query_max_misses - 1 : 0;
+
+      if( k0 > last_row_in_play ) {
+        // There's no possibility of producing an alignment, because the last row that has a cell in play
+        // is beyond the reach of k0.
+        return i;
+      }
+
+      best.reset(n, align_opts.ref_max_misses);
+
+      // Try all allowable extensions, from each target row in turn.
+      for (int k = i - 1; k >= k0; k--) {
+
+        in.k = k;
+        in.target_scores = mat.scores(k);
+        in.target_query_misses = mat.query_misses(k);
+        in.target_ref_misses = mat.ref_misses(k);
+
+        in.is_query_boundary = !align_opts.query_is_bounded && (k == 0 || i == m - 1);
+        in.query_miss = i - k - 1; // sites in query unaligned to reference
+        in.query_miss_penalty = query_miss_penalties[in.query_miss];
+        in.query_size = query_partial_sums(i-1, in.query_miss);
+
+        extend_row(in, best);
+
+      }
+
+      // Assign the backpointers and scores. Every cell of the row is written,
+      // so the row does not need to be cleared first.
+      mat.clear_cell(i, 0);
+      for (int j = 1; j < n; j++) {
+        if (best.k[j] >= 0) {
+          mat.assign(i, j, best.score[j], best.query_miss_total[j], best.ref_miss_total[j], best.k[j], best.l[j]);
+          last_row_in_play = i;
+        } else {
+          mat.clear_cell(i, j);
+        }
+      }
+
+      mat.row_filled(i);
+
+    } // for int i
+
+    return row_end;
+
+  } // fill_rows_max_miss
+
+
+  // Fill using a LinearScoreMatrix. Only the scores of the last row are available after the fill.
+  // Use build_trails_linear_memory to get the trails.
+  template<typename AlignTaskType>
+  void fill_score_matrix_using_partials_with_breaks_hardcode_penalty_max_miss(const AlignTaskType& align_task, 
+    linear_memory_tag) {
+
+    const AlignOpts& align_opts = *align_task.align_opts;
+    auto& mat = *align_task.mat;
+
+    const int m = align_task.query->size() + 1;
+    const int n = align_task.ref->size() + 1;
+
+    mat.resize(m, n, align_opts.query_max_misses + 1, align_opts.ref_max_misses + 1);
+
+    init_first_row_max_miss(align_task, mat);
+
+    int last_row_in_play = 0;
+    int rows_filled = fill_rows_max_miss(align_task, mat, 1, m, last_row_in_play);
+    mat.setNumRowsFilled(rows_filled);
+
+  } // fill_score_matrix_using_partials_with_breaks_hardcode_penalty_max_miss, linear_memory
+
+
+  // Fill using the compact, structure of arrays ScoreMatrix.
+  template<typename AlignTaskType>
+  void fill_score_matrix_using_partials_with_breaks_hardcode_penalty_max_miss(const AlignTaskType& align_task, 
+    compact_row_order_tag) {
+
+    const AlignOpts& align_opts = *align_task.align_opts;
+    auto& mat = *align_task.mat;
+
+    const int m = align_task.query->size() + 1;
+    const int n = align_task.ref->size() + 1;
+
+    mat.resize(m, n);
+
+    init_first_row_max_miss(align_task, mat);
+
+    int last_row_in_play = 0;
+    int rows_filled = fill_rows_max_miss(align_task, mat, 1, m, last_row_in_play);
+    mat.setNumRowsFilled(rows_filled);
+
+  } // fill_score_matrix_using_partials_with_breaks_hardcode_penalty_max_miss, compact_row_order
+
+
+  // Build the trails ending at the given columns of the last row of a filled compact ScoreMatrix.
+  template<typename AlignTaskType>
+  void build_trails(const AlignTaskType& align_task, const IntVec& cols, std::vector<ScoreCellVec>& trails,
+    compact_row_order_tag) {
+
+    auto& mat = *align_task.mat;
+    const size_t last_row = align_task.query->size();
+
+    trails.clear();
+    trails.resize(cols.size());
+    for(size_t t = 0; t < cols.size(); t++) {
+      mat.build_trail(last_row, cols[t], trails[t]);
+    }
+
+  }
+
+  template<typename AlignTaskType>
+  void build_trails(const AlignTaskType& align_task, const IntVec& cols, std::vector<ScoreCellVec>& trails,
+    linear_memory_tag) {
+    build_trails_linear_memory(align_task, cols, trails);
+  }
+
+
+  // Build the trails ending at the given columns of the last row of a filled LinearScoreMatrix.
+  // The cells of each trail are given starting from the end of the alignment, as in build_trail.
+  //
+  // The rows are recomputed one segment at a time, from the last segment to the first, and
+  // all trails are followed through each segment together.
+  template<typename AlignTaskType>
+  void build_trails_linear_memory(const AlignTaskType& align_task, const IntVec& cols, std::vector<ScoreCellVec>& trails) {
+
+    auto& mat = *align_task.mat;
+    const int m = align_task.query->size() + 1;
+    const int last_row = m - 1;
+    const size_t num_trails = cols.size();
+
+    trails.clear();
+    trails.resize(num_trails);
+
+    if (num_trails == 0) return;
+
+    // The end of each trail is in the last row.
+    // The m_score_ of the end cell is set as for a reset ScoreCell.
+    const double * last_row_scores = mat.scores(last_row);
+    for(size_t t = 0; t < num_trails; t++) {
+      ScoreCell cell(last_row, cols[t]);
+      cell.score_ = last_row_scores[cols[t]];
+      cell.m_score_ = INF;
+      trails[t].reserve(m);
+      trails[t].push_back(cell);
+    }
+
+    const int spacing = mat.getCheckpointSpacing();
+    int last_row_in_play = std::numeric_limits<int>::max();
+
+    for(int seg_begin = (last_row / spacing) * spacing; seg_begin >= 0; seg_begin -= spacing) {
+
+      // Check if any trail needs this segment.
+      bool have_trail = false;
+      for(size_t t = 0; t < num_trails && !have_trail; t++) {
+        const int q = trails[t].back().q_;
+        have_trail = (q > 0 && q >= seg_begin);
+      }
+
+      if (!have_trail) continue;
+
+      const int seg_end = std::min(seg_begin + spacing, m);
+
+      // Recompute the rows of the segment, recording backpointers.
+      mat.start_recording(seg_begin);
+      if (seg_begin == 0) {
+        init_first_row_max_miss(align_task, mat);
+        fill_rows_max_miss(align_task, mat, 1, seg_end, last_row_in_play);
+      } else {
+        mat.restore_checkpoint(seg_begin);
+        fill_rows_max_miss(align_task, mat, seg_begin, seg_end, last_row_in_play);
+      }
+      mat.stop_recording();
+
+      // Follow the trails back to the start of the segment.
+      for(size_t t = 0; t < num_trails; t++) {
+
+        ScoreCellVec& trail = trails[t];
+        int q = trail.back().q_;
+        int r = trail.back().r_;
+
+        while(q > 0 && q >= seg_begin) {
+          const CompactBackPointer& bp = mat.back_pointer(q, r);
+          q -= bp.dq;
+          r -= bp.dr;
+          trail.push_back(ScoreCell(q, r));
+        }
+
+      }
+
+    }
+
+  }
+
+
+
 
   // template<class ScoreMatrixType, class SizingPenaltyType>
   template<typename AlignTaskType>
@@ -3406,12 +3651,200 @@ namespace maligner_dp {
   }
 
 
+  /////////////////////////////////////////////////////////////////////
+  // Build the trail for every cell in the last row of the filled score matrix
+  // that ends an alignment, in column order.
+  template<typename AlignTaskType, typename OrderTag>
+  void get_last_row_trails(const AlignTaskType& task, LastRowTrails& trails, OrderTag) {
+
+    auto& mat = *task.mat;
+    const int last_row = task.query->size();
+    const int n = task.ref->size() + 1;
+
+    trails.clear();
+
+    for (int i = 0; i < n; i++) {
+      const ScoreCell * pCell = mat.getCell(last_row, i);
+      bool have_alignment = pCell && pCell->score_ > -INF && pCell->backPointer_;
+      if (have_alignment) {
+        trails.trails.emplace_back();
+        ScoreCellPVec& trail = trails.trails.back();
+        trail.reserve(last_row + 1);
+        build_trail(pCell, trail);
+      }
+    }
+
+  }
+
+  // For matrices which store rows as arrays, the trails are built for all alignment ends at once.
+  // The cells of the trails are stored in trails.cells.
+  template<typename AlignTaskType>
+  void get_last_row_trails_from_rows(const AlignTaskType& task, LastRowTrails& trails) {
+
+    typename AlignTaskType::score_matrix_type::order_tag order;
+    auto& mat = *task.mat;
+    const int last_row = task.query->size();
+    const int n = task.ref->size() + 1;
+
+    trails.clear();
+
+    if (last_row == 0 || (int) mat.getNumRowsFilled() <= last_row) {
+      return;
+    }
+
+    IntVec cols;
+    const double * last_row_scores = mat.scores(last_row);
+    for (int i = 0; i < n; i++) {
+      if (last_row_scores[i] > -INF) {
+        cols.push_back(i);
+      }
+    }
+
+    build_trails(task, cols, trails.cells, order);
+
+    trails.trails.resize(trails.cells.size());
+    for (size_t t = 0; t < trails.cells.size(); t++) {
+      ScoreCellPVec& trail = trails.trails[t];
+      trail.reserve(trails.cells[t].size());
+      for (const ScoreCell& cell : trails.cells[t]) {
+        trail.push_back(&cell);
+      }
+    }
+
+  }
+
+  template<typename AlignTaskType>
+  void get_last_row_trails(const AlignTaskType& task, LastRowTrails& trails, linear_memory_tag) {
+    get_last_row_trails_from_rows(task, trails);
+  }
+
+  template<typename AlignTaskType>
+  void get_last_row_trails(const AlignTaskType& task, LastRowTrails& trails, compact_row_order_tag) {
+    get_last_row_trails_from_rows(task, trails);
+  }
+
+  /////////////////////////////////////////////////////////////////////
+  // Compute the total rescaled score and the reference span of the alignment
+  // which alignment_from_trail_rescaled would make from the trail, without
+  // building its matched chunks.
+  //
+  // The scores are summed in the same order as in alignment_from_trail and
+  // Alignment::rescale_matched_chunks, so they are identical.
+  template<typename AlignTaskType>
+  AlignmentCandidate alignment_candidate_from_trail(const AlignTaskType& task, const ScoreCellPVec& trail, size_t trail_ix) {
+
+    const AlignOpts& align_opts = *task.align_opts;
+    const PartialSums& query_partial_sums = *task.query_partial_sums;
+    const PartialSums& ref_partial_sums = *task.ref_partial_sums;
+    const int num_query_frags = task.query->size();
+    const int num_ref_frags = task.ref->size();
+    const int num_ref_map_frags = task.ref_map_data->num_frags_;
+    const int ref_offset = task.ref_offset;
+
+    AlignmentCandidate candidate;
+    candidate.trail_ix = trail_ix;
+
+    const int num_chunks = int(trail.size()) - 1;
+    assert(num_chunks > 0);
+
+    // Score the chunks from the start of the alignment, as in alignment_from_trail.
+    Score total_score(0.0, 0.0, 0.0);
+    int query_interior_size = 0;
+    int ref_interior_size = 0;
+    for (int i = num_chunks - 1; i >= 0; i--) {
+
+      const int m = trail[i+1]->q_;
+      const int ml = trail[i]->q_;
+      const int n = trail[i+1]->r_ + ref_offset;
+      const int nl = trail[i]->r_ + ref_offset;
+      const int q_size = query_partial_sums(ml - 1, ml - m - 1);
+      const int r_size = ref_partial_sums(nl - ref_offset - 1, nl - n - 1);
+
+      // The boundary flags of the chunks, as set by build_chunk_trail.
+      const bool query_chunk_is_boundary = (m == 0 || ml == num_query_frags) && !align_opts.query_is_bounded;
+      const bool ref_chunk_is_boundary = !align_opts.ref_is_bounded && (n == 0 || nl == num_ref_map_frags);
+
+      const int query_misses = ml - m - 1;
+      const int ref_misses = nl - n - 1;
+      const double query_miss_score = align_opts.query_miss_penalty * query_misses;
+      const double ref_miss_score = align_opts.ref_miss_penalty * ref_misses;
+      double sizing_score = 0.0;
+
+      const bool is_ref_boundary = !align_opts.ref_is_bounded && (n == 0 || nl == num_ref_frags);
+      if (!is_ref_boundary && (!query_chunk_is_boundary || q_size > r_size )) {
+        sizing_score = sizing_penalty(q_size, r_size, align_opts);
+      }
+
+      total_score.query_miss_score += query_miss_score;
+      total_score.ref_miss_score += ref_miss_score;
+      total_score.sizing_score += sizing_score;
+
+      if (!query_chunk_is_boundary && !ref_chunk_is_boundary) {
+        query_interior_size += q_size;
+        ref_interior_size += r_size;
+      }
+
+    }
+
+    candidate.total_rescaled_score = total_score.total();
+
+    // Rescale the query chunks, as in Alignment::rescale_matched_chunks.
+    const double query_scaling_factor = ((double) ref_interior_size) / query_interior_size;
+    if (align_opts.rescale_query &&
+        !(query_scaling_factor < align_opts.min_query_scaling ||
+          query_scaling_factor > align_opts.max_query_scaling)) {
+
+      Score rescaled_score = total_score;
+      rescaled_score.sizing_score = 0.0;
+
+      for (int i = num_chunks - 1; i >= 0; i--) {
+
+        const int m = trail[i+1]->q_;
+        const int ml = trail[i]->q_;
+        const int n = trail[i+1]->r_ + ref_offset;
+        const int nl = trail[i]->r_ + ref_offset;
+        const int old_query_size = query_partial_sums(ml - 1, ml - m - 1);
+        const int ref_size = ref_partial_sums(nl - ref_offset - 1, nl - n - 1);
+        const bool query_chunk_is_boundary = (m == 0 || ml == num_query_frags) && !align_opts.query_is_bounded;
+        const bool ref_chunk_is_boundary = !align_opts.ref_is_bounded && (n == 0 || nl == num_ref_map_frags);
+
+        int new_query_size = query_scaling_factor*old_query_size;
+        if (!ref_chunk_is_boundary &&
+            (!query_chunk_is_boundary || new_query_size > ref_size)) {
+          rescaled_score.sizing_score += sizing_penalty(new_query_size, ref_size, align_opts);
+        }
+
+      }
+
+      candidate.total_rescaled_score = rescaled_score.total();
+
+    }
+
+    // The reference span, oriented as by Alignment::flip_ref_coords.
+    candidate.ref_start = trail.back()->r_ + ref_offset;
+    candidate.ref_end = trail.front()->r_ + ref_offset;
+    if (!task.ref_is_forward) {
+      const int num_frags = task.ref_map_data->num_frags_;
+      const int ref_start = num_frags - candidate.ref_end;
+      const int ref_end = num_frags - candidate.ref_start;
+      candidate.ref_start = ref_start;
+      candidate.ref_end = ref_end;
+      if (task.ref_map_data->is_circular_ && candidate.ref_start < 0) {
+        candidate.ref_start += num_frags;
+        candidate.ref_end += num_frags;
+      }
+    }
+
+    return candidate;
+
+  }
+
   /////////////////////////////////////////////////////////////////////
   // Get the best alignments in the task.
   // Try *all* alignment seeds (disregard any limits on the number of alignment seeds or
   //   alignments per reference)
-  // Rescale *all* alignments
-  // Select non-overlapping alignments in order of rescaled score.
+  // Compute the rescaled score of *all* alignments
+  // Select non-overlapping alignments in order of rescaled score, and build only those.
   // template<class ScoreMatrixType, class SizingPenaltyType>
   template<typename AlignTaskType>
   int get_best_alignments_try_all(const AlignTaskType& task) {
@@ -3433,30 +3866,36 @@ namespace maligner_dp {
     const int num_cols = mat.getNumCols();
     const int last_row = m - 1;
 
-    // Go to the last row in the matrix, and get all alignments.
-    AlignmentVec my_alignments;
-    for (int i = 0; i < n; i++) {
-      const ScoreCell * pCell = mat.getCell(last_row, i);
-      bool have_alignment = pCell && pCell->score_ > -INF && pCell->backPointer_;
-      if (have_alignment) {
-        Alignment a = alignment_from_cell(task, pCell);
-        my_alignments.push_back(std::move(a));
-      }
+    // Go to the last row in the matrix, and get the trails of all alignments.
+    LastRowTrails trails;
+    typename AlignTaskType::score_matrix_type::order_tag order;
+    get_last_row_trails(task, trails, order);
+
+    // Score the alignments without building them.
+    const size_t N = trails.trails.size();
+    AlignmentCandidateVec candidates;
+    candidates.reserve(N);
+    for(size_t i = 0; i < N; i++) {
+      candidates.push_back(alignment_candidate_from_trail(task, trails.trails[i], i));
     }
 
     // Sort the alignment in descending order score
-    std::sort(my_alignments.begin(), my_alignments.end(), AlignmentRescaledScoreComp());
+    std::sort(candidates.begin(), candidates.end(), AlignmentCandidateComp());
     
+    // Only the alignments which do not overlap a better alignment are built.
     int num_alignments = 0;
     BitCover cells_covered(n);
-    const size_t N = my_alignments.size();
     for(size_t i = 0; i < N; i++) {
 
-      Alignment& aln = my_alignments[i];
-      if(cells_covered.is_covered(aln.get_ref_start(), aln.get_ref_end())) {
+      const AlignmentCandidate& candidate = candidates[i];
+      if(cells_covered.is_covered(candidate.ref_start, candidate.ref_end)) {
         continue;
       }
 
+      Alignment aln = alignment_from_trail_rescaled(task, trails.trails[candidate.trail_ix]);
+      assert(aln.get_ref_start() == candidate.ref_start && aln.get_ref_end() == candidate.ref_end);
+      assert(aln.total_rescaled_score == candidate.total_rescaled_score);
+
       cells_covered.cover(aln.get_ref_start(), aln.get_ref_end());
 
       // Account for circularization, if necessary. Mark positions in
@@ -3646,7 +4085,7 @@ namespace maligner_dp {
 
       bool alignment_is_forward = (task.query_is_forward == task.ref_is_forward);
 
-      Alignment aln(matched_chunks, total_score,
+      Alignment aln(std::move(matched_chunks), total_score,
              *task.query_map_data, *task.ref_map_data,
              alignment_is_forward);
 
@@ -3656,15 +4095,11 @@ namespace maligner_dp {
       return aln;
   }
 
+  // Make an alignment from the trail, and rescale and orient it as given by the task.
   template<typename AlignTaskType>
-  Alignment alignment_from_cell(const AlignTaskType& task, const ScoreCell* p_cell) {
-    
-    const size_t m = task.query->size() + 1;
-    const AlignOpts& align_opts = *task.align_opts;
+  Alignment alignment_from_trail_rescaled(const AlignTaskType& task, ScoreCellPVec& trail) {
 
-    ScoreCellPVec trail;
-    trail.reserve(m);
-    build_trail(p_cell, trail);
+    const AlignOpts& align_opts = *task.align_opts;
 
     Alignment aln = alignment_from_trail(task, trail);
 
@@ -3679,6 +4114,18 @@ namespace maligner_dp {
     return aln;
   }
 
+  template<typename AlignTaskType>
+  Alignment alignment_from_cell(const AlignTaskType& task, const ScoreCell* p_cell) {
+    
+    const size_t m = task.query->size() + 1;
+
+    ScoreCellPVec trail;
+    trail.reserve(m);
+    build_trail(p_cell, trail);
+
+    return alignment_from_trail_rescaled(task, trail);
+  }
+
     //////////////////////////////////////////////////////////
   // Fill score matrix, find best alignment, and return it.
   template<typename AlignTaskType>
@@ -3712,6 +4159,62 @@ namespace maligner_dp {
   // Get best alignment from an already filled out score matrix.
   template<typename AlignTaskType>
   Alignment get_best_alignment_from_filled_scorematrix(const AlignTaskType& task) {
+    typename AlignTaskType::score_matrix_type::order_tag order;
+    return get_best_alignment_from_filled_scorematrix(task, order);
+  }
+
+  // For matrices which store rows as arrays.
+  template<typename AlignTaskType>
+  Alignment get_best_alignment_from_rows(const AlignTaskType& task) {
+
+    typename AlignTaskType::score_matrix_type::order_tag order;
+    auto& mat = *task.mat;
+    const int last_row = task.query->size();
+    const int n = task.ref->size() + 1;
+
+    if (last_row == 0 || (int) mat.getNumRowsFilled() <= last_row) {
+      return INVALID_ALIGNMENT;
+    }
+
+    // Get the cell with the best score in the last row.
+    const double * last_row_scores = mat.scores(last_row);
+    double best_score = -INF;
+    int best_col = -1;
+    for (int j = 0; j < n; j++) {
+      if (last_row_scores[j] > best_score) {
+        best_col = j;
+        best_score = last_row_scores[j];
+      }
+    }
+
+    if (best_col < 0) {
+      return INVALID_ALIGNMENT;
+    }
+
+    std::vector<ScoreCellVec> trails;
+    build_trails(task, IntVec(1, best_col), trails, order);
+
+    ScoreCellPVec trail;
+    for (const ScoreCell& cell : trails.front()) {
+      trail.push_back(&cell);
+    }
+
+    return alignment_from_trail_rescaled(task, trail);
+
+  }
+
+  template<typename AlignTaskType>
+  Alignment get_best_alignment_from_filled_scorematrix(const AlignTaskType& task, linear_memory_tag) {
+    return get_best_alignment_from_rows(task);
+  }
+
+  template<typename AlignTaskType>
+  Alignment get_best_alignment_from_filled_scorematrix(const AlignTaskType& task, compact_row_order_tag) {
+    return get_best_alignment_from_rows(task);
+  }
+
+  template<typename AlignTaskType, typename OrderTag>
+  Alignment get_best_alignment_from_filled_scorematrix(const AlignTaskType& task, OrderTag) {
 
     const AlignOpts& align_opts = *task.align_opts;
 
@@ -3739,30 +4242,13 @@ namespace maligner_dp {
   template<typename AlignTaskType>
   Alignment make_best_alignment_using_partials(const AlignTaskType& task) {
 
-    const AlignOpts& align_opts = *task.align_opts;
-
     // populate the score matrix
     // use tag dispatch to select the correct loop orders
     typename AlignTaskType::score_matrix_type::order_tag order;
     fill_score_matrix_using_partials_with_breaks_hardcode_penalty_max_miss(task, order);
 
     // get the best alignment.
-    ScoreCellPVec trail;
-    bool have_alignment = get_best_alignment_trail(task, trail);
-    if (!have_alignment) {
-      return INVALID_ALIGNMENT;
-    }
-
-    Alignment aln(alignment_from_trail(task, trail));
-    if (align_opts.rescale_query) {
-      aln.rescale_matched_chunks(align_opts);
-    }
-
-    if (!task.query_is_forward) aln.flip_query_coords();
-    if (!task.ref_is_forward) aln.flip_ref_coords();
-    aln.add_alignment_locs(*task.query_ix_to_locs, *task.ref_ix_to_locs);
-
-    return aln;
+    return get_best_alignment_from_filled_scorematrix(task, order);
   }
 
   //////////////////////////////////////////////////////////
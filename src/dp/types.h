@@ -3,6 +3,7 @@
 
 #include <vector>
 #include <memory>
+#include <cstdint>
 
 namespace maligner_dp {
 
@@ -14,6 +15,12 @@ namespace maligner_dp {
   // typedef std::shared_ptr< BoolVec > BoolVecPtr;
   typedef IntVec* IntVecPtr;
   typedef BoolVec* BoolVecPtr;
+
+  // Backpointer stored as the number of rows and columns to step back.
+  struct CompactBackPointer {
+    uint8_t dq;
+    uint8_t dr;
+  };
 }
 
 #endif
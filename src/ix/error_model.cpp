@@ -6,7 +6,7 @@ using namespace std;
 
 namespace kmer_match {
 
-  IntPairVec ErrorModel::compute_bounds(const IntVec& frags) {
+  IntPairVec ErrorModel::compute_bounds(const IntVec& frags) const {
 
     IntPairVec ret(frags.size());
 
@@ -23,7 +23,7 @@ namespace kmer_match {
 
   }
 
-  IntPairVec ErrorModel::compute_bounds(const IntVec::const_iterator s, const IntVec::const_iterator e) {
+  IntPairVec ErrorModel::compute_bounds(const IntVec::const_iterator s, const IntVec::const_iterator e) const {
 
     IntPairVec ret(e - s);
     IntPairVec::iterator ret_i = ret.begin();
@@ -39,4 +39,22 @@ namespace kmer_match {
 
   }
 
-}
\ No newline at end of file
+  QueryChunkBounds::QueryChunkBounds(const ErrorModel& error_model,
+    IntVec::const_iterator s, IntVec::const_iterator e, size_t max_frags) {
+
+    const size_t num_frags = e - s;
+    bounds_.push_back(error_model.compute_bounds(s, e));
+
+    // Add one more fragment to each of the chunks of n - 1 fragments.
+    IntVec sizes(s, e);
+    for(size_t n = 2; n <= max_frags && n <= num_frags; n++) {
+      sizes.pop_back();
+      for(size_t i = 0; i < sizes.size(); i++) {
+        sizes[i] += *(s + i + n - 1);
+      }
+      bounds_.push_back(error_model.compute_bounds(sizes));
+    }
+
+  }
+
+}
@@ -1,6 +1,7 @@
 #ifndef ERROR_MODEL_H
 #define ERROR_MODEL_H
 
+#include <cstddef>
 #include <vector>
 #include <utility>
 
@@ -16,14 +17,34 @@ namespace kmer_match {
       rel_error_(rel_error), min_error_(min_error) {};
 
 
-    IntPairVec compute_bounds(const IntVec& frags);
-    IntPairVec compute_bounds(IntVec::const_iterator s, IntVec::const_iterator e);
+    IntPairVec compute_bounds(const IntVec& frags) const;
+    IntPairVec compute_bounds(IntVec::const_iterator s, IntVec::const_iterator e) const;
 
     double rel_error_;
     double min_error_;
 
   };
 
+  // The bounds of the query chunks of 1 to max_frags consecutive fragments, for alignments
+  // which leave query sites unmatched.
+  class QueryChunkBounds {
+  public:
+
+    QueryChunkBounds(const ErrorModel& error_model, IntVec::const_iterator s, IntVec::const_iterator e,
+      size_t max_frags);
+
+    size_t num_frags() const { return bounds_[0].size(); }
+    size_t max_frags() const { return bounds_.size(); }
+
+    // The bound of the chunk of n fragments starting at fragment i.
+    const IntPair& bound(size_t i, size_t n) const { return bounds_[n - 1][i]; }
+
+    // bounds_[n - 1] has the bounds of the chunks of n fragments, so bounds_[0] has the
+    // bounds of the single fragments.
+    std::vector<IntPairVec> bounds_;
+
+  };
+
 }
 
 #endif
\ No newline at end of file
@@ -19,6 +19,11 @@ namespace kmer_match {
       size_(std::accumulate(pMap->map_.frags_.begin() + s, pMap->map_.frags_.begin() + e, 0))
     {};
 
+    // A chunk with a known size (i.e. read from a chunk database file).
+    MapChunk(const MapWrapper * pMap, size_t s, size_t e, int size) :
+      pMap_(pMap), start_(s), end_(e), size_(size)
+    {};
+
     const MapWrapper * pMap_;
     size_t start_;
     size_t end_;
@@ -13,7 +13,7 @@ using namespace maligner_maps;
 namespace kmer_match {
 
   MapChunkDB::MapChunkDB(const MapWrapperPVec& maps, size_t frags_per_chunk) :
-  frags_per_chunk_(frags_per_chunk) {
+  frags_per_chunk_(frags_per_chunk), seed_frags_(1) {
     
     size_t num_frags = 0;
 
@@ -24,7 +24,9 @@ namespace kmer_match {
     // Reserve enough space to avoid reallocation.
     map_chunks_.reserve(num_frags*frags_per_chunk);
 
-    // For each map, compute the chunks.
+    // For each map, compute the chunks. The chunks starting at the same index are adjacent
+    // in map_chunks_, so they are listed in the same order in start_chunks_.
+    uint64_t num_positions = 0;
     for(auto mi = maps.begin(); mi != maps.end(); mi++) {
 
       const MapWrapper* pMapWrapper = *mi;
@@ -32,27 +34,60 @@ namespace kmer_match {
       
       const size_t num_frags = pMap->frags_.size();
 
-      ChunksAtIndex chunks_at_index_start_(num_frags);
-      ChunksAtIndex chunks_at_index_end_(num_frags);
+      map_positions_.push_back(num_positions);
       
       for(size_t start = 0; start < num_frags; start++) {
+        start_offsets_.push_back(start_chunks_.size());
         const size_t last = min(start + frags_per_chunk, num_frags - 1);
         for(size_t end = start + 1; end <= last; end++) {
+          start_chunks_.push_back(map_chunks_.size());
+          chunk_positions_.push_back(num_positions);
           map_chunks_.emplace_back(pMapWrapper, start, end);
-          chunks_at_index_start_[start].push_back(&map_chunks_.back());
-          chunks_at_index_end_[end].push_back(&map_chunks_.back());
         } 
       }
 
-      map_to_chunks_at_start_[pMap] = std::move(chunks_at_index_start_);
-      map_to_chunks_at_end_[pMap] = std::move(chunks_at_index_end_);
+      // No chunks start at the end of the map.
+      start_offsets_.resize(num_positions + num_frags + 1, start_chunks_.size());
+      num_positions += num_frags + 1;
 
     }
 
+    start_offsets_.push_back(start_chunks_.size());
+
+    // List the chunks by the position of their end, in order of their start.
+    end_offsets_.assign(num_positions + 1, 0);
+    for(size_t i = 0; i < map_chunks_.size(); i++) {
+      end_offsets_[chunk_positions_[i] + map_chunks_[i].end_ + 1]++;
+    }
+    for(size_t p = 0; p < num_positions; p++) {
+      end_offsets_[p + 1] += end_offsets_[p];
+    }
+    end_chunks_.resize(map_chunks_.size());
+    vector<uint64_t> next(end_offsets_.begin(), end_offsets_.end() - 1);
+    for(size_t i = 0; i < map_chunks_.size(); i++) {
+      end_chunks_[next[chunk_positions_[i] + map_chunks_[i].end_]++] = i;
+    }
+
+    index_chunk_sizes();
+
     sort_chunks();
 
   }
 
+  void MapChunkDB::index_chunk_sizes() {
+
+    start_sizes_.resize(start_chunks_.size());
+    for(size_t i = 0; i < start_chunks_.size(); i++) {
+      start_sizes_[i] = map_chunks_[start_chunks_[i]].size_;
+    }
+
+    end_sizes_.resize(end_chunks_.size());
+    for(size_t i = 0; i < end_chunks_.size(); i++) {
+      end_sizes_[i] = map_chunks_[end_chunks_[i]].size_;
+    }
+
+  }
+
   class MapChunkPCmp {
   public:
     bool operator()(const MapChunk* c1, const MapChunk* c2) {
@@ -90,6 +125,189 @@ namespace kmer_match {
 
   }
 
+  namespace {
+
+    uint64_t seed_bin(int size) {
+      return min(max(size, 0) / SEED_BIN_SIZE, 0xFFFF);
+    }
+
+    // Add the runs of chunks which extend the first n chunks of run to runs.
+    void add_seed_runs(const MapChunkDB& db, vector<uint32_t>& run, size_t n, vector<uint32_t>& runs) {
+
+      if(n == run.size()) {
+        runs.insert(runs.end(), run.begin(), run.end());
+        return;
+      }
+
+      const uint32_t last = run[n - 1];
+      const uint64_t pos = db.chunk_positions_[last] + db.map_chunks_[last].end_;
+      for(uint64_t i = db.start_offsets_[pos]; i != db.start_offsets_[pos + 1]; i++) {
+        run[n] = db.start_chunks_[i];
+        add_seed_runs(db, run, n + 1, runs);
+      }
+
+    }
+
+  }
+
+  void MapChunkDB::build_seed_index(size_t seed_frags) {
+
+    seed_frags_ = seed_frags;
+    seed_keys_.clear();
+    seed_chunks_.clear();
+    seed_ranks_.clear();
+
+    if(seed_frags < 2) {
+      return;
+    }
+
+    const size_t k = seed_frags;
+
+    vector<uint32_t> runs;
+    vector<uint32_t> run(k);
+    for(size_t i = 0; i < map_chunks_.size(); i++) {
+      run[0] = i;
+      add_seed_runs(*this, run, 1, runs);
+    }
+
+    // Sort the runs by key, keeping runs with the same key in order.
+    const size_t num_runs = runs.size() / k;
+    vector<pair<uint64_t, uint32_t> > keyed_runs(num_runs);
+    for(size_t r = 0; r < num_runs; r++) {
+      uint64_t key = 0;
+      for(size_t i = 0; i + 1 < k; i++) {
+        key = (key << 16) | seed_bin(map_chunks_[runs[r*k + i]].size_);
+      }
+      key = (key << 32) | uint32_t(map_chunks_[runs[r*k + k - 1]].size_);
+      keyed_runs[r] = make_pair(key, r);
+    }
+    sort(keyed_runs.begin(), keyed_runs.end());
+
+    seed_keys_.reserve(num_runs);
+    seed_chunks_.reserve(runs.size());
+    for(const auto& keyed_run : keyed_runs) {
+      seed_keys_.push_back(keyed_run.first);
+      auto run_start = runs.begin() + keyed_run.second*k;
+      seed_chunks_.insert(seed_chunks_.end(), run_start, run_start + k);
+    }
+
+    seed_ranks_.resize(map_chunks_.size());
+    for(size_t r = 0; r < map_chunk_index_.size(); r++) {
+      seed_ranks_[map_chunk_index_[r] - map_chunks_.data()] = r;
+    }
+
+  }
+
+  void MapChunkDB::query_seed_runs(const IntPairVec& bounds, size_t seed_offset,
+    vector<pair<uint32_t, const MapChunk*> >& seeds) const {
+
+    const size_t k = seed_frags_;
+    const IntPair& last_bound = bounds[k - 1];
+    if(last_bound.second < 0) {
+      return;
+    }
+
+    // For each combination of the bins of all but the last bound, find the runs with
+    // those bins and a last chunk within the last bound.
+    vector<uint64_t> bins(k - 1);
+    for(size_t i = 0; i + 1 < k; i++) {
+      bins[i] = seed_bin(bounds[i].first);
+    }
+
+    while(true) {
+
+      uint64_t prefix = 0;
+      for(size_t i = 0; i + 1 < k; i++) {
+        prefix = (prefix << 16) | bins[i];
+      }
+      prefix <<= 32;
+
+      auto b = lower_bound(seed_keys_.begin(), seed_keys_.end(), prefix | uint32_t(max(last_bound.first, 0)));
+      auto e = upper_bound(b, seed_keys_.end(), prefix | uint32_t(last_bound.second));
+
+      for(auto ki = b; ki != e; ki++) {
+
+        // The bins match, so check the sizes.
+        const uint32_t * run = &seed_chunks_[(ki - seed_keys_.begin())*k];
+        bool is_match = true;
+        for(size_t i = 0; i + 1 < k && is_match; i++) {
+          const int size = map_chunks_[run[i]].size_;
+          is_match = size >= bounds[i].first && size <= bounds[i].second;
+        }
+
+        if(is_match) {
+          const uint32_t seed_chunk = run[seed_offset];
+          seeds.emplace_back(seed_ranks_[seed_chunk], &map_chunks_[seed_chunk]);
+        }
+
+      }
+
+      // The next combination of bins.
+      size_t i = k - 1;
+      while(i > 0 && bins[i - 1] == seed_bin(bounds[i - 1].second)) {
+        bins[i - 1] = seed_bin(bounds[i - 1].first);
+        i--;
+      }
+      if(i == 0) break;
+      bins[i - 1]++;
+
+    }
+
+  }
+
+  SeedVec MapChunkDB::get_seeds(const IntPairVec& bounds, IntPairVec::const_iterator seed_bound) const {
+
+    SeedVec seeds;
+    const size_t k = seed_frags_;
+
+    if(k < 2 || bounds.size() < k) {
+      MapChunkVecConstIterPair matches = query(*seed_bound);
+      seeds.reserve(matches.second - matches.first);
+      for(auto mi = matches.first; mi != matches.second; ++mi) {
+        seeds.emplace_back(*mi, true, true);
+      }
+      return seeds;
+    }
+
+    // The k bounds around the seed bound, extending to the right of it where possible.
+    // In the forward orientation they match a run in the same order, and in the reverse
+    // orientation in reverse order.
+    const size_t s = seed_bound - bounds.begin();
+    const size_t w = min(s, bounds.size() - k);
+    IntPairVec window(bounds.begin() + w, bounds.begin() + w + k);
+
+    typedef pair<uint32_t, const MapChunk*> RankedChunk;
+    vector<RankedChunk> forward_chunks, reverse_chunks;
+    query_seed_runs(window, s - w, forward_chunks);
+    std::reverse(window.begin(), window.end());
+    query_seed_runs(window, w + k - 1 - s, reverse_chunks);
+
+    sort(forward_chunks.begin(), forward_chunks.end());
+    forward_chunks.erase(unique(forward_chunks.begin(), forward_chunks.end()), forward_chunks.end());
+    sort(reverse_chunks.begin(), reverse_chunks.end());
+    reverse_chunks.erase(unique(reverse_chunks.begin(), reverse_chunks.end()), reverse_chunks.end());
+
+    // Merge the orientations, in order of rank as from query.
+    auto fi = forward_chunks.begin();
+    auto ri = reverse_chunks.begin();
+    while(fi != forward_chunks.end() || ri != reverse_chunks.end()) {
+      if(ri == reverse_chunks.end() || (fi != forward_chunks.end() && fi->first < ri->first)) {
+        seeds.emplace_back(fi->second, true, false);
+        ++fi;
+      } else if(fi == forward_chunks.end() || ri->first < fi->first) {
+        seeds.emplace_back(ri->second, false, true);
+        ++ri;
+      } else {
+        seeds.emplace_back(fi->second, true, true);
+        ++fi;
+        ++ri;
+      }
+    }
+
+    return seeds;
+
+  }
+
   MapChunkVecConstIterPair MapChunkDB::query(int lb, int ub) const {
     MapChunkVecConstIter lbi = lower_bound(map_chunk_index_.begin(), map_chunk_index_.end(), lb, MapChunkPIntCmp());
     MapChunkVecConstIter ubi = upper_bound(map_chunk_index_.begin(), map_chunk_index_.end(), ub, IntMapChunkPCmp());
@@ -210,87 +428,176 @@ namespace kmer_match {
   }
 
   ///////////////////////////////////////////////////////////////////////////
-  // Helper function to merge the left alignments and the right alignments
-  // Merge only the best left alignment with the best right alignment.
-  ReferenceAlignment merge_alignments_select_best(AlignmentVector&& left_aln, AlignmentVector&& right_aln,
+  // Helper function to merge the best left alignment and the best right alignment
+  // with the middle chunk. The left alignment is reversed to orient it forward.
+  ReferenceAlignment merge_best_alignments(const Alignment& left_aln, const Alignment& right_aln,
       const MapChunk* middle_chunk) {
 
-    using Size_T = AlignmentVector::size_type;
+    ConstMapChunkPVec chunks;
+    chunks.reserve(left_aln.size() + right_aln.size() + 1);
+    chunks.insert(chunks.end(), left_aln.rbegin(), left_aln.rend());
+    chunks.push_back(middle_chunk);
+    chunks.insert(chunks.end(), right_aln.begin(), right_aln.end());
 
-    if (left_aln.empty() && right_aln.empty()) return ReferenceAlignment();
+    return ReferenceAlignment(std::move(chunks));
 
-    size_t nl = max(left_aln.size(), Size_T(1));
-    size_t nr = max(right_aln.size(), Size_T(1));
+  }
 
-    ReferenceAlignmentMissRateSort ref_aln_sorter;
+  ReferenceAlignment merge_best_alignments(const Alignment& left_aln, const vector<size_t>& left_frags,
+      const Alignment& right_aln, const vector<size_t>& right_frags, const MapChunk* middle_chunk) {
 
-    if(left_aln.empty()) {
+    ReferenceAlignment aln = merge_best_alignments(left_aln, right_aln, middle_chunk);
 
-      // Select the best right alignment, merge the middle chunk, and return.
+    vector<size_t>& query_frags = aln.query_frags_;
+    query_frags.reserve(aln.chunks_.size());
+    query_frags.insert(query_frags.end(), left_frags.rbegin(), left_frags.rend());
+    query_frags.push_back(1);
+    query_frags.insert(query_frags.end(), right_frags.begin(), right_frags.end());
 
-      RefAlignmentVec right_ref_alns;
-      right_ref_alns.reserve(right_aln.size());
-      for(AlignmentVector::iterator iter = right_aln.begin(); iter != right_aln.end(); iter++){
-        right_ref_alns.emplace_back(std::move(*iter));
-      }
+    return aln;
 
-      // Sort the right alignments by miss rate
-      std::sort(right_ref_alns.begin(), right_ref_alns.end(), ref_aln_sorter);
+  }
 
-      // Construct a new reference alignment by prepending the middle chunk to the chunks of the best right alignment.
-      ReferenceAlignment& best = right_ref_alns[0];
-      best.prepend_chunk(middle_chunk);
+  ////////////////////////////////////
+  // Search node for get_best_query_chunks_dfs
+  struct QueryChunkNode {
+
+    QueryChunkNode(const MapChunk * chunk, uint64_t next, uint64_t next_end, size_t remaining,
+      size_t num_unmatched, size_t chunk_unmatched) :
+        chunk_(chunk),
+        next_begin_(next),
+        next_(next),
+        next_end_(next_end),
+        query_frags_(1),
+        remaining_(remaining),
+        num_unmatched_(num_unmatched),
+        chunk_unmatched_(chunk_unmatched)
+      { };
+
+    const MapChunk * chunk_; // The current chunk we are at
+    const uint64_t next_begin_; // The successors of the current chunk in the CSR layout
+    uint64_t next_; // the next successor to consider
+    const uint64_t next_end_;
+    size_t query_frags_; // The query fragments of the query chunk to match to the next successor
+    const size_t remaining_; // The query fragments left to match after the current chunk
+    const size_t num_unmatched_; // The number of misses incurred so far, not counting current chunk.
+    const size_t chunk_unmatched_; // The misses of the current chunk, of both maps.
 
-      return best;
+  };
+
+  bool MapChunkDB::get_best_query_chunks_dfs(const MapChunk * p_start_chunk, bool ref_right,
+    const QueryChunkBounds& query_bounds, size_t query_start, bool query_up,
+    size_t max_unmatched, Alignment& best, vector<size_t>& query_frags) const {
+
+    best.clear();
+    query_frags.clear();
+
+    const size_t num_query_frags = query_bounds.num_frags();
+    const size_t max_query_frags = query_bounds.max_frags();
+    const size_t remaining = query_up ? num_query_frags - query_start : query_start + 1;
+
+    if(remaining == 0) {
+      return false;
     }
 
-    if(right_aln.empty()) {
+    const Map* p_map = p_start_chunk->get_map();
+    const size_t num_ref_frags = p_map->frags_.size();
 
-      // Select the best left alignment, merge the middle chunk, and return.
+    // Can't extend off the end of the map.
+    if(ref_right ? p_start_chunk->end_ >= num_ref_frags : p_start_chunk->start_ == 0) {
+      return false;
+    }
 
-      RefAlignmentVec left_ref_alns;
-      left_ref_alns.reserve(left_aln.size());
-      for(AlignmentVector::iterator iter = left_aln.begin(); iter != left_aln.end(); iter++){
-        left_ref_alns.emplace_back(std::move(*iter));
+    // The successors of a chunk start where it ends to the right, or end where it starts to the left.
+    const uint64_t pos = chunk_position(p_start_chunk);
+    const vector<uint64_t>& offsets = ref_right ? start_offsets_ : end_offsets_;
+    const vector<uint32_t>& chunks = ref_right ? start_chunks_ : end_chunks_;
+    const vector<int>& sizes = ref_right ? start_sizes_ : end_sizes_;
+
+    vector<QueryChunkNode> stack;
+    stack.reserve(remaining + 1);
+
+    const uint64_t start_pos = pos + (ref_right ? p_start_chunk->end_ : p_start_chunk->start_);
+    stack.emplace_back(p_start_chunk, offsets[start_pos], offsets[start_pos + 1], remaining,
+      0, p_start_chunk->num_unmatched());
+
+    // The unmatched sites of the chunks of cur_aln (not the start chunk) at each depth.
+    vector<size_t> aln_unmatched(1, 0);
+    Alignment cur_aln;
+    vector<size_t> cur_query_frags;
+    bool have_best = false;
+    size_t best_unmatched = 0;
+
+    while(!stack.empty()) {
+
+      QueryChunkNode& cur = stack.back();
+
+      if(cur.remaining_ == 0) {
+        // An alignment is only reached if it has fewer unmatched sites than the best.
+        best = cur_aln;
+        query_frags = cur_query_frags;
+        best_unmatched = aln_unmatched.back();
+        have_best = true;
+        if(best_unmatched == 0) break;
+        stack.pop_back();
+        cur_aln.pop_back();
+        cur_query_frags.pop_back();
+        aln_unmatched.pop_back();
+        continue;
       }
 
-      // Sort the left alignments by miss rate
-      std::sort(left_ref_alns.begin(), left_ref_alns.end(), ref_aln_sorter);
+      // The node can not be extended once it has the maximum unmatched sites.
+      const size_t last_query_frags = cur.num_unmatched_ >= max_unmatched ? 0 :
+        std::min(max_query_frags, cur.remaining_);
+
+      // Try the query chunks of one fragment first, then of more fragments.
+      bool pushed = false;
+      for(; cur.query_frags_ <= last_query_frags; cur.query_frags_++, cur.next_ = cur.next_begin_) {
+
+        const size_t n = cur.query_frags_;
+        const IntPair& bound = query_bounds.bound(query_up ? num_query_frags - cur.remaining_ : cur.remaining_ - n, n);
+
+        while(cur.next_ != cur.next_end_) {
+
+          // Only look up the chunks with a size within the bound.
+          const uint64_t i = cur.next_++;
+          if (sizes[i] < bound.first || sizes[i] > bound.second) continue;
+          const MapChunk* next_chunk = &map_chunks_[chunks[i]];
+          if (ref_right ? next_chunk->end_ >= num_ref_frags : next_chunk->start_ == 0) continue;
+          const size_t next_chunk_unmatched = next_chunk->num_unmatched() + n - 1;
+          const size_t next_unmatched = aln_unmatched.back() + next_chunk_unmatched;
+          if (have_best && next_unmatched >= best_unmatched) continue;
+
+          const uint64_t next_pos = pos + (ref_right ? next_chunk->end_ : next_chunk->start_);
+          const size_t num_unmatched = cur.num_unmatched_ + cur.chunk_unmatched_;
+          const size_t next_remaining = cur.remaining_ - n;
+          cur_aln.push_back(next_chunk);
+          cur_query_frags.push_back(n);
+          aln_unmatched.push_back(next_unmatched);
+          stack.emplace_back(next_chunk, offsets[next_pos], offsets[next_pos + 1], next_remaining,
+            num_unmatched, next_chunk_unmatched);
+          pushed = true;
+          break;
 
-      // Construct a new reference alignment by prepending the middle chunk to the chunks of the best right alignment.
-      ReferenceAlignment& best = left_ref_alns[0];
-      best.reverse(); // Reverse to orient forward
-      best.append_chunk(middle_chunk);
-      
-      return best;
+        }
 
-    }
+        if(pushed) break;
 
-    // Select the best right alignment
-    RefAlignmentVec right_ref_alns;
-    right_ref_alns.reserve(right_aln.size());
-    for(AlignmentVector::iterator iter = right_aln.begin(); iter != right_aln.end(); iter++){
-      right_ref_alns.emplace_back(std::move(*iter));
-    }
-    std::sort(right_ref_alns.begin(), right_ref_alns.end(), ref_aln_sorter);
-    ReferenceAlignment& best_right = right_ref_alns[0];
+      }
 
-    // Select the best left alignment
-    RefAlignmentVec left_ref_alns;
-    left_ref_alns.reserve(left_aln.size());
-    for(AlignmentVector::iterator iter = left_aln.begin(); iter != left_aln.end(); iter++){
-      left_ref_alns.emplace_back(std::move(*iter));
-    }
-    std::sort(left_ref_alns.begin(), left_ref_alns.end(), ref_aln_sorter);
-    ReferenceAlignment& best_left = left_ref_alns[0];
-    best_left.reverse(); // reverse the left alignment to orient forward with respect to the reference.
+      // If we did not find a successor, pop this node.
+      if (!pushed) {
+        stack.pop_back();
+        if(!cur_aln.empty()) {
+          cur_aln.pop_back();
+          cur_query_frags.pop_back();
+        }
+        aln_unmatched.pop_back();
+      }
 
-    // Merge the middle chunk and right alignment with the left alignment
-    ReferenceAlignment& best_aln = best_left;
-    best_aln.append_chunk(middle_chunk);
-    best_aln.append_chunks(best_right.chunks_.begin(), best_right.chunks_.end());
+    }
 
-    return best_aln;
+    return have_best;
 
   }
 
@@ -323,9 +630,10 @@ namespace kmer_match {
     bool must_search_left_reverse = must_search_right;
     bool must_search_right_reverse = must_search_left;
 
-    MapChunkVecConstIterPair matches = query(*iter_max_bound);
-
     if(bounds.size() == 1) {
+
+      MapChunkVecConstIterPair matches = query(*iter_max_bound);
+
       // In this case, the hits are simply the range of MapChunk *'s returned by the query function
       AlignmentVector ret;
       ret.reserve(matches.second - matches.first);
@@ -336,7 +644,7 @@ namespace kmer_match {
       return ret;
     }
 
-    // For each match to the largest fragment, test if it is compatible for the other
+    // For each seed matching the largest fragment, test if it is compatible for the other
     // bounds.
     int num_matches = 0;
     typedef reverse_iterator<IntPairVec::const_iterator> RevIter;
@@ -346,9 +654,11 @@ namespace kmer_match {
     bool have_alignments_forward;
     bool have_alignments_left;
 
-    for(auto mi = matches.first; mi != matches.second; ++mi) {
+    const SeedVec seeds = get_seeds(bounds, iter_max_bound);
+
+    for(const Seed& seed : seeds) {
       
-      const MapChunk* middle_chunk = *mi;
+      const MapChunk* middle_chunk = seed.chunk_;
 
       if (middle_chunk->num_unmatched() > max_unmatched) continue;
       size_t extension_max_unmatched = max_unmatched - middle_chunk->num_unmatched();
@@ -364,7 +674,7 @@ namespace kmer_match {
 
       ///////////////////////////////////////////////////////////////////////////////////
       // Match in the forward direction
-      {
+      if(seed.forward_) {
         AlignmentVector aln_right_forward, aln_left_forward; 
         bool have_alignments_forward = true;
 
@@ -385,18 +695,18 @@ namespace kmer_match {
 
       ///////////////////////////////////////////////////////////////////////////////////
       // Match in the reverse direction
-      {
+      if(seed.reverse_) {
 
         bool have_alignments_reverse = true;
         AlignmentVector aln_right_reverse, aln_left_reverse; 
 
         if(must_search_right_reverse) {
-          aln_right_reverse = get_compatible_right_dfs(*mi, rev_start, rev_end, extension_max_unmatched);
+          aln_right_reverse = get_compatible_right_dfs(middle_chunk, rev_start, rev_end, extension_max_unmatched);
           have_alignments_reverse = !aln_right_reverse.empty();
         }
 
         if(have_alignments_reverse && must_search_left_reverse) {
-          aln_left_reverse = get_compatible_left_dfs(*mi, iter_max_bound + 1, bounds.end(), extension_max_unmatched);
+          aln_left_reverse = get_compatible_left_dfs(middle_chunk, iter_max_bound + 1, bounds.end(), extension_max_unmatched);
           have_alignments_reverse = !aln_left_reverse.empty();
         }
 
@@ -416,6 +726,8 @@ namespace kmer_match {
   // Get the best alignment in the forward and reverse direction for each seed hit.
   // Unlike get_compatbile_alignments, which returns all alignments in forward/reverse direction for a seed,
   // this will return at most two alignments per seed (one for forward direction, the other for reverse).
+  // The best extension to each side is found by a bounded search (see get_best_right_dfs), without
+  // collecting the other alignments.
   RefAlignmentVec MapChunkDB::get_compatible_alignments_best(const IntPairVec& bounds, size_t max_unmatched) const {
 
     // See if there is a sequence of fragments in the database within the error bounds.
@@ -444,10 +756,10 @@ namespace kmer_match {
     bool must_search_left_reverse = must_search_right;
     bool must_search_right_reverse = must_search_left;
 
-    MapChunkVecConstIterPair matches = query(*iter_max_bound);
-
     if(bounds.size() == 1) {
 
+      MapChunkVecConstIterPair matches = query(*iter_max_bound);
+
       // In this case, the hits are simply the range of MapChunk *'s returned by the query function
       RefAlignmentVec ret;
       ret.reserve(matches.second - matches.first);
@@ -458,19 +770,21 @@ namespace kmer_match {
       return ret;
     }
 
-    // For each match to the largest fragment, test if it is compatible for the other
+    // For each seed matching the largest fragment, test if it is compatible for the other
     // bounds.
     int num_matches = 0;
     typedef reverse_iterator<IntPairVec::const_iterator> RevIter;
 
     RefAlignmentVec all_alignments;
-    
-    bool have_alignments_forward;
-    bool have_alignments_left;
 
-    for(auto mi = matches.first; mi != matches.second; ++mi) {
+    // The best extensions to either side of the seed.
+    Alignment best_left, best_right;
+
+    const SeedVec seeds = get_seeds(bounds, iter_max_bound);
+
+    for(const Seed& seed : seeds) {
       
-      const MapChunk* middle_chunk = *mi;
+      const MapChunk* middle_chunk = seed.chunk_;
 
       if (middle_chunk->num_unmatched() > max_unmatched) continue;
       size_t extension_max_unmatched = max_unmatched - middle_chunk->num_unmatched();
@@ -486,46 +800,165 @@ namespace kmer_match {
 
       ///////////////////////////////////////////////////////////////////////////////////
       // Match in the forward direction
-      {
-        AlignmentVector aln_right_forward, aln_left_forward; 
+      if(seed.forward_) {
         bool have_alignments_forward = true;
+        best_left.clear();
+        best_right.clear();
 
         if(must_search_right) {
-          aln_right_forward = get_compatible_right_dfs(middle_chunk, iter_max_bound + 1, bounds.end(), extension_max_unmatched);
-          have_alignments_forward = !aln_right_forward.empty();
+          have_alignments_forward = get_best_right_dfs(middle_chunk, iter_max_bound + 1, bounds.end(),
+            extension_max_unmatched, best_right);
         }
 
         if(have_alignments_forward && must_search_left) {
-          aln_left_forward = get_compatible_left_dfs(middle_chunk, rev_start, rev_end, extension_max_unmatched);
-          have_alignments_forward = !aln_left_forward.empty();
+          have_alignments_forward = get_best_left_dfs(middle_chunk, rev_start, rev_end,
+            extension_max_unmatched, best_left);
         }
 
         if(have_alignments_forward) {
-          ReferenceAlignment best_forward = merge_alignments_select_best(std::move(aln_left_forward), std::move(aln_right_forward), middle_chunk);
-          all_alignments.push_back(std::move(best_forward));
+          all_alignments.push_back(merge_best_alignments(best_left, best_right, middle_chunk));
         }
       } // end match in the forward direction
 
       ///////////////////////////////////////////////////////////////////////////////////
       // Match in the reverse direction
+      if(seed.reverse_) {
+
+        bool have_alignments_reverse = true;
+        best_left.clear();
+        best_right.clear();
+
+        if(must_search_right_reverse) {
+          have_alignments_reverse = get_best_right_dfs(middle_chunk, rev_start, rev_end,
+            extension_max_unmatched, best_right);
+        }
+
+        if(have_alignments_reverse && must_search_left_reverse) {
+          have_alignments_reverse = get_best_left_dfs(middle_chunk, iter_max_bound + 1, bounds.end(),
+            extension_max_unmatched, best_left);
+        }
+
+        // The right alignment comes first in the orientation of the query.
+        if(have_alignments_reverse) {
+          all_alignments.push_back(merge_best_alignments(best_right, best_left, middle_chunk));
+        }
+
+      } // end match in the reverse direction
+
+    }
+
+    return all_alignments;
+
+  }
+
+  /////////////////////////////////////////////////////////////////////////////////////
+  // The best alignments of get_compatible_alignments_best, where each reference chunk may match
+  // a chunk of up to query_bounds.max_frags() query fragments, for unmatched sites in the query.
+  // The seed is the largest single query fragment, and the extensions are found by
+  // get_best_query_chunks_dfs. The query_frags_ of each alignment give the query fragments
+  // matched by each chunk.
+  RefAlignmentVec MapChunkDB::get_compatible_alignments_best(const QueryChunkBounds& query_bounds,
+    size_t max_unmatched) const {
+
+    if(query_bounds.max_frags() <= 1) {
+      return get_compatible_alignments_best(query_bounds.bounds_[0], max_unmatched);
+    }
+
+    const IntPairVec& bounds = query_bounds.bounds_[0];
+    const size_t num_query_frags = bounds.size();
+
+    // Find the largest fragment of the bounds.
+    // We seed on the largest fragment.
+    int max_bound = -1;
+    size_t seed_index = 0;
+    for(size_t i = 0; i < num_query_frags; i++) {
+      if (bounds[i].second > max_bound) {
+        max_bound = bounds[i].second;
+        seed_index = i;
+      }
+    }
+
+    bool must_search_left = (seed_index != 0);
+    bool must_search_right = (seed_index + 1 != num_query_frags);
+
+    // For reverse searches, the query is oriented in reverse direction.
+    // Left refers to left in the reference, right refers to right in the reference.
+    bool must_search_left_reverse = must_search_right;
+    bool must_search_right_reverse = must_search_left;
+
+    RefAlignmentVec all_alignments;
+
+    // The best extensions to either side of the seed, and their query chunks.
+    Alignment best_left, best_right;
+    vector<size_t> left_frags, right_frags;
+
+    MapChunkVecConstIterPair matches = query(bounds[seed_index]);
+
+    for(auto mi = matches.first; mi != matches.second; ++mi) {
+
+      const MapChunk* middle_chunk = *mi;
+
+      if (num_query_frags == 1) {
+        all_alignments.emplace_back(middle_chunk);
+        continue;
+      }
+
+      if (middle_chunk->num_unmatched() > max_unmatched) continue;
+      size_t extension_max_unmatched = max_unmatched - middle_chunk->num_unmatched();
+
+      // For the case of circular maps, do not work with a seed that starts more than bounds.size() fragments
+      // past the point of circularization.
+      size_t map_size_orig = middle_chunk->get_map_wrapper()->num_frags();
+      if (middle_chunk->start_ >= map_size_orig + num_query_frags) continue;
+
+      ///////////////////////////////////////////////////////////////////////////////////
+      // Match in the forward direction
       {
+        bool have_alignments_forward = true;
+        best_left.clear();
+        best_right.clear();
+        left_frags.clear();
+        right_frags.clear();
+
+        if(must_search_right) {
+          have_alignments_forward = get_best_query_chunks_dfs(middle_chunk, true, query_bounds,
+            seed_index + 1, true, extension_max_unmatched, best_right, right_frags);
+        }
+
+        if(have_alignments_forward && must_search_left) {
+          have_alignments_forward = get_best_query_chunks_dfs(middle_chunk, false, query_bounds,
+            seed_index - 1, false, extension_max_unmatched, best_left, left_frags);
+        }
 
+        if(have_alignments_forward) {
+          all_alignments.push_back(merge_best_alignments(best_left, left_frags,
+            best_right, right_frags, middle_chunk));
+        }
+      } // end match in the forward direction
+
+      ///////////////////////////////////////////////////////////////////////////////////
+      // Match in the reverse direction
+      {
         bool have_alignments_reverse = true;
-        AlignmentVector aln_right_reverse, aln_left_reverse; 
+        best_left.clear();
+        best_right.clear();
+        left_frags.clear();
+        right_frags.clear();
 
         if(must_search_right_reverse) {
-          aln_right_reverse = get_compatible_right_dfs(middle_chunk, rev_start, rev_end, extension_max_unmatched);
-          have_alignments_reverse = !aln_right_reverse.empty();
+          have_alignments_reverse = get_best_query_chunks_dfs(middle_chunk, true, query_bounds,
+            seed_index - 1, false, extension_max_unmatched, best_right, right_frags);
         }
 
         if(have_alignments_reverse && must_search_left_reverse) {
-          aln_left_reverse = get_compatible_left_dfs(middle_chunk, iter_max_bound + 1, bounds.end(), extension_max_unmatched);
-          have_alignments_reverse = !aln_left_reverse.empty();
+          have_alignments_reverse = get_best_query_chunks_dfs(middle_chunk, false, query_bounds,
+            seed_index + 1, true, extension_max_unmatched, best_left, left_frags);
         }
 
+        // The right alignment comes first in the orientation of the query.
         if(have_alignments_reverse) {
-            ReferenceAlignment best_reverse = merge_alignments_select_best(std::move(aln_right_reverse), std::move(aln_left_reverse), middle_chunk);
-            all_alignments.push_back(std::move(best_reverse));
+          all_alignments.push_back(merge_best_alignments(best_right, right_frags,
+            best_left, left_frags, middle_chunk));
         }
 
       } // end match in the reverse direction
@@ -4,10 +4,13 @@
 #include <unordered_map>
 #include <utility>
 #include <cassert>
+#include <cstdint>
+#include <limits>
 
 #include "map.h"
 #include "map_chunk.h"
 #include "ref_alignment.h"
+#include "error_model.h"
 
 namespace kmer_match {
 
@@ -18,23 +21,51 @@ namespace kmer_match {
 
   typedef std::vector<MapChunk*> MapChunkPVec;
   typedef std::vector<const MapChunk*> MapChunkConstPVec;
-  typedef std::vector<MapChunkConstPVec> ChunksAtIndex;
   typedef std::vector<const MapChunk*> Alignment;
   typedef std::vector<Alignment> AlignmentVector;
   typedef std::vector<const MapChunk*>::const_iterator MapChunkVecConstIter;
   typedef std::pair<MapChunkVecConstIter, MapChunkVecConstIter> MapChunkVecConstIterPair;
 
+  // A chunk matching the seed bound, and the orientations in which it is extended.
+  struct Seed {
+    Seed(const MapChunk * chunk, bool forward, bool reverse) :
+      chunk_(chunk), forward_(forward), reverse_(reverse) {};
+    const MapChunk * chunk_;
+    bool forward_;
+    bool reverse_;
+  };
+  typedef std::vector<Seed> SeedVec;
+
+  // Runs of chunks in the seed index are keyed by the sizes of their chunks, binned
+  // to SEED_BIN_SIZE bp for all but the last chunk.
+  const int SEED_BIN_SIZE = 1000;
+  const size_t MAX_SEED_FRAGS = 3;
+
   class MapChunkDB {
     
   public:
 
     MapChunkDB(const MapWrapperPVec& maps, size_t frags_per_chunk);
 
+    // An empty database, to be filled by read_map_chunk_db.
+    explicit MapChunkDB(size_t frags_per_chunk) : frags_per_chunk_(frags_per_chunk), seed_frags_(1) {};
+
     void sort_chunks();
 
+    // Index the runs of seed_frags consecutive chunks (2 to MAX_SEED_FRAGS), so that
+    // seeds are matched to seed_frags adjacent bounds at once instead of only to the
+    // largest bound.
+    void build_seed_index(size_t seed_frags);
+
     MapChunkVecConstIterPair query(int lb, int ub) const;
     MapChunkVecConstIterPair query(const IntPair&) const;
 
+    // The chunks matching the seed bound which may extend to an alignment, in the order of
+    // query(*seed_bound). Without a seed index, this is every chunk matching the seed bound.
+    // With one, a chunk is a seed in an orientation only if it is part of a run of chunks
+    // matching the seed_frags_ adjacent bounds around the seed bound in that orientation.
+    SeedVec get_seeds(const IntPairVec& bounds, IntPairVec::const_iterator seed_bound) const;
+
     int count_compatible_seeds(const IntPairVec& bounds) const;
     
     AlignmentVector get_compatible_alignments(const IntPairVec& bounds,
@@ -43,6 +74,13 @@ namespace kmer_match {
     RefAlignmentVec get_compatible_alignments_best(const IntPairVec& bounds,
       size_t max_unmatched = std::numeric_limits<size_t>::max()) const;
 
+    // As get_compatible_alignments_best, but a reference chunk may match a chunk of up to
+    // query_bounds.max_frags() consecutive query fragments, leaving the query sites between
+    // them unmatched. The seed is a single query fragment. The unmatched query sites count
+    // towards max_unmatched, and the query_frags_ of the alignments give the query chunks.
+    RefAlignmentVec get_compatible_alignments_best(const QueryChunkBounds& query_bounds,
+      size_t max_unmatched = std::numeric_limits<size_t>::max()) const;
+
     template <typename BoundIter >
     int count_compatible_right_bfs(const MapChunk * p_start_chunk, BoundIter bound_start, BoundIter bound_end) const;
 
@@ -65,6 +103,27 @@ namespace kmer_match {
     AlignmentVector get_compatible_left_dfs(const MapChunk * p_start_chunk,
       BoundIter bound_start, BoundIter bound_end, 
       size_t max_unmatched = std::numeric_limits<size_t>::max()) const;
+
+    // The best of the alignments found by get_compatible_right_dfs (or get_compatible_left_dfs),
+    // with the fewest unmatched sites, found by a branch and bound search which keeps only the
+    // best alignment found so far. Ties go to the first alignment in the order of the DFS.
+    // Returns false if there is no compatible alignment.
+    template <typename BoundIter >
+    bool get_best_right_dfs(const MapChunk * p_start_chunk,
+      BoundIter bound_start, BoundIter bound_end, size_t max_unmatched, Alignment& best) const;
+
+    template <typename BoundIter >
+    bool get_best_left_dfs(const MapChunk * p_start_chunk,
+      BoundIter bound_start, BoundIter bound_end, size_t max_unmatched, Alignment& best) const;
+
+    // The search of get_best_right_dfs (or get_best_left_dfs, if not ref_right) where each
+    // chunk may match a chunk of several query fragments. The query fragments are matched
+    // from query_start up to the last fragment (query_up), or down to the first. The best
+    // alignment has the fewest unmatched sites of both maps, and query_frags has the number
+    // of query fragments matched by each of its chunks.
+    bool get_best_query_chunks_dfs(const MapChunk * p_start_chunk, bool ref_right,
+      const QueryChunkBounds& query_bounds, size_t query_start, bool query_up,
+      size_t max_unmatched, Alignment& best, std::vector<size_t>& query_frags) const;
       
 
     // This is a cache friendly layout of the MapChunks.
@@ -75,10 +134,46 @@ namespace kmer_match {
     // This is a query friendly layout of MapChunks, sorted by size.
     std::vector<const MapChunk *> map_chunk_index_;
 
-    std::unordered_map<const Map *, ChunksAtIndex> map_to_chunks_at_start_;
-    std::unordered_map<const Map *, ChunksAtIndex> map_to_chunks_at_end_;
+    // The chunks starting and ending at each index of each map, in a flat (CSR) layout,
+    // so that a search step scans a contiguous run of chunk sizes.
+    // Index i of the m'th map is at position map_positions_[m] + i. The chunks starting at
+    // position p are start_chunks_[start_offsets_[p]] to start_chunks_[start_offsets_[p+1] - 1]
+    // (indices into map_chunks_), with their sizes at the same offsets in start_sizes_.
+    // The same for the chunks ending at each position.
+    std::vector<uint64_t> map_positions_;
+    std::vector<uint64_t> start_offsets_;
+    std::vector<uint32_t> start_chunks_;
+    std::vector<int> start_sizes_;
+    std::vector<uint64_t> end_offsets_;
+    std::vector<uint32_t> end_chunks_;
+    std::vector<int> end_sizes_;
+
+    // The position of index 0 of the map of each chunk in map_chunks_.
+    std::vector<uint64_t> chunk_positions_;
+
     size_t frags_per_chunk_;
 
+    // The seed index of the runs of seed_frags_ consecutive chunks, each starting where the
+    // previous one ends. seed_keys_ is sorted, and the chunks of the i'th run are
+    // seed_chunks_[i*seed_frags_] to seed_chunks_[(i+1)*seed_frags_ - 1], in reference order.
+    // seed_ranks_ has the index of each chunk in map_chunk_index_. Empty if seed_frags_ is 1.
+    size_t seed_frags_;
+    std::vector<uint64_t> seed_keys_;
+    std::vector<uint32_t> seed_chunks_;
+    std::vector<uint32_t> seed_ranks_;
+
+    // Add the seeds of the runs matching the bounds (in reference order), which have their
+    // seed chunk at seed_offset in the run, to seeds as (rank, chunk) pairs.
+    void query_seed_runs(const IntPairVec& bounds, size_t seed_offset,
+      std::vector<std::pair<uint32_t, const MapChunk*> >& seeds) const;
+
+    // Fill start_sizes_ and end_sizes_ from start_chunks_ and end_chunks_.
+    void index_chunk_sizes();
+
+    uint64_t chunk_position(const MapChunk * p_chunk) const {
+      return chunk_positions_[p_chunk - map_chunks_.data()];
+    }
+
   };
 
   ////////////////////////////////////
@@ -88,8 +183,8 @@ namespace kmer_match {
   public:
 
       SearchNode(const MapChunk * chunk,
-        MapChunkVecConstIter chunk_next,
-        MapChunkVecConstIter chunk_next_end,
+        uint64_t chunk_next,
+        uint64_t chunk_next_end,
         BoundIter b,
         int num_unmatched) :
           chunk_(chunk),
@@ -100,8 +195,8 @@ namespace kmer_match {
         { };
       
       const MapChunk * chunk_; // The current chunk we are at
-      MapChunkVecConstIter chunk_next_; // the next chunk to consider
-      const MapChunkVecConstIter chunk_next_end_; // the end of the next chunk vector (so we know when we are done trying to extend)
+      uint64_t chunk_next_; // the offset of the next chunk to consider in the CSR layout
+      const uint64_t chunk_next_end_; // the end of the next chunks (so we know when we are done trying to extend)
       BoundIter bound_iter_next_;  // The next bound to consider
       size_t num_unmatched_; // The number of misses incurred so far, not counting current chunk.
   };
@@ -124,7 +219,7 @@ namespace kmer_match {
     active_set.push_back(p_start_chunk);
 
     const Map* p_map = p_start_chunk->get_map();
-    const ChunksAtIndex& chunks_at_start = map_to_chunks_at_start_.at(p_map);
+    const uint64_t pos = chunk_position(p_start_chunk);
 
     for(BoundIter bi = bound_start; bi != bound_end; bi++) {
       
@@ -138,7 +233,6 @@ namespace kmer_match {
         const MapChunk* p_chunk = *ci;
 
         // Get chunks that follow this one from the database.
-        const Map* p_map = p_chunk->get_map();
         if(p_chunk->end_ == p_map->frags_.size()) {
 
           // We've reached the end of the map!
@@ -146,11 +240,10 @@ namespace kmer_match {
 
         }
 
-        const MapChunkConstPVec& next_chunks = chunks_at_start[p_chunk->end_];
-        for(size_t i = 0; i < next_chunks.size(); i++) {
-          const MapChunk * p_next = next_chunks[i];
-          if(p_next->size_ >= lb && p_next->size_ <= ub) {
-            new_active_set.push_back(p_next);
+        const uint64_t next_end = start_offsets_[pos + p_chunk->end_ + 1];
+        for(uint64_t i = start_offsets_[pos + p_chunk->end_]; i != next_end; i++) {
+          if(start_sizes_[i] >= lb && start_sizes_[i] <= ub) {
+            new_active_set.push_back(&map_chunks_[start_chunks_[i]]);
           }
         }
 
@@ -181,8 +274,7 @@ namespace kmer_match {
     active_set.reserve(num_bounds);
     active_set.push_back(p_start_chunk);
 
-    const Map* p_map = p_start_chunk->get_map();
-    const ChunksAtIndex& chunks_at_end = map_to_chunks_at_end_.at(p_map);
+    const uint64_t pos = chunk_position(p_start_chunk);
 
     for(BoundIter bi = bound_start; bi != bound_end; bi++) {
         
@@ -201,11 +293,11 @@ namespace kmer_match {
           continue;
         }
 
-        const MapChunkConstPVec& next_chunks = chunks_at_end[p_chunk->start_]; // Get chunks that end where the current chunk starts.
-        for(size_t i = 0; i < next_chunks.size(); i++) {
-          const MapChunk * p_next = next_chunks[i];
-          if(p_next->size_ >= lb && p_next->size_ <= ub) {
-            new_active_set.push_back(p_next);
+        // Get chunks that end where the current chunk starts.
+        const uint64_t next_end = end_offsets_[pos + p_chunk->start_ + 1];
+        for(uint64_t i = end_offsets_[pos + p_chunk->start_]; i != next_end; i++) {
+          if(end_sizes_[i] >= lb && end_sizes_[i] <= ub) {
+            new_active_set.push_back(&map_chunks_[end_chunks_[i]]);
           }
         }
 
@@ -244,7 +336,7 @@ namespace kmer_match {
     active_set.push_back(cur_alignment);
 
     const Map* p_map = p_start_chunk->get_map();
-    const ChunksAtIndex& chunks_at_start = map_to_chunks_at_start_.at(p_map);
+    const uint64_t pos = chunk_position(p_start_chunk);
 
     for(BoundIter bi = bound_start; bi != bound_end; bi++) {
         
@@ -264,14 +356,13 @@ namespace kmer_match {
           continue;
         }
 
-        const MapChunkConstPVec&  next_chunks = chunks_at_start[aln_end]; // Get chunks that start where current alignment ends
-        for(size_t i = 0; i < next_chunks.size(); i++) {
-
-          const MapChunk * p_next = next_chunks[i];
+        // Get chunks that start where current alignment ends
+        const uint64_t next_end = start_offsets_[pos + aln_end + 1];
+        for(uint64_t i = start_offsets_[pos + aln_end]; i != next_end; i++) {
 
-          if(p_next->size_ >= lb && p_next->size_ <= ub) {
+          if(start_sizes_[i] >= lb && start_sizes_[i] <= ub) {
             Alignment new_aln(aln); // unnecessary copy if this doesnt get anywhere
-            new_aln.push_back(p_next);
+            new_aln.push_back(&map_chunks_[start_chunks_[i]]);
             new_active_set.push_back(std::move(new_aln));
           }
 
@@ -315,17 +406,16 @@ namespace kmer_match {
 
     /////////////////////////////////////////////////////////////
     // Find the first chunk which extends left.
-    const Map* p_map = p_start_chunk->get_map();
-    const ChunksAtIndex& chunks_at_end = map_to_chunks_at_end_.at(p_map);
+    const uint64_t pos = chunk_position(p_start_chunk);
     BoundIter bi = bound_start;
     auto lb = bi->first;
     auto ub = bi->second;
-    const MapChunkConstPVec& next_chunks = chunks_at_end[p_start_chunk->start_]; // Get chunks that end where the current chunk starts.
-    for(size_t i = 0; i < next_chunks.size(); i++) {
-
-      const MapChunk * p_next = next_chunks[i];
+    // Get chunks that end where the current chunk starts.
+    const uint64_t next_end = end_offsets_[pos + p_start_chunk->start_ + 1];
+    for(uint64_t i = end_offsets_[pos + p_start_chunk->start_]; i != next_end; i++) {
 
-      if(p_next->size_ >= lb && p_next->size_ <= ub) {
+      if(end_sizes_[i] >= lb && end_sizes_[i] <= ub) {
+        const MapChunk * p_next = &map_chunks_[end_chunks_[i]];
         Alignment new_aln = { p_next };
         new_aln.push_back(p_next);
         active_set.push_back(std::move(new_aln));
@@ -350,14 +440,13 @@ namespace kmer_match {
           continue;
         }
 
-        const MapChunkConstPVec& next_chunks = chunks_at_end[aln_start]; // Get chunks that end where the current chunk starts.
-        for(size_t i = 0; i < next_chunks.size(); i++) {
-
-          const MapChunk * p_next = next_chunks[i];
+        // Get chunks that end where the current chunk starts.
+        const uint64_t next_end = end_offsets_[pos + aln_start + 1];
+        for(uint64_t i = end_offsets_[pos + aln_start]; i != next_end; i++) {
 
-          if(p_next->size_ >= lb && p_next->size_ <= ub) {
+          if(end_sizes_[i] >= lb && end_sizes_[i] <= ub) {
             Alignment new_aln(aln);
-            new_aln.push_back(p_next);
+            new_aln.push_back(&map_chunks_[end_chunks_[i]]);
             new_active_set.push_back(std::move(new_aln));
           }
 
@@ -396,7 +485,7 @@ namespace kmer_match {
     }
 
     const Map* p_map = p_start_chunk->get_map();
-    const ChunksAtIndex& chunks_at_start = map_to_chunks_at_start_.at(p_map);
+    const uint64_t pos = chunk_position(p_start_chunk);
 
     if(p_start_chunk->end_ >= p_map->frags_.size()) {
       // Can't extend off the right end of the map.
@@ -410,8 +499,8 @@ namespace kmer_match {
     stack.reserve(bound_end - bound_start);
 
     stack.emplace_back(p_start_chunk,
-         chunks_at_start[p_start_chunk->end_].begin(),
-         chunks_at_start[p_start_chunk->end_].end(),
+         start_offsets_[pos + p_start_chunk->end_],
+         start_offsets_[pos + p_start_chunk->end_ + 1],
          bound_start, 0); 
 
     Alignment cur_aln; // Don't include the start chunk in the alignment.
@@ -443,26 +532,26 @@ namespace kmer_match {
 
         // Get the next successor node, and if it is compatible with the bound, put it on the stack.
         bool pushed = false;
+        // The node can not be extended once it has the maximum unmatched sites.
+        if (cur.num_unmatched_ >= max_unmatched) cur.chunk_next_ = cur.chunk_next_end_;
         while(cur.chunk_next_ != cur.chunk_next_end_) {
+          // Only look up the chunks with a size within the bound.
+          const uint64_t i = cur.chunk_next_++;
+          if (start_sizes_[i] < lb || start_sizes_[i] > ub) continue;
           const MapChunk* cur_chunk = cur.chunk_;
-          const MapChunk* next_chunk = *cur.chunk_next_++;
+          const MapChunk* next_chunk = &map_chunks_[start_chunks_[i]];
           if (next_chunk->end_ >= p_map->frags_.size()) continue; // Don't extend off of the map.
-          if (cur.num_unmatched_ >= max_unmatched) continue;
-          if (next_chunk->size_ >= lb && next_chunk->size_ <= ub) {
-            
-            stack.emplace_back(next_chunk,
-                chunks_at_start[next_chunk->end_].begin(),
-                chunks_at_start[next_chunk->end_].end(),
-                cur.bound_iter_next_ + 1,
-                cur.num_unmatched_ + cur_chunk->num_unmatched());
-
-            cur_aln.push_back(next_chunk);
-            // std::cerr << "stack push!" << std::endl;
-            pushed = true;
-            goto process_stack; // Wow, I think this is a perfectly good use of goto!
-            break;
-          }
-          
+          stack.emplace_back(next_chunk,
+              start_offsets_[pos + next_chunk->end_],
+              start_offsets_[pos + next_chunk->end_ + 1],
+              cur.bound_iter_next_ + 1,
+              cur.num_unmatched_ + cur_chunk->num_unmatched());
+
+          cur_aln.push_back(next_chunk);
+          // std::cerr << "stack push!" << std::endl;
+          pushed = true;
+          goto process_stack; // Wow, I think this is a perfectly good use of goto!
+          break;
         }
 
       // if (pushed) continue;
@@ -500,8 +589,7 @@ namespace kmer_match {
       return AlignmentVector();
     }
 
-    const Map* p_map = p_start_chunk->get_map();
-    const ChunksAtIndex& chunks_at_end = map_to_chunks_at_end_.at(p_map);
+    const uint64_t pos = chunk_position(p_start_chunk);
 
     if(p_start_chunk->start_ == 0) {
       // Can't extend off the left end of the map.
@@ -514,8 +602,8 @@ namespace kmer_match {
     std::vector<Node> stack;
     stack.reserve(bound_end - bound_start);
     stack.emplace_back(p_start_chunk,
-        chunks_at_end[p_start_chunk->start_].begin(),
-        chunks_at_end[p_start_chunk->start_].end(),
+        end_offsets_[pos + p_start_chunk->start_],
+        end_offsets_[pos + p_start_chunk->start_ + 1],
         bound_start, 0); 
 
     Alignment cur_aln;
@@ -538,25 +626,25 @@ namespace kmer_match {
 
         // Get the next successor node, and if it is compatible with the bound, put it on the stack.
         bool pushed = false;
+        // The node can not be extended once it has the maximum unmatched sites.
+        if (cur.num_unmatched_ >= max_unmatched) cur.chunk_next_ = cur.chunk_next_end_;
         while(cur.chunk_next_ != cur.chunk_next_end_) {
+          // Only look up the chunks with a size within the bound.
+          const uint64_t i = cur.chunk_next_++;
+          if (end_sizes_[i] < lb || end_sizes_[i] > ub) continue;
           const MapChunk* cur_chunk = cur.chunk_;
-          const MapChunk* next_chunk = *cur.chunk_next_++;
-
+          const MapChunk* next_chunk = &map_chunks_[end_chunks_[i]];
           if (next_chunk->start_ == 0 ) continue; // Don't extend off of the reference map.
-          if (cur.num_unmatched_ >= max_unmatched) continue;
-          if (next_chunk->size_ >= lb && next_chunk->size_ <= ub) {
-            
-            stack.emplace_back(next_chunk,
-                chunks_at_end[next_chunk->start_].begin(),
-                chunks_at_end[next_chunk->start_].end(),
-                cur.bound_iter_next_ + 1,
-                cur.num_unmatched_ + cur_chunk->num_unmatched());
-            cur_aln.push_back(next_chunk);
-            pushed = true;
-            // std::cerr << "stack push!" << std::endl;
-            goto process_stack;
-            break;
-          }
+          stack.emplace_back(next_chunk,
+              end_offsets_[pos + next_chunk->start_],
+              end_offsets_[pos + next_chunk->start_ + 1],
+              cur.bound_iter_next_ + 1,
+              cur.num_unmatched_ + cur_chunk->num_unmatched());
+          cur_aln.push_back(next_chunk);
+          pushed = true;
+          // std::cerr << "stack push!" << std::endl;
+          goto process_stack;
+          break;
         }
 
       // if (pushed) continue;
@@ -575,6 +663,195 @@ namespace kmer_match {
 
   }
 
+  ////////////////////////////////////////////////////////////////////////////////
+  // The search of get_compatible_right_dfs, bounded by the unmatched sites of the best
+  // alignment found so far. A branch is cut once it has as many unmatched sites as the
+  // best alignment, since a later alignment only replaces the best if it has fewer.
+  // The search ends early on finding an alignment without unmatched sites.
+  template <typename BoundIter >
+  bool MapChunkDB::get_best_right_dfs(
+    const MapChunk * p_start_chunk,
+    BoundIter bound_start,
+    BoundIter bound_end,
+    size_t max_unmatched,
+    Alignment& best) const {
+
+    best.clear();
+
+    if(bound_start >= bound_end) {
+      return false;
+    }
+
+    const Map* p_map = p_start_chunk->get_map();
+    const uint64_t pos = chunk_position(p_start_chunk);
+
+    if(p_start_chunk->end_ >= p_map->frags_.size()) {
+      // Can't extend off the right end of the map.
+      return false;
+    }
+
+    typedef SearchNode<BoundIter> Node;
+    std::vector<Node> stack;
+    stack.reserve(bound_end - bound_start + 1);
+
+    stack.emplace_back(p_start_chunk,
+         start_offsets_[pos + p_start_chunk->end_],
+         start_offsets_[pos + p_start_chunk->end_ + 1],
+         bound_start, 0);
+
+    // The unmatched sites of the chunks of cur_aln (not the start chunk) at each depth.
+    std::vector<size_t> aln_unmatched(1, 0);
+    Alignment cur_aln;
+    bool have_best = false;
+    size_t best_unmatched = 0;
+
+    while(!stack.empty()) {
+
+      Node& cur = stack.back();
+
+      if(cur.bound_iter_next_ == bound_end) {
+        // An alignment is only reached if it has fewer unmatched sites than the best.
+        best = cur_aln;
+        best_unmatched = aln_unmatched.back();
+        have_best = true;
+        if(best_unmatched == 0) break;
+        stack.pop_back();
+        cur_aln.pop_back();
+        aln_unmatched.pop_back();
+        continue;
+      }
+
+      const int lb = cur.bound_iter_next_->first;
+      const int ub = cur.bound_iter_next_->second;
+
+      bool pushed = false;
+      // The node can not be extended once it has the maximum unmatched sites.
+      if (cur.num_unmatched_ >= max_unmatched) cur.chunk_next_ = cur.chunk_next_end_;
+      while(cur.chunk_next_ != cur.chunk_next_end_) {
+        // Only look up the chunks with a size within the bound.
+        const uint64_t i = cur.chunk_next_++;
+        if (start_sizes_[i] < lb || start_sizes_[i] > ub) continue;
+        const MapChunk* cur_chunk = cur.chunk_;
+        const MapChunk* next_chunk = &map_chunks_[start_chunks_[i]];
+        if (next_chunk->end_ >= p_map->frags_.size()) continue; // Don't extend off of the map.
+        const size_t next_unmatched = aln_unmatched.back() + next_chunk->num_unmatched();
+        if (have_best && next_unmatched >= best_unmatched) continue;
+
+        stack.emplace_back(next_chunk,
+            start_offsets_[pos + next_chunk->end_],
+            start_offsets_[pos + next_chunk->end_ + 1],
+            cur.bound_iter_next_ + 1,
+            cur.num_unmatched_ + cur_chunk->num_unmatched());
+        cur_aln.push_back(next_chunk);
+        aln_unmatched.push_back(next_unmatched);
+        pushed = true;
+        break;
+      }
+
+      // If we did not find a successor, pop this node.
+      if (!pushed) {
+        stack.pop_back();
+        if(!cur_aln.empty()) { cur_aln.pop_back(); }
+        aln_unmatched.pop_back();
+      }
+
+    }
+
+    return have_best;
+
+  }
+
+  ////////////////////////////////////////////////////////////////////////////////
+  // The search of get_compatible_left_dfs, bounded as in get_best_right_dfs.
+  template <typename BoundIter >
+  bool MapChunkDB::get_best_left_dfs(
+    const MapChunk * p_start_chunk,
+    BoundIter bound_start,
+    BoundIter bound_end,
+    size_t max_unmatched,
+    Alignment& best) const {
+
+    best.clear();
+
+    if(bound_start >= bound_end) {
+      return false;
+    }
+
+    const uint64_t pos = chunk_position(p_start_chunk);
+
+    if(p_start_chunk->start_ == 0) {
+      // Can't extend off the left end of the map.
+      return false;
+    }
+
+    typedef SearchNode<BoundIter> Node;
+    std::vector<Node> stack;
+    stack.reserve(bound_end - bound_start + 1);
+
+    stack.emplace_back(p_start_chunk,
+        end_offsets_[pos + p_start_chunk->start_],
+        end_offsets_[pos + p_start_chunk->start_ + 1],
+        bound_start, 0);
+
+    std::vector<size_t> aln_unmatched(1, 0);
+    Alignment cur_aln;
+    bool have_best = false;
+    size_t best_unmatched = 0;
+
+    while(!stack.empty()) {
+
+      Node& cur = stack.back();
+
+      if(cur.bound_iter_next_ == bound_end) {
+        best = cur_aln;
+        best_unmatched = aln_unmatched.back();
+        have_best = true;
+        if(best_unmatched == 0) break;
+        stack.pop_back();
+        cur_aln.pop_back();
+        aln_unmatched.pop_back();
+        continue;
+      }
+
+      const int lb = cur.bound_iter_next_->first;
+      const int ub = cur.bound_iter_next_->second;
+
+      bool pushed = false;
+      // The node can not be extended once it has the maximum unmatched sites.
+      if (cur.num_unmatched_ >= max_unmatched) cur.chunk_next_ = cur.chunk_next_end_;
+      while(cur.chunk_next_ != cur.chunk_next_end_) {
+        // Only look up the chunks with a size within the bound.
+        const uint64_t i = cur.chunk_next_++;
+        if (end_sizes_[i] < lb || end_sizes_[i] > ub) continue;
+        const MapChunk* cur_chunk = cur.chunk_;
+        const MapChunk* next_chunk = &map_chunks_[end_chunks_[i]];
+        if (next_chunk->start_ == 0 ) continue; // Don't extend off of the reference map.
+        const size_t next_unmatched = aln_unmatched.back() + next_chunk->num_unmatched();
+        if (have_best && next_unmatched >= best_unmatched) continue;
+
+        stack.emplace_back(next_chunk,
+            end_offsets_[pos + next_chunk->start_],
+            end_offsets_[pos + next_chunk->start_ + 1],
+            cur.bound_iter_next_ + 1,
+            cur.num_unmatched_ + cur_chunk->num_unmatched());
+        cur_aln.push_back(next_chunk);
+        aln_unmatched.push_back(next_unmatched);
+        pushed = true;
+        break;
+      }
+
+      if (!pushed) {
+        stack.pop_back();
+        if(!cur_aln.empty()) { cur_aln.pop_back(); }
+        aln_unmatched.pop_back();
+      }
+
+    }
+
+    return have_best;
+
+  }
+
   std::ostream& operator<<(std::ostream& os, const Alignment& );
 
 }
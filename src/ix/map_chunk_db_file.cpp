@@ -0,0 +1,273 @@
+#include <cstring>
+#include <fstream>
+#include <sstream>
+#include <unordered_map>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "map_chunk_db_file.h"
+
+using namespace std;
+
+namespace kmer_match {
+
+  namespace {
+
+    const size_t ALIGNMENT = 8;
+
+    uint64_t aligned(uint64_t offset) {
+      return (offset + ALIGNMENT - 1) / ALIGNMENT * ALIGNMENT;
+    }
+
+    // Append the values to the file at the next aligned offset, and return the offset.
+    template<typename T>
+    uint64_t write_values(ofstream& f, const vector<T>& values) {
+      const uint64_t pos = f.tellp();
+      const uint64_t offset = aligned(pos);
+      const char zeros[ALIGNMENT] = {0};
+      f.write(zeros, offset - pos);
+      f.write(reinterpret_cast<const char*>(values.data()), values.size() * sizeof(T));
+      return offset;
+    }
+
+    // FNV-1a hash of the fragments of a map.
+    uint64_t hash_frags(const FragVec& frags) {
+      uint64_t h = 14695981039346656037ULL;
+      for(auto frag : frags) {
+        const uint32_t v = frag;
+        for(int b = 0; b < 4; b++) {
+          h ^= (v >> (8*b)) & 0xff;
+          h *= 1099511628211ULL;
+        }
+      }
+      return h;
+    }
+
+    // A read only mapping of a chunk database file.
+    class MappedFile {
+    public:
+
+      MappedFile(const string& file_name) : data_(nullptr), size_(0) {
+
+        const int fd = open(file_name.c_str(), O_RDONLY);
+        if(fd < 0) {
+          throw MapChunkDBException("could not open " + file_name);
+        }
+
+        struct stat st;
+        if(fstat(fd, &st) != 0 || size_t(st.st_size) < sizeof(MapChunkDBHeader)) {
+          close(fd);
+          throw MapChunkDBException(file_name + " is too short");
+        }
+
+        void * data = mmap(nullptr, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+        close(fd);
+
+        if(data == MAP_FAILED) {
+          throw MapChunkDBException("could not map " + file_name);
+        }
+
+        data_ = static_cast<const char*>(data);
+        size_ = st.st_size;
+
+      }
+
+      ~MappedFile() {
+        munmap(const_cast<char*>(data_), size_);
+      }
+
+      // Return the count values of type T at offset, or throw if they are not within the file.
+      template<typename T>
+      const T * values_at(uint64_t offset, uint64_t count) const {
+        if(offset % ALIGNMENT != 0 || offset > size_ || count > (size_ - offset) / sizeof(T)) {
+          throw MapChunkDBException("file is truncated or corrupt");
+        }
+        return reinterpret_cast<const T*>(data_ + offset);
+      }
+
+    private:
+      const char * data_;
+      size_t size_;
+    };
+
+  }
+
+  void write_map_chunk_db(const string& file_name, const MapChunkDB& db, const MapWrapperPVec& maps) {
+
+    ofstream f(file_name, ios::binary);
+    if(!f) {
+      throw runtime_error("Could not open chunk database for writing: " + file_name);
+    }
+
+    unordered_map<const MapWrapper *, uint32_t> map_ids;
+    vector<MapChunkDBMapRecord> map_records(maps.size());
+    uint64_t num_positions = 0;
+
+    for(size_t i = 0; i < maps.size(); i++) {
+      const FragVec& frags = maps[i]->map_.frags_;
+      map_ids[maps[i]] = i;
+      map_records[i].num_frags = frags.size();
+      map_records[i].frags_hash = hash_frags(frags);
+      map_records[i].position_offset = num_positions;
+      num_positions += frags.size() + 1;
+    }
+
+    const MapChunk * first_chunk = db.map_chunks_.data();
+
+    vector<MapChunkRecord> chunks;
+    chunks.reserve(db.map_chunks_.size());
+    for(const MapChunk& chunk : db.map_chunks_) {
+      MapChunkRecord rec;
+      rec.map_id = map_ids.at(chunk.get_map_wrapper());
+      rec.start = chunk.start_;
+      rec.end = chunk.end_;
+      rec.size = chunk.size_;
+      chunks.push_back(rec);
+    }
+
+    vector<uint32_t> size_index;
+    size_index.reserve(db.map_chunk_index_.size());
+    for(const MapChunk * p_chunk : db.map_chunk_index_) {
+      size_index.push_back(p_chunk - first_chunk);
+    }
+
+    MapChunkDBHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, MAP_CHUNK_DB_MAGIC, sizeof(header.magic));
+    header.version = MAP_CHUNK_DB_VERSION;
+    header.byte_order = MAP_CHUNK_DB_BYTE_ORDER;
+    header.frags_per_chunk = db.frags_per_chunk_;
+    header.num_maps = maps.size();
+    header.num_chunks = chunks.size();
+    header.num_positions = num_positions;
+
+    // Write the header again once the offsets are known.
+    f.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    header.maps_offset = write_values(f, map_records);
+    header.chunks_offset = write_values(f, chunks);
+    header.start_offsets_offset = write_values(f, db.start_offsets_);
+    header.start_chunks_offset = write_values(f, db.start_chunks_);
+    header.end_offsets_offset = write_values(f, db.end_offsets_);
+    header.end_chunks_offset = write_values(f, db.end_chunks_);
+    header.size_index_offset = write_values(f, size_index);
+    f.seekp(0);
+    f.write(reinterpret_cast<const char*>(&header), sizeof(header));
+
+    if(!f) {
+      throw runtime_error("Error writing chunk database: " + file_name);
+    }
+
+  }
+
+  MapChunkDB read_map_chunk_db(const string& file_name, const MapWrapperPVec& maps, size_t frags_per_chunk) {
+
+    const MappedFile file(file_name);
+    const MapChunkDBHeader& header = *file.values_at<MapChunkDBHeader>(0, 1);
+
+    if(memcmp(header.magic, MAP_CHUNK_DB_MAGIC, sizeof(MAP_CHUNK_DB_MAGIC)) != 0) {
+      throw MapChunkDBException(file_name + " is not a chunk database");
+    }
+
+    if(header.version != MAP_CHUNK_DB_VERSION || header.byte_order != MAP_CHUNK_DB_BYTE_ORDER) {
+      throw MapChunkDBException(file_name + " was written by an incompatible version or machine");
+    }
+
+    if(header.frags_per_chunk != frags_per_chunk) {
+      ostringstream msg;
+      msg << file_name << " was built with " << header.frags_per_chunk
+          << " max. consecutive unmatched sites, not " << frags_per_chunk;
+      throw MapChunkDBException(msg.str());
+    }
+
+    if(header.num_maps != maps.size()) {
+      ostringstream msg;
+      msg << file_name << " was built for " << header.num_maps << " reference maps, not " << maps.size();
+      throw MapChunkDBException(msg.str());
+    }
+
+    const MapChunkDBMapRecord * map_records = file.values_at<MapChunkDBMapRecord>(header.maps_offset, header.num_maps);
+    for(size_t i = 0; i < maps.size(); i++) {
+      const FragVec& frags = maps[i]->map_.frags_;
+      if(map_records[i].num_frags != frags.size() || map_records[i].frags_hash != hash_frags(frags) ||
+         map_records[i].position_offset + frags.size() + 1 > header.num_positions) {
+        throw MapChunkDBException(file_name + " was built for different reference maps. Reference map "
+          + maps[i]->map_.name_ + " does not match.");
+      }
+    }
+
+    const MapChunkRecord * chunks = file.values_at<MapChunkRecord>(header.chunks_offset, header.num_chunks);
+    const uint64_t * start_offsets = file.values_at<uint64_t>(header.start_offsets_offset, header.num_positions + 1);
+    const uint64_t * end_offsets = file.values_at<uint64_t>(header.end_offsets_offset, header.num_positions + 1);
+    const uint32_t * start_chunks = file.values_at<uint32_t>(header.start_chunks_offset, start_offsets[header.num_positions]);
+    const uint32_t * end_chunks = file.values_at<uint32_t>(header.end_chunks_offset, end_offsets[header.num_positions]);
+    const uint32_t * size_index = file.values_at<uint32_t>(header.size_index_offset, header.num_chunks);
+
+    // The offsets must be non decreasing, and within the chunk arrays.
+    for(size_t i = 0; i < header.num_positions; i++) {
+      if(start_offsets[i] > start_offsets[i + 1] || end_offsets[i] > end_offsets[i + 1]) {
+        throw MapChunkDBException(file_name + " is corrupt");
+      }
+    }
+
+    MapChunkDB db(frags_per_chunk);
+    const size_t num_chunks = header.num_chunks;
+
+    // The chunks. Reserve them all up front, since the indices point into map_chunks_.
+    db.map_chunks_.reserve(num_chunks);
+    for(size_t i = 0; i < num_chunks; i++) {
+      const MapChunkRecord& rec = chunks[i];
+      if(rec.map_id >= maps.size() || rec.start >= rec.end || rec.end > maps[rec.map_id]->map_.frags_.size()) {
+        throw MapChunkDBException(file_name + " is corrupt");
+      }
+      db.map_chunks_.emplace_back(maps[rec.map_id], rec.start, rec.end, rec.size);
+    }
+
+    const MapChunk * first_chunk = db.map_chunks_.data();
+
+    auto chunk_at = [&](uint32_t chunk_id) {
+      if(chunk_id >= num_chunks) {
+        throw MapChunkDBException(file_name + " is corrupt");
+      }
+      return first_chunk + chunk_id;
+    };
+
+    // The chunks starting and ending at each index of each map.
+    for(size_t m = 0; m < maps.size(); m++) {
+      db.map_positions_.push_back(map_records[m].position_offset);
+    }
+
+    db.chunk_positions_.reserve(num_chunks);
+    for(size_t i = 0; i < num_chunks; i++) {
+      db.chunk_positions_.push_back(map_records[chunks[i].map_id].position_offset);
+    }
+
+    db.start_offsets_.assign(start_offsets, start_offsets + header.num_positions + 1);
+    db.end_offsets_.assign(end_offsets, end_offsets + header.num_positions + 1);
+    db.start_chunks_.assign(start_chunks, start_chunks + start_offsets[header.num_positions]);
+    db.end_chunks_.assign(end_chunks, end_chunks + end_offsets[header.num_positions]);
+
+    for(uint32_t chunk_id : db.start_chunks_) {
+      chunk_at(chunk_id);
+    }
+
+    for(uint32_t chunk_id : db.end_chunks_) {
+      chunk_at(chunk_id);
+    }
+
+    db.index_chunk_sizes();
+
+    // The chunks sorted by size.
+    db.map_chunk_index_.resize(num_chunks);
+    for(size_t i = 0; i < num_chunks; i++) {
+      db.map_chunk_index_[i] = chunk_at(size_index[i]);
+    }
+
+    return db;
+
+  }
+
+}
@@ -0,0 +1,94 @@
+#ifndef MAP_CHUNK_DB_FILE
+#define MAP_CHUNK_DB_FILE
+
+/////////////////////////////////////////////////////////////////////////////
+// A flat, pointer free file format for a MapChunkDB, so that maligner_ix
+// can load the chunk database instead of rebuilding it.
+//
+// Chunks are referred to by their index in the file, and maps by their
+// index in the MapWrapperPVec the database was built from. All sections
+// are aligned to 8 bytes and written in native byte order:
+//
+//   MapChunkDBHeader
+//   MapChunkDBMapRecord for each map
+//   MapChunkRecord for each chunk, in the order of MapChunkDB::map_chunks_
+//   start offsets: for each map m and each fragment index i <= num_frags(m), the
+//     offset of the chunks starting at i in start chunks (CSR layout, with
+//     a final entry for the total), as MapChunkDB::start_offsets_
+//   start chunks: chunk indices, as MapChunkDB::start_chunks_
+//   end offsets, end chunks: the same for the chunks ending at each index
+//   size index: chunk indices, sorted by chunk size as MapChunkDB::map_chunk_index_
+//
+// A file records the number of fragments and a hash of the fragments of each
+// map, so that it is only loaded for the maps it was built from.
+/////////////////////////////////////////////////////////////////////////////
+
+#include <cstdint>
+#include <exception>
+#include <string>
+
+#include "map_chunk_db.h"
+
+namespace kmer_match {
+
+  class MapChunkDBException : public std::exception
+  {
+    public:
+
+      MapChunkDBException(const std::string& msg) {
+        message_ = "Error reading chunk database: " + msg;
+      };
+
+      virtual const char* what() const noexcept
+      {
+        return message_.c_str();
+      }
+
+      std::string message_;
+
+  };
+
+  struct MapChunkDBHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t byte_order; // Written as MAP_CHUNK_DB_BYTE_ORDER
+    uint64_t frags_per_chunk;
+    uint64_t num_maps;
+    uint64_t num_chunks;
+    uint64_t num_positions; // Total of num_frags + 1 over the maps.
+    uint64_t maps_offset;
+    uint64_t chunks_offset;
+    uint64_t start_offsets_offset;
+    uint64_t start_chunks_offset;
+    uint64_t end_offsets_offset;
+    uint64_t end_chunks_offset;
+    uint64_t size_index_offset;
+  };
+
+  struct MapChunkDBMapRecord {
+    uint64_t num_frags;
+    uint64_t frags_hash;
+    uint64_t position_offset; // Index of the first position of the map in the start and end offsets.
+  };
+
+  struct MapChunkRecord {
+    uint32_t map_id;
+    uint32_t start;
+    uint32_t end;
+    int32_t size;
+  };
+
+  const char MAP_CHUNK_DB_MAGIC[8] = {'M', 'A', 'L', 'I', 'G', 'N', 'C', 'X'};
+  const uint32_t MAP_CHUNK_DB_VERSION = 1;
+  const uint32_t MAP_CHUNK_DB_BYTE_ORDER = 0x01020304;
+
+  // Write the chunk database, built from maps, to a file.
+  void write_map_chunk_db(const std::string& file_name, const MapChunkDB& db, const MapWrapperPVec& maps);
+
+  // Read a chunk database written by write_map_chunk_db for the same maps and frags_per_chunk.
+  // Throws MapChunkDBException if the file can not be read or was built for other maps.
+  MapChunkDB read_map_chunk_db(const std::string& file_name, const MapWrapperPVec& maps, size_t frags_per_chunk);
+
+}
+
+#endif
@@ -58,6 +58,7 @@ namespace kmer_match {
     // Reverse the alignment
     void reverse() {
       std::reverse(chunks_.begin(), chunks_.end());
+      std::reverse(query_frags_.begin(), query_frags_.end());
       compute_summary();
     }
 
@@ -78,6 +79,11 @@ namespace kmer_match {
     void check_sane() const; // Check that the reference alignment is sane (i.e all chunks from the same map and in proper order?)
 
     ConstMapChunkPVec chunks_;
+
+    // The number of query fragments matched by each chunk, if a chunk may match
+    // several query fragments. Empty if each chunk matches one query fragment.
+    std::vector<size_t> query_frags_;
+
     int start_;
     int end_;
     int num_misses_;
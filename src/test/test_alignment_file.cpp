@@ -0,0 +1,101 @@
+// Check that an alignments text file converted to the binary alignment format
+// converts back to the same text, and compare the time to read each format.
+//
+// Usage: test_alignment_file ALIGNMENTS_FILE BINARY_FILE
+//
+// BINARY_FILE is overwritten.
+
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <cstdlib>
+
+#include "alignment.h"
+#include "alignment_file.h"
+#include "text_buffer.h"
+#include "timer.h"
+
+using namespace maligner_dp;
+using lmm_utils::TextBuffer;
+using lmm_utils::Timer;
+
+int main(int argc, char* argv[]) {
+
+  if(argc != 3) {
+    std::cerr << "Usage: " << argv[0] << " ALIGNMENTS_FILE BINARY_FILE\n";
+    return EXIT_FAILURE;
+  }
+
+  const std::string text_file(argv[1]);
+  const std::string binary_file(argv[2]);
+
+  std::ifstream is(text_file);
+  std::ostringstream text;
+  text << is.rdbuf();
+
+  int num_mismatches = 0;
+  Timer timer;
+
+  // Text to binary
+  timer.start();
+  {
+    std::istringstream lines(text.str());
+    std::string line, query_map, ref_map;
+    AlignmentRecord rec;
+    std::vector<AlignmentChunkRecord> chunks;
+    AlignmentFileWriter writer(binary_file);
+
+    std::getline(lines, line); // header
+    while(std::getline(lines, line)) {
+      if(!parse_alignment_text(line, rec, query_map, ref_map, chunks)) {
+        std::cout << "MISMATCH: could not parse " << line << "\n";
+        num_mismatches++;
+        continue;
+      }
+      writer.write(rec, query_map, ref_map, chunks.data());
+    }
+
+    writer.close();
+  }
+  timer.end();
+  const double parse_seconds = timer.elapsed_seconds();
+
+  if(!is_alignment_file(binary_file)) {
+    std::cout << "MISMATCH: not detected as a binary alignment file\n";
+    return EXIT_FAILURE;
+  }
+
+  // Binary to text
+  timer.start();
+  TextBuffer buf;
+  AlignmentFile aln_file(binary_file);
+  double sum_scores = 0.0;
+  for(size_t i = 0; i < aln_file.num_alignments(); i++) {
+    sum_scores += aln_file.record(i).total_rescaled_score;
+  }
+  timer.end();
+  const double read_seconds = timer.elapsed_seconds();
+
+  std::ostringstream header;
+  header << AlignmentHeader();
+  buf << header.str();
+  for(size_t i = 0; i < aln_file.num_alignments(); i++) {
+    aln_file.print_alignment(buf, i);
+  }
+
+  if(buf.str() != text.str()) {
+    std::cout << "MISMATCH: converted text differs\n";
+    num_mismatches++;
+  }
+
+  std::cout << "alignments: " << aln_file.num_alignments() << "\n"
+            << "sum of total_rescaled_score: " << sum_scores << "\n"
+            << "parse and write binary: " << parse_seconds << " s\n"
+            << "read binary scores: " << read_seconds << " s\n"
+            << "mismatches: " << num_mismatches << "\n";
+
+  return num_mismatches == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+
+}
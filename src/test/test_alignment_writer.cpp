@@ -0,0 +1,213 @@
+// Check that alignment records written to a TextBuffer are byte identical to
+// the records written with print_alignment to an ostream, and compare the
+// number of records per second written by each.
+//
+// Usage: test_alignment_writer [NUM_RECORDS]
+
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <random>
+#include <limits>
+#include <cstdlib>
+#include <cstring>
+#include <cmath>
+
+#include "alignment.h"
+#include "map_data.h"
+#include "text_buffer.h"
+#include "timer.h"
+
+using namespace maligner_dp;
+using maligner_maps::MapData;
+using lmm_utils::TextBuffer;
+using lmm_utils::Timer;
+
+std::string ostream_string(double v) {
+  std::ostringstream os;
+  os << v;
+  return os.str();
+}
+
+std::string buffer_string(double v) {
+  TextBuffer buf;
+  buf << v;
+  return buf.release();
+}
+
+int check_double(double v) {
+  const std::string expected = ostream_string(v);
+  const std::string actual = buffer_string(v);
+  if(expected != actual) {
+    std::cout << "MISMATCH: " << expected << " formatted as " << actual << "\n";
+    return 1;
+  }
+  return 0;
+}
+
+int check_doubles(std::mt19937_64& gen) {
+
+  int num_mismatches = 0;
+
+  const double special[] = {
+    0.0, -0.0, 1.0, -1.0, 0.5, 1.5, 2.5, 0.1, 0.2, 0.3, 1e-5, 1e-4, 1e-3, 0.0001234565,
+    123456.0, 1234565.0, 1234575.0, 999999.5, 9999995.0, 100000.0, 999999.0, 1000000.0,
+    1e15, 1e-15, 1e300, 1e-300, 5e-324, 1.7976931348623157e308, 12345678901234567890.0,
+    std::numeric_limits<double>::infinity(), -std::numeric_limits<double>::infinity(),
+    std::numeric_limits<double>::quiet_NaN()
+  };
+
+  for(double v : special) {
+    num_mismatches += check_double(v);
+    num_mismatches += check_double(-v);
+  }
+
+  // Values of each magnitude, and values with few significant digits.
+  std::uniform_real_distribution<double> mantissa(1.0, 10.0);
+  std::uniform_int_distribution<int> exponent(-20, 20);
+  std::uniform_int_distribution<int> digits(0, 9999999);
+  for(int i = 0; i < 1000000; i++) {
+    const double p = std::pow(10.0, exponent(gen));
+    num_mismatches += check_double(mantissa(gen) * p);
+    num_mismatches += check_double(-digits(gen) * p);
+    num_mismatches += check_double(digits(gen) / 8.0);
+  }
+
+  // Random bit patterns.
+  for(int i = 0; i < 1000000; i++) {
+    const uint64_t bits = gen();
+    double v;
+    memcpy(&v, &bits, sizeof(v));
+    num_mismatches += check_double(v);
+  }
+
+  return num_mismatches;
+
+}
+
+int check_ints() {
+
+  int num_mismatches = 0;
+
+  const long long values[] = {
+    0, 1, -1, 9, 10, -10, 99, 100, 2147483647LL, -2147483647LL - 1,
+    std::numeric_limits<long long>::max(), std::numeric_limits<long long>::min()
+  };
+
+  for(long long v : values) {
+    std::ostringstream os;
+    TextBuffer buf;
+    os << v << " " << int(v) << " " << (unsigned long long)(v) << " " << size_t(v);
+    buf << v << " " << int(v) << " " << (unsigned long long)(v) << " " << size_t(v);
+    if(os.str() != buf.str()) {
+      std::cout << "MISMATCH: " << os.str() << " formatted as " << buf.str() << "\n";
+      num_mismatches++;
+    }
+  }
+
+  return num_mismatches;
+
+}
+
+// An alignment with random values, which only needs to be printable.
+Alignment random_alignment(std::mt19937_64& gen, const MapData& query_md, const MapData& ref_md) {
+
+  std::uniform_int_distribution<int> num_chunks_dist(1, 40);
+  std::uniform_int_distribution<int> index_dist(0, 200);
+  std::uniform_int_distribution<int> size_dist(0, 200000);
+  std::exponential_distribution<double> score_dist(0.1);
+  std::uniform_real_distribution<double> unit_dist(0.0, 1.0);
+
+  Alignment aln;
+  aln.query_map_data = &query_md;
+  aln.ref_map_data = &ref_md;
+  aln.is_forward = gen() % 2;
+
+  const int num_chunks = num_chunks_dist(gen);
+  for(int i = 0; i < num_chunks; i++) {
+    MatchedChunk mc(Chunk(index_dist(gen), index_dist(gen), size_dist(gen), false),
+                    Chunk(index_dist(gen), index_dist(gen), size_dist(gen), false),
+                    Score(score_dist(gen), score_dist(gen), score_dist(gen)));
+    aln.matched_chunks.push_back(mc);
+  }
+
+  aln.query_start = index_dist(gen);
+  aln.query_end = index_dist(gen);
+  aln.ref_start = index_dist(gen);
+  aln.ref_end = index_dist(gen);
+  aln.query_start_bp = size_dist(gen);
+  aln.query_end_bp = size_dist(gen);
+  aln.ref_start_bp = size_dist(gen);
+  aln.ref_end_bp = size_dist(gen);
+  aln.query_misses = index_dist(gen);
+  aln.ref_misses = index_dist(gen);
+  aln.query_miss_rate = unit_dist(gen);
+  aln.ref_miss_rate = unit_dist(gen);
+  aln.total_score = score_dist(gen);
+  aln.total_rescaled_score = score_dist(gen);
+  aln.m_score = -score_dist(gen);
+  aln.p_val = unit_dist(gen) * unit_dist(gen) * 1e-3;
+  aln.num_trials = index_dist(gen);
+  aln.score.sizing_score = score_dist(gen);
+  aln.rescaled_score.sizing_score = score_dist(gen);
+  aln.query_scaling_factor = 0.95 + 0.1 * unit_dist(gen);
+  aln.num_interior_chunks = index_dist(gen);
+  aln.score_per_inner_chunk = score_dist(gen);
+
+  return aln;
+
+}
+
+int main(int argc, char* argv[]) {
+
+  const size_t num_records = argc > 1 ? std::atol(argv[1]) : 200000;
+
+  std::mt19937_64 gen(1);
+
+  int num_mismatches = 0;
+  num_mismatches += check_ints();
+  num_mismatches += check_doubles(gen);
+
+  const MapData query_md("query_map", 100, 1000000, false, true);
+  const MapData ref_md("ref_map", 10000, 100000000, false, true);
+
+  AlignmentVec alns;
+  alns.reserve(num_records);
+  for(size_t i = 0; i < num_records; i++) {
+    alns.push_back(random_alignment(gen, query_md, ref_md));
+  }
+
+  Timer timer;
+
+  timer.start();
+  std::ostringstream os;
+  for(const auto& aln : alns) {
+    print_alignment(os, aln);
+  }
+  const std::string ostream_output = os.str();
+  timer.end();
+  const double ostream_seconds = timer.elapsed_seconds();
+
+  timer.start();
+  TextBuffer buf;
+  for(const auto& aln : alns) {
+    print_alignment(buf, aln);
+  }
+  const std::string buffer_output = buf.release();
+  timer.end();
+  const double buffer_seconds = timer.elapsed_seconds();
+
+  if(ostream_output != buffer_output) {
+    std::cout << "MISMATCH: alignment records differ\n";
+    num_mismatches++;
+  }
+
+  std::cout << "records: " << num_records << "\n"
+            << "ostream: " << num_records / ostream_seconds << " records/s\n"
+            << "TextBuffer: " << num_records / buffer_seconds << " records/s\n"
+            << "mismatches: " << num_mismatches << "\n";
+
+  return num_mismatches == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+
+}
@@ -0,0 +1,154 @@
+// Check that items pass through an SPSCQueue between threads in order, that
+// AsyncMapReader reads the same maps as MapReader, and that AsyncWriter writes
+// the same bytes as writing directly, and compare the time taken by each.
+//
+// Usage: test_async_io MAPS_FILE [NUM_ITEMS]
+
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+#include <cstdlib>
+
+#include "map.h"
+#include "map_reader.h"
+#include "async_io.h"
+#include "spsc_queue.h"
+#include "timer.h"
+
+using maligner_maps::Map;
+using maligner_maps::MapReader;
+using lmm_utils::AsyncMapReader;
+using lmm_utils::AsyncWriter;
+using lmm_utils::SPSCQueue;
+using lmm_utils::Timer;
+
+bool same_map(const Map& a, const Map& b) {
+  return a.name_ == b.name_ && a.size_ == b.size_ && a.frags_ == b.frags_;
+}
+
+int main(int argc, char* argv[]) {
+
+  if(argc < 2 || argc > 3) {
+    std::cerr << "Usage: " << argv[0] << " MAPS_FILE [NUM_ITEMS]\n";
+    return EXIT_FAILURE;
+  }
+
+  const std::string maps_file(argv[1]);
+  const size_t num_items = argc > 2 ? std::strtoul(argv[2], nullptr, 10) : 1000000;
+
+  int num_mismatches = 0;
+  Timer timer;
+
+  // Queue order, with a small queue so that both threads wait on it.
+  {
+    SPSCQueue<size_t> queue(8);
+    size_t num_out_of_order = 0;
+
+    std::thread consumer([&]() {
+      size_t expected = 0;
+      size_t item;
+      while(queue.pop(item)) {
+        if(item != expected) num_out_of_order++;
+        expected = item + 1;
+      }
+      if(expected != num_items) num_out_of_order++;
+    });
+
+    timer.start();
+    for(size_t i = 0; i < num_items; i++) {
+      size_t item = i;
+      queue.push(item);
+    }
+    queue.close();
+    consumer.join();
+    timer.end();
+
+    if(num_out_of_order) {
+      std::cout << "MISMATCH: " << num_out_of_order << " items out of order\n";
+      num_mismatches++;
+    }
+    std::cout << "queue items: " << num_items << " in " << timer.elapsed_seconds() << " s\n";
+  }
+
+  // Map readers.
+  {
+    std::vector<Map> maps;
+    Map map;
+
+    timer.start();
+    MapReader reader(maps_file);
+    while(reader.next(map)) {
+      maps.push_back(map);
+    }
+    timer.end();
+    const double read_seconds = timer.elapsed_seconds();
+
+    timer.start();
+    size_t num_maps = 0;
+    {
+      AsyncMapReader async_reader(maps_file);
+      while(async_reader.next(map)) {
+        if(num_maps >= maps.size() || !same_map(map, maps[num_maps])) {
+          std::cout << "MISMATCH: map " << num_maps << " differs\n";
+          num_mismatches++;
+          break;
+        }
+        num_maps++;
+      }
+    }
+    timer.end();
+
+    if(num_maps != maps.size()) {
+      std::cout << "MISMATCH: read " << num_maps << " of " << maps.size() << " maps\n";
+      num_mismatches++;
+    }
+
+    // Stop a reader before the end of the file.
+    {
+      AsyncMapReader async_reader(maps_file, 0, 1, 0, 2);
+      async_reader.next(map);
+    }
+
+    std::cout << "maps: " << maps.size() << "\n"
+              << "MapReader: " << read_seconds << " s\n"
+              << "AsyncMapReader: " << timer.elapsed_seconds() << " s\n";
+  }
+
+  // Writers to two streams.
+  {
+    std::ostringstream direct_a, direct_b, async_a, async_b;
+    const size_t num_blocks = num_items / 10;
+
+    for(size_t i = 0; i < num_blocks; i++) {
+      std::ostream& os = i % 3 ? direct_a : direct_b;
+      os << "block " << i << "\n";
+    }
+
+    timer.start();
+    {
+      AsyncWriter writer(4);
+      for(size_t i = 0; i < num_blocks; i++) {
+        std::ostringstream block;
+        block << "block " << i << "\n";
+        writer.write(i % 3 ? async_a : async_b, block.str());
+        writer.write(async_a, std::string());
+      }
+      writer.close();
+    }
+    timer.end();
+
+    if(direct_a.str() != async_a.str() || direct_b.str() != async_b.str()) {
+      std::cout << "MISMATCH: AsyncWriter output differs\n";
+      num_mismatches++;
+    }
+
+    std::cout << "AsyncWriter blocks: " << num_blocks << " in " << timer.elapsed_seconds() << " s\n";
+  }
+
+  std::cout << "mismatches: " << num_mismatches << "\n";
+
+  return num_mismatches == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+
+}
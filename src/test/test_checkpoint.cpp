@@ -0,0 +1,222 @@
+// Check that MapReader resumes from a position from tell, and that a
+// Checkpointer truncates the outputs to their sizes at the checkpoint and
+// rejects a checkpoint of a different run.
+//
+// Usage: test_checkpoint MAPS_FILE TMP_PREFIX
+//
+// Files starting with TMP_PREFIX are overwritten.
+
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <cstdlib>
+
+#include "map.h"
+#include "map_reader.h"
+#include "checkpoint.h"
+#include "async_io.h"
+
+using maligner_maps::Map;
+using maligner_maps::MapReader;
+using lmm_utils::Checkpointer;
+using lmm_utils::CheckpointException;
+using lmm_utils::AsyncMapReader;
+
+bool same_map(const Map& a, const Map& b) {
+  return a.name_ == b.name_ && a.size_ == b.size_ && a.frags_ == b.frags_;
+}
+
+std::string read_file(const std::string& file_name) {
+  std::ifstream is(file_name);
+  std::ostringstream os;
+  os << is.rdbuf();
+  return os.str();
+}
+
+// Check that the rest of the maps read by reader are the maps of the shard from first on.
+template <typename Reader>
+bool same_maps_from(Reader& reader, const std::vector<Map>& maps, size_t first) {
+  Map map;
+  size_t j = first;
+  for(; reader.next(map); j++) {
+    if(j >= maps.size() || !same_map(map, maps[j])) {
+      return false;
+    }
+  }
+  return j == maps.size();
+}
+
+// Seek to the position after each map of a shard, and check the rest of the maps.
+// A seek to position 0, as on a fresh run, starts at the start of the shard.
+int check_seek(const std::string& maps_file, size_t shard_index, size_t num_shards) {
+
+  std::vector<Map> maps;
+  std::vector<uint64_t> positions;
+  {
+    MapReader reader(maps_file, shard_index, num_shards);
+    Map map;
+    while(reader.next(map)) {
+      maps.push_back(map);
+      positions.push_back(reader.tell());
+    }
+  }
+
+  int num_mismatches = 0;
+
+  {
+    MapReader reader(maps_file, shard_index, num_shards);
+    reader.seek(0);
+    if(!same_maps_from(reader, maps, 0)) {
+      std::cout << "MISMATCH: shard " << shard_index << "/" << num_shards << " differs after seek(0)\n";
+      num_mismatches++;
+    }
+  }
+
+  {
+    AsyncMapReader reader(maps_file, shard_index, num_shards, 0);
+    if(!same_maps_from(reader, maps, 0)) {
+      std::cout << "MISMATCH: shard " << shard_index << "/" << num_shards << " differs in AsyncMapReader\n";
+      num_mismatches++;
+    }
+  }
+
+  if(!positions.empty()) {
+    AsyncMapReader reader(maps_file, shard_index, num_shards, positions[0]);
+    if(!same_maps_from(reader, maps, 1)) {
+      std::cout << "MISMATCH: shard " << shard_index << "/" << num_shards
+                << " differs in AsyncMapReader resumed after map 0\n";
+      num_mismatches++;
+    }
+  }
+
+  for(size_t i = 0; i < positions.size(); i++) {
+
+    MapReader reader(maps_file, shard_index, num_shards);
+    reader.seek(positions[i]);
+
+    Map map;
+    size_t j = i + 1;
+    for(; reader.next(map); j++) {
+      if(j >= maps.size() || !same_map(map, maps[j])) {
+        break;
+      }
+    }
+
+    if(j != maps.size()) {
+      std::cout << "MISMATCH: shard " << shard_index << "/" << num_shards
+                << " resumed after map " << i << " differs at map " << j << "\n";
+      num_mismatches++;
+    }
+
+  }
+
+  std::cout << "shard " << shard_index << "/" << num_shards << ": " << maps.size() << " maps\n";
+
+  return num_mismatches;
+
+}
+
+int main(int argc, char* argv[]) {
+
+  if(argc != 3) {
+    std::cerr << "Usage: " << argv[0] << " MAPS_FILE TMP_PREFIX\n";
+    return EXIT_FAILURE;
+  }
+
+  const std::string maps_file(argv[1]);
+  const std::string prefix(argv[2]);
+  const std::string checkpoint_file = prefix + ".checkpoint";
+  const std::string output_a = prefix + ".a.txt";
+  const std::string output_b = prefix + ".b.txt";
+
+  int num_mismatches = 0;
+
+  num_mismatches += check_seek(maps_file, 0, 1);
+  num_mismatches += check_seek(maps_file, 1, 3);
+  num_mismatches += check_seek(maps_file, 2, 3);
+
+  // Write the outputs, checkpoint, and then write partial records after the checkpoint.
+  {
+    std::ofstream a(output_a), b(output_b);
+    a << "header\nrecord 1\n";
+    b << "score 1\n";
+    a.flush();
+    b.flush();
+
+    Checkpointer checkpointer(checkpoint_file, 0.0);
+    checkpointer.add_output(output_a);
+    checkpointer.add_output(output_b);
+    checkpointer.set_value("query_maps_file", maps_file);
+    checkpointer.write(1234, 1);
+
+    a << "record 2\nrec";
+    b << "sco";
+  }
+
+  // Resume.
+  {
+    Checkpointer checkpointer(checkpoint_file, 0.0);
+    checkpointer.add_output(output_a);
+    checkpointer.add_output(output_b);
+    checkpointer.set_value("query_maps_file", maps_file);
+    checkpointer.resume();
+
+    if(checkpointer.input_position() != 1234 || checkpointer.num_queries() != 1) {
+      std::cout << "MISMATCH: resumed at " << checkpointer.input_position() << " after "
+                << checkpointer.num_queries() << " queries\n";
+      num_mismatches++;
+    }
+
+    if(read_file(output_a) != "header\nrecord 1\n" || read_file(output_b) != "score 1\n") {
+      std::cout << "MISMATCH: outputs not truncated to the checkpoint\n";
+      num_mismatches++;
+    }
+  }
+
+  // A checkpoint of a different run is rejected.
+  {
+    Checkpointer checkpointer(checkpoint_file, 0.0);
+    checkpointer.add_output(output_a);
+    checkpointer.set_value("query_maps_file", maps_file + ".other");
+
+    bool threw = false;
+    try {
+      checkpointer.resume();
+    } catch(CheckpointException& e) {
+      threw = true;
+    }
+
+    if(!threw) {
+      std::cout << "MISMATCH: resumed a checkpoint of a different run\n";
+      num_mismatches++;
+    }
+  }
+
+  // An output shorter than at the checkpoint is rejected.
+  {
+    std::ofstream(output_b).close();
+
+    Checkpointer checkpointer(checkpoint_file, 0.0);
+    checkpointer.add_output(output_a);
+    checkpointer.add_output(output_b);
+
+    bool threw = false;
+    try {
+      checkpointer.resume();
+    } catch(CheckpointException& e) {
+      threw = true;
+    }
+
+    if(!threw) {
+      std::cout << "MISMATCH: resumed with an output shorter than the checkpoint\n";
+      num_mismatches++;
+    }
+  }
+
+  std::cout << "mismatches: " << num_mismatches << "\n";
+
+  return num_mismatches == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+
+}
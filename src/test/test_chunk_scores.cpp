@@ -0,0 +1,227 @@
+// Check that the SIMD chunk score kernels give exactly the same results as the scalar kernel:
+//  1. On random rows, cell by cell.
+//  2. On alignments of queries to references, using each kernel for the fill.
+//
+// Usage: test_chunk_scores QUERY_MAPS_FILE REFERENCE_MAPS_FILE [QUERY_MAX_MISSES REF_MAX_MISSES]
+
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <random>
+#include <cstdlib>
+#include <cstring>
+
+#include "map.h"
+#include "map_reader.h"
+
+// dp includes
+#include "map_data.h"
+#include "alignment.h"
+#include "align.h"
+#include "ScoreMatrix.h"
+#include "chunk_scores.h"
+
+// common includes
+#include "timer.h"
+
+using namespace maligner_dp;
+using namespace maligner_maps;
+using lmm_utils::Timer;
+
+bool same_double(double a, double b) {
+  return std::memcmp(&a, &b, sizeof(double)) == 0;
+}
+
+bool same_extensions(const RowExtensions& a, const RowExtensions& b) {
+  for (size_t j = 0; j < a.k.size(); j++) {
+    if (a.k[j] != b.k[j] || a.l[j] != b.l[j] || !same_double(a.score[j], b.score[j]) ||
+        a.ref_miss_total[j] != b.ref_miss_total[j] || a.query_miss_total[j] != b.query_miss_total[j]) {
+      return false;
+    }
+  }
+  return true;
+}
+
+// Compare the kernel for level against the scalar kernel on random rows.
+int check_random_rows(SimdLevel level, int num_trials) {
+
+  const RowExtensionFunction scalar = get_row_extension_function(SIMD_SCALAR);
+  const RowExtensionFunction simd = get_row_extension_function(level);
+
+  std::mt19937 gen(1234);
+  std::uniform_int_distribution<int> frag_size(0, 20000);
+  std::uniform_int_distribution<int> coin(0, 3);
+  std::uniform_int_distribution<int> num_misses(0, 4);
+
+  int num_mismatches = 0;
+
+  for (int trial = 0; trial < num_trials; trial++) {
+
+    const int ref_max_misses = trial % 70; // Cover several 64 lane windows
+    const int n = 1 + ref_max_misses + trial % 13;
+
+    IntVec ref(n - 1);
+    for (auto& f : ref) f = frag_size(gen);
+    const PartialSums ref_partial_sums(ref, ref_max_misses);
+    const SDInv ref_sd_inv(ref_partial_sums, 0.05, 750.0);
+
+    DoubleVec ref_miss_penalties(ref_max_misses + 1);
+    for (int r = 0; r <= ref_max_misses; r++) ref_miss_penalties[r] = 3.0 * r;
+
+    RowExtensionInputs in;
+    in.ref_partial_sums = &ref_partial_sums;
+    in.ref_sd_inv = &ref_sd_inv;
+    in.ref_miss_penalties = &ref_miss_penalties[0];
+    in.n = n;
+    in.ref_max_misses = ref_max_misses;
+    in.ref_is_bounded = coin(gen) != 0;
+    in.query_max_total_misses = 6;
+    in.ref_max_total_misses = 8 + ref_max_misses / 2;
+    in.max_chunk_sizing_error = coin(gen) == 0 ? INF : 16.0;
+
+    RowExtensions scalar_best, simd_best;
+    scalar_best.reset(n, ref_max_misses);
+    simd_best.reset(n, ref_max_misses);
+
+    // Extend from several target rows, as the fill does.
+    for (int k = 3; k >= 0; k--) {
+
+      DoubleVec target_scores(n);
+      IntVec target_qm(n), target_rm(n);
+      for (int l = 0; l < n; l++) {
+        target_scores[l] = coin(gen) == 0 ? -INF : -0.37 * frag_size(gen) * (coin(gen) == 0 ? 0.0 : 1.0);
+        target_qm[l] = num_misses(gen);
+        target_rm[l] = num_misses(gen);
+      }
+
+      in.k = k;
+      in.target_scores = &target_scores[0];
+      in.target_query_misses = &target_qm[0];
+      in.target_ref_misses = &target_rm[0];
+      in.query_miss = 3 - k;
+      in.query_size = frag_size(gen) * (1 + coin(gen));
+      in.query_miss_penalty = 18.0 * in.query_miss;
+      in.is_query_boundary = coin(gen) == 0;
+
+      scalar(in, scalar_best);
+      simd(in, simd_best);
+
+    }
+
+    if (!same_extensions(scalar_best, simd_best)) {
+      std::cout << "MISMATCH: " << simd_level_name(level) << " random trial " << trial << "\n";
+      num_mismatches++;
+    }
+
+  }
+
+  return num_mismatches;
+
+}
+
+std::string alignments_to_string(const AlignmentVec& alns) {
+  std::ostringstream oss;
+  for(const auto& aln : alns) {
+    print_alignment(oss, aln);
+  }
+  return oss.str();
+}
+
+// Align all queries to all references, and return the alignments as a string.
+std::string align_all(const MapVec& query_maps, const std::vector<RefMapWrapper>& ref_map_wrappers,
+  const AlignOpts& align_opts, CompactScoreMatrix& sm) {
+
+  std::ostringstream oss;
+
+  for(const auto& query_map : query_maps) {
+
+    const QueryMapWrapper qmw(query_map, align_opts.query_max_misses);
+
+    for(const auto& rmw : ref_map_wrappers) {
+      for(int i = 0; i < 2; i++) {
+
+        const bool query_is_forward = (i == 0);
+        AlignmentVec alns;
+
+        AlignTask<CompactScoreMatrix, Chi2SizingPenalty> task(
+          &qmw.map_data_, &rmw.map_data_,
+          query_is_forward ? &qmw.get_frags() : &qmw.get_frags_reverse(),
+          &rmw.get_frags(),
+          query_is_forward ? &qmw.get_partial_sums_forward() : &qmw.get_partial_sums_reverse(),
+          &rmw.get_partial_sums(),
+          &rmw.sd_inv_,
+          &qmw.ix_to_locs_,
+          &rmw.ix_to_locs_,
+          0, // ref_offset
+          &sm, &alns,
+          query_is_forward,
+          true, // ref_is_forward
+          align_opts);
+
+        make_best_alignments_using_partials(task);
+        oss << alignments_to_string(alns);
+
+      }
+    }
+  }
+
+  return oss.str();
+
+}
+
+int main(int argc, char* argv[]) {
+
+  if(argc != 3 && argc != 5) {
+    std::cerr << "Usage: " << argv[0] << " QUERY_MAPS_FILE REFERENCE_MAPS_FILE [QUERY_MAX_MISSES REF_MAX_MISSES]\n";
+    return EXIT_FAILURE;
+  }
+
+  std::string query_maps_file(argv[1]);
+  std::string ref_maps_file(argv[2]);
+  int query_max_misses = argc == 5 ? atoi(argv[3]) : 2;
+  int ref_max_misses = argc == 5 ? atoi(argv[4]) : 5;
+
+  AlignOpts align_opts(18.0, 3.0, query_max_misses, ref_max_misses,
+    0.05, 500.0, std::numeric_limits<double>::infinity(),
+    0.50, 0.25, 100, 10, 0, false, false, true, 0.85, 1.15);
+
+  MapVec query_maps(read_maps(query_maps_file));
+  MapVec ref_maps(read_maps(ref_maps_file));
+  std::vector<RefMapWrapper> ref_map_wrappers;
+  for(const auto& ref_map : ref_maps) {
+    ref_map_wrappers.push_back(RefMapWrapper(ref_map, false, ref_max_misses, 0.05, 500.0));
+  }
+
+  const SimdLevel best_level = detect_simd_level();
+  std::cout << "detected: " << simd_level_name(best_level) << "\n";
+
+  CompactScoreMatrix sm;
+  int num_mismatches = 0;
+
+  set_simd_level(SIMD_SCALAR);
+  Timer timer;
+  const std::string scalar_alignments = align_all(query_maps, ref_map_wrappers, align_opts, sm);
+  std::cout << simd_level_name(SIMD_SCALAR) << " " << timer << "\n";
+
+  for (int level = SIMD_SCALAR + 1; level <= best_level; level++) {
+
+    num_mismatches += check_random_rows(SimdLevel(level), 20000);
+
+    set_simd_level(SimdLevel(level));
+    timer.reset();
+    const std::string alignments = align_all(query_maps, ref_map_wrappers, align_opts, sm);
+    std::cout << simd_level_name(SimdLevel(level)) << " " << timer << "\n";
+
+    if (alignments != scalar_alignments) {
+      std::cout << "MISMATCH: " << simd_level_name(SimdLevel(level)) << " alignments\n";
+      num_mismatches++;
+    }
+
+  }
+
+  std::cout << "mismatches: " << num_mismatches << "\n";
+
+  return num_mismatches == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+
+}
@@ -0,0 +1,171 @@
+// Check that text written to gzip and zstd compressed files reads back the same,
+// and that MapReader reads the same maps from a compressed copy of a maps file,
+// and compare the time to read the plain and compressed maps.
+//
+// Usage: test_compressed_stream MAPS_FILE TMP_PREFIX
+//
+// Files starting with TMP_PREFIX are overwritten.
+
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <memory>
+#include <iterator>
+#include <random>
+#include <cstdlib>
+
+#include "map.h"
+#include "map_reader.h"
+#include "compressed_stream.h"
+#include "timer.h"
+
+using maligner_maps::Map;
+using maligner_maps::MapReader;
+using lmm_utils::Compression;
+using lmm_utils::Timer;
+
+bool same_map(const Map& a, const Map& b) {
+  return a.name_ == b.name_ && a.size_ == b.size_ && a.frags_ == b.frags_;
+}
+
+int main(int argc, char* argv[]) {
+
+  if(argc != 3) {
+    std::cerr << "Usage: " << argv[0] << " MAPS_FILE TMP_PREFIX\n";
+    return EXIT_FAILURE;
+  }
+
+  const std::string maps_file(argv[1]);
+  const std::string prefix(argv[2]);
+
+  int num_mismatches = 0;
+  Timer timer;
+
+  // Random lines, long enough to span several compressed blocks.
+  std::string text;
+  {
+    std::mt19937 gen(42);
+    std::uniform_int_distribution<int> frag(100, 100000);
+    std::ostringstream os;
+    for(int i = 0; i < 200000; i++) {
+      os << "map_" << i;
+      for(int j = i % 17; j >= 0; j--) {
+        os << "\t" << frag(gen);
+      }
+      os << "\n";
+    }
+    text = os.str();
+  }
+
+  std::ifstream maps_is(maps_file);
+  std::ostringstream maps_text;
+  maps_text << maps_is.rdbuf();
+
+  std::vector<Map> maps;
+  {
+    Map map;
+    timer.start();
+    MapReader reader(maps_file);
+    while(reader.next(map)) {
+      maps.push_back(map);
+    }
+    timer.end();
+    std::cout << "maps: " << maps.size() << "\n"
+              << "plain: " << timer.elapsed_seconds() << " s\n";
+  }
+
+  const std::vector<std::string> extensions = {".gz", ".zst"};
+
+  for(const std::string& ext : extensions) {
+
+    const Compression compression = lmm_utils::compression_for_name(ext);
+
+    if(!lmm_utils::compression_supported(compression)) {
+      std::cout << ext << ": not supported\n";
+      continue;
+    }
+
+    // Text round trip.
+    const std::string text_file = prefix + ".txt" + ext;
+    {
+      std::unique_ptr<std::ostream> os(lmm_utils::open_output_file(text_file));
+      *os << text;
+    }
+
+    if(lmm_utils::file_compression(text_file) != compression) {
+      std::cout << "MISMATCH: " << text_file << " not detected as " << ext << "\n";
+      num_mismatches++;
+    }
+
+    {
+      std::unique_ptr<std::istream> is(lmm_utils::open_input_file(text_file));
+      std::ostringstream read;
+      read << is->rdbuf();
+      if(read.str() != text) {
+        std::cout << "MISMATCH: " << ext << " text differs\n";
+        num_mismatches++;
+      }
+    }
+
+    // Maps round trip.
+    const std::string compressed_maps_file = prefix + ".maps" + ext;
+    {
+      std::unique_ptr<std::ostream> os(lmm_utils::open_output_file(compressed_maps_file));
+      *os << maps_text.str();
+    }
+
+    Map map;
+    size_t num_maps = 0;
+    timer.start();
+    {
+      MapReader reader(compressed_maps_file);
+      while(reader.next(map)) {
+        if(num_maps >= maps.size() || !same_map(map, maps[num_maps])) {
+          std::cout << "MISMATCH: " << ext << " map " << num_maps << " differs\n";
+          num_mismatches++;
+          break;
+        }
+        num_maps++;
+      }
+    }
+    timer.end();
+
+    if(num_maps != maps.size()) {
+      std::cout << "MISMATCH: " << ext << " read " << num_maps << " of " << maps.size() << " maps\n";
+      num_mismatches++;
+    }
+
+    std::cout << ext << ": " << timer.elapsed_seconds() << " s\n";
+
+    // A truncated file is an error.
+    const std::string truncated_file = prefix + ".truncated" + ext;
+    {
+      std::ifstream is(text_file, std::ios::binary);
+      std::string data((std::istreambuf_iterator<char>(is)), std::istreambuf_iterator<char>());
+      std::ofstream os(truncated_file, std::ios::binary);
+      os.write(data.data(), data.size() / 2);
+    }
+
+    bool threw = false;
+    try {
+      std::unique_ptr<std::istream> is(lmm_utils::open_input_file(truncated_file));
+      std::string line;
+      while(std::getline(*is, line)) {}
+    } catch(lmm_utils::CompressionException& e) {
+      threw = true;
+    }
+
+    if(!threw) {
+      std::cout << "MISMATCH: " << ext << " truncated file read without error\n";
+      num_mismatches++;
+    }
+
+  }
+
+  std::cout << "mismatches: " << num_mismatches << "\n";
+
+  return num_mismatches == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+
+}
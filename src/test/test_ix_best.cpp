@@ -0,0 +1,217 @@
+// Check that the best alignments found by MapChunkDB::get_compatible_alignments_best
+// are the alignments with the fewest unmatched reference sites among all compatible
+// alignments of each seed and orientation, taking the first in search order on ties,
+// and that seeding with a seed index gives the same alignments from fewer seeds.
+//
+// Usage: test_ix_best QUERY_MAPS_FILE REFERENCE_MAPS_FILE
+
+#include <iostream>
+#include <string>
+#include <vector>
+#include <map>
+#include <utility>
+#include <cstdlib>
+
+#include "map.h"
+#include "map_reader.h"
+#include "map_wrapper_base.h"
+#include "error_model.h"
+#include "map_chunk_db.h"
+#include "ref_alignment.h"
+
+using namespace maligner_maps;
+using namespace kmer_match;
+
+typedef std::pair<const MapChunk*, bool> SeedKey;
+
+// The number of reference sites skipped by an alignment, in either orientation.
+size_t num_unmatched(const Alignment& aln) {
+  size_t n = 0;
+  for(const MapChunk* chunk : aln) {
+    n += chunk->num_unmatched();
+  }
+  return n;
+}
+
+// The bounds of the interior fragments of the query, as in maligner_ix.
+IntPairVec query_bounds(const Map& query_map, const ErrorModel& error_model) {
+  MapWrapper query(query_map, false, false);
+  const FragVec& frags = query.get_frags();
+  if(frags.size() < 3) return IntPairVec();
+  return error_model.compute_bounds(frags.begin() + 1, frags.end() - 1);
+}
+
+size_t max_unmatched(const IntPairVec& bounds, double max_unmatched_rate) {
+  return size_t((max_unmatched_rate/(1 - max_unmatched_rate)) * bounds.size());
+}
+
+// The number of seeds of the bounds, counting each orientation.
+size_t num_seeds(const MapChunkDB& chunkDB, const IntPairVec& bounds) {
+  IntPairVec::const_iterator seed_bound = bounds.begin();
+  for(auto i = bounds.begin(); i != bounds.end(); i++) {
+    if(i->second > seed_bound->second) seed_bound = i;
+  }
+  size_t n = 0;
+  for(const Seed& seed : chunkDB.get_seeds(bounds, seed_bound)) {
+    n += seed.forward_ + seed.reverse_;
+  }
+  return n;
+}
+
+int check_query(const Map& query_map, const MapChunkDB& chunkDB, const ErrorModel& error_model,
+  double max_unmatched_rate, size_t& num_alignments) {
+
+  IntPairVec bounds = query_bounds(query_map, error_model);
+  if(bounds.empty()) return 0;
+  const size_t max_unmatched = ::max_unmatched(bounds, max_unmatched_rate);
+
+  // The seed is the largest bound, which is at the same position in the alignments
+  // in either orientation.
+  int max_bound = -1;
+  size_t seed_index = 0;
+  for(size_t i = 0; i < bounds.size(); i++) {
+    if(bounds[i].second > max_bound) {
+      max_bound = bounds[i].second;
+      seed_index = i;
+    }
+  }
+
+  // Select the first alignment with the fewest misses for each seed and orientation.
+  AlignmentVector all_alns = chunkDB.get_compatible_alignments(bounds, max_unmatched);
+  std::vector<SeedKey> keys;
+  std::map<SeedKey, const Alignment*> expected;
+  for(const auto& aln : all_alns) {
+    SeedKey key(aln[seed_index], ReferenceAlignment(aln).is_forward());
+    auto iter = expected.find(key);
+    if(iter == expected.end()) {
+      keys.push_back(key);
+      expected.insert(std::make_pair(key, &aln));
+    } else if(num_unmatched(aln) < num_unmatched(*iter->second)) {
+      iter->second = &aln;
+    }
+  }
+
+  RefAlignmentVec best_alns = chunkDB.get_compatible_alignments_best(bounds, max_unmatched);
+  num_alignments += best_alns.size();
+
+  if(best_alns.size() != keys.size()) {
+    std::cout << "MISMATCH: " << query_map.name_ << " has " << best_alns.size()
+              << " best alignments, expected " << keys.size() << "\n";
+    return 1;
+  }
+
+  for(size_t i = 0; i < keys.size(); i++) {
+    const Alignment& a = best_alns[i].chunks_;
+    const Alignment& b = *expected.find(keys[i])->second;
+    if(a != b) {
+      std::cout << "MISMATCH: " << query_map.name_ << " alignment " << i << " has "
+                << num_unmatched(a) << " unmatched sites, expected " << num_unmatched(b) << "\n";
+      return 1;
+    }
+  }
+
+  return 0;
+
+}
+
+// Check that seeding with an index of runs of seed_frags chunks gives the same alignments
+// as seeding on the largest bound only.
+int check_seed_index(const MapVec& query_maps, MapChunkDB& chunkDB, const ErrorModel& error_model,
+  double max_unmatched_rate, size_t seed_frags) {
+
+  std::vector<RefAlignmentVec> expected;
+  size_t num_plain_seeds = 0;
+  chunkDB.build_seed_index(1);
+  for(const auto& query_map : query_maps) {
+    IntPairVec bounds = query_bounds(query_map, error_model);
+    if(bounds.empty()) continue;
+    expected.push_back(chunkDB.get_compatible_alignments_best(bounds, max_unmatched(bounds, max_unmatched_rate)));
+    num_plain_seeds += num_seeds(chunkDB, bounds);
+  }
+
+  int n = 0;
+  size_t num_index_seeds = 0;
+  size_t q = 0;
+  chunkDB.build_seed_index(seed_frags);
+  for(const auto& query_map : query_maps) {
+    IntPairVec bounds = query_bounds(query_map, error_model);
+    if(bounds.empty()) continue;
+    RefAlignmentVec alns = chunkDB.get_compatible_alignments_best(bounds, max_unmatched(bounds, max_unmatched_rate));
+    bool same = alns.size() == expected[q].size();
+    for(size_t i = 0; same && i < alns.size(); i++) {
+      same = alns[i].chunks_ == expected[q][i].chunks_;
+    }
+    if(!same) {
+      std::cout << "MISMATCH: " << query_map.name_ << " has different alignments with "
+                << seed_frags << " seed fragments\n";
+      n++;
+    }
+    num_index_seeds += num_seeds(chunkDB, bounds);
+    q++;
+  }
+
+  std::cout << "  seed fragments " << seed_frags << ": " << num_index_seeds << " of "
+            << num_plain_seeds << " seeds, " << n << " mismatches\n";
+
+  chunkDB.build_seed_index(1);
+
+  return n;
+
+}
+
+int main(int argc, char* argv[]) {
+
+  if(argc != 3) {
+    std::cerr << "Usage: " << argv[0] << " QUERY_MAPS_FILE REFERENCE_MAPS_FILE\n";
+    return EXIT_FAILURE;
+  }
+
+  MapVec query_maps = MapReader(argv[1]).read_all_maps();
+  MapVec ref_maps_temp = MapReader(argv[2]).read_all_maps();
+
+  const ErrorModel error_model(0.05, 1000);
+  const double max_unmatched_rate = 0.50;
+
+  int num_mismatches = 0;
+
+  for(int is_circular = 0; is_circular < 2; is_circular++) {
+
+    MapWrapperVec ref_maps;
+    for(const auto& ref_map : ref_maps_temp) {
+      ref_maps.emplace_back(ref_map, is_circular, false);
+    }
+
+    MapWrapperPVec p_ref_maps;
+    for(auto& ref_map : ref_maps) {
+      p_ref_maps.push_back(&ref_map);
+    }
+
+    for(int max_unmatched_sites = 2; max_unmatched_sites <= 3; max_unmatched_sites++) {
+
+      MapChunkDB chunkDB(p_ref_maps, max_unmatched_sites);
+
+      int n = 0;
+      size_t num_alignments = 0;
+      for(const auto& query_map : query_maps) {
+        n += check_query(query_map, chunkDB, error_model, max_unmatched_rate, num_alignments);
+      }
+
+      std::cout << (is_circular ? "circular" : "linear") << ", max unmatched sites "
+                << max_unmatched_sites << ": " << num_alignments << " alignments, "
+                << n << " mismatches\n";
+
+      num_mismatches += n;
+
+      for(size_t seed_frags = 2; seed_frags <= MAX_SEED_FRAGS; seed_frags++) {
+        num_mismatches += check_seed_index(query_maps, chunkDB, error_model, max_unmatched_rate, seed_frags);
+      }
+
+    }
+
+  }
+
+  std::cout << "mismatches: " << num_mismatches << "\n";
+
+  return num_mismatches == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+
+}
@@ -0,0 +1,126 @@
+// Check that MapChunkDB::get_compatible_alignments_best finds the alignments of queries
+// with an extra site, which is unmatched in the reference, when a reference chunk may match
+// a chunk of two query fragments. The queries are windows of the reference maps with one
+// fragment split in two, in either orientation.
+//
+// Usage: test_ix_query_misses REFERENCE_MAPS_FILE
+
+#include <iostream>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <cstdlib>
+
+#include "map.h"
+#include "map_reader.h"
+#include "map_wrapper_base.h"
+#include "error_model.h"
+#include "map_chunk_db.h"
+#include "ref_alignment.h"
+
+using namespace maligner_maps;
+using namespace kmer_match;
+
+const size_t WINDOW_FRAGS = 12;
+const size_t WINDOW_STEP = 37;
+
+// Check that the alignments include the window of the reference, from start to start + the
+// window size, with the split fragment matched by a chunk of two query fragments.
+bool has_alignment(const RefAlignmentVec& alns, const Map* p_map, size_t start,
+  size_t split, bool is_forward) {
+
+  for(ReferenceAlignment aln : alns) {
+
+    if(aln.get_map() != p_map || aln.is_forward() != is_forward) continue;
+    if(!is_forward) aln.reverse();
+    if(aln.chunks_.size() != WINDOW_FRAGS || aln.query_frags_.size() != WINDOW_FRAGS) continue;
+
+    bool same = true;
+    for(size_t i = 0; same && i < WINDOW_FRAGS; i++) {
+      const MapChunk* chunk = aln.chunks_[i];
+      same = chunk->start_ == start + i && chunk->end_ == start + i + 1 &&
+        aln.query_frags_[i] == (i == split ? 2 : 1);
+    }
+    if(same) return true;
+
+  }
+
+  return false;
+
+}
+
+int main(int argc, char* argv[]) {
+
+  if(argc != 2) {
+    std::cerr << "Usage: " << argv[0] << " REFERENCE_MAPS_FILE\n";
+    return EXIT_FAILURE;
+  }
+
+  MapVec ref_maps_temp = MapReader(argv[1]).read_all_maps();
+
+  const ErrorModel error_model(0.05, 1000);
+  const size_t max_unmatched = 4;
+
+  MapWrapperVec ref_maps;
+  for(const auto& ref_map : ref_maps_temp) {
+    ref_maps.emplace_back(ref_map, false, false);
+  }
+
+  MapWrapperPVec p_ref_maps;
+  for(auto& ref_map : ref_maps) {
+    p_ref_maps.push_back(&ref_map);
+  }
+
+  MapChunkDB chunkDB(p_ref_maps, 2);
+
+  int num_mismatches = 0;
+  size_t num_queries = 0;
+
+  for(const auto& ref_map : ref_maps) {
+
+    const IntVec& ref_frags = ref_map.get_frags();
+    const Map* p_map = &ref_map.map_;
+
+    for(size_t start = 1; start + WINDOW_FRAGS + 1 < ref_frags.size(); start += WINDOW_STEP) {
+
+      // Split the second largest fragment, so that the seed is not split, and the
+      // query fragments are not within the sizing error of their neighbours.
+      IntVec::const_iterator b = ref_frags.begin() + start;
+      const size_t max_frag = std::max_element(b, b + WINDOW_FRAGS) - b;
+      size_t split = max_frag == 0 ? 1 : 0;
+      for(size_t i = 0; i < WINDOW_FRAGS; i++) {
+        if(i != max_frag && b[i] > b[split]) split = i;
+      }
+
+      IntVec frags(b, b + split);
+      frags.push_back(ref_frags[start + split] / 3);
+      frags.push_back(ref_frags[start + split] - frags.back());
+      frags.insert(frags.end(), b + split + 1, b + WINDOW_FRAGS);
+
+      for(int is_forward = 1; is_forward >= 0; is_forward--) {
+
+        if(!is_forward) std::reverse(frags.begin(), frags.end());
+
+        QueryChunkBounds query_bounds(error_model, frags.begin(), frags.end(), 2);
+        RefAlignmentVec alns = chunkDB.get_compatible_alignments_best(query_bounds, max_unmatched);
+
+        if(!has_alignment(alns, p_map, start, split, is_forward)) {
+          std::cout << "MISMATCH: " << p_map->name_ << " window at " << start << " split at "
+                    << start + split << " not found " << (is_forward ? "forward" : "reverse") << "\n";
+          num_mismatches++;
+        }
+
+        num_queries++;
+
+      }
+
+    }
+
+  }
+
+  std::cout << num_queries << " queries\n";
+  std::cout << "mismatches: " << num_mismatches << "\n";
+
+  return num_mismatches == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+
+}
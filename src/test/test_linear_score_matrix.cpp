@@ -0,0 +1,158 @@
+// Align queries to references using the full ScoreMatrix, the compact ScoreMatrix and
+// the LinearScoreMatrix, and check that the same alignments are produced.
+//
+// Usage: test_linear_score_matrix QUERY_MAPS_FILE REFERENCE_MAPS_FILE [QUERY_MAX_MISSES REF_MAX_MISSES]
+
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <cstdlib>
+
+#include "map.h"
+#include "map_reader.h"
+
+// dp includes
+#include "map_data.h"
+#include "alignment.h"
+#include "align.h"
+#include "ScoreMatrix.h"
+#include "LinearScoreMatrix.h"
+
+// common includes
+#include "timer.h"
+
+using namespace maligner_dp;
+using namespace maligner_maps;
+using lmm_utils::Timer;
+
+typedef ScoreMatrix<row_order_tag> RowScoreMatrix;
+
+std::string alignments_to_string(const AlignmentVec& alns) {
+  std::ostringstream oss;
+  for(const auto& aln : alns) {
+    print_alignment(oss, aln);
+  }
+  return oss.str();
+}
+
+template<class MatrixType>
+AlignTask<MatrixType, Chi2SizingPenalty> make_task(const QueryMapWrapper& qmw, const RefMapWrapper& rmw,
+  bool query_is_forward, MatrixType& sm, AlignmentVec& alns, const AlignOpts& align_opts) {
+
+  return AlignTask<MatrixType, Chi2SizingPenalty>(
+    &qmw.map_data_, &rmw.map_data_,
+    query_is_forward ? &qmw.get_frags() : &qmw.get_frags_reverse(),
+    &rmw.get_frags(),
+    query_is_forward ? &qmw.get_partial_sums_forward() : &qmw.get_partial_sums_reverse(),
+    &rmw.get_partial_sums(),
+    &rmw.sd_inv_,
+    &qmw.ix_to_locs_,
+    &rmw.ix_to_locs_,
+    0, // ref_offset
+    &sm, &alns,
+    query_is_forward,
+    true, // ref_is_forward
+    align_opts);
+
+}
+
+int main(int argc, char* argv[]) {
+
+  if(argc != 3 && argc != 5) {
+    std::cerr << "Usage: " << argv[0] << " QUERY_MAPS_FILE REFERENCE_MAPS_FILE [QUERY_MAX_MISSES REF_MAX_MISSES]\n";
+    return EXIT_FAILURE;
+  }
+
+  std::string query_maps_file(argv[1]);
+  std::string ref_maps_file(argv[2]);
+  int query_max_misses = argc == 5 ? atoi(argv[3]) : 2;
+  int ref_max_misses = argc == 5 ? atoi(argv[4]) : 5;
+
+  AlignOpts align_opts(18.0, 3.0, query_max_misses, ref_max_misses,
+    0.05, 500.0, std::numeric_limits<double>::infinity(),
+    0.50, 0.25, 100, 10, 0, false, false, true, 0.85, 1.15);
+
+  MapVec ref_maps(read_maps(ref_maps_file));
+  std::vector<RefMapWrapper> ref_map_wrappers;
+  for(const auto& ref_map : ref_maps) {
+    ref_map_wrappers.push_back(RefMapWrapper(ref_map, false, ref_max_misses, 0.05, 500.0));
+  }
+
+  RowScoreMatrix sm;
+  CompactScoreMatrix csm;
+  LinearScoreMatrix lsm; // Default checkpoint spacing
+  LinearScoreMatrix lsm_small(query_max_misses + 1); // Smallest checkpoint spacing, many segments
+
+  Timer timer;
+
+  MapReader query_map_reader(query_maps_file);
+  Map query_map;
+  int num_tasks = 0;
+  int num_alignments = 0;
+  int num_mismatches = 0;
+
+  while(query_map_reader.next(query_map)) {
+
+    const QueryMapWrapper qmw(query_map, query_max_misses);
+
+    for(const auto& rmw : ref_map_wrappers) {
+
+      for(int i = 0; i < 2; i++) {
+
+        const bool query_is_forward = (i == 0);
+        AlignmentVec alns_full, alns_compact, alns_linear, alns_small;
+
+        auto task_full = make_task(qmw, rmw, query_is_forward, sm, alns_full, align_opts);
+        auto task_compact = make_task(qmw, rmw, query_is_forward, csm, alns_compact, align_opts);
+        auto task_linear = make_task(qmw, rmw, query_is_forward, lsm, alns_linear, align_opts);
+        auto task_small = make_task(qmw, rmw, query_is_forward, lsm_small, alns_small, align_opts);
+
+        make_best_alignments_using_partials(task_full);
+        make_best_alignments_using_partials(task_compact);
+        make_best_alignments_using_partials(task_linear);
+        make_best_alignments_using_partials(task_small);
+
+        const std::string full_str = alignments_to_string(alns_full);
+        bool match = (full_str == alignments_to_string(alns_compact)) &&
+                     (full_str == alignments_to_string(alns_linear)) &&
+                     (full_str == alignments_to_string(alns_small));
+
+        // The compact matrix is not cleared between fills. Check that rows which were
+        // not filled for this task read as empty, as in the full matrix.
+        for(size_t row = 0; row < sm.getNumRows(); row++) {
+          match = match && (sm.countFilledByRow(row) == csm.countFilledByRow(row)) &&
+                           (sm.getMaxScoreByRow(row) == csm.getMaxScoreByRow(row));
+        }
+
+        // Check the single best alignment.
+        AlignmentVec best_full(1, make_best_alignment_using_partials(task_full));
+        AlignmentVec best_compact(1, make_best_alignment_using_partials(task_compact));
+        AlignmentVec best_linear(1, make_best_alignment_using_partials(task_linear));
+        match = match && (alignments_to_string(best_full) == alignments_to_string(best_compact)) &&
+                         (alignments_to_string(best_full) == alignments_to_string(best_linear));
+
+        if (!match) {
+          std::cout << "MISMATCH: query " << query_map.name_ << " ref " << rmw.get_name()
+                    << " query_is_forward " << query_is_forward << "\n";
+          num_mismatches++;
+        }
+
+        num_tasks++;
+        num_alignments += alns_full.size();
+
+      }
+    }
+  }
+
+  std::cout << "tasks: " << num_tasks << "\n"
+            << "alignments: " << num_alignments << "\n"
+            << "mismatches: " << num_mismatches << "\n"
+            << timer << "\n"
+            << "linear memory usage (bytes): " << lsm.getMemoryUsage() << "\n"
+            << "compact memory usage (bytes): " << csm.getMemoryUsage() << "\n"
+            << "full memory usage (bytes): " << sm.getMemoryUsage() << "\n";
+
+  return num_mismatches == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+
+}
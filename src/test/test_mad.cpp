@@ -42,6 +42,11 @@ int main(int argc, char* argv[]) {
   std::cout << "median v3: " << median(v3) << "\n";
   std::cout << "mad v3: " << mad(v3) << "\n";
 
+  // 1 - 0.01^(1/100) = 0.0450074
+  std::cout << "binomial_upper_bound(0, 100, 0.99): " << binomial_upper_bound(0, 100, 0.99) << "\n";
+  std::cout << "binomial_upper_bound(10, 100, 0.95): " << binomial_upper_bound(10, 100, 0.95) << "\n";
+  std::cout << "binomial_cdf(10, 100, 0.1): " << binomial_cdf(10, 100, 0.1) << "\n";
+
   return EXIT_SUCCESS;
 
 }
@@ -0,0 +1,264 @@
+// Check that the maps parser accepts and rejects the same lines as the
+// istringstream parser it replaced, and compare the throughput of MapReader
+// against reading lines with getline and parsing them with istringstream.
+// Also check that the shards of a maps file hold each map once, and in order.
+//
+// Usage: test_map_reader [MAPS_FILE [REPEATS]]
+
+#include <iostream>
+#include <sstream>
+#include <fstream>
+#include <string>
+#include <vector>
+#include <cstdlib>
+
+#include "map.h"
+#include "map_reader.h"
+
+// common includes
+#include "timer.h"
+
+using namespace maligner_maps;
+using lmm_utils::Timer;
+
+// The istringstream parser of Map(const std::string& line), for reference.
+Map parse_map_istringstream(const std::string& line) {
+
+  Map map;
+  std::istringstream iss(line);
+
+  iss >> map.name_;
+  if (iss.fail()) throw ReadMapException(line);
+
+  iss >> map.size_;
+  if (iss.fail()) throw ReadMapException(line);
+
+  unsigned int num_frags;
+  iss >> num_frags;
+  if (iss.fail()) throw ReadMapException(line);
+
+  int frag_size;
+  while(iss) {
+    iss >> frag_size;
+    if(!iss.fail()) {
+      map.frags_.push_back(frag_size);
+    }
+  }
+
+  if (iss.fail() && !iss.eof()) throw ReadMapException(line);
+  if (num_frags != map.frags_.size()) throw ReadMapException(line);
+
+  return map;
+
+}
+
+bool same_map(const Map& a, const Map& b) {
+  return a.name_ == b.name_ && a.size_ == b.size_ && a.frags_ == b.frags_;
+}
+
+// Parse the line with both parsers, and check that the results agree.
+bool check_line(const std::string& line) {
+
+  bool ref_ok = true, new_ok = true;
+  Map ref_map, new_map;
+
+  try {
+    ref_map = parse_map_istringstream(line);
+  } catch(ReadMapException& e) {
+    ref_ok = false;
+  }
+
+  try {
+    new_map = Map(line);
+  } catch(ReadMapException& e) {
+    new_ok = false;
+  }
+
+  if(ref_ok != new_ok || (ref_ok && !same_map(ref_map, new_map))) {
+    std::cout << "MISMATCH: \"" << line << "\" istringstream: " << ref_ok << " parse_map: " << new_ok << "\n";
+    return false;
+  }
+
+  return true;
+
+}
+
+int check_lines() {
+
+  const std::vector<std::string> lines {
+    "",
+    "   ",
+    "map",
+    "map 100",
+    "map 100 2",
+    "map 100 2 1 2",
+    "map\t100\t2\t1\t2",
+    "map\t100\t2\t1\t2\r",
+    "  map 100 2 1 2  ",
+    "map 100 3 1 2",
+    "map 100 2 1 2 3",
+    "map 100 0",
+    "map 100 2 1 x",
+    "map 100 2 1 2x",
+    "map 100 2 1 2.5",
+    "map 100 2 1-2",
+    "map 100 2 +1 -2",
+    "map 100 2 1 2 -",
+    "map 100 2 1 2 - ",
+    "map 100 2 1 2 + 3",
+    "map 100 2 0x10 2",
+    "map -100 2 1 2",
+    "map 100 -1",
+    "map x 2 1 2",
+    "map 4294967295 0",
+    "map 4294967296 0",
+    "map -4294967295 0",
+    "map 99999999999999999999 0",
+    "map 100 2 2147483647 -2147483648",
+    "map 100 2 2147483648 1",
+    "map 100 2 1 -2147483649",
+    "map 100 1 1 2147483648",
+    "map 100 1 1 99999999999999999999",
+    "map 100 1 1 99999999999999999999 ",
+  };
+
+  int num_mismatches = 0;
+  for(const auto& line : lines) {
+    if(!check_line(line)) num_mismatches++;
+  }
+
+  return num_mismatches;
+
+}
+
+// Read the file with getline and istringstream, as MapReader used to.
+MapVec read_maps_istringstream(const std::string& maps_file) {
+
+  MapVec maps;
+  std::ifstream f(maps_file);
+  std::string line;
+
+  while(std::getline(f, line)) {
+    try {
+      maps.push_back(parse_map_istringstream(line));
+    } catch(ReadMapException& e) {
+    }
+  }
+
+  return maps;
+
+}
+
+int check_file(const std::string& maps_file, int repeats) {
+
+  std::ifstream f(maps_file, std::ios::binary | std::ios::ate);
+  const double megabytes = double(f.tellg()) * repeats / 1e6;
+
+  MapVec ref_maps;
+  Timer timer;
+  for(int i = 0; i < repeats; i++) {
+    ref_maps = read_maps_istringstream(maps_file);
+  }
+  timer.end();
+  std::cout << "istringstream: " << timer << " " << megabytes / timer.elapsed_seconds() << " MB/s\n";
+
+  MapVec new_maps;
+  timer.reset();
+  for(int i = 0; i < repeats; i++) {
+    MapReader reader(maps_file);
+    new_maps = reader.read_all_maps();
+  }
+  timer.end();
+  std::cout << "MapReader: " << timer << " " << megabytes / timer.elapsed_seconds() << " MB/s\n";
+
+  // Stream the maps into a single Map, as the binaries do for queries.
+  size_t num_frags = 0;
+  timer.reset();
+  for(int i = 0; i < repeats; i++) {
+    MapReader reader(maps_file);
+    Map map;
+    while(reader.next(map)) {
+      num_frags += map.frags_.size();
+    }
+  }
+  timer.end();
+  std::cout << "MapReader next: " << timer << " " << megabytes / timer.elapsed_seconds() << " MB/s"
+            << " (" << num_frags << " fragments)\n";
+
+  int num_mismatches = 0;
+
+  if(ref_maps.size() != new_maps.size()) {
+    std::cout << "MISMATCH: read " << ref_maps.size() << " maps with istringstream and "
+              << new_maps.size() << " with MapReader\n";
+    return 1;
+  }
+
+  for(size_t i = 0; i < ref_maps.size(); i++) {
+    if(!same_map(ref_maps[i], new_maps[i])) {
+      std::cout << "MISMATCH: map " << i << " " << ref_maps[i].name_ << "\n";
+      num_mismatches++;
+    }
+  }
+
+  return num_mismatches;
+
+}
+
+// Read the maps file in shards, and check that the shards in order hold the maps of the file.
+int check_shards(const std::string& maps_file) {
+
+  MapReader reader(maps_file);
+  const MapVec maps = reader.read_all_maps();
+
+  int num_mismatches = 0;
+
+  for(size_t num_shards = 1; num_shards <= 8; num_shards++) {
+
+    MapVec shard_maps;
+    std::cout << num_shards << " shards:";
+
+    for(size_t shard = 0; shard < num_shards; shard++) {
+      MapReader shard_reader(maps_file, shard, num_shards);
+      const MapVec s = shard_reader.read_all_maps();
+      shard_maps.insert(shard_maps.end(), s.begin(), s.end());
+      std::cout << " " << s.size();
+    }
+
+    std::cout << "\n";
+
+    bool same = shard_maps.size() == maps.size();
+    for(size_t i = 0; same && i < maps.size(); i++) {
+      same = same_map(maps[i], shard_maps[i]);
+    }
+
+    if(!same) {
+      std::cout << "MISMATCH: " << num_shards << " shards\n";
+      num_mismatches++;
+    }
+
+  }
+
+  return num_mismatches;
+
+}
+
+int main(int argc, char* argv[]) {
+
+  if(argc > 3) {
+    std::cerr << "Usage: " << argv[0] << " [MAPS_FILE [REPEATS]]\n";
+    return EXIT_FAILURE;
+  }
+
+  int num_mismatches = check_lines();
+
+  if(argc >= 2) {
+    const int repeats = argc == 3 ? atoi(argv[2]) : 1;
+    num_mismatches += check_file(argv[1], repeats);
+    num_mismatches += check_shards(argv[1]);
+  }
+
+  std::cout << "mismatches: " << num_mismatches << "\n";
+
+  return num_mismatches == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+
+}
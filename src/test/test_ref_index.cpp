@@ -0,0 +1,125 @@
+// Check that the reference maps read from a reference index are the same as
+// the reference maps built from the maps file, for linear and circular references.
+//
+// Usage: test_ref_index REFERENCE_MAPS_FILE INDEX_FILE
+//
+// INDEX_FILE is overwritten.
+
+#include <iostream>
+#include <string>
+#include <vector>
+#include <cstdlib>
+
+#include "map.h"
+#include "map_reader.h"
+
+// dp includes
+#include "map_wrappers.h"
+#include "ref_index.h"
+
+using namespace maligner_dp;
+using namespace maligner_maps;
+
+template<typename T>
+bool same_values(const T * a, const T * b, size_t n) {
+  for(size_t i = 0; i < n; i++) {
+    if(a[i] != b[i]) return false;
+  }
+  return true;
+}
+
+bool same_ref_map(const RefMapWrapper& a, const RefMapWrapper& b) {
+  return a.map_.name_ == b.map_.name_ &&
+    a.map_.size_ == b.map_.size_ &&
+    a.map_.frags_ == b.map_.frags_ &&
+    a.num_frags() == b.num_frags() &&
+    a.is_circular() == b.is_circular() &&
+    a.map_data_.is_bounded_ == b.map_data_.is_bounded_ &&
+    a.frags_reverse_ == b.frags_reverse_ &&
+    a.ix_to_locs_ == b.ix_to_locs_ &&
+    a.ps_.size() == b.ps_.size() &&
+    same_values(a.ps_.data(), b.ps_.data(), a.ps_.size()) &&
+    same_values(a.ps_reverse_.data(), b.ps_reverse_.data(), a.ps_.size()) &&
+    same_values(a.sd_inv_.data(), b.sd_inv_.data(), a.ps_.size()) &&
+    same_values(a.sd_inv_reverse_.data(), b.sd_inv_reverse_.data(), a.ps_.size());
+}
+
+int check_index(const MapVec& ref_maps, const std::string& index_file, bool is_circular) {
+
+  const int ref_max_misses = 4;
+  const double sd_rate = 0.05;
+  const double min_sd = 750.0;
+
+  std::vector<RefMapWrapper> ref_map_wrappers;
+  for(const auto& ref_map : ref_maps) {
+    ref_map_wrappers.push_back(RefMapWrapper(ref_map, is_circular, ref_max_misses, sd_rate, min_sd));
+  }
+
+  write_ref_index(index_file, ref_map_wrappers, ref_max_misses, sd_rate, min_sd, is_circular);
+
+  if(!is_ref_index_file(index_file)) {
+    std::cout << "MISMATCH: not detected as an index\n";
+    return 1;
+  }
+
+  RefIndex ref_index(index_file);
+  int num_mismatches = 0;
+
+  if(ref_index.num_maps() != ref_map_wrappers.size()) {
+    std::cout << "MISMATCH: index has " << ref_index.num_maps() << " maps\n";
+    return 1;
+  }
+
+  for(size_t i = 0; i < ref_index.num_maps(); i++) {
+
+    // Check a copy as well, since the maps are copied into the databases of the binaries.
+    const RefMapWrapper rmw(ref_index.get_ref_map_wrapper(i));
+    const RefMapWrapper rmw_copy(rmw);
+
+    if(!same_ref_map(rmw, ref_map_wrappers[i]) || !same_ref_map(rmw_copy, ref_map_wrappers[i])) {
+      std::cout << "MISMATCH: map " << i << " circular: " << is_circular << "\n";
+      num_mismatches++;
+    }
+
+  }
+
+  // The parameters must match
+  try {
+    ref_index.check_params(ref_max_misses, sd_rate, min_sd, is_circular);
+  } catch(RefIndexException& e) {
+    std::cout << "MISMATCH: " << e.what() << "\n";
+    num_mismatches++;
+  }
+
+  try {
+    ref_index.check_params(ref_max_misses + 1, sd_rate, min_sd, is_circular);
+    std::cout << "MISMATCH: different ref_max_misses accepted\n";
+    num_mismatches++;
+  } catch(RefIndexException& e) {
+  }
+
+  return num_mismatches;
+
+}
+
+int main(int argc, char* argv[]) {
+
+  if(argc != 3) {
+    std::cerr << "Usage: " << argv[0] << " REFERENCE_MAPS_FILE INDEX_FILE\n";
+    return EXIT_FAILURE;
+  }
+
+  std::string ref_maps_file(argv[1]);
+  std::string index_file(argv[2]);
+
+  MapVec ref_maps(read_maps(ref_maps_file));
+
+  int num_mismatches = 0;
+  num_mismatches += check_index(ref_maps, index_file, false);
+  num_mismatches += check_index(ref_maps, index_file, true);
+
+  std::cout << "mismatches: " << num_mismatches << "\n";
+
+  return num_mismatches == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+
+}
@@ -39,7 +39,8 @@ int main(int argc, char* argv[]) {
   typedef ScoreMatrix<row_order_tag> ScoreMatrixType;
  
   std::cout << "sizeof(ScoreCell): " << sizeof(ScoreCell) << "\n"
-            << "sizeof(ScoreMatrix): " << sizeof(ScoreMatrixType) << "\n";
+            << "sizeof(ScoreMatrix): " << sizeof(ScoreMatrixType) << "\n"
+            << "sizeof(Alignment): " << sizeof(Alignment) << "\n";
 
   ScoreCell cell1, cell2;
 
@@ -0,0 +1,124 @@
+// Check that lines written to a UnixSocketListener by a client are read back
+// by a SocketConnection, including a last line without a newline, and that
+// writing to a connection closed by the client fails instead of raising SIGPIPE,
+// and that shutdown_read stops a read_line blocked in another thread.
+//
+// Usage: test_unix_socket SOCKET_PATH
+//
+// SOCKET_PATH is replaced if it is a socket.
+
+#include <iostream>
+#include <string>
+#include <thread>
+#include <chrono>
+#include <vector>
+#include <cstdlib>
+#include <cstring>
+
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include "unix_socket.h"
+
+using lmm_utils::UnixSocketListener;
+using lmm_utils::SocketConnection;
+
+int connect_to(const std::string& path) {
+  struct sockaddr_un addr;
+  std::memset(&addr, 0, sizeof(addr));
+  addr.sun_family = AF_UNIX;
+  std::strncpy(addr.sun_path, path.c_str(), sizeof(addr.sun_path) - 1);
+  const int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+  if(connect(fd, reinterpret_cast<struct sockaddr*>(&addr), sizeof(addr)) != 0) {
+    close(fd);
+    return -1;
+  }
+  return fd;
+}
+
+int main(int argc, char* argv[]) {
+
+  if(argc != 2) {
+    std::cerr << "Usage: " << argv[0] << " SOCKET_PATH\n";
+    return EXIT_FAILURE;
+  }
+
+  const std::string path(argv[1]);
+  int num_mismatches = 0;
+
+  UnixSocketListener listener(path);
+
+  // Long lines span several reads.
+  std::vector<std::string> lines;
+  for(int i = 0; i < 1000; i++) {
+    lines.push_back("map_" + std::to_string(i) + std::string(i * 97 % 5000, 'x'));
+  }
+
+  std::thread client([&]() {
+    SocketConnection connection(connect_to(path));
+    std::string data;
+    for(size_t i = 0; i < lines.size(); i++) {
+      data += lines[i];
+      if(i + 1 < lines.size()) {
+        data += '\n';
+      }
+    }
+    connection.write(data);
+    close(connect_to(path));
+  });
+
+  {
+    SocketConnection connection(listener.accept());
+    std::string line;
+    size_t num_lines = 0;
+    for(; connection.read_line(line); num_lines++) {
+      if(num_lines >= lines.size() || line != lines[num_lines]) {
+        std::cout << "MISMATCH: line " << num_lines << " differs\n";
+        num_mismatches++;
+        break;
+      }
+    }
+    if(num_lines != lines.size()) {
+      std::cout << "MISMATCH: read " << num_lines << " of " << lines.size() << " lines\n";
+      num_mismatches++;
+    }
+  }
+
+  client.join();
+
+  // The second connection is closed by the client without reading.
+  {
+    SocketConnection connection(listener.accept());
+    std::string line;
+    while(connection.read_line(line)) {}
+    const std::string data(1 << 20, 'x');
+    bool ok = true;
+    for(int i = 0; i < 8 && ok; i++) {
+      ok = connection.write(data);
+    }
+    if(ok || connection.is_open()) {
+      std::cout << "MISMATCH: write to a closed connection succeeded\n";
+      num_mismatches++;
+    }
+  }
+
+  // The third connection is kept open by the client, and the server stops reading it.
+  {
+    const int client_fd = connect_to(path);
+    SocketConnection connection(listener.accept());
+    std::thread reader([&]() {
+      std::string line;
+      while(connection.read_line(line)) {}
+    });
+    std::this_thread::sleep_for(std::chrono::milliseconds(50));
+    connection.shutdown_read();
+    reader.join();
+    close(client_fd);
+  }
+
+  std::cout << "mismatches: " << num_mismatches << "\n";
+
+  return num_mismatches == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+
+}